@@ -0,0 +1,100 @@
+/*
+ * anim.h
+ *
+ * Non-blocking LED animation sequencer
+ *
+ * An animation is a const keyframe table in flash. Each keyframe holds an
+ * LED frame mask and how long to show it. anim_update() is called from the
+ * main loop and advances the sequence from timer_ticks(), so the caller
+ * keeps handling input while an animation plays.
+ */
+
+#ifndef ANIM_H_
+#define ANIM_H_
+
+#include "main.h"
+#include <stdint.h>
+
+/* Keyframe flags */
+#define ANIM_MASK_PARAM   0x01  /* show the mask passed to anim_play() */
+#define ANIM_HOLD_PARAM   0x02  /* hold for the time passed to anim_play() */
+#define ANIM_BREATHE      0x04  /* breathe between half and full brightness */
+
+/* Animation flags */
+#define ANIM_LOOP         0x01  /* restart from the first keyframe */
+
+#define ANIM_FOREVER      UINT32_MAX    /* length of a looping animation */
+
+typedef struct {
+    uint8_t mask;           /* LED frame, bit 0 = LED 1 */
+    uint8_t flags;          /* ANIM_MASK_PARAM, ANIM_HOLD_PARAM, ANIM_BREATHE */
+    uint16_t duration_ms;   /* time to show the frame */
+} AnimFrame;
+
+typedef struct {
+    const AnimFrame *frames;
+    uint8_t count;
+    uint8_t flags;          /* ANIM_LOOP */
+} Animation;
+
+/* Define a const Animation from a keyframe array */
+#define ANIM_DEFINE(name, frames, flags) \
+    const Animation name = { frames, (uint8_t)(sizeof(frames) / sizeof((frames)[0])), flags }
+
+/**
+ * Start an animation, replacing any animation in progress
+ * @param anim Keyframe table to play
+ * @param mask Frame for ANIM_MASK_PARAM keyframes
+ * @param hold_ms Duration for ANIM_HOLD_PARAM keyframes
+ * @return Length in milliseconds, ANIM_FOREVER if it loops
+ */
+uint32_t anim_play(const Animation *anim, uint8_t mask, uint32_t hold_ms);
+
+/**
+ * Length of an animation without playing it
+ * @param anim Keyframe table
+ * @param hold_ms Duration for ANIM_HOLD_PARAM keyframes
+ * @return Length in milliseconds, ANIM_FOREVER if it loops
+ */
+uint32_t anim_length(const Animation *anim, uint32_t hold_ms);
+
+/**
+ * Advance the animation, call often from the main loop
+ * @return 1 while an animation is playing, 0 when idle
+ */
+int anim_update(void);
+
+/**
+ * Call a function whenever anim_update() has work to do
+ * The hook runs in SysTick interrupt context, e.g. to signal a task.
+ * @param hook Function to call, NULL for none
+ * @param arg Passed to hook
+ */
+void anim_set_wake_hook(void (*hook)(void *arg), void *arg);
+
+/**
+ * Check if an animation is playing
+ * @return 1 if playing, 0 if idle
+ */
+int anim_busy(void);
+
+/**
+ * Jump to the next keyframe (ends the animation on the last one)
+ */
+void anim_skip(void);
+
+/**
+ * Stop the animation and turn off all LEDs
+ */
+void anim_cancel(void);
+
+/**
+ * Freeze or continue the animation in progress
+ * While frozen the current frame stays up and no wake-up is due; on resume
+ * the keyframe goes on for the time it had left. anim_play() and
+ * anim_cancel() end a freeze.
+ * @param pause 1 to freeze, 0 to continue
+ */
+void anim_pause(int pause);
+
+#endif /* ANIM_H_ */
@@ -0,0 +1,34 @@
+/*
+ * arena.h
+ *
+ * Ring tournament on the board: the ring bus, the draw and the game
+ *
+ * Every board on the ring (ringbus.h) is a table, its ring address the
+ * table number, and seats two entrants (tourney.h). When the ring has
+ * been counted its master starts a tournament of TOURNEY_MODE; a board
+ * joining or leaving the ring has it counted again, and that starts a
+ * new tournament.
+ *
+ * When a table's match is drawn the board sends "round R: Pl v Pr" as
+ * TLM_TEXT telemetry, Pl on the left button. The first match to end on
+ * the board after that is the result: entered here and broadcast on the
+ * ring. After each round, and once more at the end, every board sends the
+ * standings as TLM_TEXT, so a dashboard on any board's USART2 shows them
+ * without a PC in the ring.
+ *
+ * Build with -DTOURNEY=1; it cannot be combined with NETPLAY.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "main.h"
+#include <stdint.h>
+
+/**
+ * Join the ring and follow its tournament
+ * Call after game_init() and telemetry_init(), before telemetry_start().
+ */
+void arena_init(void);
+
+#endif /* ARENA_H_ */
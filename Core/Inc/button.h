@@ -6,26 +6,130 @@
  * Hardware Configuration:
  * Left Button:  PB15 (GPIOB Pin 15) - Active LOW with internal pull-up
  * Right Button: PC8  (GPIOC Pin 8)  - Active LOW with internal pull-up
+ *
+ * Both pins raise an EXTI interrupt on every edge. The ISR timestamps the
+ * edge and pushes it into a single-producer/single-consumer ring that the
+ * game loop drains with button_read_edge() or button_read().
+ *
+ * Debouncing is per button: each has its own DEBOUNCE_DELAY_US window
+ * after a debounced edge, for presses and releases alike, so one player
+ * can never blind the other. Edges that come debounced already (the key
+ * sampler) pass straight through, see button_set_pass_through().
  */
 
 #ifndef BUTTON_H_
 #define BUTTON_H_
 
 #include "main.h"
+#include <stdint.h>
 
 #define LEFT_BUTTON  1
 #define RIGHT_BUTTON 2
 
+/* Edge captured by the EXTI interrupt, or a debounced edge */
+typedef struct {
+    uint64_t timestamp;   /* timebase_us() at the edge */
+    uint8_t button;       /* LEFT_BUTTON or RIGHT_BUTTON */
+    uint8_t pressed;      /* 1 = pressed, 0 = released */
+} ButtonEvent;
+
 /**
- * Initialize button state tracking
- * Note: GPIO pins configured by MX_GPIO_Init() in main.c
+ * Initialize button state tracking and empty the event queue
+ * Note: GPIO pins and EXTI lines configured by MX_GPIO_Init() in main.c
  */
 void button_init(void);
 
+/**
+ * EXTI handler hook, call from HAL_GPIO_EXTI_Callback()
+ * @param pin GPIO pin that triggered the interrupt
+ */
+void button_irq(uint16_t pin);
+
+/**
+ * Queue an edge as if the EXTI interrupt had captured it (replay)
+ * Interrupt-safe only from the same priority as the button EXTI.
+ * @param event Edge with its original timestamp
+ */
+void button_inject(const ButtonEvent *event);
+
+/**
+ * Pop the oldest raw edge from the event queue
+ * @param event Filled in when an event is available
+ * @return 1 if an event was returned, 0 if the queue is empty
+ */
+int button_get_event(ButtonEvent *event);
+
+/**
+ * Check whether the event queue holds unread events
+ * @return 1 if events are pending, 0 otherwise
+ */
+int button_pending(void);
+
+/**
+ * Discard all queued events (e.g. presses made during an animation)
+ */
+void button_flush(void);
+
+/**
+ * Read the next debounced press or release of either button
+ * Edges come out in timestamp order, each with the time of the raw edge
+ * that caused it (or the end of the debounce window for a level that
+ * changed while the button was locked).
+ * @param edge Filled in when an edge is available
+ * @return 1 if an edge was returned, 0 if there is none yet
+ */
+int button_read_edge(ButtonEvent *edge);
+
+/**
+ * Time at which button_read_edge() will have an edge without a new
+ * interrupt: a debounce window closing on a level that changed during it
+ * @return timebase_us() time, UINT64_MAX if none is pending
+ */
+uint64_t button_settle_at(void);
+
 /**
  * Read button state with debouncing and edge detection
+ * Reads debounced edges until a press is found, dropping releases.
  * @return 0 (no press), LEFT_BUTTON, or RIGHT_BUTTON
  */
 int button_read(void);
 
+/**
+ * Like button_read(), also returning when the press happened
+ * @param at_us Set to the press edge's timebase_us() timestamp
+ * @return 0 (no press), LEFT_BUTTON, or RIGHT_BUTTON
+ */
+int button_read_press(uint64_t *at_us);
+
+/**
+ * Call a function for every edge entering the queue (e.g. a recorder)
+ * The hook runs in the context that queued the edge, usually the EXTI.
+ * @param hook Function to call, NULL for none
+ */
+void button_set_edge_hook(void (*hook)(const ButtonEvent *event));
+
+/**
+ * Change the debounce time, from task context (the console)
+ * Windows already open keep their end; button_init() restores the default.
+ * @param us Time a button ignores edges after a debounced change
+ */
+void button_set_debounce_us(uint32_t us);
+
+/**
+ * Current debounce time in microseconds
+ */
+uint32_t button_debounce_us(void);
+
+/**
+ * Take queued edges as debounced already: every level change is an edge
+ * at its own time, with no window after it. button_init() turns it off.
+ * @param on 1 for queued edges from the key sampler, 0 for raw EXTI edges
+ */
+void button_set_pass_through(int on);
+
+/**
+ * Number of events dropped because the queue was full
+ */
+uint32_t button_dropped(void);
+
 #endif /* BUTTON_H_ */
@@ -0,0 +1,64 @@
+/*
+ * clock.h
+ *
+ * Dynamic clock scaling between gameplay and idle phases
+ *
+ * CLOCK_PROFILE_RUN is the CubeMX configuration: HSI16 -> PLL at 80 MHz,
+ * regulator range 1, 4 flash wait states. CLOCK_PROFILE_IDLE runs from
+ * MSI at 8 MHz in regulator range 2 with 1 wait state, for score screens,
+ * animations and waiting for a serve.
+ *
+ * After every switch the clock consumers are fixed up: SysTick (done by
+ * HAL_RCC_ClockConfig), the TIM2 timebase prescaler and the TIM1 LED PWM
+ * slot rate. The USARTs are clocked from HSI16, which is kept running, so
+ * a switch in the middle of a transfer does not change its baud rate.
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "main.h"
+#include <stdint.h>
+
+typedef enum {
+    CLOCK_PROFILE_RUN = 0,  /* PLL 80 MHz, range 1 */
+    CLOCK_PROFILE_IDLE      /* MSI 8 MHz, range 2 */
+} ClockProfile;
+
+/**
+ * Record the profile set up by SystemClock_Config()
+ */
+void clock_init(void);
+
+/**
+ * Switch the system clock profile, no-op if already active
+ * Call from thread context only, not from an interrupt handler.
+ * @param profile Profile to switch to
+ */
+void clock_set_profile(ClockProfile profile);
+
+/**
+ * Get the active clock profile
+ * @return Active profile
+ */
+ClockProfile clock_profile(void);
+
+/**
+ * Re-apply the active profile after STOP2 wake-up
+ * Called by power_idle_until() with interrupts disabled.
+ */
+void clock_restore(void);
+
+/**
+ * Duration of the last profile switch
+ * @return Microseconds from start of switch to fixed-up peripherals
+ */
+uint32_t clock_last_switch_us(void);
+
+/**
+ * Longest profile switch seen so far
+ * @return Microseconds
+ */
+uint32_t clock_max_switch_us(void);
+
+#endif /* CLOCK_H_ */
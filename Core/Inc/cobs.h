@@ -0,0 +1,96 @@
+/*
+ * cobs.h
+ *
+ * Consistent Overhead Byte Stuffing and a CRC-8 for serial frames
+ *
+ * COBS rewrites a frame so it holds no zero byte, at a cost of one byte
+ * per 254 (plus one); a zero then marks the end of every frame on the
+ * wire. A receiver that joins mid-stream or loses a byte resynchronises
+ * at the next zero. The CRC-8 (polynomial 0x07) inside the frame catches
+ * what the framing cannot, such as a byte changed by a baud rate switch.
+ */
+
+#ifndef COBS_H_
+#define COBS_H_
+
+#include <stdint.h>
+
+/* Longest encoding of len bytes, without the zero delimiter */
+#define COBS_MAX(len)  ((len) + (len) / 254u + 1u)
+
+/**
+ * Encode a frame
+ * @param in Frame
+ * @param len Its length
+ * @param out Room for COBS_MAX(len) bytes, no zero is written
+ * @return Encoded length
+ */
+static inline uint32_t cobs_encode(const uint8_t *in, uint32_t len, uint8_t *out) {
+    uint32_t code_at = 0;
+    uint32_t o = 1;
+    uint8_t code = 1;
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[o++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+/**
+ * Decode a frame received up to (not including) its zero delimiter
+ * @param in Encoded frame
+ * @param len Its length
+ * @param out Room for len bytes
+ * @return Decoded length, -1 if the frame is malformed
+ */
+static inline int32_t cobs_decode(const uint8_t *in, uint32_t len, uint8_t *out) {
+    uint32_t i = 0;
+    uint32_t o = 0;
+
+    while (i < len) {
+        uint8_t code = in[i++];
+
+        if (code == 0 || i + code - 1u > len) {
+            return -1;
+        }
+        for (uint8_t n = 1; n < code; n++) {
+            if (in[i] == 0) {
+                return -1;
+            }
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < len) {
+            out[o++] = 0;
+        }
+    }
+    return (int32_t)o;
+}
+
+/**
+ * CRC-8, polynomial 0x07, initial value 0
+ * @param data Bytes
+ * @param len Their number
+ * @return CRC
+ */
+static inline uint8_t crc8(const uint8_t *data, uint32_t len) {
+    uint8_t crc = 0;
+
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+#endif /* COBS_H_ */
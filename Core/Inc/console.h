@@ -0,0 +1,53 @@
+/*
+ * console.h
+ *
+ * Serial command console on USART2 receive
+ *
+ * DMA1 Channel 6 copies every received byte into a circular buffer; the
+ * CPU never polls the line. The USART idle-line interrupt (a line gone
+ * quiet for one character time) and the DMA half and full transfer
+ * interrupts signal the console task, which takes up the new bytes, edits
+ * the line and runs it through console_execute() at the end of line.
+ * Replies go out as TLM_TEXT telemetry records, so the dashboard reading
+ * USART2 sees them in the same stream.
+ *
+ * In STOP2 the USART is not clocked: a falling edge on RX (PA3, EXTI line
+ * 3) wakes the board and the console then holds STOP2 off for
+ * CONSOLE_AWAKE_MS after the last byte received. The character that woke
+ * the board is lost, so a host sends an end of line first.
+ *
+ * Resources: USART2 RX, DMA1 Channel 6 (request 2), DMA1_Channel6_IRQn,
+ *            EXTI line 3, EXTI3_IRQn
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define CONSOLE_RX         128     /* receive buffer bytes */
+#define CONSOLE_AWAKE_MS   30000   /* STOP2 held off after the last byte */
+
+/**
+ * Start reception and add the console task
+ * Call after telemetry_init() and sched_init().
+ */
+void console_init(void);
+
+/**
+ * DMA1 Channel 6 interrupt handler hook
+ */
+void console_dma_irq(void);
+
+/**
+ * USART2 interrupt handler hook (idle line)
+ */
+void console_uart_irq(void);
+
+/**
+ * EXTI line 3 interrupt handler hook (RX wake-up from STOP2)
+ */
+void console_wake_irq(void);
+
+#endif /* CONSOLE_H_ */
@@ -0,0 +1,42 @@
+/*
+ * console_cmd.h
+ *
+ * Command interpreter of the serial console
+ *
+ * Turns one line of text into calls on the game and button modules and a
+ * one-line reply. It touches no hardware, so the host tests run it as is;
+ * console.c feeds it the lines received on USART2.
+ *
+ *   help                       list the commands and parameters
+ *   get [param]                show one or all parameters
+ *   set <param> <value>        change a parameter
+ *   pause, resume              freeze and continue the game (not NETPLAY)
+ *   selftest                   LED walk, counters, then a new match
+ *
+ * Parameters (times in ms):
+ *   win                        points to win a game
+ *   speed, min, decrease       step time formula, setting one selects it
+ *   early, late                hit window around the end LED
+ *   profile                    a speed profile name, or "formula"
+ *   debounce                   EXTI edge debounce time, applies at once
+ *                              (KEYS_SAMPLED 0; the key sampler has its own)
+ * Game parameters apply from the next serve on (see game_configure()).
+ */
+
+#ifndef CONSOLE_CMD_H_
+#define CONSOLE_CMD_H_
+
+#include <stdint.h>
+
+#define CONSOLE_LINE_MAX  64    /* longest command line, without its end */
+
+/**
+ * Run one command line
+ * @param line Command, NUL-terminated, without its end of line
+ * @param reply Room for the reply, NUL-terminated, without an end of line
+ * @param size Size of reply
+ * @return Length of the reply
+ */
+uint32_t console_execute(const char *line, char *reply, uint32_t size);
+
+#endif /* CONSOLE_CMD_H_ */
@@ -0,0 +1,105 @@
+/*
+ * game.h
+ *
+ * Ping-pong game as cooperative scheduler tasks
+ *
+ * The rules live in game_core.c; this module feeds them events and carries
+ * out their requests. It is split into three tasks, highest priority first:
+ *   input  - signaled from the button EXTI, drains the button queue
+ *   logic  - feeds presses, ball steps and the end of animations to the
+ *            game core
+ *   render - advances animations and draws the ball, woken by the logic
+ *            task and the animation keyframe timer
+ * No task ever waits; the scheduler sleeps when all of them are done.
+ *
+ * Every match is recorded (see replay.h): the core is fed logical event
+ * times, so the seed and the button edges are enough to play it again.
+ * The pacing (game_configure) and the debounce time are not in the log: a
+ * replay only plays out the same on a board set up the same way.
+ */
+
+#ifndef GAME_H_
+#define GAME_H_
+
+#include "main.h"
+#include "game_core.h"
+#include "replay.h"
+#include <stdint.h>
+
+/**
+ * Register the game tasks, start recording and start the intro animation
+ * Call after sched_init() and the LED, button and timer modules.
+ * @param seed Serve direction seed, recorded with the match
+ */
+void game_init(uint32_t seed);
+
+/**
+ * Restart the game and play a recorded match back from now on
+ * The edges are fed through the button queue at their recorded offsets
+ * from the start; presses made meanwhile mix in, so leave the buttons alone.
+ * @param log Log produced by a recording, must stay valid while playing
+ * @param len Length of the log in bytes
+ * @return 1 if playback started, 0 if the log is not valid
+ */
+int game_replay(const uint8_t *log, uint32_t len);
+
+/**
+ * The recording of the current match, restarted by game_init() and
+ * game_replay(); read buf/len to save or send it
+ */
+const ReplayLog *game_recording(void);
+
+/**
+ * Current game state, read-only (telemetry and host tests)
+ */
+const Game *game_state(void);
+
+/**
+ * Pacing the game takes up between rallies, read-only
+ */
+const GameConfig *game_config(void);
+
+/**
+ * Change the pacing from the next serve on
+ * The copy is taken up before the next event outside a rally, so the
+ * rally in progress finishes at its own pace.
+ * @param next Pacing to copy; speed_curve must stay valid
+ */
+void game_configure(const GameConfig *next);
+
+/**
+ * Freeze or continue the game
+ * While paused the ball, the animation and a replay in progress stand
+ * still and presses are dropped; on resume every pending time moves on by
+ * the length of the pause.
+ * @param pause 1 to pause, 0 to resume
+ * @return 1 if the game is now paused or running as asked, 0 if it cannot
+ *         pause (a NETPLAY build: the other board's clock runs on)
+ */
+int game_pause(int pause);
+
+/**
+ * Whether the game is paused
+ */
+int game_paused(void);
+
+/**
+ * Call a function whenever a match is over, with its final score
+ * @param hook Called from the logic task, NULL for none
+ */
+void game_set_over_hook(void (*hook)(const Game *game));
+
+/**
+ * Walk the LEDs one by one, then light them all, and start a new match
+ * when done; the match in progress is abandoned
+ * @return Length of the walk in milliseconds
+ */
+uint32_t game_selftest(void);
+
+/**
+ * Button interrupt hook, call from HAL_GPIO_EXTI_Callback() after
+ * button_irq()
+ */
+void game_input_irq(void);
+
+#endif /* GAME_H_ */
@@ -0,0 +1,179 @@
+/*
+ * game_core.h
+ *
+ * Table-driven ping-pong rules, free of hardware
+ *
+ * All game state lives in a Game struct, so any number of games can run
+ * side by side (the board runs one, host tests run many). The rules are a
+ * const transition table in flash indexed by state and event; handling an
+ * event is one table lookup, an optional action and an optional state
+ * entry, so it takes constant time.
+ *
+ * The core does not touch LEDs, timers or clocks. After game_event() the
+ * caller looks at the request fields (show, step_at, fast) and carries
+ * them out; see game.c.
+ *
+ * The ball is simulated in fixed GAME_TICK_US steps with its position in
+ * Q16 LED units, caught up to the time of each event. The caller is only
+ * woken (step_at) for the tick on which the ball reaches the next LED.
+ */
+
+#ifndef GAME_CORE_H_
+#define GAME_CORE_H_
+
+#include <stdint.h>
+
+/* Game configuration constants, the defaults of game_default_config */
+#define WINNING_SCORE       5
+#define INITIAL_SPEED_US    200000
+#define MIN_SPEED_US        100000
+#define SPEED_DECREASE_US   20000
+#define SCORE_DISPLAY_TIME  2000
+#define HIT_EARLY_US        40000
+#define HIT_LATE_US         20000
+#define GAME_LEDS           8       /* field of one board */
+
+#define GAME_NO_STEP  UINT64_MAX
+#define GAME_TICK_US  1000          /* ball simulation step, 1 kHz */
+#define GAME_Q16_ONE  (1 << 16)     /* one LED in ball_q16 */
+
+/* States, GAME_STAY is the "no transition" marker in the table */
+typedef enum {
+    GAME_STAY = 0,
+    GAME_INTRO,         /* start animation */
+    GAME_START,         /* serve: ball to the middle, random direction */
+    BALL_MOVING,        /* ball in play, direction in Game.direction */
+    GAME_MISS,          /* miss animation */
+    POINT_SCORED,       /* score display */
+    GAME_WINNER,        /* winner animation */
+    GAME_OVER,          /* final score, then a new match */
+    GAME_STATE_COUNT
+} GameState;
+
+typedef enum {
+    GAME_EV_PRESS_LEFT = 0,
+    GAME_EV_PRESS_RIGHT,
+    GAME_EV_STEP,       /* step_at has been reached */
+    GAME_EV_ANIM_DONE,  /* the requested animation finished */
+    GAME_EV_SERVE,      /* internal, raised by entering GAME_START */
+    GAME_EVENT_COUNT
+} GameEvent;
+
+/* Pictures the caller is asked to put up */
+typedef enum {
+    GAME_SHOW_NONE = 0,
+    GAME_SHOW_BALL,     /* trail at position, direction */
+    GAME_SHOW_INTRO,
+    GAME_SHOW_MISS,
+    GAME_SHOW_SCORE,
+    GAME_SHOW_WINNER,   /* side of the player who reached WINNING_SCORE */
+    GAME_SHOW_OVER      /* final score */
+} GameShow;
+
+/* Pacing of a game, kept by reference: change it between rallies only */
+typedef struct {
+    uint8_t winning_score;
+    uint32_t initial_speed_us;  /* first step time of every serve */
+    uint32_t min_speed_us;      /* returns stop shortening the step here */
+    uint32_t speed_decrease_us; /* step shortening per return */
+    uint32_t hit_early_us;      /* a press this long before the ball reaches
+                                   the end LED is kept and returns it */
+    uint32_t hit_late_us;       /* the ball stays on the end LED this long
+                                   past its step time before it is missed */
+    const uint32_t *speed_curve;/* step time by returns so far, a row of
+                                   speed_curves; NULL to go by the three
+                                   speed fields above */
+    uint8_t field_leds;         /* LEDs end to end, GAME_LEDS on one board
+                                   and twice that on two linked boards */
+} GameConfig;
+
+extern const GameConfig game_default_config;
+
+typedef struct {
+    const GameConfig *config;
+    uint8_t state;          /* GameState */
+    int8_t position;        /* ball LED, 1 to field_leds */
+    int8_t direction;       /* 1 = towards right player, -1 = left */
+    uint8_t left_score;
+    uint8_t right_score;
+    uint32_t speed_us;      /* time per ball step */
+    uint8_t rally;          /* returns since the serve */
+    int32_t ball_q16;       /* ball position in LEDs, Q16, as of tick_at */
+    uint32_t ball_rem;      /* travel below one Q16 unit, in speed_us parts */
+    uint64_t tick_at;       /* time of the last simulated tick */
+    uint64_t now_us;        /* time of the event being handled */
+    uint32_t rng;           /* serve direction generator, from the seed */
+
+    /* Hit window, judged on event times */
+    uint64_t arrived_at;    /* the ball reached the end LED it heads for */
+    uint64_t early_at;      /* kept early press, GAME_NO_STEP if none */
+    uint8_t leaving;        /* past its step time on the end LED */
+    int16_t hit_offset_ms;  /* last return: press time - arrived_at,
+                               negative for an early press */
+
+    /* Requests to the caller */
+    uint64_t step_at;       /* raise GAME_EV_STEP at this time, or GAME_NO_STEP */
+    uint8_t show;           /* GameShow to put up, caller resets to NONE */
+    uint8_t fast;           /* 1 while a rally needs the full clock */
+} Game;
+
+/**
+ * Start a new game with the intro animation
+ * The same seed and the same events at the same times always play out the
+ * same game.
+ * @param game Game to reset
+ * @param config Pacing, NULL for game_default_config (kept by reference)
+ * @param seed Seeds the serve direction generator
+ * @param now_us Current time in microseconds
+ */
+void game_reset(Game *game, const GameConfig *config, uint32_t seed, uint64_t now_us);
+
+/**
+ * Feed one event into the state machine
+ * @param game Game
+ * @param event GameEvent
+ * @param now_us Current time in microseconds
+ */
+void game_event(Game *game, uint8_t event, uint64_t now_us);
+
+/**
+ * Pick the earliest event due by now, for callers that gather presses and
+ * animation ends and feed them at the time they happened
+ * At equal times the press goes first, then the ball step, then the end of
+ * the animation.
+ * @param game Game
+ * @param press_at Time of the earliest press not yet fed, GAME_NO_STEP if none
+ * @param press_event GAME_EV_PRESS_LEFT or GAME_EV_PRESS_RIGHT for that press
+ * @param anim_end_at End of the requested animation, GAME_NO_STEP if none
+ * @param now_us Current time in microseconds
+ * @param at_us Set to the time of the returned event
+ * @return The GameEvent to feed, GAME_EVENT_COUNT if nothing is due
+ */
+uint8_t game_next_due(const Game *game, uint64_t press_at, uint8_t press_event,
+                      uint64_t anim_end_at, uint64_t now_us, uint64_t *at_us);
+
+/**
+ * Ball position in Q16 LED units at a time, for renderers that want more
+ * than the LED; the integer part rounded back towards where the ball came
+ * from is the LED lit
+ * @param game Game in BALL_MOVING
+ * @param now_us Current time in microseconds, not before the last event
+ * @return Position, LED 1 is 1 << 16
+ */
+int32_t game_ball_q16(const Game *game, uint64_t now_us);
+
+/**
+ * Move every pending time of the game later, as if the time in between had
+ * not passed (pause and resume)
+ * @param game Game
+ * @param us Length of the pause in microseconds
+ */
+void game_shift(Game *game, uint64_t us);
+
+/**
+ * Winner of the game once a score reached the winning score
+ * @return 0 (left player) or 1 (right player)
+ */
+uint8_t game_winner(const Game *game);
+
+#endif /* GAME_CORE_H_ */
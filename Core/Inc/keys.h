@@ -0,0 +1,74 @@
+/*
+ * keys.h
+ *
+ * Timer-DMA sampled inputs with a vertical-counter debouncer
+ *
+ * TIM5 raises two DMA requests per sample period; DMA2 copies GPIOB->IDR
+ * and GPIOC->IDR into circular buffers with no CPU involvement. keys_poll()
+ * packs each sample pair into one 32-bit word (bit n = PBn, bit 16 + n =
+ * PCn), runs it through a VCounter, and hands debounced edges of the game
+ * buttons to the button queue with button_inject(), which passes them on
+ * without a debounce window of its own. Any other line in
+ * KEYS_MASK (serve, pause, menu buttons of an extended controller) is read
+ * with keys_pressed().
+ *
+ * Sampling only runs while something may happen: the button EXTI starts
+ * it through keys_wake(), and keys_poll() stops it (allowing STOP2 again)
+ * once every key has been released and quiet for KEYS_IDLE_MS.
+ *
+ * Edges are stamped with the first of the VCOUNTER_SAMPLES equal samples
+ * that completed the debounce, when the contact settled, so both players
+ * are timed alike and the counter adds no latency to the game.
+ */
+
+#ifndef KEYS_H_
+#define KEYS_H_
+
+#include "main.h"
+#include <stdint.h>
+
+/* 1: the button EXTI starts the sampler, 0: button_irq() debounces edges */
+#define KEYS_SAMPLED     1
+
+#define KEYS_SAMPLE_HZ   1000
+#define KEYS_BUFFER      64     /* samples per port, the longest poll gap */
+#define KEYS_POLL_MS     4      /* batch size while sampling */
+#define KEYS_IDLE_MS     250    /* stop sampling after this long released */
+
+/* Sample word bit of a pin */
+#define KEY_PB(pin)      (1u << (pin))
+#define KEY_PC(pin)      (1u << (16 + (pin)))
+
+/* Sampled lines, all active low with pull-ups */
+#define KEYS_MASK        (KEY_PB(15) | KEY_PC(8))
+
+/**
+ * Enable TIM5/DMA2 clocks and set up the DMA channels, sampling stopped
+ * Call after button_init(): it puts the button module in pass-through.
+ */
+void keys_init(void);
+
+/**
+ * Start sampling, call from the button EXTI (interrupt-safe)
+ */
+void keys_wake(void);
+
+/**
+ * Debounce the samples taken since the last call and queue game button
+ * edges; starts and stops the sampler
+ * @return timebase_us() time of the next poll, UINT64_MAX while stopped
+ */
+uint64_t keys_poll(void);
+
+/**
+ * Debounced levels of all sampled lines
+ * @return KEY_PB()/KEY_PC() bits of the keys held down
+ */
+uint32_t keys_pressed(void);
+
+/**
+ * Refit the sample rate after a system clock change
+ */
+void keys_recalibrate(void);
+
+#endif /* KEYS_H_ */
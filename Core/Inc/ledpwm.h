@@ -0,0 +1,76 @@
+/*
+ * ledpwm.h
+ *
+ * DMA-driven PWM engine for the LED field
+ *
+ * TIM1 runs at LEDPWM_FREQ_HZ * LEDPWM_SLOTS compare events per second.
+ * Each compare event on CH1, CH2 and CH4 triggers a DMA1 channel that copies
+ * the next word of a circular waveform table into one GPIO port's BSRR.
+ * The CPU only touches the tables when the picture changes, and then the
+ * back tables: a committed picture goes live half a table at a time behind
+ * the DMA, so no period shows part of the old picture and part of the new.
+ *
+ * Resources: TIM1, DMA1 Channel 2/3/4 (request 7, TIM1_CH1/CH2/CH4),
+ *            DMA1_Channel2_IRQn (half and full transfer)
+ */
+
+#ifndef LEDPWM_H_
+#define LEDPWM_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define LEDPWM_SLOTS      256   /* brightness steps per PWM period */
+#define LEDPWM_MAX_PORTS  3     /* one DMA channel per GPIO port */
+#define LEDPWM_FREQ_HZ    200   /* PWM period rate, well above flicker */
+
+/**
+ * Enable TIM1/DMA1 clocks and configure the DMA channels
+ */
+void ledpwm_init(void);
+
+/**
+ * Start streaming the waveform tables to the given ports
+ * Fill the tables with ledpwm_wave() before calling; they show at once.
+ * @param ports GPIO port for each waveform table
+ * @param count Number of ports (1 to LEDPWM_MAX_PORTS)
+ */
+void ledpwm_start(GPIO_TypeDef *const ports[], int count);
+
+/**
+ * Stop the timer and DMA, pins keep their last written state
+ */
+void ledpwm_stop(void);
+
+/**
+ * Recompute the slot rate after a system clock change
+ * Keeps the DMA position, so the picture does not jump.
+ */
+void ledpwm_recalibrate(void);
+
+/**
+ * Check if the engine is streaming
+ * @return 1 if running, 0 otherwise
+ */
+int ledpwm_running(void);
+
+/**
+ * Back waveform table for a port, LEDPWM_SLOTS BSRR words
+ * Fill it, then ledpwm_commit() (or ledpwm_start() when stopped). A commit
+ * not yet taken up is withdrawn, so a half-written table never goes live.
+ * @param port Port index as passed to ledpwm_start()
+ */
+uint32_t *ledpwm_wave(int port);
+
+/**
+ * Show the back tables while streaming, from the next whole PWM period
+ * that starts after the next half transfer: within 1.5 periods
+ */
+void ledpwm_commit(void);
+
+/**
+ * DMA1 Channel 2 interrupt handler hook
+ */
+void ledpwm_dma_irq(void);
+
+#endif /* LEDPWM_H_ */
@@ -20,6 +20,14 @@
 #define LEDS_H_
 
 #include "main.h"
+#include <stdint.h>
+
+/* Frame mask bit for LED position i (1-8) */
+#define LED_BIT(i)        ((uint8_t)(1u << ((i) - 1)))
+
+/* Frame masks for each player's half of the field */
+#define LEDS_LEFT_HALF    0x0F    /* LED 1-4 */
+#define LEDS_RIGHT_HALF   0xF0    /* LED 5-8 */
 
 /**
  * Initialize LED control module (call once at startup)
@@ -27,6 +35,48 @@
  */
 void leds_init(void);
 
+/**
+ * Show a frame with one BSRR write per port, skipped if unchanged
+ * @param mask Bit 0 = LED 1 ... bit 7 = LED 8, 1 = on
+ */
+void leds_set_mask(uint8_t mask);
+
+/**
+ * Show a frame with per-LED brightness (gamma corrected)
+ * Without PWM, levels of 128 and above are on and the rest off.
+ * @param levels Perceptual brightness 0-255 for LED 1..8
+ */
+void leds_set_levels(const uint8_t levels[8]);
+
+/**
+ * Light the ball at position i with a fading trail behind it
+ * @param i Ball position (1-8), values out of range are ignored
+ * @param direction Ball direction (1 = moving right, -1 = moving left)
+ */
+void leds_trail(int i, int direction);
+
+/**
+ * Allow or forbid DMA PWM brightness
+ * When allowed, the DMA engine only runs while a frame has dimmed LEDs.
+ * Requires ledpwm_init() before enabling.
+ * @param enable 1 to allow DMA PWM, 0 for on/off frames only
+ */
+void leds_pwm_enable(int enable);
+
+/**
+ * Call a function with every new frame put up, plain or dimmed
+ * leds_init() removes it.
+ * @param hook Called with the brightness of LED 1..8 (plain frames 0 or
+ *             255), from the caller of leds_*(); NULL for none
+ */
+void leds_set_frame_hook(void (*hook)(const uint8_t levels[8]));
+
+/**
+ * Get the frame currently on the LEDs
+ * @return Mask of lit LEDs (bit 0 = LED 1)
+ */
+uint8_t leds_get_mask(void);
+
 /**
  * Light up LED at position i (1-8), turn off all others
  * @param i LED position (1-8), values out of range are ignored
@@ -0,0 +1,76 @@
+/*
+ * link.h
+ *
+ * Board-to-board serial link on USART1, both directions by DMA
+ *
+ * The transport of netplay.h: PA9 (TX) of each board goes to PA10 (RX) of
+ * the other, with a common ground. USART1 runs from HSI16, so the clock
+ * profiles (clock.h) leave the baud rate alone.
+ *
+ * Transmit: link_send() appends to one of two buffers while DMA2 Channel
+ * 6 sends the other; the completion starts the filled one. Receive: DMA2
+ * Channel 7 copies every byte into a circular buffer, and the idle-line
+ * and half/full transfer interrupts call the receive hook.
+ *
+ * The USART is not clocked in STOP2, so the link holds STOP2 off from
+ * link_init() on.
+ *
+ * Resources: USART1, PA9/PA10 (AF7), DMA2 Channel 6 (request 2),
+ *            DMA2 Channel 7 (request 2), USART1_IRQn,
+ *            DMA2_Channel6_IRQn, DMA2_Channel7_IRQn
+ */
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define LINK_BAUD   1000000     /* 16 MHz / 16, an exact divider */
+#define LINK_TX     256         /* bytes per transmit buffer */
+#define LINK_RX     256         /* receive ring bytes */
+
+/**
+ * Set up USART1 and both DMA channels, hold STOP2 off
+ * @param received Called from the interrupts when bytes came in
+ */
+void link_init(void (*received)(void));
+
+/**
+ * Queue bytes for sending, matches the netplay transport
+ * Whole frames only: a frame that does not fit is dropped, and counted.
+ * @param bytes Encoded frame
+ * @param len Its length
+ * @param arg Unused
+ */
+void link_send(const uint8_t *bytes, uint32_t len, void *arg);
+
+/**
+ * Take up received bytes
+ * @param buf Destination
+ * @param size Room in buf
+ * @return Bytes copied, 0 once none are left
+ */
+uint32_t link_read(uint8_t *buf, uint32_t size);
+
+/**
+ * Frames dropped because both transmit buffers were full
+ */
+uint32_t link_overflows(void);
+
+/**
+ * DMA2 Channel 6 interrupt handler hook (transmit)
+ */
+void link_tx_dma_irq(void);
+
+/**
+ * DMA2 Channel 7 interrupt handler hook (receive)
+ */
+void link_rx_dma_irq(void);
+
+/**
+ * USART1 interrupt handler hook (idle line)
+ */
+void link_uart_irq(void);
+
+#endif /* LINK_H_ */
@@ -53,6 +53,8 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+void SystemClock_Config(void);
+extern UART_HandleTypeDef huart2;
 
 /* USER CODE END EFP */
 
@@ -0,0 +1,58 @@
+/*
+ * mirror.h
+ *
+ * Live copy of the LED frames as telemetry, for spectators and debugging
+ *
+ * Every frame leds.c puts up goes out as a TLM_LEDS record on USART2
+ * (telemetry.h), delta- and run-length encoded (mirror_codec.h) and timed
+ * with the frame's time. Unchanged frames send nothing. After a record the
+ * mirror waits for as long as that record takes of MIRROR_SHARE_PCT of the
+ * line, and frames meanwhile are merged into the last of them, so the
+ * game's own records and text keep the rest. A ball step costs a 4-byte
+ * payload, 13 bytes on the wire with the record header and COBS: at 115200
+ * baud and a quarter of the line that is MIRROR_MIN_US = 4.5 ms, about 220
+ * frames a second.
+ *
+ * A key frame goes out every MIRROR_KEY_US, and after a record was dropped
+ * for lack of room, so a viewer that joins late or lost a record picks up
+ * again within a second (Host/sim/led_view.c).
+ */
+
+#ifndef MIRROR_H_
+#define MIRROR_H_
+
+#include "main.h"
+#include "telemetry.h"
+#include <stdint.h>
+
+#ifndef MIRROR_ENABLE
+#define MIRROR_ENABLE  1    /* build with -DMIRROR_ENABLE=0 to leave it out */
+#endif
+
+#define MIRROR_SHARE_PCT  25      /* of the telemetry line the mirror may fill */
+#define MIRROR_KEY_US     1000000   /* key frame period */
+
+/* Wait after a record of len payload bytes, 10 bits a byte on the line */
+#define MIRROR_RECORD_US(len) \
+    ((uint32_t)(TELEMETRY_WIRE(len) * 10ull * 1000000u * 100u / \
+                ((uint64_t)MIRROR_SHARE_PCT * TELEMETRY_BAUD)))
+
+#define MIRROR_MIN_US     MIRROR_RECORD_US(4)   /* after a ball step */
+
+/**
+ * Hook the LED frames and add the mirror task
+ * Call after leds_init(), telemetry_init() and sched_init().
+ */
+void mirror_init(void);
+
+/**
+ * Records sent, keys included
+ */
+uint32_t mirror_frames(void);
+
+/**
+ * Frames merged into a later one by the rate limit
+ */
+uint32_t mirror_merged(void);
+
+#endif /* MIRROR_H_ */
@@ -0,0 +1,69 @@
+/*
+ * mirror_codec.h
+ *
+ * LED frame encoding of the mirror stream, free of hardware
+ *
+ * A frame is the brightness of the 8 LEDs, 0-255 each (plain frames are
+ * 0 and 255 only). Each TLM_LEDS record carries one frame, timed by the
+ * record's time_ms, as one of:
+ *
+ *   KEY    kind, then (count u8, level u8) runs covering all 8 LEDs:
+ *          all off is 3 bytes
+ *   DELTA  kind, then the LEDs that changed since the previous frame as
+ *          groups: (skip << 4 | count) u8 and count new levels, skip
+ *          being the unchanged LEDs since the end of the previous group.
+ *          A ball moving on one LED is 4 bytes
+ *
+ * The encoder sends whichever is shorter, and nothing for a frame that
+ * did not change. A decoder takes deltas only on top of a key, so a
+ * reader that starts late or saw a record go missing waits for the next
+ * one.
+ */
+
+#ifndef MIRROR_CODEC_H_
+#define MIRROR_CODEC_H_
+
+#include <stdint.h>
+
+#define MIRROR_LEDS         8
+#define MIRROR_PAYLOAD_MAX  (1 + 2 * MIRROR_LEDS)   /* a key of 8 runs */
+
+typedef enum {
+    MIRROR_KEY = 1,
+    MIRROR_DELTA
+} MirrorKind;
+
+/* Either end of the stream: the frame last sent or decoded */
+typedef struct {
+    uint8_t levels[MIRROR_LEDS];
+    uint8_t valid;              /* levels hold a frame */
+} MirrorCodec;
+
+/**
+ * Forget the previous frame: the encoder's next one is a key, the
+ * decoder waits for one
+ */
+void mirror_codec_reset(MirrorCodec *c);
+
+/**
+ * Encode a frame against the previous one
+ * @param c Encoder state
+ * @param levels Brightness of LED 1..8
+ * @param key 1 to send a key whatever changed
+ * @param out Room for MIRROR_PAYLOAD_MAX bytes
+ * @return Payload length, 0 if the frame did not change
+ */
+uint8_t mirror_encode(MirrorCodec *c, const uint8_t levels[MIRROR_LEDS], int key, uint8_t *out);
+
+/**
+ * Decode a TLM_LEDS payload into c->levels
+ * @param c Decoder state
+ * @param payload Record payload
+ * @param len Its length
+ * @return 1 if c->levels is the new frame, 0 if the record is malformed or
+ *         a delta without a key before it; deltas are then refused until
+ *         the next key
+ */
+int mirror_decode(MirrorCodec *c, const uint8_t *payload, uint8_t len);
+
+#endif /* MIRROR_CODEC_H_ */
@@ -0,0 +1,156 @@
+/*
+ * netplay.h
+ *
+ * Two-board match over a serial link, free of hardware
+ *
+ * Each board is one player with its own 8 LEDs: the left board shows LEDs
+ * 1-8 of a 16-LED field, the right board LEDs 9-16, and the ball passes
+ * from one to the other. Both boards run the whole game in a rollback
+ * session (rollback.h) and send each other their presses.
+ *
+ * Link set-up:
+ *   HELLO    both boards, with a random id; the lower id plays left and
+ *            keeps the shared clock (its own timebase)
+ *   SYNC     the right board measures its clock offset NTP-style, keeping
+ *            the sample with the shortest round trip
+ *   START    the left board sends the seed, the start time and its pacing
+ * In play both boards send INPUT every NETPLAY_BEAT_US and at once on a
+ * press. It carries every press the other board has not acknowledged and
+ * the time up to which the sender has sent them all (confirmed).
+ *
+ * Input delay plus rollback: the session runs NETPLAY_DELAY_US behind the
+ * shared clock, so a press that crosses the link faster than that is in
+ * place before its time comes. Slower ones roll the session back. The
+ * session never runs more than ROLLBACK_WINDOW_US past the other board's
+ * confirmed time: on a stalled link the game waits rather than diverges.
+ *
+ * Frames are COBS-encoded with a CRC-8 and a 0x00 delimiter (cobs.h); a
+ * frame that fails the check is dropped and the next INPUT repeats it.
+ *
+ * The transport is a callback, so the same code runs on the board (link.c,
+ * USART1) and on the host (Host/sim/net_sim.c, a pty pair).
+ */
+
+#ifndef NETPLAY_H_
+#define NETPLAY_H_
+
+#include "game_core.h"
+#include "rollback.h"
+#include <stdint.h>
+
+#ifndef NETPLAY
+#define NETPLAY  0      /* build with -DNETPLAY=1 for a two-board match */
+#endif
+
+#define NETPLAY_DELAY_US     30000   /* session lag behind the shared clock */
+#define NETPLAY_BEAT_US      20000   /* INPUT period */
+#define NETPLAY_HELLO_US     200000  /* HELLO, READY and SYNC retry period */
+#define NETPLAY_RESYNC_US    1000000 /* clock offset refresh in play */
+#define NETPLAY_SYNCS        8       /* offset samples before READY */
+#define NETPLAY_START_US     300000  /* START lead on the shared clock */
+#define NETPLAY_UNACKED      8       /* presses in flight */
+#define NETPLAY_FRAME_MAX    96      /* decoded frame, CRC included */
+
+typedef enum {
+    NETPLAY_LEFT = 0,
+    NETPLAY_RIGHT
+} NetplaySide;
+
+typedef enum {
+    NETPLAY_PHASE_HELLO = 0,    /* no peer yet */
+    NETPLAY_PHASE_SYNC,         /* peer known, clocks being matched */
+    NETPLAY_PHASE_PLAYING
+} NetplayPhase;
+
+typedef struct {
+    uint8_t phase;              /* NetplayPhase */
+    uint8_t side;               /* NetplaySide, once the peer is known */
+    uint32_t id;
+    uint32_t peer_id;
+    uint32_t seed;              /* used if this board plays left */
+    int64_t offset_us;          /* shared clock - local timebase */
+    uint32_t best_rtt_us;       /* round trip of the offset in use */
+    uint8_t samples;
+
+    GameConfig config;          /* the left board's, sent with START */
+    uint64_t start_us;
+    Rollback rb;
+
+    /* Presses */
+    RollbackInput outbox[NETPLAY_UNACKED];  /* sent, not yet acknowledged */
+    uint8_t out_count;
+    uint8_t out_seq;            /* sequence number of outbox[0] */
+    uint8_t in_seq;             /* presses received from the peer */
+    uint64_t confirmed_us;      /* ours up to here are all in the outbox */
+    uint64_t peer_confirmed_us; /* theirs up to here are all received */
+    uint8_t send_now;
+
+    /* Timers, local timebase */
+    uint64_t next_hello;
+    uint64_t next_sync;
+    uint64_t next_beat;
+
+    /* Receive */
+    uint8_t rx[NETPLAY_FRAME_MAX + 2];
+    uint8_t rx_len;
+    uint8_t rx_over;            /* frame too long, skip to the delimiter */
+
+    void (*send)(const uint8_t *bytes, uint32_t len, void *arg);
+    void *send_arg;
+
+    /* Statistics */
+    uint32_t rx_bad;            /* frames dropped by CRC or framing */
+    uint32_t stalls;            /* runs held back by the peer */
+    uint32_t lost;              /* presses dropped, outbox full */
+} Netplay;
+
+/**
+ * Start looking for a peer
+ * The game is reset and held in its intro until the match starts.
+ * @param np Link state
+ * @param id Random id, must differ from the peer's
+ * @param seed Serve seed, used if this board plays left
+ * @param config Pacing sent to the peer if this board plays left;
+ *               field_leds is set to twice GAME_LEDS
+ * @param show_ms Length of the show a game requests (rollback_reset())
+ * @param send Transport, takes whole encoded frames
+ * @param arg Passed to send
+ * @param now Local timebase
+ */
+void netplay_init(Netplay *np, uint32_t id, uint32_t seed, const GameConfig *config,
+                  uint32_t (*show_ms)(const Game *game),
+                  void (*send)(const uint8_t *bytes, uint32_t len, void *arg), void *arg,
+                  uint64_t now);
+
+/**
+ * Take up received bytes, any split
+ * @param np Link state
+ * @param bytes Received bytes
+ * @param len Their number
+ * @param now Local timebase
+ */
+void netplay_receive(Netplay *np, const uint8_t *bytes, uint32_t len, uint64_t now);
+
+/**
+ * A press on this board, ignored before the match starts
+ * @param np Link state
+ * @param at Time of the press edge, local timebase
+ */
+void netplay_press(Netplay *np, uint64_t at);
+
+/**
+ * Send what is due and run the game up to now minus the input delay
+ * Pass every press stamped up to now to netplay_press() first: now is
+ * sent to the peer as the confirmed time.
+ * @param np Link state
+ * @param now Local timebase
+ * @return Local time to run again at the latest
+ */
+uint64_t netplay_run(Netplay *np, uint64_t now);
+
+/**
+ * Local timebase time of a shared clock time
+ */
+uint64_t netplay_local(const Netplay *np, uint64_t shared_us);
+
+#endif /* NETPLAY_H_ */
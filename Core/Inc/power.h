@@ -0,0 +1,51 @@
+/*
+ * power.h
+ *
+ * Tickless low-power idle
+ *
+ * power_idle_until() puts the CPU to sleep until the earliest of: the given
+ * deadline, the next timer wheel expiry, or any interrupt (button EXTI,
+ * UART, DMA). SysTick is suspended while asleep and the wheel and HAL tick
+ * are caught up afterwards from the microsecond timebase.
+ *
+ * Short or PWM-busy waits use Sleep mode with the TIM2 alarm as wake-up.
+ * Longer waits with no DMA running use STOP2 with LPTIM1 (LSI / 32 = 1 kHz)
+ * as wake-up timer; the active clock profile is restored on wake.
+ *
+ * Resources: LPTIM1, LPTIM1_IRQn, EXTI line 32
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define POWER_NO_DEADLINE  UINT64_MAX
+
+/**
+ * Start LSI and configure LPTIM1 as STOP2 wake-up timer
+ */
+void power_init(void);
+
+/**
+ * Sleep until a deadline, the next timer expiry or an interrupt
+ * Returns early on any interrupt, so call it from a loop. May be called
+ * with interrupts disabled (to close a check-then-sleep race); they are
+ * enabled on return.
+ * @param deadline_us Absolute timebase_us() time, or POWER_NO_DEADLINE
+ */
+void power_idle_until(uint64_t deadline_us);
+
+/**
+ * Forbid or allow STOP2 (nestable), e.g. while a UART transfer runs
+ * @param inhibit 1 to add an inhibit, 0 to release one
+ */
+void power_stop_inhibit(int inhibit);
+
+/**
+ * LPTIM1 interrupt handler hook, call from LPTIM1_IRQHandler()
+ */
+void power_lptim_irq(void);
+
+#endif /* POWER_H_ */
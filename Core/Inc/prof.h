@@ -0,0 +1,107 @@
+/*
+ * prof.h
+ *
+ * Cycle-accurate profiling scopes on the DWT cycle counter
+ *
+ * A scope is a named stretch of code between PROF_BEGIN() and PROF_END().
+ * Every pass records its length in core cycles into a static table: count,
+ * min, max, total and a log2 histogram (bucket b holds passes of 2^(b-1)
+ * to 2^b - 1 cycles, bucket 0 those of zero). prof_dump() sends the table
+ * as TLM_TEXT telemetry records; in a profiling build a low-priority task
+ * does so every PROF_DUMP_PERIOD_MS, skipping rallies so the dump never
+ * crowds out the game's records.
+ *
+ * With PROF_ENABLE 0 (the default) the macros expand to nothing and the
+ * module is not built, so release builds carry no trace of it. Build with
+ * -DPROF_ENABLE=1 to profile.
+ *
+ * Reading the counter takes one load, so a scope adds a few cycles plus
+ * one prof_record() call after the measured stretch. Cycles are core
+ * cycles at whatever clock profile ran the code (80 MHz in a rally).
+ *
+ * Resources: DWT, telemetry text (while dumping)
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE  0
+#endif
+
+#define PROF_BUCKETS        24      /* the last one takes 2^22 cycles and up */
+#define PROF_DUMP_PERIOD_MS 10000
+
+/* X(ID, "name") for every scope */
+#define PROF_SCOPES(X) \
+    X(SCHED_RUN,   "sched_run_once") \
+    X(GAME_EVENT,  "game_event") \
+    X(BUTTON_READ, "button_read_edge") \
+    X(LEDS_INDEX,  "leds_index") \
+    X(LEDS_TRAIL,  "leds_trail") \
+    X(TIMEBASE_US, "timebase_us")
+
+typedef enum {
+#define PROF_SCOPE_ENUM_(id, name) PROF_##id,
+    PROF_SCOPES(PROF_SCOPE_ENUM_)
+#undef PROF_SCOPE_ENUM_
+    PROF_SCOPE_COUNT
+} ProfScope;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[PROF_BUCKETS];
+} ProfStats;
+
+#if PROF_ENABLE
+
+/* Open scope id (a ProfScope without the PROF_ prefix) in this block */
+#define PROF_BEGIN(id)  uint32_t prof_start_##id = DWT->CYCCNT
+/* Close it and record the pass */
+#define PROF_END(id)    prof_record(PROF_##id, DWT->CYCCNT - prof_start_##id)
+
+/**
+ * Start the cycle counter, clear the table and add the dump task
+ * Call after game_init() so the dump task runs below the game.
+ */
+void prof_init(void);
+
+/**
+ * Record one pass of a scope, safe to call from interrupt handlers
+ * @param scope ProfScope
+ * @param cycles Length of the pass
+ */
+void prof_record(uint8_t scope, uint32_t cycles);
+
+/**
+ * Statistics of a scope so far
+ * @param scope ProfScope
+ * @return Its table entry
+ */
+const ProfStats *prof_stats(uint8_t scope);
+
+/**
+ * Clear the table
+ */
+void prof_reset(void);
+
+/**
+ * Send the table as TLM_TEXT telemetry, one line per scope; skipped while
+ * earlier telemetry text, such as the last table, is still going out
+ */
+void prof_dump(void);
+
+#else
+
+#define PROF_BEGIN(id)  do { } while (0)
+#define PROF_END(id)    do { } while (0)
+
+#endif /* PROF_ENABLE */
+
+#endif /* PROF_H_ */
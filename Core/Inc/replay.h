@@ -0,0 +1,84 @@
+/*
+ * replay.h
+ *
+ * Compact match recording for deterministic replay
+ *
+ * A log holds the game's RNG seed, the time the game started and every raw
+ * button edge with its timestamp. The game core only depends on those (ball
+ * steps and animation ends are derived from them), so feeding the edges back
+ * through button_inject() at the same times relative to the start replays
+ * the match exactly, on the board or on the host.
+ *
+ * Format (little endian):
+ *   "RPL1"                 magic
+ *   uint32                 seed
+ *   varint                 start time in us
+ *   varint per edge        (delta_us << 2) | (button - 1) << 1 | pressed,
+ *                          delta from the previous edge (or the start)
+ * A press with its release typically takes 4-6 bytes.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include "button.h"
+#include <stdint.h>
+
+#define REPLAY_HEADER_MAX  17   /* magic + seed + longest start varint */
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t len;           /* bytes used */
+    uint64_t last_us;       /* timestamp of the previous edge */
+    uint32_t edges;         /* edges recorded */
+    uint8_t full;           /* an edge did not fit, recording stopped */
+} ReplayLog;
+
+typedef struct {
+    const uint8_t *buf;
+    uint32_t len;
+    uint32_t pos;
+    uint64_t last_us;
+} ReplayReader;
+
+/**
+ * Start a recording, discarding what the buffer held
+ * @param log Log to start
+ * @param buf Storage, at least REPLAY_HEADER_MAX bytes
+ * @param size Size of buf
+ * @param seed Game RNG seed
+ * @param start_us Time the game was reset
+ * @return 1 on success, 0 if buf is too small
+ */
+int replay_record_start(ReplayLog *log, uint8_t *buf, uint32_t size,
+                        uint32_t seed, uint64_t start_us);
+
+/**
+ * Append an edge; edges must come in timestamp order
+ * @param log Recording
+ * @param event Edge
+ */
+void replay_record_edge(ReplayLog *log, const ButtonEvent *event);
+
+/**
+ * Open a log for reading
+ * @param reader Reader to set up
+ * @param buf Log bytes
+ * @param len Number of bytes
+ * @param seed Set to the recorded seed
+ * @param start_us Set to the recorded start time
+ * @return 1 if the header is valid, 0 otherwise
+ */
+int replay_open(ReplayReader *reader, const uint8_t *buf, uint32_t len,
+                uint32_t *seed, uint64_t *start_us);
+
+/**
+ * Read the next edge
+ * @param reader Open reader
+ * @param event Set to the edge, with its recorded timestamp
+ * @return 1 if an edge was read, 0 at the end of the log
+ */
+int replay_next(ReplayReader *reader, ButtonEvent *event);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,151 @@
+/*
+ * ring.h
+ *
+ * Token ring over daisy-chained serial links, free of hardware
+ *
+ * Each board's TX goes to the next board's RX, the last board's TX back
+ * to the first; frames travel one way round. There is no central PC:
+ *
+ *   CLAIM   every board sends its id until a master is found; a board
+ *           passes on lower ids than its own and drops higher ones, so
+ *           only the lowest id comes back to its sender (Chang-Roberts),
+ *           which becomes the master at address 0
+ *   ENUM    the master sends a count round; each board takes it as its
+ *           address and passes it on one higher
+ *   START   the master sends the board count round; every board knows
+ *           the ring once it has passed
+ *   TOKEN   then circulates for good. A board may add one message of its
+ *           own, sent ahead of the token, and only while holding it
+ *   MSG     a broadcast; every other board delivers it once and passes it
+ *           on unchanged, its sender takes it off the ring
+ *
+ * Bounded latency: a message travels ahead of the token, so it is round
+ * the ring within one token rotation, and a board waits at most one
+ * rotation for the token. A rotation is N hops of at most RING_HOP_US,
+ * plus RING_PACE_US that the master holds an idle token. The master
+ * regenerates a lost token, under a new epoch so a stray old one dies at
+ * the master. A message whose sender sees the token back before the
+ * message is resent on that visit; every board delivers each (sender,
+ * seq) once.
+ *
+ * Zero-copy forwarding: ring_receive() only reads an encoded frame and
+ * says whether to pass it on as it is, so the transport can send it
+ * straight out of its receive buffer. Frames the board makes itself (the
+ * token, its own messages, CLAIM and ENUM) go to the send callback.
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+
+#define RING_NODES_MAX    64        /* boards on one ring */
+#define RING_PAYLOAD_MAX  8         /* message bytes */
+#define RING_FRAME_MAX    (RING_PAYLOAD_MAX + 5)   /* decoded, CRC included */
+#define RING_QUEUE        8         /* own messages waiting to go */
+#define RING_HOP_US       2000      /* worst time a frame takes per board */
+#define RING_PACE_US      10000     /* master holds an idle token this long */
+#define RING_CLAIM_US     100000    /* CLAIM repeat while electing */
+
+typedef enum {
+    RING_PHASE_ELECT = 0,       /* no master yet */
+    RING_PHASE_ENUM,            /* master known, ring being counted */
+    RING_PHASE_READY            /* token running */
+} RingPhase;
+
+typedef struct {
+    uint8_t bytes[RING_PAYLOAD_MAX];
+    uint8_t len;
+} RingMsg;
+
+typedef struct {
+    uint8_t phase;              /* RingPhase */
+    uint32_t id;                /* random, unique on the ring */
+    uint32_t master_id;         /* lowest id seen while electing */
+    uint8_t address;            /* hops from the master, 0 for the master */
+    uint8_t nodes;              /* boards on the ring, once READY */
+    uint8_t epoch;              /* of the live token */
+
+    /* Own messages; out[0] is on the ring if in_flight */
+    RingMsg out[RING_QUEUE];
+    uint8_t out_count;
+    uint8_t out_seq;            /* sequence number of out[0] */
+    uint8_t in_flight;
+
+    /* Broadcasts delivered, per sender address */
+    uint8_t seen_seq[RING_NODES_MAX];
+    uint8_t seen[RING_NODES_MAX];
+    uint8_t seen_lap[RING_NODES_MAX];   /* master: rotation it last passed */
+
+    /* Timers */
+    uint64_t token_at;          /* the token last passed (or was made) */
+    uint64_t next_claim;
+    uint64_t hold_until;        /* master: idle token goes out again */
+    uint8_t holding;            /* master: token held for pacing */
+
+    void (*send)(const uint8_t *bytes, uint32_t len, void *arg);
+    void (*deliver)(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg);
+    void (*ready)(void *arg);
+    void *arg;
+
+    /* Statistics */
+    uint32_t rotations;         /* master: tokens back */
+    uint32_t rotation_max_us;   /* master: slowest of them */
+    uint64_t rotation_start;
+    uint32_t regenerated;       /* master: tokens made again */
+    uint32_t resent;
+    uint32_t rx_bad;            /* frames failing CRC or framing */
+    uint32_t elections;
+} Ring;
+
+/**
+ * Start electing a master
+ * @param ring Node state
+ * @param id Random id, unique on the ring
+ * @param send Transport for frames this board makes: one encoded frame
+ *             with its 0x00 delimiter
+ * @param deliver Called with each broadcast from another board, once
+ * @param ready Called when the ring is (again) counted, NULL for none
+ * @param arg Passed to the callbacks
+ * @param now Local time
+ */
+void ring_init(Ring *ring, uint32_t id,
+               void (*send)(const uint8_t *bytes, uint32_t len, void *arg),
+               void (*deliver)(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg),
+               void (*ready)(void *arg), void *arg, uint64_t now);
+
+/**
+ * Take up one received frame
+ * @param ring Node state
+ * @param encoded COBS bytes of the frame, without the delimiter
+ * @param len Their number
+ * @param now Local time
+ * @return 1 if the transport is to pass the frame on unchanged (with a
+ *         0x00 delimiter), 0 if it ends here
+ */
+int ring_receive(Ring *ring, const uint8_t *encoded, uint32_t len, uint64_t now);
+
+/**
+ * Queue a broadcast to every other board, sent on a token visit
+ * @param ring Node state
+ * @param bytes Message
+ * @param len Up to RING_PAYLOAD_MAX
+ * @return 1 if queued, 0 if the queue is full
+ */
+int ring_post(Ring *ring, const uint8_t *bytes, uint8_t len);
+
+/**
+ * Timers: CLAIM repeats, token pacing and loss
+ * @param ring Node state
+ * @param now Local time
+ * @return Local time to run again at the latest
+ */
+uint64_t ring_run(Ring *ring, uint64_t now);
+
+/**
+ * Longest wait for a full token rotation on a ring of a given size, the
+ * bound on message latency once the ring is READY
+ */
+uint64_t ring_rotation_bound_us(uint8_t nodes);
+
+#endif /* RING_H_ */
@@ -0,0 +1,81 @@
+/*
+ * ringbus.h
+ *
+ * Token ring (ring.h) on UART5, both directions by DMA
+ *
+ * Boards are daisy-chained: PC12 (TX) of each goes to PD2 (RX) of the
+ * next, the last board's TX back to the first's RX, all on a common
+ * ground. UART5 runs from HSI16 like the two-board link (link.h).
+ *
+ * Receive: DMA2 Channel 2 copies every byte into a circular buffer; the
+ * idle-line and half/full transfer interrupts signal the ring task, which
+ * takes up each frame where it lies. Transmit: DMA2 Channel 1 works
+ * through a queue of (address, length) entries. A frame the ring passes
+ * on is queued as it lies in the receive buffer, as two entries if it
+ * wraps round the end, and is never copied; only frames this board makes
+ * are copied, into the queue entry. The queue holds far fewer bytes than
+ * the receive buffer and both lines run at one rate, so a frame has left
+ * before the receive DMA comes round to overwrite it.
+ *
+ * The USART is not clocked in STOP2, so the ring holds STOP2 off from
+ * ringbus_init() on.
+ *
+ * Resources: UART5, PC12/PD2 (AF8), DMA2 Channel 1 (request 2),
+ *            DMA2 Channel 2 (request 2), UART5_IRQn,
+ *            DMA2_Channel1_IRQn, DMA2_Channel2_IRQn
+ */
+
+#ifndef RINGBUS_H_
+#define RINGBUS_H_
+
+#include "main.h"
+#include "ring.h"
+#include <stdint.h>
+
+#define RINGBUS_BAUD   1000000     /* 16 MHz / 16, an exact divider */
+#define RINGBUS_RX     1024        /* receive ring bytes */
+#define RINGBUS_TXQ    32          /* transmit queue entries */
+
+/**
+ * Set up UART5 and both DMA channels, add the ring task and start
+ * electing a master; holds STOP2 off
+ * Call after sched_init(). The callbacks run in the ring task.
+ * @param deliver Called with each broadcast from another board
+ * @param ready Called when the ring is (again) counted, NULL for none
+ * @param arg Passed to the callbacks
+ */
+void ringbus_init(void (*deliver)(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg),
+                  void (*ready)(void *arg), void *arg);
+
+/**
+ * Queue a broadcast to every other board, from task context
+ * @return 1 if queued, 0 if the queue is full
+ */
+int ringbus_post(const uint8_t *bytes, uint8_t len);
+
+/**
+ * The ring's state: address, board count and statistics, read-only
+ */
+const Ring *ringbus_state(void);
+
+/**
+ * Frames dropped because the transmit queue was full
+ */
+uint32_t ringbus_overflows(void);
+
+/**
+ * DMA2 Channel 1 interrupt handler hook (transmit)
+ */
+void ringbus_tx_dma_irq(void);
+
+/**
+ * DMA2 Channel 2 interrupt handler hook (receive)
+ */
+void ringbus_rx_dma_irq(void);
+
+/**
+ * UART5 interrupt handler hook (idle line)
+ */
+void ringbus_uart_irq(void);
+
+#endif /* RINGBUS_H_ */
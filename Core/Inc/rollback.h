@@ -0,0 +1,104 @@
+/*
+ * rollback.h
+ *
+ * Rollback session over the game core, free of hardware
+ *
+ * Two boards run the same game from the same seed and feed it the same
+ * timestamped presses, so they play out the same match (the core is
+ * deterministic, see game_core.h). A press from the other board arrives
+ * late by the link latency; if the session has already simulated past its
+ * time, the session restores the last snapshot taken before it and plays
+ * the events since then again with the press in its place. The press is
+ * judged on the time it was made, whichever board made it.
+ *
+ * Snapshots are whole copies of the game (it holds no pointers but its
+ * config), taken before the first event at least ROLLBACK_SNAP_US after
+ * the previous one. A press older than the oldest snapshot can no longer
+ * be placed; the caller keeps the simulation within ROLLBACK_WINDOW_US of
+ * the last time the other board vouched for (see netplay.h) so that does
+ * not happen.
+ */
+
+#ifndef ROLLBACK_H_
+#define ROLLBACK_H_
+
+#include "game_core.h"
+#include <stdint.h>
+
+#define ROLLBACK_SNAPS      16      /* snapshots kept */
+#define ROLLBACK_SNAP_US    25000   /* least simulated time between them */
+#define ROLLBACK_WINDOW_US  250000  /* deepest rollback the caller allows */
+#define ROLLBACK_INPUTS     32      /* presses kept for replaying */
+
+/* A press, either board's */
+typedef struct {
+    uint64_t at_us;
+    uint8_t event;          /* GAME_EV_PRESS_LEFT or GAME_EV_PRESS_RIGHT */
+} RollbackInput;
+
+/* Game with the end of its animation: all a replay starts from */
+typedef struct {
+    Game game;
+    uint64_t anim_end_at;
+    uint64_t at_us;         /* events before this time are in, none after */
+} RollbackSnap;
+
+typedef struct {
+    Game game;              /* fed every event up to sim_us */
+    uint64_t anim_end_at;   /* the requested animation ends */
+    uint64_t sim_us;
+    uint32_t (*show_ms)(const Game *game);  /* length of game->show, in ms,
+                                               UINT32_MAX if it has no end */
+
+    RollbackSnap snaps[ROLLBACK_SNAPS];
+    uint8_t snap_first;
+    uint8_t snap_count;
+
+    RollbackInput inputs[ROLLBACK_INPUTS];  /* by time, then event */
+    uint8_t input_count;
+    uint8_t input_next;     /* first input not yet fed */
+
+    /* For the caller to put up */
+    uint32_t shows;         /* show requests so far */
+    uint8_t show;           /* the latest GameShow requested */
+
+    /* Statistics */
+    uint32_t rollbacks;
+    uint32_t replayed;      /* events fed again by rollbacks */
+    uint32_t dropped;       /* presses too old or too many to place */
+} Rollback;
+
+/**
+ * Start a session on a new game
+ * @param rb Session
+ * @param config Pacing, kept by reference
+ * @param seed Serve direction seed, the same on both boards
+ * @param start_us Time the game starts, on the shared clock
+ * @param show_ms Length of the show a game requests, UINT32_MAX for none
+ */
+void rollback_reset(Rollback *rb, const GameConfig *config, uint32_t seed, uint64_t start_us,
+                    uint32_t (*show_ms)(const Game *game));
+
+/**
+ * Add a press, rolling back if the session is already past its time
+ * @param rb Session
+ * @param event GAME_EV_PRESS_LEFT or GAME_EV_PRESS_RIGHT
+ * @param at_us Time of the press on the shared clock
+ * @return 1 if placed, 0 if dropped (too old or no room)
+ */
+int rollback_input(Rollback *rb, uint8_t event, uint64_t at_us);
+
+/**
+ * Feed every event due up to a time
+ * @param rb Session
+ * @param until_us Time to simulate to, earlier times are ignored
+ */
+void rollback_advance(Rollback *rb, uint64_t until_us);
+
+/**
+ * Next time the game has an event of its own (ball step or animation end)
+ * @return Time on the shared clock, GAME_NO_STEP if none
+ */
+uint64_t rollback_next_at(const Rollback *rb);
+
+#endif /* ROLLBACK_H_ */
@@ -0,0 +1,91 @@
+/*
+ * sched.h
+ *
+ * Cooperative run-to-completion task scheduler
+ *
+ * A task is a function that does a bounded piece of work and returns. It
+ * becomes ready when its periodic release time comes (period_us), when it
+ * asked to be woken at a given time (sched_wake_at), or when an interrupt
+ * handler signals it (sched_signal). sched_dispatch() runs ready tasks in
+ * priority order (the order they were added) and puts the CPU to sleep with
+ * power_idle_until() when none is ready.
+ *
+ * Every run is timed on the microsecond timebase. A run that completes
+ * later than deadline_us after the task became ready counts as a miss.
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define SCHED_NEVER  UINT64_MAX
+
+typedef void (*TaskFn)(void *arg);
+
+typedef struct Task {
+    const char *name;
+    TaskFn run;
+    void *arg;                  /* passed to run */
+    uint32_t period_us;         /* periodic release, 0 = event-triggered */
+    uint32_t deadline_us;       /* ready-to-done budget, 0 = none */
+
+    /* Scheduler state */
+    struct Task *next;          /* priority list */
+    uint64_t release;           /* next timed release, SCHED_NEVER = none */
+    uint64_t signal_at;         /* timebase_us() of the first pending signal */
+    volatile uint8_t signaled;  /* set by sched_signal() */
+
+    /* Statistics */
+    uint32_t runs;
+    uint32_t last_us;           /* run time of the last run */
+    uint32_t max_us;            /* longest run time */
+    uint32_t misses;            /* runs that finished past their deadline */
+} Task;
+
+/**
+ * Forget all tasks
+ */
+void sched_init(void);
+
+/**
+ * Add a task below all tasks added before it
+ * A periodic task is first released one period from now.
+ * @param task Task with name, run, arg, period_us and deadline_us filled in
+ */
+void sched_add(Task *task);
+
+/**
+ * Make a task ready, safe to call from interrupt handlers
+ * @param task Task to run
+ */
+void sched_signal(Task *task);
+
+/**
+ * Release a task at an absolute time, replaces the previous release
+ * @param task Task to run
+ * @param at_us timebase_us() time, or SCHED_NEVER to cancel
+ */
+void sched_wake_at(Task *task, uint64_t at_us);
+
+/**
+ * Run the highest-priority ready task
+ * @return 1 if a task ran, 0 if none was ready
+ */
+int sched_run_once(void);
+
+/**
+ * Run ready tasks until none is left, then sleep until the next release
+ * or interrupt. Call from the main loop.
+ */
+void sched_dispatch(void);
+
+/**
+ * Iterate the task list
+ * @param task NULL for the first task, or a task for the one after it
+ * @return Next task in priority order, NULL at the end
+ */
+Task *sched_next_task(const Task *task);
+
+#endif /* SCHED_H_ */
@@ -15,18 +15,38 @@
 #include <stdint.h>
 
 /**
- * Display current score on LEDs
+ * Build the LED frame that shows the score
+ * @param right_score Right player score (0-4 shown)
+ * @param left_score Left player score (0-4 shown)
+ * @return Frame mask for leds_set_mask()
+ */
+uint8_t score_mask(uint8_t right_score, uint8_t left_score);
+
+/**
+ * Start displaying the current score (non-blocking, see anim.h)
  * @param right_score Right player score (0-4)
  * @param left_score Left player score (0-4)
  * @param duration_ms Display duration in milliseconds
+ * @return Length of the whole display in milliseconds
  */
-void show_score(uint8_t right_score, uint8_t left_score, uint32_t duration_ms);
+uint32_t show_score(uint8_t right_score, uint8_t left_score, uint32_t duration_ms);
 
 /**
- * Show winner by blinking their side's LEDs
+ * Start blinking the winner's side of the LEDs (non-blocking, see anim.h)
  * @param winner 0 (left player) or 1 (right player)
+ * @return Length of the animation in milliseconds
+ */
+uint32_t show_winner(uint8_t winner);
+
+/**
+ * Length of the score display, as show_score() would return it
  * @param duration_ms Display duration in milliseconds
  */
-void show_winner(uint8_t winner, uint32_t duration_ms);
+uint32_t score_length(uint32_t duration_ms);
+
+/**
+ * Length of the winner display, as show_winner() would return it
+ */
+uint32_t winner_length(void);
 
 #endif /* SCORE_H_ */
@@ -0,0 +1,85 @@
+/*
+ * speed_curve.h
+ *
+ * Difficulty profiles as step-time tables indexed by rally count
+ *
+ * Each profile is a formula in the number of returns so far, expanded by
+ * X-macros into a const table at compile time: the tables sit in flash and
+ * a return looks its step time up instead of computing it. A rally longer
+ * than the table keeps the last entry.
+ *
+ * To add a profile, write its formula and add a line to SPEED_PROFILES;
+ * the enum, the table row and the name follow from it.
+ */
+
+#ifndef SPEED_CURVE_H_
+#define SPEED_CURVE_H_
+
+#include <stdint.h>
+#include "game_core.h"
+
+/* Rally counts the tables cover, 0 is the serve */
+#define SPEED_CURVE_RALLIES(F) \
+    F(0), F(1), F(2), F(3), F(4), F(5), F(6), F(7), \
+    F(8), F(9), F(10), F(11), F(12), F(13), F(14), F(15)
+#define SPEED_CURVE_LEN  16
+
+#define SPEED_MAX_(a, b)  ((a) > (b) ? (a) : (b))
+#define SPEED_SPAN_US     (INITIAL_SPEED_US - MIN_SPEED_US)
+
+/* SPEED_DECREASE_US per return down to MIN_SPEED_US */
+#define SPEED_LINEAR_US(n) \
+    SPEED_MAX_(INITIAL_SPEED_US - (n) * SPEED_DECREASE_US, MIN_SPEED_US)
+
+/* Halves the way left to MIN_SPEED_US every SPEED_HALF_RALLIES returns,
+   linear in between: fast early, then ever smaller steps */
+#define SPEED_HALF_RALLIES  3
+#define SPEED_EXPONENTIAL_US(n) \
+    (MIN_SPEED_US + (SPEED_SPAN_US >> ((n) / SPEED_HALF_RALLIES)) \
+     - (SPEED_SPAN_US >> ((n) / SPEED_HALF_RALLIES + 1)) * ((n) % SPEED_HALF_RALLIES) \
+       / SPEED_HALF_RALLIES)
+
+/* Speeds up over the first SPEED_CAP_RALLIES returns only, to half way
+   between the initial and the minimum step time */
+#define SPEED_CAP_RALLIES  4
+#define SPEED_CAP_US       ((INITIAL_SPEED_US + MIN_SPEED_US) / 2)
+#define SPEED_CAPPED_US(n) \
+    SPEED_MAX_(INITIAL_SPEED_US - (n) * ((INITIAL_SPEED_US - SPEED_CAP_US) / SPEED_CAP_RALLIES), \
+               SPEED_CAP_US)
+
+/* X(ID, "name", formula) for every profile */
+#define SPEED_PROFILES(X) \
+    X(LINEAR,      "linear",      SPEED_LINEAR_US) \
+    X(EXPONENTIAL, "exponential", SPEED_EXPONENTIAL_US) \
+    X(CAPPED,      "capped",      SPEED_CAPPED_US)
+
+typedef enum {
+#define SPEED_PROFILE_ENUM_(id, name, formula) SPEED_PROFILE_##id,
+    SPEED_PROFILES(SPEED_PROFILE_ENUM_)
+#undef SPEED_PROFILE_ENUM_
+    SPEED_PROFILE_COUNT
+} SpeedProfile;
+
+/* Profile of game_default_config, chosen at build time (-DSPEED_PROFILE=...) */
+#ifndef SPEED_PROFILE
+#define SPEED_PROFILE  SPEED_PROFILE_LINEAR
+#endif
+
+/* Step time in us after n returns, per profile */
+extern const uint32_t speed_curves[SPEED_PROFILE_COUNT][SPEED_CURVE_LEN];
+
+/**
+ * Profile by name, for configuration read at run time
+ * @param name "linear", "exponential", "capped"
+ * @return The SpeedProfile, SPEED_PROFILE_COUNT if there is none by that name
+ */
+uint8_t speed_profile_find(const char *name);
+
+/**
+ * Name of a profile
+ * @param profile SpeedProfile
+ * @return Name as in SPEED_PROFILES, "?" if out of range
+ */
+const char *speed_profile_name(uint8_t profile);
+
+#endif /* SPEED_CURVE_H_ */
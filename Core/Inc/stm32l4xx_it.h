@@ -55,6 +55,21 @@ void SVC_Handler(void);
 void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
+void EXTI9_5_IRQHandler(void);
+void EXTI15_10_IRQHandler(void);
+void TIM2_IRQHandler(void);
+void LPTIM1_IRQHandler(void);
+void DMA1_Channel2_IRQHandler(void);
+void DMA1_Channel7_IRQHandler(void);
+void USART2_IRQHandler(void);
+void DMA1_Channel6_IRQHandler(void);
+void EXTI3_IRQHandler(void);
+void DMA2_Channel6_IRQHandler(void);
+void DMA2_Channel7_IRQHandler(void);
+void USART1_IRQHandler(void);
+void DMA2_Channel1_IRQHandler(void);
+void DMA2_Channel2_IRQHandler(void);
+void UART5_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
@@ -0,0 +1,110 @@
+/*
+ * telemetry.h
+ *
+ * Game events as COBS-framed binary records on USART2, sent by DMA
+ *
+ * telemetry_send() builds a frame, COBS-encodes it into a TX ring and
+ * returns: its cost is bounded by the frame size whatever the line is
+ * doing. DMA1 Channel 7 drains the ring into USART2 in the background, one
+ * contiguous stretch per transfer. When the ring has no room for a frame
+ * the frame is dropped whole and counted, so a slow or unplugged dashboard
+ * never holds up the game.
+ *
+ * Frame, before COBS and the 0x00 delimiter (little endian):
+ *   type u8, seq u8, time_ms u32, payload (per type), crc8 u8
+ * seq counts every frame built, dropped ones included, so a receiver sees
+ * gaps. time_ms is the time of the event, not of the send.
+ *
+ * STOP2 is held off from the first byte queued until the last one has left
+ * the shift register.
+ *
+ * Text (console replies, announcements, dumps) is longer than a record
+ * and often longer than the ring has room for. telemetry_text() queues it
+ * in a text buffer, and the telemetry task sends it as TLM_TEXT records,
+ * split at line ends, trying again every TELEMETRY_RETRY_US while the
+ * ring is full. The records carry the time they are sent.
+ *
+ * Resources: USART2 TX, DMA1 Channel 7 (request 2), DMA1_Channel7_IRQn,
+ *            USART2_IRQn, the telemetry task
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "main.h"
+#include <stdint.h>
+
+#define TELEMETRY_RING         1024    /* TX ring bytes, a power of two */
+#define TELEMETRY_PAYLOAD_MAX  32
+#define TELEMETRY_TEXT         2048    /* text buffer bytes, a power of two */
+#define TELEMETRY_RETRY_US     10000   /* ring full: try again this much later */
+#define TELEMETRY_BAUD         115200  /* as MX_USART2_UART_Init() sets it */
+
+/* Bytes on the wire of a record with len payload bytes: header, CRC, the
+   COBS code byte and the delimiter */
+#define TELEMETRY_WIRE(len)    ((len) + 9u)
+
+/* Record types and their payloads */
+typedef enum {
+    TLM_STATE = 1,      /* state u8 (GameState) */
+    TLM_SERVE,          /* direction i8, speed_ms u16 */
+    TLM_HIT,            /* button u8, offset_ms i16, rally u8, speed_ms u16 */
+    TLM_MISS,           /* button u8 of the player who missed, rally u8 */
+    TLM_SCORE,          /* left u8, right u8 */
+    TLM_TEXT,           /* text; a line spans records up to the one
+                           ending in '\n' */
+    TLM_LEDS,           /* LED frame, key or delta (mirror_codec.h) */
+} TelemetryType;
+
+/**
+ * Set up DMA1 Channel 7 for USART2 transmit
+ * Call after MX_USART2_UART_Init().
+ */
+void telemetry_init(void);
+
+/**
+ * Queue one record, from task context
+ * @param type TelemetryType
+ * @param at_us Time of the event
+ * @param payload Payload bytes
+ * @param len Payload length, at most TELEMETRY_PAYLOAD_MAX
+ * @return 1 if queued, 0 if dropped for lack of room
+ */
+int telemetry_send(uint8_t type, uint64_t at_us, const uint8_t *payload, uint8_t len);
+
+/**
+ * Add the telemetry task, at the lowest priority so far
+ * Call after sched_init() and after the tasks that must come first.
+ */
+void telemetry_start(void);
+
+/**
+ * Queue text for the telemetry task, from task context
+ * Lines end in '\n'; a line longer than a record spans several.
+ * @param text Text, not terminated
+ * @param len Text length
+ * @return 1 if queued, 0 if dropped whole for lack of room
+ */
+int telemetry_text(const char *text, uint32_t len);
+
+/**
+ * Text bytes queued and not yet sent
+ */
+uint32_t telemetry_text_pending(void);
+
+/**
+ * Records dropped because the ring was full
+ */
+uint32_t telemetry_overflows(void);
+
+/**
+ * DMA1 Channel 7 interrupt handler hook
+ */
+void telemetry_dma_irq(void);
+
+/**
+ * USART2 interrupt handler hook
+ */
+void telemetry_uart_irq(void);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,54 @@
+/*
+ * timebase.h
+ *
+ * Monotonic 64-bit microsecond clock
+ *
+ * TIM2 (32-bit) is prescaled to 1 MHz. Its overflow interrupt extends the
+ * count to 64 bits, so the clock never wraps in practice. Compare channel 1
+ * provides a one-shot alarm that wakes the CPU from __WFI() at a deadline
+ * with microsecond accuracy.
+ *
+ * Resources: TIM2, TIM2_IRQn
+ */
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include "main.h"
+#include <stdint.h>
+
+/**
+ * Start TIM2 at 1 MHz, the clock reads 0 right after this call
+ */
+void timebase_init(void);
+
+/**
+ * Current time
+ * @return Microseconds since timebase_init()
+ */
+uint64_t timebase_us(void);
+
+/**
+ * Arm the wake-up alarm, replacing any earlier alarm
+ * @param at_us Absolute time from timebase_us()
+ * @return 1 if armed, 0 if at_us has already passed
+ */
+int timebase_alarm(uint64_t at_us);
+
+/**
+ * Reload the prescaler after a system clock change, keeps the count
+ */
+void timebase_recalibrate(void);
+
+/**
+ * Account for time TIM2 did not see (e.g. STOP2, where it is unclocked)
+ * @param us Microseconds to add to the clock
+ */
+void timebase_advance(uint64_t us);
+
+/**
+ * TIM2 interrupt handler hook, call from TIM2_IRQHandler()
+ */
+void timebase_irq(void);
+
+#endif /* TIMEBASE_H_ */
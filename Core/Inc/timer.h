@@ -1,7 +1,20 @@
 /*
  * timer.h
  *
- * Non-blocking timer module using HAL_GetTick()
+ * Software timer wheel driven by SysTick
+ *
+ * Any number of one-shot and periodic timers can run at once. Timers live
+ * in a four-level hierarchical wheel (64 slots per level, 1 ms resolution,
+ * about 4.6 hours range), so starting, stopping and expiring a timer are
+ * all O(1). timer_tick() is called from SysTick_Handler() every millisecond.
+ *
+ * Callbacks run in SysTick interrupt context and must be short. Code that
+ * only needs to know that time is up can pass a NULL callback and poll
+ * timer_expired() instead.
+ *
+ * UsTimer is a one-shot deadline on the microsecond timebase for intervals
+ * that need finer steps than the 1 ms wheel. Starting one arms the TIM2
+ * alarm, so a __WFI() loop wakes exactly at the deadline.
  */
 
 #ifndef TIMER_H_
@@ -10,16 +23,96 @@
 #include "main.h"
 #include <stdint.h>
 
+typedef void (*TimerCallback)(void *arg);
+
+typedef struct SoftTimer {
+    struct SoftTimer *next;     /* wheel slot list */
+    struct SoftTimer **pprev;   /* link that points at this timer */
+    uint32_t expires;           /* wheel tick of expiry */
+    uint32_t period;            /* reload in ms, 0 = one-shot */
+    TimerCallback callback;     /* called on expiry, may be NULL */
+    void *arg;                  /* passed to callback */
+    volatile uint8_t state;     /* TIMER_IDLE, TIMER_PENDING or TIMER_EXPIRED */
+} SoftTimer;
+
+typedef struct {
+    uint64_t deadline;          /* timebase_us() of expiry */
+} UsTimer;
+
+#define TIMER_IDLE     0
+#define TIMER_PENDING  1
+#define TIMER_EXPIRED  2
+
+/**
+ * Reset the wheel, all timers are forgotten
+ */
+void timer_wheel_init(void);
+
+/**
+ * Advance the wheel by one millisecond, call from SysTick_Handler()
+ */
+void timer_tick(void);
+
+/**
+ * Advance the wheel by several milliseconds at once, firing every timer
+ * that came due in order. Used to catch up after SysTick was suspended.
+ * @param ticks Milliseconds to advance
+ */
+void timer_advance(uint32_t ticks);
+
+/**
+ * Time until the wheel next needs attention
+ * Exact for timers due within 64 ms, otherwise the next cascade point.
+ * @param ticks Set to milliseconds from now (at least 1)
+ * @return 1 if any timer is pending, 0 if the wheel is empty
+ */
+int timer_next_expiry(uint32_t *ticks);
+
+/**
+ * Current wheel time
+ * @return Milliseconds since timer_wheel_init()
+ */
+uint32_t timer_ticks(void);
+
+/**
+ * Start (or restart) a timer
+ * @param t Timer, owned by the caller and kept alive while pending
+ * @param ms Time to first expiry in milliseconds (0 is treated as 1)
+ * @param period_ms Reload interval, 0 for a one-shot timer
+ * @param callback Called in SysTick context on each expiry, may be NULL
+ * @param arg Passed to callback
+ */
+void timer_start(SoftTimer *t, uint32_t ms, uint32_t period_ms,
+                 TimerCallback callback, void *arg);
+
+/**
+ * Stop a timer, safe to call on an idle or expired timer
+ */
+void timer_stop(SoftTimer *t);
+
+/**
+ * Check if a one-shot timer has expired
+ * @return 1 if expired, 0 if still pending or never started
+ */
+int timer_expired(const SoftTimer *t);
+
+/**
+ * Check if a timer is waiting to expire
+ * @return 1 if pending, 0 otherwise
+ */
+int timer_active(const SoftTimer *t);
+
 /**
- * Start a non-blocking timer
- * @param ms Duration in milliseconds
+ * Start a microsecond one-shot timer and arm the wake-up alarm
+ * @param t Timer
+ * @param us Time to expiry in microseconds
  */
-void timer_init(uint32_t ms);
+void timer_us_start(UsTimer *t, uint32_t us);
 
 /**
- * Check if timer has expired
- * @return 0 (still running) or 1 (expired)
+ * Check if a microsecond timer has expired
+ * @return 1 if expired, 0 otherwise
  */
-int timer_now(void);
+int timer_us_expired(const UsTimer *t);
 
 #endif /* TIMER_H_ */
@@ -0,0 +1,140 @@
+/*
+ * tourney.h
+ *
+ * Tournament over the tables of a ring, free of hardware
+ *
+ * N tables seat 2N entrants, numbered from 0. Every board keeps the whole
+ * tournament and applies the same results in any order, so all boards
+ * agree on the draw and the standings without a central PC; results go
+ * round as ring broadcasts (ring.h).
+ *
+ *   Round-robin  2N - 1 rounds by the circle method: entrant 0 stays, the
+ *                others turn one place a round. Every table plays in
+ *                every round, and everyone meets everyone once.
+ *   Knockout     the bracket is the next power of two; match i of a round
+ *                pairs slot i with the slot as far from the end, and the
+ *                empty slots are byes, which go through unplayed. The
+ *                matches that are played go to tables 0, 1, ... in order.
+ *
+ * A round starts when every match of the previous one has a result. Ring
+ * messages from different boards may come in a different order on each
+ * board, so a result for the next round is held until it starts; a board
+ * cannot be further ahead, as it needs everyone's results to get there.
+ * Standings: wins, then points won minus points lost, then entrant number.
+ */
+
+#ifndef TOURNEY_H_
+#define TOURNEY_H_
+
+#include <stdint.h>
+
+#ifndef TOURNEY
+#define TOURNEY  0      /* build with -DTOURNEY=1 for a ring tournament */
+#endif
+
+#define TOURNEY_TABLES_MAX    32
+#define TOURNEY_ENTRANTS_MAX  (2 * TOURNEY_TABLES_MAX)
+#define TOURNEY_NONE          0xFF      /* no entrant, no match */
+#define TOURNEY_MESSAGE_MAX   8         /* fits a ring message */
+
+typedef enum {
+    TOURNEY_ROUND_ROBIN = 0,
+    TOURNEY_KNOCKOUT
+} TourneyMode;
+
+#ifndef TOURNEY_MODE
+#define TOURNEY_MODE  TOURNEY_ROUND_ROBIN
+#endif
+
+typedef struct {
+    uint32_t id;                /* which tournament, set by the ring master */
+    uint8_t mode;               /* TourneyMode */
+    uint8_t tables;
+    uint8_t entrants;
+    uint8_t round;              /* from 0 */
+    uint8_t rounds;
+    uint8_t done;
+
+    /* This round */
+    uint8_t match_of[TOURNEY_TABLES_MAX];   /* table -> match, or NONE */
+    uint8_t played[TOURNEY_TABLES_MAX];     /* per match */
+    uint8_t winner[TOURNEY_TABLES_MAX];     /* per match, knockout */
+    uint8_t slots[TOURNEY_ENTRANTS_MAX];    /* knockout bracket */
+    uint8_t slot_count;
+
+    /* Results for the next round, in before the last of this one */
+    uint8_t early[TOURNEY_TABLES_MAX][2];
+    uint8_t early_set[TOURNEY_TABLES_MAX];
+
+    /* Standings */
+    uint8_t wins[TOURNEY_ENTRANTS_MAX];
+    uint8_t losses[TOURNEY_ENTRANTS_MAX];
+    int16_t diff[TOURNEY_ENTRANTS_MAX];     /* points won - points lost */
+} Tourney;
+
+/**
+ * Start a tournament
+ * @param t Tournament
+ * @param id Its id, shared by every board
+ * @param mode TOURNEY_ROUND_ROBIN or TOURNEY_KNOCKOUT
+ * @param tables Tables playing, 1 to TOURNEY_TABLES_MAX
+ */
+void tourney_reset(Tourney *t, uint32_t id, uint8_t mode, uint8_t tables);
+
+/**
+ * A table's match in the current round, while it has no result
+ * @param t Tournament
+ * @param table Table number (the board's ring address)
+ * @param left Entrant on the left
+ * @param right Entrant on the right
+ * @return 1 if the table has a match to play, 0 if not
+ */
+int tourney_pairing(const Tourney *t, uint8_t table, uint8_t *left, uint8_t *right);
+
+/**
+ * Enter a match result; the next round starts with the last one, and a
+ * result for that round is held until then
+ * @param t Tournament
+ * @param round Round the match was drawn in
+ * @param table Table it was played on
+ * @param left_score Final score of the left entrant
+ * @param right_score Final score of the right entrant
+ * @return 1 if taken or held, 0 if stale, repeated or not a match
+ */
+int tourney_result(Tourney *t, uint8_t round, uint8_t table, uint8_t left_score, uint8_t right_score);
+
+/**
+ * Entrants in standings order, best first
+ * @param t Tournament
+ * @param order Room for t->entrants entrants
+ * @return t->entrants
+ */
+uint8_t tourney_standings(const Tourney *t, uint8_t *order);
+
+/**
+ * Ring message starting a tournament on every board
+ * @return Message length
+ */
+uint8_t tourney_start_message(const Tourney *t, uint8_t *out);
+
+/**
+ * Ring message with a result
+ * @return Message length
+ */
+uint8_t tourney_result_message(uint8_t round, uint8_t table, uint8_t left_score,
+                               uint8_t right_score, uint8_t *out);
+
+/**
+ * Apply a ring message: a start with a new id resets the tournament
+ * @return 1 if it changed anything
+ */
+int tourney_message(Tourney *t, const uint8_t *bytes, uint8_t len);
+
+/**
+ * Standings as text, one line per entrant: rank, entrant, wins-losses,
+ * point difference
+ * @return Length written, without the terminating zero
+ */
+uint32_t tourney_format(const Tourney *t, char *out, uint32_t size);
+
+#endif /* TOURNEY_H_ */
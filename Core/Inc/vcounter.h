@@ -0,0 +1,63 @@
+/*
+ * vcounter.h
+ *
+ * Bit-parallel vertical-counter debouncer
+ *
+ * Debounces up to 32 inputs at once: bit n of every word belongs to input
+ * n. Three counter bit-planes hold, per input, how many samples in a row
+ * differed from the debounced state. An input flips on the
+ * VCOUNTER_SAMPLES-th such sample; a sample that agrees clears its count.
+ * One update is a dozen bitwise operations whatever the number of inputs.
+ */
+
+#ifndef VCOUNTER_H_
+#define VCOUNTER_H_
+
+#include <stdint.h>
+
+#define VCOUNTER_SAMPLES  8     /* samples an input must hold to flip */
+
+typedef struct {
+    uint32_t state;             /* debounced levels */
+    uint32_t c0, c1, c2;        /* count bit-planes, least significant first */
+} VCounter;
+
+/**
+ * Start from known levels with no counts running
+ * @param v Debouncer
+ * @param state Debounced levels to start from
+ */
+static inline void vcounter_reset(VCounter *v, uint32_t state) {
+    v->state = state;
+    v->c0 = 0;
+    v->c1 = 0;
+    v->c2 = 0;
+}
+
+/**
+ * Feed one sample of all inputs
+ * @param v Debouncer
+ * @param sample Raw levels
+ * @return Inputs whose debounced level flipped with this sample
+ */
+static inline uint32_t vcounter_update(VCounter *v, uint32_t sample) {
+    uint32_t delta = sample ^ v->state;
+    uint32_t flipped = delta & v->c0 & v->c1 & v->c2;
+
+    /* Count up where the sample differs, clear elsewhere; 7 + 1 wraps
+       to 0 exactly where the input flips */
+    v->c2 = (v->c2 ^ (v->c1 & v->c0)) & delta;
+    v->c1 = (v->c1 ^ v->c0) & delta;
+    v->c0 = ~v->c0 & delta;
+    v->state ^= flipped;
+    return flipped;
+}
+
+/**
+ * Inputs that are part way through a count
+ */
+static inline uint32_t vcounter_busy(const VCounter *v) {
+    return v->c0 | v->c1 | v->c2;
+}
+
+#endif /* VCOUNTER_H_ */
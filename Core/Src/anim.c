@@ -0,0 +1,206 @@
+/*
+ * anim.c
+ *
+ * Non-blocking LED animation sequencer
+ */
+
+#include "anim.h"
+#include "leds.h"
+#include "timer.h"
+#include "stm32l4xx_hal.h"
+
+#define BREATHE_PERIOD_MS  1000
+#define BREATHE_STEP_MS    20
+
+static const Animation *current = 0;
+static uint8_t frame_index = 0;
+static uint32_t frame_start = 0;
+static uint8_t param_mask = 0;
+static uint32_t param_hold = 0;
+static uint8_t paused = 0;
+static uint32_t paused_at = 0;          /* timer_ticks() when frozen */
+static SoftTimer wake_timer;            /* lets power_idle_until() wake us */
+static TimerCallback wake_hook = NULL;  /* run on wake_timer expiry */
+static void *wake_hook_arg = NULL;
+
+/* Frame mask of a keyframe */
+static uint8_t frame_mask(const AnimFrame *frame) {
+    return (frame->flags & ANIM_MASK_PARAM) ? param_mask : frame->mask;
+}
+
+/* Duration of a keyframe */
+static uint32_t frame_duration(const AnimFrame *frame) {
+    return (frame->flags & ANIM_HOLD_PARAM) ? param_hold : frame->duration_ms;
+}
+
+/* Schedule the next wake-up for the current keyframe */
+static void arm_wake(void) {
+    const AnimFrame *frame = &current->frames[frame_index];
+
+    if (frame->flags & ANIM_BREATHE) {
+        timer_start(&wake_timer, BREATHE_STEP_MS, BREATHE_STEP_MS, wake_hook, wake_hook_arg);
+    } else {
+        int32_t left = (int32_t)(frame_start + frame_duration(frame) - timer_ticks());
+
+        timer_start(&wake_timer, left > 0 ? (uint32_t)left : 1, 0, wake_hook, wake_hook_arg);
+    }
+}
+
+/* Breathing level for a frame that has been shown for elapsed ms */
+static uint8_t breathe_level(uint32_t elapsed) {
+    uint32_t phase = elapsed % BREATHE_PERIOD_MS;
+    uint32_t half = BREATHE_PERIOD_MS / 2;
+    uint32_t ramp = (phase < half) ? phase : BREATHE_PERIOD_MS - phase;
+
+    return (uint8_t)(255 - (127 * ramp) / half);
+}
+
+/* Move to the next keyframe starting at time start, or finish */
+static void next_frame(uint32_t start) {
+    frame_index++;
+
+    if (frame_index >= current->count) {
+        if (!(current->flags & ANIM_LOOP)) {
+            current = 0;
+            timer_stop(&wake_timer);
+            return;
+        }
+        frame_index = 0;
+    }
+
+    frame_start = start;
+    leds_set_mask(frame_mask(&current->frames[frame_index]));
+    arm_wake();
+}
+
+/**
+ * Start an animation, replacing any animation in progress
+ */
+uint32_t anim_play(const Animation *anim, uint8_t mask, uint32_t hold_ms) {
+    if (anim == 0 || anim->count == 0) {
+        current = 0;
+        paused = 0;
+        timer_stop(&wake_timer);
+        return 0;
+    }
+
+    current = anim;
+    paused = 0;
+    frame_index = 0;
+    frame_start = timer_ticks();
+    param_mask = mask;
+    param_hold = hold_ms;
+    leds_set_mask(frame_mask(&anim->frames[0]));
+    arm_wake();
+
+    return anim_length(anim, hold_ms);
+}
+
+/**
+ * Length of an animation without playing it
+ */
+uint32_t anim_length(const Animation *anim, uint32_t hold_ms) {
+    if (anim == 0 || anim->count == 0) {
+        return 0;
+    }
+    if (anim->flags & ANIM_LOOP) {
+        return ANIM_FOREVER;
+    }
+
+    uint32_t length = 0;
+    for (int n = 0; n < anim->count; n++) {
+        const AnimFrame *frame = &anim->frames[n];
+
+        length += (frame->flags & ANIM_HOLD_PARAM) ? hold_ms : frame->duration_ms;
+    }
+    return length;
+}
+
+/**
+ * Advance the animation, call often from the main loop
+ */
+int anim_update(void) {
+    uint32_t now = timer_ticks();
+
+    if (paused) {
+        return current != 0;
+    }
+
+    /* Catch up on keyframes that ended since the last call, at most one
+       pass over the table so zero-length looping tables cannot hang */
+    for (int n = 0; current != 0 && n <= current->count; n++) {
+        const AnimFrame *frame = &current->frames[frame_index];
+        uint32_t duration = frame_duration(frame);
+        uint32_t elapsed = now - frame_start;
+
+        if (elapsed < duration) {
+            if (frame->flags & ANIM_BREATHE) {
+                uint8_t mask = frame_mask(frame);
+                uint8_t level = breathe_level(elapsed);
+                uint8_t levels[8];
+
+                for (int j = 0; j < 8; j++) {
+                    levels[j] = (mask & (1u << j)) ? level : 0;
+                }
+                leds_set_levels(levels);
+            }
+            return 1;
+        }
+
+        next_frame(frame_start + duration);
+    }
+
+    return current != 0;
+}
+
+/**
+ * Call a function whenever anim_update() has work to do
+ */
+void anim_set_wake_hook(void (*hook)(void *arg), void *arg) {
+    wake_hook = hook;
+    wake_hook_arg = arg;
+}
+
+/**
+ * Check if an animation is playing
+ */
+int anim_busy(void) {
+    return current != 0;
+}
+
+/**
+ * Jump to the next keyframe (ends the animation on the last one)
+ */
+void anim_skip(void) {
+    if (current == 0 || paused) {
+        return;
+    }
+    next_frame(timer_ticks());
+}
+
+/**
+ * Stop the animation and turn off all LEDs
+ */
+void anim_cancel(void) {
+    current = 0;
+    paused = 0;
+    timer_stop(&wake_timer);
+    leds_clear();
+}
+
+/**
+ * Freeze or continue the animation in progress
+ */
+void anim_pause(int pause) {
+    if (pause && !paused) {
+        paused = 1;
+        paused_at = timer_ticks();
+        timer_stop(&wake_timer);
+    } else if (!pause && paused) {
+        paused = 0;
+        frame_start += timer_ticks() - paused_at;
+        if (current != 0) {
+            arm_wake();
+        }
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * arena.c
+ *
+ * Ring tournament on the board: the ring bus, the draw and the game
+ *
+ * Everything here runs in task context: the ring callbacks in the ring
+ * task, the match end in the logic task. Text goes out through
+ * telemetry_text(): the standings of a full ring are more than the
+ * telemetry ring holds at once, and the telemetry task sends them a line
+ * at a time as it has room.
+ */
+
+#include "arena.h"
+#include "game.h"
+#include "netplay.h"
+#include "ringbus.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "tourney.h"
+#include <stdio.h>
+
+#if TOURNEY && NETPLAY
+#error "TOURNEY and NETPLAY both take over the game, build with one of them"
+#endif
+
+static Tourney tourney;
+static uint8_t announced = TOURNEY_NONE;    /* round last announced */
+static uint8_t finished = 0;                /* final standings sent */
+
+static void standings(void) {
+    static char buf[TOURNEY_ENTRANTS_MAX * 24];
+
+    telemetry_text(buf, tourney_format(&tourney, buf, sizeof(buf)));
+}
+
+/* Tell the dashboard what changed: a new round, or the end */
+static void announce(void) {
+    char line[40];
+    uint8_t l;
+    uint8_t r;
+
+    if (tourney.id == 0 || finished) {
+        return;
+    }
+    if (tourney.done) {
+        finished = 1;
+        telemetry_text("tournament over\n", 16);
+        standings();
+        return;
+    }
+    if (tourney.round == announced) {
+        return;
+    }
+    if (tourney.round != 0) {
+        standings();
+    }
+    announced = tourney.round;
+
+    int len = tourney_pairing(&tourney, ringbus_state()->address, &l, &r)
+              ? snprintf(line, sizeof(line), "round %u: P%u v P%u\n", tourney.round + 1u, l, r)
+              : snprintf(line, sizeof(line), "round %u: no match\n", tourney.round + 1u);
+
+    telemetry_text(line, (uint32_t)len);
+}
+
+static void started(void) {
+    announced = TOURNEY_NONE;
+    finished = 0;
+    announce();
+}
+
+/* A broadcast from another board */
+static void deliver(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg) {
+    uint32_t id = tourney.id;
+
+    (void)sender;
+    (void)arg;
+    if (tourney_message(&tourney, bytes, len)) {
+        if (tourney.id != id) {
+            started();
+        } else {
+            announce();
+        }
+    }
+}
+
+/* The ring counted (again): the master starts a tournament for it, the
+   others wait for its START */
+static void ready(void *arg) {
+    const Ring *ring = ringbus_state();
+    uint8_t msg[TOURNEY_MESSAGE_MAX];
+
+    (void)arg;
+    tourney.id = 0;
+    if (ring->address != 0) {
+        return;
+    }
+    tourney_reset(&tourney, (ring->id ^ (uint32_t)timebase_us()) | 1u, TOURNEY_MODE, ring->nodes);
+    ringbus_post(msg, tourney_start_message(&tourney, msg));
+    started();
+}
+
+/* A match ended: the result of this table's, if it has one to play */
+static void match_over(const Game *game) {
+    uint8_t table = ringbus_state()->address;
+    uint8_t round = tourney.round;
+    uint8_t msg[TOURNEY_MESSAGE_MAX];
+    uint8_t l;
+    uint8_t r;
+
+    if (tourney.id == 0 || !tourney_pairing(&tourney, table, &l, &r)) {
+        return;
+    }
+    if (!ringbus_post(msg, tourney_result_message(round, table, game->left_score,
+                                                  game->right_score, msg))) {
+        telemetry_text("ring busy, play again\n", 22);
+        return;
+    }
+    tourney_result(&tourney, round, table, game->left_score, game->right_score);
+    announce();
+}
+
+/**
+ * Join the ring and follow its tournament
+ */
+void arena_init(void) {
+    tourney.id = 0;
+    game_set_over_hook(match_over);
+    ringbus_init(deliver, ready, NULL);
+}
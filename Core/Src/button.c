@@ -6,9 +6,22 @@
  * Hardware Configuration:
  * Left button:  PB15 (GPIOB Pin 15) - Active LOW
  * Right button: PC8  (GPIOC Pin 8)  - Active LOW
+ *
+ * The EXTI ISR is the only writer of queue_head and the game loop is the
+ * only writer of queue_tail, so the ring needs no locking.
+ *
+ * Each button has its own debounce state machine. An edge that changes the
+ * debounced level is reported at once with its own timestamp, then that
+ * button ignores edges for the debounce time. If the raw level differs from
+ * the debounced one when the window closes (a short press or a release
+ * that bounced), the change is reported at the close of the window.
+ * Edges of both buttons come out in timestamp order. In pass-through mode
+ * the windows are skipped: the key sampler has debounced the edges already.
  */
 
 #include "button.h"
+#include "timebase.h"
+#include "prof.h"
 #include "stm32l4xx_hal.h"
 
 #define LEFT_BUTTON_PORT   GPIOB
@@ -16,49 +29,279 @@
 #define RIGHT_BUTTON_PORT  GPIOC
 #define RIGHT_BUTTON_PIN   GPIO_PIN_8
 
-#define DEBOUNCE_DELAY_MS  20
+#define DEBOUNCE_DELAY_US  20000   /* default, see button_set_debounce_us() */
+
+#define QUEUE_SIZE         16   /* must be a power of two */
+#define QUEUE_MASK         (QUEUE_SIZE - 1)
+
+#define BUTTON_COUNT       2
+#define OUT_SIZE           4    /* debounced edges from one raw edge, at most 3 */
+
+/* Debounce state of one button */
+typedef struct {
+    uint8_t level;              /* debounced, 1 = pressed */
+    uint8_t raw;                /* level of the last raw edge */
+    uint64_t locked_until;      /* raw edges before this are bounce */
+} Debounce;
+
+static ButtonEvent queue[QUEUE_SIZE];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_tail = 0;
+static volatile uint32_t queue_dropped = 0;
+
+static void (*edge_hook)(const ButtonEvent *event) = NULL;
 
-static uint8_t left_button_prev_state = 1;
-static uint8_t right_button_prev_state = 1;
-static uint32_t last_press_time = 0;
+static Debounce inputs[BUTTON_COUNT];
+static uint32_t debounce_us = DEBOUNCE_DELAY_US;
+static uint8_t pass_through = 0;
+
+static ButtonEvent out[OUT_SIZE];   /* debounced edges not yet read */
+static uint8_t out_head = 0;
+static uint8_t out_count = 0;
 
 /**
- * Initialize button state tracking
- * Note: GPIO pins configured by MX_GPIO_Init() in main.c
+ * Initialize button state tracking and empty the event queue
+ * Note: GPIO pins and EXTI lines configured by MX_GPIO_Init() in main.c
  */
 void button_init(void) {
-    left_button_prev_state = 1;
-    right_button_prev_state = 1;
-    last_press_time = 0;
+    for (int n = 0; n < BUTTON_COUNT; n++) {
+        inputs[n].level = 0;
+        inputs[n].raw = 0;
+        inputs[n].locked_until = 0;
+    }
+    debounce_us = DEBOUNCE_DELAY_US;
+    pass_through = 0;
+    queue_dropped = 0;
+    button_flush();
 }
 
 /**
- * Read button state with debouncing and edge detection
- * @return 0 (no press), LEFT_BUTTON, or RIGHT_BUTTON
+ * EXTI handler hook, runs in interrupt context
  */
-int button_read(void) {
-    uint32_t current_time = HAL_GetTick();
+void button_irq(uint16_t pin) {
+    ButtonEvent event;
 
-    if ((current_time - last_press_time) < DEBOUNCE_DELAY_MS) {
+    if (pin == LEFT_BUTTON_PIN) {
+        event.button = LEFT_BUTTON;
+        event.pressed = (HAL_GPIO_ReadPin(LEFT_BUTTON_PORT, LEFT_BUTTON_PIN) == GPIO_PIN_RESET);
+    } else if (pin == RIGHT_BUTTON_PIN) {
+        event.button = RIGHT_BUTTON;
+        event.pressed = (HAL_GPIO_ReadPin(RIGHT_BUTTON_PORT, RIGHT_BUTTON_PIN) == GPIO_PIN_RESET);
+    } else {
+        return;
+    }
+    event.timestamp = timebase_us();
+
+    button_inject(&event);
+}
+
+/**
+ * Queue an edge as if the EXTI interrupt had captured it
+ */
+void button_inject(const ButtonEvent *event) {
+    uint8_t head = queue_head;
+    if (((uint8_t)(head - queue_tail)) >= QUEUE_SIZE) {
+        queue_dropped++;
+        return;
+    }
+
+    queue[head & QUEUE_MASK] = *event;
+    __DMB();    /* publish the slot before the index */
+    queue_head = head + 1;
+
+    /* Dropped edges never reach the game, so they are not reported */
+    if (edge_hook != NULL) {
+        edge_hook(event);
+    }
+}
+
+/**
+ * Pop the oldest raw edge from the event queue
+ */
+int button_get_event(ButtonEvent *event) {
+    uint8_t tail = queue_tail;
+
+    if (tail == queue_head) {
         return 0;
     }
 
-    uint8_t left_current = HAL_GPIO_ReadPin(LEFT_BUTTON_PORT, LEFT_BUTTON_PIN);
-    uint8_t right_current = HAL_GPIO_ReadPin(RIGHT_BUTTON_PORT, RIGHT_BUTTON_PIN);
+    __DMB();    /* read the slot only after seeing the index */
+    *event = queue[tail & QUEUE_MASK];
+    queue_tail = tail + 1;
+    return 1;
+}
+
+/**
+ * Check whether the event queue holds unread events
+ */
+int button_pending(void) {
+    return queue_tail != queue_head;
+}
+
+/**
+ * Discard all queued events
+ */
+void button_flush(void) {
+    queue_tail = queue_head;
+    out_count = 0;
+}
+
+/* Report a debounced level change and lock the button */
+static void change(uint8_t button, uint8_t level, uint64_t at) {
+    Debounce *d = &inputs[button - 1];
+    ButtonEvent *edge = &out[(out_head + out_count) % OUT_SIZE];
 
-    int result = 0;
+    d->level = level;
+    d->locked_until = pass_through ? at : at + debounce_us;
 
-    if (right_button_prev_state == 1 && right_current == 0) {
-        result = RIGHT_BUTTON;
-        last_press_time = current_time;
+    edge->timestamp = at;
+    edge->button = button;
+    edge->pressed = level;
+    out_count++;
+}
+
+/* Close the windows ending by now, earliest first, taking up a raw level
+   that moved on during the window */
+static void settle(uint64_t now) {
+    for (;;) {
+        Debounce *first = 0;
+        uint8_t button = 0;
+
+        for (uint8_t n = 0; n < BUTTON_COUNT; n++) {
+            Debounce *d = &inputs[n];
+
+            if (d->raw != d->level && d->locked_until <= now &&
+                (first == 0 || d->locked_until < first->locked_until)) {
+                first = d;
+                button = n + 1;
+            }
+        }
+        if (first == 0) {
+            return;
+        }
+        change(button, first->raw, first->locked_until);
     }
-    else if (left_button_prev_state == 1 && left_current == 0) {
-        result = LEFT_BUTTON;
-        last_press_time = current_time;
+}
+
+/* Run one raw edge through its button's state machine */
+static void debounce(const ButtonEvent *event) {
+    Debounce *d = &inputs[event->button - 1];
+
+    settle(event->timestamp);
+
+    d->raw = event->pressed;
+    if (d->raw != d->level && event->timestamp >= d->locked_until) {
+        change(event->button, d->raw, event->timestamp);
     }
+}
 
-    left_button_prev_state = left_current;
-    right_button_prev_state = right_current;
+/* Next debounced edge, feeding the debouncer as far as needed */
+static int read_edge(ButtonEvent *edge) {
+    ButtonEvent event;
+    uint64_t now = timebase_us();   /* raw edges stamped before are queued */
 
-    return result;
+    /* Each raw edge adds at most three debounced ones, so stop feeding
+       as soon as there is one to hand out */
+    while (out_count == 0 && button_get_event(&event)) {
+        if (event.button >= 1 && event.button <= BUTTON_COUNT) {
+            debounce(&event);
+        }
+    }
+    if (out_count == 0) {
+        settle(now);
+    }
+    if (out_count == 0) {
+        return 0;
+    }
+
+    *edge = out[out_head];
+    out_head = (out_head + 1) % OUT_SIZE;
+    out_count--;
+    return 1;
+}
+
+/**
+ * Read the next debounced edge of either button
+ */
+int button_read_edge(ButtonEvent *edge) {
+    PROF_BEGIN(BUTTON_READ);
+    int got = read_edge(edge);
+
+    PROF_END(BUTTON_READ);
+    return got;
+}
+
+/**
+ * When a debounce window closes on a level that changed meanwhile
+ */
+uint64_t button_settle_at(void) {
+    uint64_t at = UINT64_MAX;
+
+    for (int n = 0; n < BUTTON_COUNT; n++) {
+        if (inputs[n].raw != inputs[n].level && inputs[n].locked_until < at) {
+            at = inputs[n].locked_until;
+        }
+    }
+    return at;
+}
+
+/**
+ * Read button state with debouncing and edge detection
+ * @return 0 (no press), LEFT_BUTTON, or RIGHT_BUTTON
+ */
+int button_read(void) {
+    uint64_t at;
+
+    return button_read_press(&at);
+}
+
+/**
+ * Read the next debounced press and when it happened
+ */
+int button_read_press(uint64_t *at_us) {
+    ButtonEvent edge;
+
+    while (button_read_edge(&edge)) {
+        if (edge.pressed) {
+            *at_us = edge.timestamp;
+            return edge.button;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Call a function for every edge entering the queue
+ */
+void button_set_edge_hook(void (*hook)(const ButtonEvent *event)) {
+    edge_hook = hook;
+}
+
+/**
+ * Change the debounce time
+ */
+void button_set_debounce_us(uint32_t us) {
+    debounce_us = us;
+}
+
+/**
+ * Current debounce time
+ */
+uint32_t button_debounce_us(void) {
+    return debounce_us;
+}
+
+/**
+ * Take queued edges as debounced already
+ */
+void button_set_pass_through(int on) {
+    pass_through = on ? 1 : 0;
+}
+
+/**
+ * Number of events dropped because the queue was full
+ */
+uint32_t button_dropped(void) {
+    return queue_dropped;
 }
@@ -0,0 +1,153 @@
+/*
+ * clock.c
+ *
+ * Dynamic clock scaling between gameplay and idle phases
+ */
+
+#include "clock.h"
+#include "timebase.h"
+#include "ledpwm.h"
+#include "keys.h"
+#include "stm32l4xx_hal.h"
+
+static ClockProfile current = CLOCK_PROFILE_RUN;
+static uint32_t last_switch_us = 0;
+static uint32_t max_switch_us = 0;
+
+/* MSI 8 MHz, then drop the PLL and the regulator to range 2 */
+static void config_idle(void) {
+    RCC_OscInitTypeDef osc = {0};
+    RCC_ClkInitTypeDef clk = {0};
+
+    osc.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+    osc.MSIState = RCC_MSI_ON;
+    osc.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+    osc.MSIClockRange = RCC_MSIRANGE_7;
+    osc.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        Error_Handler();
+    }
+
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                    RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+    clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV1;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_1) != HAL_OK) {
+        Error_Handler();
+    }
+
+    /* PLL is no longer the system clock, so it may be stopped */
+    osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    osc.PLL.PLLState = RCC_PLL_OFF;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        Error_Handler();
+    }
+
+    /* Range 2 only after the clock is below 26 MHz */
+    if (HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE2) != HAL_OK) {
+        Error_Handler();
+    }
+
+    /* Wake from STOP2 straight into the idle clock */
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_MSI);
+}
+
+/* CubeMX configuration: range 1 first, then PLL 80 MHz */
+static void config_run(void) {
+    RCC_OscInitTypeDef osc = {0};
+
+    SystemClock_Config();
+
+    /* MSI was the idle clock (and the reset clock), stop it */
+    osc.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+    osc.MSIState = RCC_MSI_OFF;
+    osc.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        Error_Handler();
+    }
+
+    /* Wake from STOP2 on HSI16, the PLL source, for a fast restore */
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI);
+}
+
+/* Refit everything that divides down the bus clocks */
+static void fix_up_peripherals(void) {
+    timebase_recalibrate();
+    ledpwm_recalibrate();
+    keys_recalibrate();
+
+    /* The USARTs run from HSI16 in either profile, so a switch never
+       touches their baud rate; STOP2 stops HSI16 when it wakes on MSI */
+    if (!(RCC->CR & RCC_CR_HSIRDY)) {
+        __HAL_RCC_HSI_ENABLE();
+        while (!(RCC->CR & RCC_CR_HSIRDY)) {
+        }
+    }
+}
+
+static void apply(ClockProfile profile) {
+    if (profile == CLOCK_PROFILE_IDLE) {
+        config_idle();
+    } else {
+        config_run();
+    }
+    current = profile;
+    fix_up_peripherals();
+}
+
+/**
+ * Record the profile set up by SystemClock_Config()
+ */
+void clock_init(void) {
+    current = CLOCK_PROFILE_RUN;
+    last_switch_us = 0;
+    max_switch_us = 0;
+}
+
+/**
+ * Switch the system clock profile
+ */
+void clock_set_profile(ClockProfile profile) {
+    if (profile == current) {
+        return;
+    }
+
+    uint64_t start = timebase_us();
+
+    apply(profile);
+
+    last_switch_us = (uint32_t)(timebase_us() - start);
+    if (last_switch_us > max_switch_us) {
+        max_switch_us = last_switch_us;
+    }
+}
+
+/**
+ * Get the active clock profile
+ */
+ClockProfile clock_profile(void) {
+    return current;
+}
+
+/**
+ * Re-apply the active profile after STOP2 wake-up
+ */
+void clock_restore(void) {
+    apply(current);
+}
+
+/**
+ * Duration of the last profile switch
+ */
+uint32_t clock_last_switch_us(void) {
+    return last_switch_us;
+}
+
+/**
+ * Longest profile switch seen so far
+ */
+uint32_t clock_max_switch_us(void) {
+    return max_switch_us;
+}
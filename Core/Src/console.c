@@ -0,0 +1,187 @@
+/*
+ * console.c
+ *
+ * Serial command console on USART2 receive
+ *
+ * The DMA is the only writer of the buffer and the console task its only
+ * reader; the task reads the write position from the channel's remaining
+ * count, so nothing is shared beyond the signal.
+ */
+
+#include "console.h"
+#include "console_cmd.h"
+#include "power.h"
+#include "sched.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "stm32l4xx_hal.h"
+
+#define CONSOLE_DEADLINE_US  5000
+#define REPLY_MAX            160
+
+static uint8_t rx[CONSOLE_RX];
+static uint16_t rx_tail = 0;        /* next byte to take up */
+static char line[CONSOLE_LINE_MAX + 1];
+static uint8_t line_len = 0;
+static uint8_t line_long = 0;       /* bytes dropped from the current line */
+static volatile uint8_t woken = 0;  /* RX edge while STOP2 was allowed */
+static uint8_t awake = 0;           /* holding STOP2 off */
+static uint64_t awake_until = 0;
+
+static DMA_HandleTypeDef hdma_rx;
+
+static void console_run(void *arg);
+
+static Task console_task = {
+    .name = "console", .run = console_run, .deadline_us = CONSOLE_DEADLINE_US
+};
+
+/* Half or full buffer received */
+static void received(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    sched_signal(&console_task);
+}
+
+/* Reply as telemetry text, ending in a newline */
+static void reply(char *text, uint32_t len) {
+    text[len] = '\n';
+    telemetry_text(text, len + 1u);
+}
+
+/* Edit the line with one byte, run it at the end of line */
+static void take(uint8_t c) {
+    char text[REPLY_MAX + 1];           /* and the newline */
+
+    if (c == '\r' || c == '\n') {
+        if (line_long) {
+            static const char too_long[] = "error: line too long\n";
+
+            telemetry_text(too_long, sizeof(too_long) - 1u);
+        } else if (line_len != 0) {
+            line[line_len] = '\0';
+            reply(text, console_execute(line, text, REPLY_MAX));
+        }
+        line_len = 0;
+        line_long = 0;
+    } else if (c == '\b' || c == 0x7F) {
+        if (line_len != 0) {
+            line_len--;
+        }
+    } else if (line_len < CONSOLE_LINE_MAX) {
+        line[line_len++] = (char)c;
+    } else {
+        line_long = 1;
+    }
+}
+
+/* Console task: take up the bytes received, keep the board awake */
+static void console_run(void *arg) {
+    uint64_t now = timebase_us();
+    uint16_t head = (uint16_t)(CONSOLE_RX - __HAL_DMA_GET_COUNTER(&hdma_rx));
+    uint8_t active = woken;
+
+    (void)arg;
+    woken = 0;
+
+    if (head == CONSOLE_RX) {
+        head = 0;
+    }
+    while (rx_tail != head) {
+        take(rx[rx_tail]);
+        rx_tail = (uint16_t)((rx_tail + 1u) % CONSOLE_RX);
+        active = 1;
+    }
+
+    if (active) {
+        awake_until = now + CONSOLE_AWAKE_MS * 1000ull;
+        if (!awake) {
+            awake = 1;
+            power_stop_inhibit(1);
+            EXTI->IMR1 &= ~EXTI_IMR1_IM3;   /* the USART hears the line now */
+        }
+    } else if (awake && now >= awake_until) {
+        awake = 0;
+        EXTI->PR1 = EXTI_PR1_PIF3;
+        EXTI->IMR1 |= EXTI_IMR1_IM3;
+        power_stop_inhibit(0);
+    }
+    sched_wake_at(&console_task, awake ? awake_until : SCHED_NEVER);
+}
+
+/**
+ * Start reception and add the console task
+ */
+void console_init(void) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma_rx.Instance = DMA1_Channel6;
+    hdma_rx.Init.Request = DMA_REQUEST_2;   /* USART2_RX */
+    hdma_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_rx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_rx) != HAL_OK) {
+        Error_Handler();
+    }
+    hdma_rx.XferHalfCpltCallback = received;
+    hdma_rx.XferCpltCallback = received;
+
+    rx_tail = 0;
+    line_len = 0;
+    if (HAL_DMA_Start_IT(&hdma_rx, (uint32_t)&USART2->RDR, (uint32_t)rx, CONSOLE_RX) != HAL_OK) {
+        Error_Handler();
+    }
+    USART2->ICR = USART_ICR_IDLECF | USART_ICR_ORECF;
+    USART2->CR3 |= USART_CR3_DMAR;
+    USART2->CR1 |= USART_CR1_IDLEIE;
+
+    /* RX stays in its alternate function; EXTI line 3 watches PA3 too */
+    SYSCFG->EXTICR[0] = (SYSCFG->EXTICR[0] & ~SYSCFG_EXTICR1_EXTI3) | SYSCFG_EXTICR1_EXTI3_PA;
+    EXTI->FTSR1 |= EXTI_FTSR1_FT3;
+    EXTI->PR1 = EXTI_PR1_PIF3;
+    EXTI->IMR1 |= EXTI_IMR1_IM3;
+
+    HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+    HAL_NVIC_SetPriority(EXTI3_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(EXTI3_IRQn);
+
+    sched_add(&console_task);
+}
+
+/**
+ * DMA1 Channel 6 interrupt handler hook
+ */
+void console_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_rx);
+}
+
+/**
+ * USART2 interrupt handler hook
+ */
+void console_uart_irq(void) {
+    uint32_t isr = USART2->ISR;
+
+    if ((USART2->CR1 & USART_CR1_IDLEIE) && (isr & USART_ISR_IDLE)) {
+        USART2->ICR = USART_ICR_IDLECF;
+        sched_signal(&console_task);
+    }
+    if (isr & USART_ISR_ORE) {
+        /* A byte lost while the DMA was held off; reception goes on */
+        USART2->ICR = USART_ICR_ORECF;
+    }
+}
+
+/**
+ * EXTI line 3 interrupt handler hook
+ */
+void console_wake_irq(void) {
+    if (EXTI->PR1 & EXTI_PR1_PIF3) {
+        EXTI->PR1 = EXTI_PR1_PIF3;
+        woken = 1;
+        sched_signal(&console_task);
+    }
+}
@@ -0,0 +1,265 @@
+/*
+ * console_cmd.c
+ *
+ * Command interpreter of the serial console
+ */
+
+#include "console_cmd.h"
+#include "game.h"
+#include "button.h"
+#include "sched.h"
+#include "speed_curve.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS_MAX  3
+
+/* Name, lowest and highest value (ms for times) of every parameter */
+#define CONSOLE_PARAMS(X) \
+    X(WIN,      "win",      1,  99)   \
+    X(SPEED,    "speed",    10, 5000) \
+    X(MIN,      "min",      10, 5000) \
+    X(DECREASE, "decrease", 0,  1000) \
+    X(EARLY,    "early",    0,  1000) \
+    X(LATE,     "late",     0,  1000) \
+    X(PROFILE,  "profile",  0,  0)    \
+    X(DEBOUNCE, "debounce", 0,  200)
+
+#define PARAM_ENUM_(id, name, lo, hi)  PARAM_##id,
+#define PARAM_ROW_(id, name, lo, hi)   [PARAM_##id] = {name, lo, hi},
+
+typedef enum {
+    CONSOLE_PARAMS(PARAM_ENUM_)
+    PARAM_COUNT
+} Param;
+
+typedef struct {
+    const char *name;
+    uint32_t lo;
+    uint32_t hi;
+} ParamInfo;
+
+static const ParamInfo params[PARAM_COUNT] = {
+    CONSOLE_PARAMS(PARAM_ROW_)
+};
+
+/* Name of the speed profile a config uses, "formula" for none */
+static const char *profile_of(const GameConfig *config) {
+    for (uint8_t p = 0; p < SPEED_PROFILE_COUNT; p++) {
+        if (config->speed_curve == speed_curves[p]) {
+            return speed_profile_name(p);
+        }
+    }
+    return "formula";
+}
+
+static Param param_find(const char *name) {
+    uint8_t p = 0;
+
+    while (p < PARAM_COUNT && strcmp(params[p].name, name) != 0) {
+        p++;
+    }
+    return (Param)p;
+}
+
+/* "name=value" of a parameter */
+static int param_text(Param p, char *out, uint32_t size) {
+    const GameConfig *c = game_config();
+    uint32_t value = 0;
+
+    switch (p) {
+    case PARAM_WIN:      value = c->winning_score; break;
+    case PARAM_SPEED:    value = c->initial_speed_us / 1000u; break;
+    case PARAM_MIN:      value = c->min_speed_us / 1000u; break;
+    case PARAM_DECREASE: value = c->speed_decrease_us / 1000u; break;
+    case PARAM_EARLY:    value = c->hit_early_us / 1000u; break;
+    case PARAM_LATE:     value = c->hit_late_us / 1000u; break;
+    case PARAM_DEBOUNCE: value = button_debounce_us() / 1000u; break;
+    case PARAM_PROFILE:
+        return snprintf(out, size, "%s=%s", params[p].name, profile_of(c));
+    default:
+        break;
+    }
+    return snprintf(out, size, "%s=%lu", params[p].name, (unsigned long)value);
+}
+
+/* Check and store a parameter, NULL or the reason it was refused */
+static const char *param_set(Param p, const char *text) {
+    GameConfig c = *game_config();
+    char *end;
+    unsigned long value = 0;
+
+    if (p == PARAM_PROFILE) {
+        uint8_t profile = speed_profile_find(text);
+
+        if (strcmp(text, "formula") == 0) {
+            c.speed_curve = NULL;
+        } else if (profile < SPEED_PROFILE_COUNT) {
+            c.speed_curve = speed_curves[profile];
+        } else {
+            return "unknown";
+        }
+        game_configure(&c);
+        return NULL;
+    }
+
+    value = strtoul(text, &end, 10);
+    if (*text == '\0' || *end != '\0') {
+        return "not a number";
+    }
+    if (value < params[p].lo || value > params[p].hi) {
+        return "out of range";
+    }
+
+    switch (p) {
+    case PARAM_WIN:      c.winning_score = (uint8_t)value; break;
+    case PARAM_SPEED:    c.initial_speed_us = value * 1000u; break;
+    case PARAM_MIN:      c.min_speed_us = value * 1000u; break;
+    case PARAM_DECREASE: c.speed_decrease_us = value * 1000u; break;
+    case PARAM_EARLY:    c.hit_early_us = value * 1000u; break;
+    case PARAM_LATE:     c.hit_late_us = value * 1000u; break;
+    case PARAM_DEBOUNCE:
+        button_set_debounce_us(value * 1000u);
+        return NULL;
+    default:
+        break;
+    }
+
+    /* The three speed fields only count without a profile */
+    if (p == PARAM_SPEED || p == PARAM_MIN || p == PARAM_DECREASE) {
+        c.speed_curve = NULL;
+    }
+    if (c.min_speed_us > c.initial_speed_us) {
+        return "above speed";
+    }
+    if (c.speed_decrease_us > c.initial_speed_us - c.min_speed_us) {
+        return (p == PARAM_DECREASE) ? "above speed - min" : "leaves decrease above speed - min";
+    }
+    game_configure(&c);
+    return NULL;
+}
+
+/* Split a line into words in place, return their number */
+static int split(char *line, char *words[]) {
+    int count = 0;
+    char *at = line;
+
+    while (count < WORDS_MAX + 1) {
+        while (*at == ' ' || *at == '\t') {
+            *at++ = '\0';
+        }
+        if (*at == '\0') {
+            break;
+        }
+        words[count++] = at;
+        while (*at != '\0' && *at != ' ' && *at != '\t') {
+            at++;
+        }
+    }
+    return count;
+}
+
+static int cmd_get(char *words[], int count, char *out, uint32_t size) {
+    if (count == 2) {
+        Param p = param_find(words[1]);
+
+        if (p == PARAM_COUNT) {
+            return snprintf(out, size, "error: unknown parameter %s", words[1]);
+        }
+        return param_text(p, out, size);
+    }
+
+    int len = 0;
+
+    for (uint8_t p = 0; p < PARAM_COUNT && len + 1 < (int)size; p++) {
+        if (p != 0) {
+            out[len++] = ' ';
+        }
+        len += param_text((Param)p, out + len, size - (uint32_t)len);
+    }
+    return len;
+}
+
+static int cmd_set(char *words[], int count, char *out, uint32_t size) {
+    if (count != 3) {
+        return snprintf(out, size, "error: set <param> <value>");
+    }
+
+    Param p = param_find(words[1]);
+
+    if (p == PARAM_COUNT) {
+        return snprintf(out, size, "error: unknown parameter %s", words[1]);
+    }
+
+    const char *refused = param_set(p, words[2]);
+
+    if (refused != NULL) {
+        return snprintf(out, size, "error: %s %s", words[1], refused);
+    }
+
+    int len = param_text(p, out, size);
+
+    if (p != PARAM_DEBOUNCE && len < (int)size) {
+        len += snprintf(out + len, size - (uint32_t)len, " from the next serve");
+    }
+    return len;
+}
+
+static int cmd_selftest(char *out, uint32_t size) {
+    uint32_t misses = 0;
+
+    for (Task *task = sched_next_task(NULL); task != NULL; task = sched_next_task(task)) {
+        misses += task->misses;
+    }
+
+    uint32_t walk_ms = game_selftest();
+
+    return snprintf(out, size, "selftest: led walk %lu ms, dropped edges %lu, "
+                    "telemetry overflows %lu, deadline misses %lu",
+                    (unsigned long)walk_ms, (unsigned long)button_dropped(),
+                    (unsigned long)telemetry_overflows(), (unsigned long)misses);
+}
+
+/**
+ * Run one command line
+ */
+uint32_t console_execute(const char *line, char *reply, uint32_t size) {
+    char copy[CONSOLE_LINE_MAX + 1];
+    char *words[WORDS_MAX + 1];
+    int len;
+
+    if (size == 0) {
+        return 0;
+    }
+    strncpy(copy, line, CONSOLE_LINE_MAX);
+    copy[CONSOLE_LINE_MAX] = '\0';
+
+    int count = split(copy, words);
+
+    if (count == 0) {
+        len = 0;
+        reply[0] = '\0';
+    } else if (strcmp(words[0], "get") == 0 && count <= 2) {
+        len = cmd_get(words, count, reply, size);
+    } else if (strcmp(words[0], "set") == 0) {
+        len = cmd_set(words, count, reply, size);
+    } else if (strcmp(words[0], "pause") == 0 && count == 1) {
+        len = game_pause(1) ? snprintf(reply, size, "paused")
+                            : snprintf(reply, size, "error: no pause in a netplay build");
+    } else if (strcmp(words[0], "resume") == 0 && count == 1) {
+        len = game_pause(0) ? snprintf(reply, size, "resumed")
+                            : snprintf(reply, size, "error: no pause in a netplay build");
+    } else if (strcmp(words[0], "selftest") == 0 && count == 1) {
+        len = cmd_selftest(reply, size);
+    } else if (strcmp(words[0], "help") == 0) {
+        len = snprintf(reply, size, "get [param], set <param> <value>, pause, resume, "
+                       "selftest; params: win speed min decrease early late profile debounce");
+    } else {
+        len = snprintf(reply, size, "error: unknown command %s, try help", words[0]);
+    }
+
+    /* snprintf gives the length it wanted, not what fitted */
+    return (len < 0) ? 0 : ((uint32_t)len < size ? (uint32_t)len : size - 1u);
+}
@@ -0,0 +1,613 @@
+/*
+ * game.c
+ *
+ * Ping-pong game as cooperative scheduler tasks
+ */
+
+#include "game.h"
+#include "sched.h"
+#include "leds.h"
+#include "button.h"
+#include "timebase.h"
+#include "score.h"
+#include "anim.h"
+#include "clock.h"
+#include "replay.h"
+#include "keys.h"
+#include "prof.h"
+#include "telemetry.h"
+#include "netplay.h"
+#if NETPLAY
+#include "link.h"
+#endif
+
+#define PRESS_MAX           8       /* presses waiting for the logic task */
+#define RECORD_SIZE         4096    /* bytes, roughly 800 presses */
+
+/* Deadlines from becoming ready to done */
+#define INPUT_DEADLINE_US   1000
+#define LOGIC_DEADLINE_US   1000
+#define RENDER_DEADLINE_US  2000
+
+/* Three flashes to signal game start */
+static const AnimFrame start_frames[] = {
+    {0x00, 0, 500},
+    {0xFF, 0, 200}, {0x00, 0, 200},
+    {0xFF, 0, 200}, {0x00, 0, 200},
+    {0xFF, 0, 200}, {0x00, 0, 700}
+};
+static ANIM_DEFINE(start_anim, start_frames, 0);
+
+/* Rapid triple flash after a miss */
+static const AnimFrame miss_frames[] = {
+    {0xFF, 0, 100}, {0x00, 0, 100},
+    {0xFF, 0, 100}, {0x00, 0, 100},
+    {0xFF, 0, 100}, {0x00, 0, 100}
+};
+static ANIM_DEFINE(miss_anim, miss_frames, 0);
+
+/* Final score, pause, then two flashes before the next match */
+static const AnimFrame game_over_frames[] = {
+    {0x00, 0, 1000},
+    {0x00, ANIM_MASK_PARAM | ANIM_BREATHE, 3000},
+    {0x00, 0, 2000},
+    {0xFF, 0, 300}, {0x00, 0, 300},
+    {0xFF, 0, 300}, {0x00, 0, 300}
+};
+static ANIM_DEFINE(game_over_anim, game_over_frames, 0);
+
+/* Self-test: every LED on its own, end to end, then all of them */
+static const AnimFrame selftest_frames[] = {
+    {0x01, 0, 150}, {0x02, 0, 150}, {0x04, 0, 150}, {0x08, 0, 150},
+    {0x10, 0, 150}, {0x20, 0, 150}, {0x40, 0, 150}, {0x80, 0, 150},
+    {0xFF, 0, 500}, {0x00, 0, 300}
+};
+static ANIM_DEFINE(selftest_anim, selftest_frames, 0);
+
+static void input_run(void *arg);
+static void logic_run(void *arg);
+static void render_run(void *arg);
+static void new_match(uint32_t seed, uint64_t now);
+
+static Task input_task = {
+    .name = "input", .run = input_run, .deadline_us = INPUT_DEADLINE_US
+};
+static Task logic_task = {
+    .name = "logic", .run = logic_run, .deadline_us = LOGIC_DEADLINE_US
+};
+static Task render_task = {
+    .name = "render", .run = render_run, .deadline_us = RENDER_DEADLINE_US
+};
+
+/* Debounced press with the time of its edge */
+typedef struct {
+    uint64_t at;
+    uint8_t button;
+} Press;
+
+static Game game;
+static GameConfig config;           /* the game's, changes between rallies */
+static GameConfig pending;          /* game_configure(), taken up by config */
+static Press presses[PRESS_MAX];    /* presses not yet seen by logic, in order */
+static uint8_t press_count = 0;
+static uint64_t anim_end_at = GAME_NO_STEP; /* the requested animation ends */
+static uint8_t draw_ball = 0;       /* render the ball on the next run */
+static uint8_t paused = 0;
+static uint64_t paused_at = 0;
+static uint64_t selftest_end = GAME_NO_STEP;    /* self-test running until */
+
+static uint8_t record_buf[RECORD_SIZE];
+static ReplayLog record;
+
+static ReplayReader playback;
+static uint8_t playing = 0;
+static int64_t playback_shift = 0;  /* added to recorded timestamps */
+static ButtonEvent playback_next;   /* next edge to inject */
+
+static void (*over_hook)(const Game *game);     /* a match has ended */
+
+#if NETPLAY
+static Netplay net;
+static uint8_t net_show = GAME_SHOW_NONE;   /* the session's show put up */
+static uint64_t net_show_end = GAME_NO_STEP;
+#endif
+
+/* Button edge entering the queue, EXTI context */
+static void record_edge(const ButtonEvent *event) {
+    replay_record_edge(&record, event);
+}
+
+/* Animation keyframe timer expiry, SysTick context */
+static void anim_wake(void *arg) {
+    (void)arg;
+    sched_signal(&render_task);
+}
+
+/* Carry out what the game core asked for */
+static void apply(void) {
+    /* Interludes run on the slow clock, rallies on the full one */
+    clock_set_profile(game.fast ? CLOCK_PROFILE_RUN : CLOCK_PROFILE_IDLE);
+
+    uint32_t length = ANIM_FOREVER;
+
+    if (game.show != GAME_SHOW_NONE) {
+        draw_ball = 0;
+    }
+
+    switch (game.show) {
+    case GAME_SHOW_NONE:
+        return;
+
+    case GAME_SHOW_BALL:
+        if (anim_busy()) {
+            anim_cancel();
+        }
+        draw_ball = 1;
+        sched_signal(&render_task);
+        break;
+
+    case GAME_SHOW_INTRO:
+        length = anim_play(&start_anim, 0, 0);
+        break;
+
+    case GAME_SHOW_MISS:
+        length = anim_play(&miss_anim, 0, 0);
+        break;
+
+    case GAME_SHOW_SCORE:
+        length = show_score(game.right_score, game.left_score, SCORE_DISPLAY_TIME);
+        break;
+
+    case GAME_SHOW_WINNER:
+        length = show_winner(game_winner(&game));
+        break;
+
+    case GAME_SHOW_OVER:
+        length = anim_play(&game_over_anim, score_mask(game.right_score, game.left_score), 0);
+        break;
+    }
+    game.show = GAME_SHOW_NONE;
+
+    /*
+     * The animation ends after its length counted from the event that asked
+     * for it, not from when render got around to it, so the game never
+     * depends on how busy the CPU was.
+     */
+    anim_end_at = (length == ANIM_FOREVER) ? GAME_NO_STEP : game.now_us + (uint64_t)length * 1000;
+}
+
+/* Telemetry of what one event changed, given the state and rally before */
+static void report(uint8_t state, uint8_t rally, uint64_t at) {
+    uint8_t p[6];
+    uint16_t speed_ms = (uint16_t)(game.speed_us / 1000u);
+
+    if (game.state == BALL_MOVING && game.rally != rally && game.rally != 0) {
+        /* The ball now moves away from whoever hit it */
+        p[0] = (game.direction > 0) ? LEFT_BUTTON : RIGHT_BUTTON;
+        p[1] = (uint8_t)game.hit_offset_ms;
+        p[2] = (uint8_t)((uint16_t)game.hit_offset_ms >> 8);
+        p[3] = game.rally;
+        p[4] = (uint8_t)speed_ms;
+        p[5] = (uint8_t)(speed_ms >> 8);
+        telemetry_send(TLM_HIT, at, p, 6);
+    }
+    if (game.state == state) {
+        return;
+    }
+
+    p[0] = game.state;
+    telemetry_send(TLM_STATE, at, p, 1);
+
+    switch (game.state) {
+    case BALL_MOVING:
+        p[0] = (uint8_t)game.direction;
+        p[1] = (uint8_t)speed_ms;
+        p[2] = (uint8_t)(speed_ms >> 8);
+        telemetry_send(TLM_SERVE, at, p, 3);
+        break;
+
+    case GAME_MISS:
+        p[0] = (game.position > 8) ? RIGHT_BUTTON : LEFT_BUTTON;
+        p[1] = game.rally;
+        telemetry_send(TLM_MISS, at, p, 2);
+        break;
+
+    case POINT_SCORED:
+        p[0] = game.left_score;
+        p[1] = game.right_score;
+        telemetry_send(TLM_SCORE, at, p, 2);
+        break;
+    }
+}
+
+#if NETPLAY
+/* Length of a show as apply() will put it up, for the rollback session */
+static uint32_t show_length(const Game *g) {
+    switch (g->show) {
+    case GAME_SHOW_INTRO:  return anim_length(&start_anim, 0);
+    case GAME_SHOW_MISS:   return anim_length(&miss_anim, 0);
+    case GAME_SHOW_SCORE:  return score_length(SCORE_DISPLAY_TIME);
+    case GAME_SHOW_WINNER: return winner_length();
+    case GAME_SHOW_OVER:   return anim_length(&game_over_anim, 0);
+    default:               return ANIM_FOREVER;
+    }
+}
+
+/* Bytes from the other board, interrupt context */
+static void link_received(void) {
+    sched_signal(&logic_task);
+}
+
+/*
+ * Logic with a second board: the rollback session in netplay.c plays the
+ * whole 16-LED field, and either button on this board is its own player.
+ * The game shown is the session's, copied after every run; a show is put
+ * up when it is a new request, so a rollback that replays the same score
+ * does not restart its animation.
+ */
+static void net_logic(uint64_t now) {
+    uint8_t bytes[64];
+    uint32_t len;
+
+    while ((len = link_read(bytes, sizeof(bytes))) != 0) {
+        netplay_receive(&net, bytes, len, now);
+    }
+    for (uint8_t n = 0; n < press_count; n++) {
+        netplay_press(&net, presses[n].at);
+    }
+    press_count = 0;
+
+    uint64_t wake = netplay_run(&net, now);
+    const Rollback *rb = &net.rb;
+    uint8_t state = game.state;
+    uint8_t rally = game.rally;
+    uint8_t fresh = (rb->show != net_show || rb->anim_end_at != net_show_end);
+    uint8_t moved = (rb->game.position != game.position || rb->game.direction != game.direction);
+
+    game = rb->game;
+    game.show = (fresh || (moved && rb->show == GAME_SHOW_BALL)) ? rb->show : GAME_SHOW_NONE;
+    net_show = rb->show;
+    net_show_end = rb->anim_end_at;
+    report(state, rally, game.now_us);
+    apply();
+
+    sched_wake_at(&logic_task, wake);
+}
+#endif
+
+/* Inject recorded edges that are due, return when the next one is */
+static uint64_t playback_run(uint64_t now) {
+    while (playing) {
+        uint64_t at = (uint64_t)((int64_t)playback_next.timestamp + playback_shift);
+
+        if (at > now) {
+            return at;
+        }
+
+        ButtonEvent event = playback_next;
+        uint32_t primask = __get_PRIMASK();
+
+        event.timestamp = at;
+        __disable_irq();            /* the EXTI pushes into the same queue */
+        button_inject(&event);
+        __set_PRIMASK(primask);
+
+        playing = replay_next(&playback, &playback_next);
+    }
+    return SCHED_NEVER;
+}
+
+/* Move debounced presses from the button queue to the press list */
+static uint64_t read_presses(void) {
+    uint64_t at;
+    int button;
+
+    /* Sampled keys first, so every edge stamped before now is queued */
+    uint64_t keys_at = keys_poll();
+
+    while (press_count < PRESS_MAX && (button = button_read_press(&at)) != 0) {
+        presses[press_count].at = at;
+        presses[press_count].button = (uint8_t)button;
+        press_count++;
+    }
+    return keys_at;
+}
+
+/* Input task: inject replayed edges, turn queued edges into presses */
+static void input_run(void *arg) {
+    uint64_t wake = SCHED_NEVER;
+
+    (void)arg;
+
+    if (playing && !paused) {
+        wake = playback_run(timebase_us());
+    }
+
+    uint64_t keys_at = read_presses();
+
+    if (press_count) {
+        sched_signal(&logic_task);
+    }
+    if (keys_at < wake) {
+        wake = keys_at;
+    }
+
+    /* A press made while its button was still locked shows up when the
+       debounce window closes */
+    if (button_settle_at() < wake) {
+        wake = button_settle_at();
+    }
+    sched_wake_at(&input_task, wake);
+}
+
+/*
+ * Logic task: feed presses, ball steps and animation ends to the core
+ *
+ * Every event carries the time it happened (the press edge, step_at, the
+ * animation end) rather than the time this task ran, and due events are
+ * fed in time order. The game then depends only on the seed and the
+ * button edges, which is what a replay log holds.
+ */
+static void logic_run(void *arg) {
+    uint64_t now = timebase_us();
+    uint8_t taken = 0;
+
+    (void)arg;
+
+    /* Edges stamped before now are all queued already */
+    read_presses();
+
+#if NETPLAY
+    net_logic(now);
+    return;
+#endif
+
+    if (selftest_end != GAME_NO_STEP && now >= selftest_end) {
+        new_match(game.rng, selftest_end);
+    }
+    if (paused || selftest_end != GAME_NO_STEP) {
+        /* Presses made meanwhile are dropped */
+        press_count = 0;
+        sched_wake_at(&logic_task, selftest_end);
+        return;
+    }
+
+    for (;;) {
+        uint64_t press_at = GAME_NO_STEP;
+        uint8_t press_event = GAME_EV_PRESS_LEFT;
+        uint64_t at;
+
+        if (taken < press_count) {
+            press_at = presses[taken].at;
+            press_event = (presses[taken].button == LEFT_BUTTON) ? GAME_EV_PRESS_LEFT : GAME_EV_PRESS_RIGHT;
+        }
+
+        uint8_t event = game_next_due(&game, press_at, press_event, anim_end_at, now, &at);
+
+        if (event == GAME_EVENT_COUNT) {
+            break;
+        }
+        if (event == GAME_EV_ANIM_DONE) {
+            anim_end_at = GAME_NO_STEP;
+        } else if (event != GAME_EV_STEP) {
+            taken++;
+        }
+
+        uint8_t state = game.state;
+        uint8_t rally = game.rally;
+
+        if (state != BALL_MOVING) {
+            config = pending;
+        }
+
+        PROF_BEGIN(GAME_EVENT);
+        game_event(&game, event, at);
+        PROF_END(GAME_EVENT);
+        report(state, rally, at);
+        apply();
+        if (game.state == GAME_OVER && state != GAME_OVER && over_hook && !playing) {
+            over_hook(&game);
+        }
+    }
+
+    /* Keep presses stamped after now for the next run */
+    for (uint8_t n = taken; n < press_count; n++) {
+        presses[n - taken] = presses[n];
+    }
+    press_count -= taken;
+
+    if (press_count) {
+        sched_signal(&logic_task);
+    }
+    sched_wake_at(&logic_task, (game.step_at < anim_end_at) ? game.step_at : anim_end_at);
+}
+
+/* Render task: animations and the ball trail */
+static void render_run(void *arg) {
+    (void)arg;
+
+    if (draw_ball) {
+        draw_ball = 0;
+#if NETPLAY
+        /* This board's half of the field */
+        int position = game.position - ((net.side == NETPLAY_RIGHT) ? GAME_LEDS : 0);
+
+        if (position >= 1 && position <= GAME_LEDS) {
+            leds_trail(position, game.direction);
+        } else {
+            leds_clear();
+        }
+#else
+        leds_trail(game.position, game.direction);
+#endif
+    }
+
+    if (anim_busy()) {
+        anim_update();
+    }
+}
+
+/* Reset the game and the pending events */
+static void restart(uint32_t seed, uint64_t now) {
+    press_count = 0;
+    anim_end_at = GAME_NO_STEP;
+    config = pending;
+    game_reset(&game, &config, seed, now);
+    report(GAME_STAY, 0, now);
+    apply();
+    sched_wake_at(&logic_task, anim_end_at);
+}
+
+/* Restart the game on a new recording */
+static void new_match(uint32_t seed, uint64_t now) {
+    playing = 0;
+    selftest_end = GAME_NO_STEP;
+    replay_record_start(&record, record_buf, sizeof(record_buf), seed, now);
+    restart(seed, now);
+}
+
+/**
+ * Register the game tasks, start recording and start the intro animation
+ */
+void game_init(uint32_t seed) {
+    uint64_t now = timebase_us();
+
+    sched_add(&input_task);
+    sched_add(&logic_task);
+    sched_add(&render_task);
+    anim_set_wake_hook(anim_wake, NULL);
+
+    paused = 0;
+    pending = game_default_config;
+    button_set_edge_hook(record_edge);
+    new_match(seed, now);
+
+#if NETPLAY
+    /* The chip's unique id tells the two boards apart */
+    netplay_init(&net, HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2(), seed, &pending,
+                 show_length, link_send, NULL, now);
+    link_init(link_received);
+    sched_signal(&logic_task);
+#endif
+}
+
+/**
+ * Play a recorded match back from now on
+ */
+int game_replay(const uint8_t *log, uint32_t len) {
+    uint32_t seed;
+    uint64_t start;
+    uint64_t now = timebase_us();
+
+#if NETPLAY
+    return 0;                       /* the match belongs to both boards */
+#endif
+    if (!replay_open(&playback, log, len, &seed, &start)) {
+        return 0;
+    }
+
+    /* The playback is recorded like any other match */
+    replay_record_start(&record, record_buf, sizeof(record_buf), seed, now);
+    playback_shift = (int64_t)(now - start);
+    playing = replay_next(&playback, &playback_next);
+    selftest_end = GAME_NO_STEP;
+
+    button_flush();
+    restart(seed, now);
+    sched_signal(&input_task);
+    return 1;
+}
+
+/**
+ * The recording of the current match
+ */
+const ReplayLog *game_recording(void) {
+    return &record;
+}
+
+/**
+ * Current game state, read-only
+ */
+const Game *game_state(void) {
+    return &game;
+}
+
+/**
+ * Pacing taken up between rallies
+ */
+const GameConfig *game_config(void) {
+    return &pending;
+}
+
+/**
+ * Change the pacing from the next serve on
+ */
+void game_configure(const GameConfig *next) {
+    pending = *next;
+}
+
+/**
+ * Freeze or continue the game
+ */
+int game_pause(int pause) {
+    uint64_t now = timebase_us();
+
+#if NETPLAY
+    (void)now;
+    return !pause;                  /* the other board's clock runs on */
+#endif
+    if (pause && !paused) {
+        paused = 1;
+        paused_at = now;
+        anim_pause(1);
+        clock_set_profile(CLOCK_PROFILE_IDLE);
+    } else if (!pause && paused) {
+        uint64_t shift = now - paused_at;
+
+        paused = 0;
+        game_shift(&game, shift);
+        if (anim_end_at != GAME_NO_STEP) {
+            anim_end_at += shift;
+        }
+        playback_shift += (int64_t)shift;
+        anim_pause(0);
+        clock_set_profile(game.fast ? CLOCK_PROFILE_RUN : CLOCK_PROFILE_IDLE);
+        sched_signal(&input_task);
+    }
+    sched_signal(&logic_task);
+    return 1;
+}
+
+/**
+ * Whether the game is paused
+ */
+int game_paused(void) {
+    return paused;
+}
+
+/**
+ * Call a function whenever a match is over
+ */
+void game_set_over_hook(void (*hook)(const Game *game)) {
+    over_hook = hook;
+}
+
+/**
+ * Walk the LEDs, then start a new match
+ */
+uint32_t game_selftest(void) {
+    uint32_t length = anim_play(&selftest_anim, 0, 0);
+
+    draw_ball = 0;
+    selftest_end = timebase_us() + (uint64_t)length * 1000;
+    clock_set_profile(CLOCK_PROFILE_IDLE);
+    sched_signal(&logic_task);
+    return length;
+}
+
+/**
+ * Button interrupt hook
+ */
+void game_input_irq(void) {
+    sched_signal(&input_task);
+}
@@ -0,0 +1,401 @@
+/*
+ * game_core.c
+ *
+ * Table-driven ping-pong rules, free of hardware
+ *
+ * See GAME_GUIDE.md for game rules and instructions
+ */
+
+#include "game_core.h"
+#include "speed_curve.h"
+#include <stddef.h>
+
+const GameConfig game_default_config = {
+    WINNING_SCORE, INITIAL_SPEED_US, MIN_SPEED_US, SPEED_DECREASE_US,
+    HIT_EARLY_US, HIT_LATE_US, speed_curves[SPEED_PROFILE], GAME_LEDS
+};
+
+typedef int (*GameAction)(Game *game);
+
+/*
+ * A table entry: run the action (if any), then go to next if the action
+ * returned nonzero (or there is none), otherwise to otherwise. GAME_STAY
+ * keeps the state without running its entry action. An all-zero entry
+ * ignores the event.
+ */
+typedef struct {
+    GameAction action;
+    uint8_t next;
+    uint8_t otherwise;
+} Transition;
+
+static int hit_left(Game *game);
+static int hit_right(Game *game);
+static int step(Game *game);
+static int won(Game *game);
+static int new_match(Game *game);
+
+static const Transition transitions[GAME_STATE_COUNT][GAME_EVENT_COUNT] = {
+    [GAME_INTRO] = {
+        [GAME_EV_ANIM_DONE]   = { NULL, GAME_START, GAME_STAY },
+    },
+    [GAME_START] = {
+        [GAME_EV_SERVE]       = { NULL, BALL_MOVING, GAME_STAY },
+    },
+    [BALL_MOVING] = {
+        [GAME_EV_PRESS_LEFT]  = { hit_left, BALL_MOVING, GAME_STAY },
+        [GAME_EV_PRESS_RIGHT] = { hit_right, BALL_MOVING, GAME_STAY },
+        [GAME_EV_STEP]        = { step, GAME_MISS, GAME_STAY },
+    },
+    [GAME_MISS] = {
+        [GAME_EV_ANIM_DONE]   = { NULL, POINT_SCORED, GAME_STAY },
+    },
+    /* A press skips the score, winner and game over screens */
+    [POINT_SCORED] = {
+        [GAME_EV_PRESS_LEFT]  = { won, GAME_WINNER, GAME_START },
+        [GAME_EV_PRESS_RIGHT] = { won, GAME_WINNER, GAME_START },
+        [GAME_EV_ANIM_DONE]   = { won, GAME_WINNER, GAME_START },
+    },
+    [GAME_WINNER] = {
+        [GAME_EV_PRESS_LEFT]  = { NULL, GAME_OVER, GAME_STAY },
+        [GAME_EV_PRESS_RIGHT] = { NULL, GAME_OVER, GAME_STAY },
+        [GAME_EV_ANIM_DONE]   = { NULL, GAME_OVER, GAME_STAY },
+    },
+    [GAME_OVER] = {
+        [GAME_EV_PRESS_LEFT]  = { new_match, GAME_START, GAME_STAY },
+        [GAME_EV_PRESS_RIGHT] = { new_match, GAME_START, GAME_STAY },
+        [GAME_EV_ANIM_DONE]   = { new_match, GAME_START, GAME_STAY },
+    },
+};
+
+/* Travel in Q16 units over ticks whole ticks, and the remainder left */
+static uint32_t travel(const Game *game, uint64_t ticks, uint32_t *rem) {
+    uint64_t total = ticks * (uint64_t)GAME_Q16_ONE * GAME_TICK_US + game->ball_rem;
+
+    *rem = (uint32_t)(total % game->speed_us);
+    return (uint32_t)(total / game->speed_us);
+}
+
+/*
+ * Run the ticks up to until_us (including one at until_us if inclusive).
+ * Speed is constant between returns, so n ticks at once come out exactly
+ * as n single ticks of GAME_Q16_ONE * GAME_TICK_US / speed_us would.
+ */
+static void advance(Game *game, uint64_t until_us, int inclusive) {
+    if (until_us <= game->tick_at || (!inclusive && until_us - game->tick_at < GAME_TICK_US)) {
+        return;
+    }
+
+    uint64_t ticks = (until_us - game->tick_at - (inclusive ? 0 : 1)) / GAME_TICK_US;
+    uint32_t moved = travel(game, ticks, &game->ball_rem);
+
+    game->ball_q16 += (game->direction > 0) ? (int32_t)moved : -(int32_t)moved;
+    game->tick_at += ticks * GAME_TICK_US;
+}
+
+/* LED of a Q16 position: the integer part, rounded back towards where the
+   ball came from so it changes as it reaches the next LED */
+static int8_t led_of(const Game *game, int32_t ball_q16) {
+    if (game->direction < 0) {
+        ball_q16 += GAME_Q16_ONE - 1;
+    }
+    return (int8_t)(ball_q16 >> 16);
+}
+
+/* Put the ball up and time the tick on which it reaches the next LED */
+static void show_ball(Game *game) {
+    int32_t next = (int32_t)(game->position + game->direction) * GAME_Q16_ONE;
+    uint64_t distance = (uint64_t)(next > game->ball_q16 ? next - game->ball_q16
+                                                         : game->ball_q16 - next);
+    uint64_t per_tick = (uint64_t)GAME_Q16_ONE * GAME_TICK_US;
+    uint64_t ticks = (distance * game->speed_us - game->ball_rem + per_tick - 1) / per_tick;
+
+    game->show = GAME_SHOW_BALL;
+    game->step_at = game->tick_at + ticks * GAME_TICK_US;
+}
+
+/* Start the ball on its LED, ticks counted from now */
+static void launch(Game *game) {
+    game->ball_q16 = (int32_t)game->position * GAME_Q16_ONE;
+    game->ball_rem = 0;
+    game->tick_at = game->now_us;
+    show_ball(game);
+}
+
+/* xorshift32, never sticks at zero as the seed is forced odd */
+static uint32_t next_random(Game *game) {
+    uint32_t x = game->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    game->rng = x;
+    return x;
+}
+
+/* Step time for the rally so far: a table lookup, or the three speed
+   fields of configs without a curve */
+static uint32_t rally_speed(const Game *game) {
+    const GameConfig *config = game->config;
+
+    if (config->speed_curve != NULL) {
+        return config->speed_curve[(game->rally < SPEED_CURVE_LEN) ? game->rally
+                                                                   : SPEED_CURVE_LEN - 1];
+    }
+    if (game->rally == 0) {
+        return config->initial_speed_us;
+    }
+    /* Never below the minimum, whatever the decrease */
+    return (game->speed_us > config->min_speed_us + config->speed_decrease_us)
+           ? game->speed_us - config->speed_decrease_us : config->min_speed_us;
+}
+
+/* Turn the ball around, the press came offset_us after it arrived */
+static void send_back(Game *game, int64_t offset_us) {
+    game->direction = (int8_t)-game->direction;
+    if (game->rally < UINT8_MAX) {
+        game->rally++;
+    }
+    game->speed_us = rally_speed(game);
+    game->hit_offset_ms = (int16_t)(offset_us / 1000);
+    game->early_at = GAME_NO_STEP;
+    game->leaving = 0;
+}
+
+/*
+ * Return by the player at the given end. The window runs from hit_early_us
+ * before the ball reaches the end LED until hit_late_us after it would
+ * leave it; a press before the ball is there is kept and returns the ball
+ * the moment it arrives.
+ */
+static int hit(Game *game, int8_t direction, int8_t end) {
+    if (game->direction != direction) {
+        return 0;
+    }
+
+    advance(game, game->now_us, 0);
+    if (game->position == end) {
+        send_back(game, (int64_t)(game->now_us - game->arrived_at));
+        return 1;
+    }
+
+    if (game->position == end - direction && game->early_at == GAME_NO_STEP &&
+        game->now_us + game->config->hit_early_us >= game->step_at) {
+        game->early_at = game->now_us;
+    }
+    return 0;
+}
+
+static int hit_left(Game *game) {
+    return hit(game, -1, 1);
+}
+
+static int hit_right(Game *game) {
+    return hit(game, 1, (int8_t)game->config->field_leds);
+}
+
+/* Move the ball one LED, 1 if it left the field */
+static int step(Game *game) {
+    if (game->now_us < game->step_at) {
+        return 0;
+    }
+
+    int8_t next = (int8_t)(game->position + game->direction);
+    int8_t last = (int8_t)game->config->field_leds;
+
+    if (!game->leaving) {
+        advance(game, game->now_us, 1);
+        next = led_of(game, game->ball_q16);
+    }
+
+    if (next >= 1 && next <= last) {
+        game->position = next;
+        if (next == 1 || next == last) {
+            game->arrived_at = game->now_us;
+            if (game->early_at != GAME_NO_STEP) {
+                send_back(game, -(int64_t)(game->now_us - game->early_at));
+                launch(game);
+                return 0;
+            }
+        }
+        show_ball(game);
+        return 0;
+    }
+
+    /* Late tolerance: the ball holds on the end LED a little longer */
+    if (!game->leaving && game->config->hit_late_us > 0) {
+        game->leaving = 1;
+        game->step_at += game->config->hit_late_us;
+        return 0;
+    }
+
+    game->position = next;
+    if (next > last) {
+        game->left_score++;
+    } else {
+        game->right_score++;
+    }
+    return 1;
+}
+
+static int won(Game *game) {
+    uint8_t target = game->config->winning_score;
+
+    return game->left_score >= target || game->right_score >= target;
+}
+
+static int new_match(Game *game) {
+    game->left_score = 0;
+    game->right_score = 0;
+    return 1;
+}
+
+/* Entry action of a state, may raise a follow-up event */
+static int enter(Game *game) {
+    game->step_at = GAME_NO_STEP;
+
+    switch (game->state) {
+    case GAME_INTRO:
+        game->fast = 0;
+        game->show = GAME_SHOW_INTRO;
+        break;
+
+    case GAME_START:
+        game->fast = 1;
+        game->position = (int8_t)(game->config->field_leds / 2);
+        game->rally = 0;
+        game->speed_us = rally_speed(game);
+        game->direction = (next_random(game) & 0x100) ? -1 : 1;
+        return GAME_EV_SERVE;
+
+    case BALL_MOVING:
+        game->early_at = GAME_NO_STEP;
+        game->leaving = 0;
+        launch(game);
+        break;
+
+    case GAME_MISS:
+        game->show = GAME_SHOW_MISS;
+        break;
+
+    case POINT_SCORED:
+        game->fast = 0;
+        game->show = GAME_SHOW_SCORE;
+        break;
+
+    case GAME_WINNER:
+        game->show = GAME_SHOW_WINNER;
+        break;
+
+    case GAME_OVER:
+        game->show = GAME_SHOW_OVER;
+        break;
+    }
+    return -1;
+}
+
+/**
+ * Start a new game with the intro animation
+ */
+void game_reset(Game *game, const GameConfig *config, uint32_t seed, uint64_t now_us) {
+    game->config = (config != NULL) ? config : &game_default_config;
+    game->rng = seed | 1;
+    game->arrived_at = now_us;
+    game->early_at = GAME_NO_STEP;
+    game->leaving = 0;
+    game->hit_offset_ms = 0;
+    game->left_score = 0;
+    game->right_score = 0;
+    game->position = (int8_t)(game->config->field_leds / 2);
+    game->direction = 1;
+    game->rally = 0;
+    game->speed_us = rally_speed(game);
+    game->now_us = now_us;
+    game->show = GAME_SHOW_NONE;
+    game->state = GAME_INTRO;
+    enter(game);
+}
+
+/**
+ * Feed one event into the state machine
+ */
+void game_event(Game *game, uint8_t event, uint64_t now_us) {
+    game->now_us = now_us;
+
+    /* At most one follow-up event per entry: constant work per call */
+    while (event < GAME_EVENT_COUNT && game->state < GAME_STATE_COUNT) {
+        const Transition *t = &transitions[game->state][event];
+        uint8_t next = (t->action == NULL || t->action(game)) ? t->next : t->otherwise;
+
+        if (next == GAME_STAY) {
+            return;
+        }
+
+        game->state = next;
+        int follow = enter(game);
+
+        if (follow < 0) {
+            return;
+        }
+        event = (uint8_t)follow;
+    }
+}
+
+/**
+ * Pick the earliest event due by now
+ */
+uint8_t game_next_due(const Game *game, uint64_t press_at, uint8_t press_event,
+                      uint64_t anim_end_at, uint64_t now_us, uint64_t *at_us) {
+    uint64_t at = press_at;
+    uint8_t event = press_event;
+
+    if (game->step_at < at) {
+        at = game->step_at;
+        event = GAME_EV_STEP;
+    }
+    if (anim_end_at < at) {
+        at = anim_end_at;
+        event = GAME_EV_ANIM_DONE;
+    }
+    if (at > now_us || at == GAME_NO_STEP) {
+        return GAME_EVENT_COUNT;
+    }
+
+    *at_us = at;
+    return event;
+}
+
+/**
+ * Ball position in Q16 LED units at a time
+ */
+int32_t game_ball_q16(const Game *game, uint64_t now_us) {
+    uint32_t rem;
+    uint32_t moved = 0;
+
+    if (now_us > game->tick_at && !game->leaving) {
+        moved = travel(game, (now_us - game->tick_at) / GAME_TICK_US, &rem);
+    }
+    return game->ball_q16 + ((game->direction > 0) ? (int32_t)moved : -(int32_t)moved);
+}
+
+/**
+ * Move every pending time of the game later
+ */
+void game_shift(Game *game, uint64_t us) {
+    game->now_us += us;
+    game->tick_at += us;
+    game->arrived_at += us;
+    if (game->early_at != GAME_NO_STEP) {
+        game->early_at += us;
+    }
+    if (game->step_at != GAME_NO_STEP) {
+        game->step_at += us;
+    }
+}
+
+/**
+ * Winner of the game once a score reached the winning score
+ */
+uint8_t game_winner(const Game *game) {
+    return game->right_score >= game->config->winning_score;
+}
@@ -0,0 +1,214 @@
+/*
+ * keys.c
+ *
+ * Timer-DMA sampled inputs with a vertical-counter debouncer
+ *
+ * TIM5 counts at the APB1 clock with CCR1 and CCR2 at 0, so CC1 and CC2
+ * fire together once per sample period. Each raises a DMA request
+ * (RM0351 DMA2 request 5: CH1 -> Channel 5, CH2 -> Channel 4) that copies
+ * one port's IDR into a circular buffer.
+ */
+
+#include "keys.h"
+#include "vcounter.h"
+#include "button.h"
+#include "timebase.h"
+#include "power.h"
+#include "stm32l4xx_hal.h"
+
+#define SAMPLE_US        (1000000u / KEYS_SAMPLE_HZ)
+
+/* Game buttons among the sampled lines */
+static const struct {
+    uint32_t bit;
+    uint8_t button;
+} game_keys[] = {
+    { KEY_PB(15), LEFT_BUTTON },
+    { KEY_PC(8),  RIGHT_BUTTON },
+};
+
+static uint16_t samples_b[KEYS_BUFFER];
+static uint16_t samples_c[KEYS_BUFFER];
+
+static DMA_HandleTypeDef hdma_keys_b;
+static DMA_HandleTypeDef hdma_keys_c;
+
+static VCounter counter;
+static uint16_t read_pos = 0;       /* next sample to debounce */
+static uint8_t running = 0;
+static volatile uint8_t wake_requested = 0;
+static uint64_t quiet_since = 0;    /* last time a key was down or moving */
+
+static void init_channel(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel) {
+    hdma->Instance = channel;
+    hdma->Init.Request = DMA_REQUEST_5;
+    hdma->Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma->Init.Mode = DMA_CIRCULAR;
+    hdma->Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(hdma) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+/**
+ * Enable TIM5/DMA2 clocks and set up the DMA channels
+ */
+void keys_init(void) {
+    __HAL_RCC_TIM5_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    init_channel(&hdma_keys_b, DMA2_Channel5);  /* TIM5_CH1 */
+    init_channel(&hdma_keys_c, DMA2_Channel4);  /* TIM5_CH2 */
+
+    TIM5->CR1 = 0;
+    TIM5->DIER = 0;
+    running = 0;
+    wake_requested = 0;
+    vcounter_reset(&counter, 0);
+
+    /* The vertical counter is the debouncer, the button module only queues */
+    button_set_pass_through(KEYS_SAMPLED);
+}
+
+/* Auto-reload for one sample period at the current APB1 clock */
+static uint32_t sample_arr(void) {
+    uint32_t period = HAL_RCC_GetPCLK1Freq() / KEYS_SAMPLE_HZ;
+
+    return (period > 1) ? period - 1 : 1;
+}
+
+/* Samples written by both channels, as an index into the buffers */
+static uint16_t write_pos(void) {
+    uint16_t pos_b = KEYS_BUFFER - __HAL_DMA_GET_COUNTER(&hdma_keys_b);
+    uint16_t pos_c = KEYS_BUFFER - __HAL_DMA_GET_COUNTER(&hdma_keys_c);
+    uint16_t ahead_b = (uint16_t)((pos_b - read_pos + KEYS_BUFFER) % KEYS_BUFFER);
+    uint16_t ahead_c = (uint16_t)((pos_c - read_pos + KEYS_BUFFER) % KEYS_BUFFER);
+
+    /* CH2's transfer may still be in flight behind CH1's */
+    return (ahead_b < ahead_c) ? pos_b : pos_c;
+}
+
+static void start(uint64_t now) {
+    /* Prime the buffers with the idle level so a stale word is harmless */
+    for (int n = 0; n < KEYS_BUFFER; n++) {
+        samples_b[n] = 0xFFFF;
+        samples_c[n] = 0xFFFF;
+    }
+
+    if (HAL_DMA_Start(&hdma_keys_b, (uint32_t)&GPIOB->IDR, (uint32_t)samples_b,
+                      KEYS_BUFFER) != HAL_OK ||
+        HAL_DMA_Start(&hdma_keys_c, (uint32_t)&GPIOC->IDR, (uint32_t)samples_c,
+                      KEYS_BUFFER) != HAL_OK) {
+        Error_Handler();
+    }
+
+    TIM5->PSC = 0;
+    TIM5->ARR = sample_arr();
+    TIM5->CCR1 = 0;
+    TIM5->CCR2 = 0;
+    TIM5->CNT = 0;
+    TIM5->EGR = TIM_EGR_UG;     /* load PSC/ARR now */
+    TIM5->SR = 0;
+    TIM5->DIER = TIM_DIER_CC1DE | TIM_DIER_CC2DE;
+    TIM5->CR1 = TIM_CR1_CEN;
+
+    read_pos = 0;
+    quiet_since = now;
+    running = 1;
+    power_stop_inhibit(1);      /* TIM5 and DMA stop in STOP2 */
+}
+
+static void stop(void) {
+    TIM5->CR1 = 0;
+    TIM5->DIER = 0;
+    HAL_DMA_Abort(&hdma_keys_b);
+    HAL_DMA_Abort(&hdma_keys_c);
+    running = 0;
+    power_stop_inhibit(0);
+}
+
+/**
+ * Start sampling, call from the button EXTI
+ */
+void keys_wake(void) {
+    wake_requested = 1;
+}
+
+/**
+ * Debounce the samples taken since the last call
+ */
+uint64_t keys_poll(void) {
+    uint64_t now = timebase_us();
+
+    if (wake_requested) {
+        wake_requested = 0;
+        if (!running) {
+            start(now);
+        }
+        quiet_since = now;
+    }
+    if (!running) {
+        return UINT64_MAX;
+    }
+
+    uint16_t end = write_pos();
+    uint16_t count = (uint16_t)((end - read_pos + KEYS_BUFFER) % KEYS_BUFFER);
+
+    /* The newest sample was taken at about now */
+    uint64_t at = now - (uint64_t)count * SAMPLE_US;
+
+    while (read_pos != end) {
+        uint32_t sample = ~((uint32_t)samples_b[read_pos] |
+                            (uint32_t)samples_c[read_pos] << 16) & KEYS_MASK;
+        uint32_t flipped = vcounter_update(&counter, sample);
+
+        at += SAMPLE_US;
+        read_pos = (uint16_t)((read_pos + 1) % KEYS_BUFFER);
+
+        for (uint32_t k = 0; flipped && k < sizeof(game_keys) / sizeof(game_keys[0]); k++) {
+            if (flipped & game_keys[k].bit) {
+                ButtonEvent event;
+
+                /* The first of the stable samples, when the contact settled */
+                event.timestamp = at - (uint64_t)(VCOUNTER_SAMPLES - 1) * SAMPLE_US;
+                event.button = game_keys[k].button;
+                event.pressed = (counter.state & game_keys[k].bit) ? 1 : 0;
+                button_inject(&event);
+            }
+        }
+    }
+
+    if (counter.state | vcounter_busy(&counter)) {
+        quiet_since = now;
+    } else if (now - quiet_since >= (uint64_t)KEYS_IDLE_MS * 1000) {
+        stop();
+        return UINT64_MAX;
+    }
+    return now + (uint64_t)KEYS_POLL_MS * 1000;
+}
+
+/**
+ * Debounced levels of all sampled lines
+ */
+uint32_t keys_pressed(void) {
+    return counter.state;
+}
+
+/**
+ * Refit the sample rate after a system clock change
+ */
+void keys_recalibrate(void) {
+    if (!running) {
+        return;
+    }
+
+    /* ARR is not preloaded: restart the count so it never runs past it */
+    TIM5->CR1 = 0;
+    TIM5->ARR = sample_arr();
+    TIM5->CNT = 0;
+    TIM5->CR1 = TIM_CR1_CEN;
+}
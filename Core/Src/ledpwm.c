@@ -0,0 +1,217 @@
+/*
+ * ledpwm.c
+ *
+ * DMA-driven PWM engine for the LED field
+ *
+ * TIM1 counts at the APB2 clock with all three compare registers at 0, so
+ * CC1, CC2 and CC4 fire together once per slot. Each raises a DMA request
+ * (RM0351 DMA1 request 7: CH1 -> Channel 2, CH2 -> Channel 3,
+ * CH4 -> Channel 4) that writes one word from a circular table to BSRR.
+ *
+ * The tables the DMA reads are never written while it reads them in the
+ * same period. A new picture goes into the back tables; at the half
+ * transfer of Channel 2 (all three channels move in step) the first half
+ * goes live, the DMA being in the second, and the second half is put
+ * aside, to go live at the transfer complete, the DMA being back in the
+ * first. The period after that shows the new picture whole.
+ */
+
+#include "ledpwm.h"
+#include "stm32l4xx_hal.h"
+
+#define HALF  (LEDPWM_SLOTS / 2)
+
+static uint32_t wave[LEDPWM_MAX_PORTS][LEDPWM_SLOTS];   /* read by the DMA */
+static uint32_t back[LEDPWM_MAX_PORTS][LEDPWM_SLOTS];   /* the next picture */
+static uint32_t tail[LEDPWM_MAX_PORTS][HALF];           /* its second half */
+static volatile uint8_t pending = 0;    /* back tables committed */
+static volatile uint8_t tail_ready = 0; /* first half live, tail to go */
+
+static DMA_HandleTypeDef hdma_ledpwm[LEDPWM_MAX_PORTS];
+
+static DMA_Channel_TypeDef *const dma_channels[LEDPWM_MAX_PORTS] = {
+    DMA1_Channel2,  /* TIM1_CH1 */
+    DMA1_Channel3,  /* TIM1_CH2 */
+    DMA1_Channel4   /* TIM1_CH4 */
+};
+
+static const uint32_t dma_enables[LEDPWM_MAX_PORTS] = {
+    TIM_DIER_CC1DE,
+    TIM_DIER_CC2DE,
+    TIM_DIER_CC4DE
+};
+
+static uint8_t active_ports = 0;
+
+static void copy(uint32_t *to, const uint32_t *from, int count) {
+    for (int n = 0; n < count; n++) {
+        to[n] = from[n];
+    }
+}
+
+/* DMA in the second half: the first half and the tail of the back tables */
+static void half_done(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    if (!pending) {
+        return;
+    }
+    for (int p = 0; p < active_ports; p++) {
+        copy(wave[p], back[p], HALF);
+        copy(tail[p], back[p] + HALF, HALF);
+    }
+    pending = 0;
+    tail_ready = 1;
+}
+
+/* DMA back in the first half: the second half */
+static void full_done(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    if (!tail_ready) {
+        return;
+    }
+    for (int p = 0; p < active_ports; p++) {
+        copy(wave[p] + HALF, tail[p], HALF);
+    }
+    tail_ready = 0;
+}
+
+/**
+ * Enable TIM1/DMA1 clocks and configure the DMA channels
+ */
+void ledpwm_init(void) {
+    __HAL_RCC_TIM1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    for (int p = 0; p < LEDPWM_MAX_PORTS; p++) {
+        hdma_ledpwm[p].Instance = dma_channels[p];
+        hdma_ledpwm[p].Init.Request = DMA_REQUEST_7;
+        hdma_ledpwm[p].Init.Direction = DMA_MEMORY_TO_PERIPH;
+        hdma_ledpwm[p].Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_ledpwm[p].Init.MemInc = DMA_MINC_ENABLE;
+        hdma_ledpwm[p].Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+        hdma_ledpwm[p].Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+        hdma_ledpwm[p].Init.Mode = DMA_CIRCULAR;
+        hdma_ledpwm[p].Init.Priority = DMA_PRIORITY_LOW;
+        if (HAL_DMA_Init(&hdma_ledpwm[p]) != HAL_OK) {
+            Error_Handler();
+        }
+    }
+
+    hdma_ledpwm[0].XferHalfCpltCallback = half_done;
+    hdma_ledpwm[0].XferCpltCallback = full_done;
+    HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+
+    TIM1->CR1 = 0;
+    TIM1->DIER = 0;
+    active_ports = 0;
+}
+
+/* Auto-reload for one waveform slot at the current APB2 clock */
+static uint32_t slot_arr(void) {
+    uint32_t period = HAL_RCC_GetPCLK2Freq() / (LEDPWM_FREQ_HZ * LEDPWM_SLOTS);
+
+    return (period > 1) ? period - 1 : 1;
+}
+
+/**
+ * Start streaming the waveform tables to the given ports
+ */
+void ledpwm_start(GPIO_TypeDef *const ports[], int count) {
+    if (count < 1 || count > LEDPWM_MAX_PORTS) {
+        return;
+    }
+    ledpwm_stop();
+
+    /* Nothing streams yet: the back tables go live at once */
+    for (int p = 0; p < count; p++) {
+        copy(wave[p], back[p], LEDPWM_SLOTS);
+    }
+    pending = 0;
+    tail_ready = 0;
+
+    uint32_t dier = 0;
+    for (int p = 0; p < count; p++) {
+        /* Channel 2 alone interrupts, at the half and the end of a period */
+        HAL_StatusTypeDef status = (p == 0)
+            ? HAL_DMA_Start_IT(&hdma_ledpwm[p], (uint32_t)wave[p],
+                               (uint32_t)&ports[p]->BSRR, LEDPWM_SLOTS)
+            : HAL_DMA_Start(&hdma_ledpwm[p], (uint32_t)wave[p],
+                            (uint32_t)&ports[p]->BSRR, LEDPWM_SLOTS);
+
+        if (status != HAL_OK) {
+            Error_Handler();
+        }
+        dier |= dma_enables[p];
+    }
+
+    TIM1->PSC = 0;
+    TIM1->ARR = slot_arr();
+    TIM1->CCR1 = 0;
+    TIM1->CCR2 = 0;
+    TIM1->CCR4 = 0;
+    TIM1->CNT = 0;
+    TIM1->EGR = TIM_EGR_UG;     /* load PSC/ARR now */
+    TIM1->SR = 0;
+    TIM1->DIER = dier;
+    TIM1->CR1 = TIM_CR1_CEN;
+
+    active_ports = (uint8_t)count;
+}
+
+/**
+ * Stop the timer and DMA, pins keep their last written state
+ */
+void ledpwm_stop(void) {
+    TIM1->CR1 = 0;
+    TIM1->DIER = 0;
+
+    for (int p = 0; p < active_ports; p++) {
+        HAL_DMA_Abort(&hdma_ledpwm[p]);
+    }
+    active_ports = 0;
+}
+
+/**
+ * Recompute the slot rate after a system clock change
+ */
+void ledpwm_recalibrate(void) {
+    if (!active_ports) {
+        return;
+    }
+
+    /* ARR is not preloaded: restart the count so it never runs past it */
+    TIM1->CR1 = 0;
+    TIM1->ARR = slot_arr();
+    TIM1->CNT = 0;
+    TIM1->CR1 = TIM_CR1_CEN;
+}
+
+/**
+ * Check if the engine is streaming
+ */
+int ledpwm_running(void) {
+    return active_ports != 0;
+}
+
+/**
+ * Back waveform table for a port, withdraws a commit not yet taken up
+ */
+uint32_t *ledpwm_wave(int port) {
+    pending = 0;
+    return back[port];
+}
+
+/**
+ * Show the back tables from the next whole period on
+ */
+void ledpwm_commit(void) {
+    pending = 1;
+}
+
+/**
+ * DMA1 Channel 2 interrupt handler hook
+ */
+void ledpwm_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_ledpwm[0]);
+}
@@ -12,9 +12,20 @@
  * LED 6             - PA12
  * LED 7             - PC5
  * LED 8 (rightmost) - PC6
+ *
+ * A frame is an 8-bit mask (bit 0 = LED 1). leds_set_mask() turns it into
+ * one BSRR store per port, so every LED changes state in the same bus cycle
+ * for its port and no read-modify-write of ODR is needed.
+ *
+ * With PWM enabled, frames that contain dimmed LEDs are written into the
+ * ledpwm waveform tables instead, one word per brightness slot, and DMA
+ * streams them to BSRR in the background. Plain on/off frames stop the DMA
+ * and go straight to BSRR, so the MCU may enter STOP2 while they show.
  */
 
 #include "leds.h"
+#include "ledpwm.h"
+#include "prof.h"
 #include "stm32l4xx_hal.h"
 
 /* LED pin definitions */
@@ -34,43 +45,263 @@ static const LED_Pin led_pins[8] = {
     {GPIOC, GPIO_PIN_6}    // LED 8
 };
 
+/* Per-port BSRR words, built from led_pins[] by leds_init() */
+#define LED_PORTS 3
+
+typedef struct {
+    GPIO_TypeDef* port;
+    uint32_t all_pins;      /* every LED pin on this port */
+    uint32_t set_lo[16];    /* set bits for LEDs 1-4, indexed by mask & 0x0F */
+    uint32_t set_hi[16];    /* set bits for LEDs 5-8, indexed by mask >> 4 */
+} LED_Port;
+
+static LED_Port led_ports[LED_PORTS];
+static uint8_t led_port_count = 0;
+static uint16_t current_mask = 0xFFFF;  /* invalid, forces the first write */
+static uint8_t lit_mask = 0;
+static uint8_t pwm_enabled = 0;
+static GPIO_TypeDef *port_list[LED_PORTS];
+static void (*frame_hook)(const uint8_t levels[8]);
+
+/* Perceptual level -> PWM duty, gamma 2.2, non-zero levels stay visible */
+static const uint8_t gamma8[256] = {
+      0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+/* BSRR word that shows frame mask on port p */
+static inline uint32_t port_word(const LED_Port *lp, uint8_t mask) {
+    uint32_t set = lp->set_lo[mask & 0x0F] | lp->set_hi[mask >> 4];
+
+    /* Set bits in the low half, reset bits in the high half */
+    return set | ((lp->all_pins & ~set) << 16);
+}
+
+/* Fill the PWM tables: slot s shows every LED whose duty is above s */
+static void fill_wave(const uint8_t duty[8]) {
+    uint8_t mask = 0;
+
+    for (int j = 0; j < 8; j++) {
+        if (duty[j] != 0) {
+            mask |= (uint8_t)(1u << j);
+        }
+    }
+
+    for (int s = 0; s < LEDPWM_SLOTS; s++) {
+        for (int j = 0; j < 8; j++) {
+            if (duty[j] == s && duty[j] != 255) {
+                mask &= (uint8_t)~(1u << j);
+            }
+        }
+        for (int p = 0; p < led_port_count; p++) {
+            ledpwm_wave(p)[s] = port_word(&led_ports[p], mask);
+        }
+    }
+    if (ledpwm_running()) {
+        ledpwm_commit();
+    }
+}
+
 /**
  * Initialize LED control module
  * Note: GPIO pins configured by MX_GPIO_Init() in main.c
  */
 void leds_init(void) {
+    led_port_count = 0;
+    frame_hook = NULL;
+
+    for (int j = 0; j < 8; j++) {
+        int p = 0;
+
+        while (p < led_port_count && led_ports[p].port != led_pins[j].port) {
+            p++;
+        }
+        if (p == led_port_count) {
+            led_ports[p].port = led_pins[j].port;
+            led_ports[p].all_pins = 0;
+            port_list[p] = led_pins[j].port;
+            led_port_count++;
+        }
+        led_ports[p].all_pins |= led_pins[j].pin;
+    }
+
+    for (int p = 0; p < led_port_count; p++) {
+        for (int n = 0; n < 16; n++) {
+            uint32_t lo = 0;
+            uint32_t hi = 0;
+
+            for (int b = 0; b < 4; b++) {
+                if ((n & (1 << b)) == 0) {
+                    continue;
+                }
+                if (led_pins[b].port == led_ports[p].port) {
+                    lo |= led_pins[b].pin;
+                }
+                if (led_pins[b + 4].port == led_ports[p].port) {
+                    hi |= led_pins[b + 4].pin;
+                }
+            }
+            led_ports[p].set_lo[n] = lo;
+            led_ports[p].set_hi[n] = hi;
+        }
+    }
+
+    current_mask = 0xFFFF;
     leds_clear();
 }
 
 /**
- * Light up LED at position i (1-8), turn off all others
+ * Show a frame: bit n lights LED n+1, all other LEDs off
  */
-void leds_index(int i) {
-    if (i < 1 || i > 8) {
+void leds_set_mask(uint8_t mask) {
+    if (mask == current_mask) {
         return;
     }
+    current_mask = mask;
+    lit_mask = mask;
+
+    if (ledpwm_running()) {
+        ledpwm_stop();
+    }
+
+    for (int p = 0; p < led_port_count; p++) {
+        led_ports[p].port->BSRR = port_word(&led_ports[p], mask);
+    }
+
+    if (frame_hook) {
+        uint8_t levels[8];
+
+        for (int j = 0; j < 8; j++) {
+            levels[j] = (mask & (1u << j)) ? 255 : 0;
+        }
+        frame_hook(levels);
+    }
+}
+
+/**
+ * Show a frame with per-LED brightness
+ */
+void leds_set_levels(const uint8_t levels[8]) {
+    uint8_t mask = 0;
+    uint8_t full = 0;
+    uint8_t duty[8];
 
     for (int j = 0; j < 8; j++) {
-        HAL_GPIO_WritePin(led_pins[j].port, led_pins[j].pin, GPIO_PIN_RESET);
+        duty[j] = gamma8[levels[j]];
+        if (levels[j] != 0) {
+            mask |= (uint8_t)(1u << j);
+        }
+        if (levels[j] == 255 || (!pwm_enabled && levels[j] >= 128)) {
+            full |= (uint8_t)(1u << j);
+        }
+    }
+
+    /* No PWM, or nothing dimmed: a plain frame does it.
+       Without PWM anything at half brightness or more is on. */
+    if (!pwm_enabled || mask == full) {
+        leds_set_mask(full);
+        return;
+    }
+
+    fill_wave(duty);
+    if (!ledpwm_running()) {
+        ledpwm_start(port_list, led_port_count);
+    }
+
+    current_mask = 0xFFFF;  /* not a plain frame, next leds_set_mask() must write */
+    lit_mask = mask;
+    if (frame_hook) {
+        frame_hook(levels);
+    }
+}
+
+/**
+ * Light the ball at position i with a fading trail behind it
+ */
+void leds_trail(int i, int direction) {
+    static const uint8_t trail[3] = {255, 80, 24};
+    uint8_t levels[8] = {0};
+
+    if (i < 1 || i > 8) {
+        return;
     }
 
-    HAL_GPIO_WritePin(led_pins[i-1].port, led_pins[i-1].pin, GPIO_PIN_SET);
+    PROF_BEGIN(LEDS_TRAIL);
+    for (int k = 0; k < 3; k++) {
+        int pos = i - k * direction;
+
+        if (pos >= 1 && pos <= 8) {
+            levels[pos - 1] = trail[k];
+        }
+    }
+    leds_set_levels(levels);
+    PROF_END(LEDS_TRAIL);
+}
+
+/**
+ * Allow or forbid DMA PWM brightness
+ */
+void leds_pwm_enable(int enable) {
+    pwm_enabled = enable ? 1 : 0;
+
+    if (!pwm_enabled && ledpwm_running()) {
+        /* Fall back to the plain frame of everything that was lit */
+        current_mask = 0xFFFF;
+        leds_set_mask(lit_mask);
+    }
+}
+
+/**
+ * Call a function with every new frame
+ */
+void leds_set_frame_hook(void (*hook)(const uint8_t levels[8])) {
+    frame_hook = hook;
+}
+
+/**
+ * Currently displayed frame
+ */
+uint8_t leds_get_mask(void) {
+    return lit_mask;
+}
+
+/**
+ * Light up LED at position i (1-8), turn off all others
+ */
+void leds_index(int i) {
+    if (i < 1 || i > 8) {
+        return;
+    }
+
+    PROF_BEGIN(LEDS_INDEX);
+    leds_set_mask(LED_BIT(i));
+    PROF_END(LEDS_INDEX);
 }
 
 /**
  * Turn off all LEDs
  */
 void leds_clear(void) {
-    for (int i = 0; i < 8; i++) {
-        HAL_GPIO_WritePin(led_pins[i].port, led_pins[i].pin, GPIO_PIN_RESET);
-    }
+    leds_set_mask(0x00);
 }
 
 /**
  * Turn on all LEDs
  */
 void leds_all(void) {
-    for (int i = 0; i < 8; i++) {
-        HAL_GPIO_WritePin(led_pins[i].port, led_pins[i].pin, GPIO_PIN_SET);
-    }
-}
\ No newline at end of file
+    leds_set_mask(0xFF);
+}
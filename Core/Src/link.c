@@ -0,0 +1,218 @@
+/*
+ * link.c
+ *
+ * Board-to-board serial link on USART1, both directions by DMA
+ *
+ * link_send() runs in task context and the transmit completion in the
+ * DMA interrupt; the buffer switch happens with interrupts locked. The
+ * receive DMA is the only writer of the ring and link_read() its only
+ * reader, which takes the write position from the remaining count.
+ */
+
+#include "link.h"
+#include "power.h"
+#include "stm32l4xx_hal.h"
+
+static uint8_t tx[2][LINK_TX];
+static volatile uint16_t tx_len[2];
+static volatile uint8_t fill = 0;       /* buffer link_send() appends to */
+static volatile uint8_t sending = 0;    /* the DMA has the other one */
+static uint32_t overflows = 0;
+
+static uint8_t rx[LINK_RX];
+static uint16_t rx_tail = 0;            /* next byte to take up */
+static void (*rx_hook)(void);
+
+static DMA_HandleTypeDef hdma_tx;
+static DMA_HandleTypeDef hdma_rx;
+
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/* Send the filled buffer, appends go to the other. Interrupts locked. */
+static void start_next(void) {
+    uint8_t b = fill;
+
+    if (tx_len[b] == 0) {
+        return;
+    }
+    fill = (uint8_t)(b ^ 1u);
+    sending = 1;
+    if (HAL_DMA_Start_IT(&hdma_tx, (uint32_t)tx[b], (uint32_t)&USART1->TDR, tx_len[b]) != HAL_OK) {
+        /* Channel in error: drop the buffer rather than stall */
+        tx_len[b] = 0;
+        sending = 0;
+    }
+}
+
+/* Transmit complete (or failed, the bytes are lost either way) */
+static void transfer_done(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    tx_len[fill ^ 1u] = 0;
+    sending = 0;
+    start_next();
+}
+
+/* Half or full ring received */
+static void rx_event(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    if (rx_hook) {
+        rx_hook();
+    }
+}
+
+static void dma_setup(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel, uint32_t direction,
+                      uint32_t mode) {
+    hdma->Instance = channel;
+    hdma->Init.Request = DMA_REQUEST_2;     /* USART1_TX on 6, USART1_RX on 7 */
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.Mode = mode;
+    hdma->Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(hdma) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+/**
+ * Set up USART1 and both DMA channels, hold STOP2 off
+ */
+void link_init(void (*received)(void)) {
+    GPIO_InitTypeDef gpio = {0};
+
+    rx_hook = received;
+
+    __HAL_RCC_USART1_CONFIG(RCC_USART1CLKSOURCE_HSI);
+    __HAL_RCC_USART1_CLK_ENABLE();
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    gpio.Pin = GPIO_PIN_9 | GPIO_PIN_10;
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = GPIO_PULLUP;        /* an unplugged RX idles high */
+    gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    gpio.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+    USART1->CR1 = 0;
+    USART1->BRR = UART_DIV_SAMPLING16(HSI_VALUE, LINK_BAUD);
+    USART1->CR3 = USART_CR3_DMAT | USART_CR3_DMAR;
+
+    dma_setup(&hdma_tx, DMA2_Channel6, DMA_MEMORY_TO_PERIPH, DMA_NORMAL);
+    hdma_tx.XferCpltCallback = transfer_done;
+    hdma_tx.XferErrorCallback = transfer_done;
+
+    dma_setup(&hdma_rx, DMA2_Channel7, DMA_PERIPH_TO_MEMORY, DMA_CIRCULAR);
+    hdma_rx.XferHalfCpltCallback = rx_event;
+    hdma_rx.XferCpltCallback = rx_event;
+
+    tx_len[0] = tx_len[1] = 0;
+    fill = 0;
+    sending = 0;
+    rx_tail = 0;
+    if (HAL_DMA_Start_IT(&hdma_rx, (uint32_t)&USART1->RDR, (uint32_t)rx, LINK_RX) != HAL_OK) {
+        Error_Handler();
+    }
+
+    USART1->ICR = USART_ICR_IDLECF | USART_ICR_ORECF;
+    USART1->CR1 = USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE | USART_CR1_UE;
+
+    HAL_NVIC_SetPriority(DMA2_Channel6_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Channel6_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Channel7_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Channel7_IRQn);
+    HAL_NVIC_SetPriority(USART1_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+
+    power_stop_inhibit(1);
+}
+
+/**
+ * Queue bytes for sending
+ */
+void link_send(const uint8_t *bytes, uint32_t len, void *arg) {
+    (void)arg;
+
+    uint32_t primask = lock();
+    uint8_t b = fill;
+
+    if (tx_len[b] + len > LINK_TX) {
+        overflows++;
+        unlock(primask);
+        return;
+    }
+    for (uint32_t n = 0; n < len; n++) {
+        tx[b][tx_len[b] + n] = bytes[n];
+    }
+    tx_len[b] = (uint16_t)(tx_len[b] + len);
+    if (!sending) {
+        start_next();
+    }
+    unlock(primask);
+}
+
+/**
+ * Take up received bytes
+ */
+uint32_t link_read(uint8_t *buf, uint32_t size) {
+    uint16_t head = (uint16_t)(LINK_RX - __HAL_DMA_GET_COUNTER(&hdma_rx));
+    uint32_t len = 0;
+
+    if (head == LINK_RX) {
+        head = 0;
+    }
+    while (rx_tail != head && len < size) {
+        buf[len++] = rx[rx_tail];
+        rx_tail = (uint16_t)((rx_tail + 1u) % LINK_RX);
+    }
+    return len;
+}
+
+/**
+ * Frames dropped because both transmit buffers were full
+ */
+uint32_t link_overflows(void) {
+    return overflows;
+}
+
+/**
+ * DMA2 Channel 6 interrupt handler hook
+ */
+void link_tx_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_tx);
+}
+
+/**
+ * DMA2 Channel 7 interrupt handler hook
+ */
+void link_rx_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_rx);
+}
+
+/**
+ * USART1 interrupt handler hook
+ */
+void link_uart_irq(void) {
+    uint32_t isr = USART1->ISR;
+
+    if (isr & USART_ISR_IDLE) {
+        USART1->ICR = USART_ICR_IDLECF;
+        if (rx_hook) {
+            rx_hook();
+        }
+    }
+    if (isr & USART_ISR_ORE) {
+        /* A byte lost; the frame fails its CRC and the next INPUT repeats it */
+        USART1->ICR = USART_ICR_ORECF;
+    }
+}
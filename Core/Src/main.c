@@ -22,9 +22,22 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "leds.h"
+#include "ledpwm.h"
 #include "button.h"
+#include "keys.h"
 #include "timer.h"
-#include "score.h"
+#include "timebase.h"
+#include "anim.h"
+#include "power.h"
+#include "clock.h"
+#include "sched.h"
+#include "game.h"
+#include "prof.h"
+#include "telemetry.h"
+#include "console.h"
+#include "mirror.h"
+#include "arena.h"
+#include "tourney.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -54,13 +67,31 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_USART2_UART_Init(void);
 /* USER CODE BEGIN PFP */
-void ping_pong_game(void);
 void test_leds(void);
+static uint32_t game_seed(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 
+/**
+  * @brief  Seed for the serve direction
+  * @note   The 96-bit device UID tells boards apart; the SysTick count
+  *         depends on how long the oscillators took to start, which varies
+  *         from one power-up to the next. The seed is recorded with the
+  *         match, so a replay does not need it to be reproducible.
+  * @retval Seed
+  */
+static uint32_t game_seed(void)
+{
+  const uint32_t *uid = (const uint32_t *)UID_BASE;
+  uint32_t seed = uid[0] ^ (uid[1] * 0x9E3779B9u) ^ (uid[2] * 0x85EBCA6Bu);
+
+  seed ^= SysTick->VAL * 0xC2B2AE35u;
+  seed ^= (uint32_t)timebase_us();
+  return seed;
+}
+
 /* USER CODE END 0 */
 
 /**
@@ -94,13 +125,33 @@ int main(void)
   MX_GPIO_Init();
   MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
+  clock_init();
+  timebase_init();
+  power_init();
+  timer_wheel_init();
   leds_init();
+  ledpwm_init();
+  leds_pwm_enable(1);
   button_init();
+  keys_init();
+  telemetry_init();
+  sched_init();
+#if MIRROR_ENABLE
+  mirror_init();
+#endif
 
   /* Uncomment test_leds() to run LED test instead of game */
   /* test_leds(); */
 
-  ping_pong_game();
+  game_init(game_seed());
+  console_init();
+#if TOURNEY
+  arena_init();
+#endif
+#if PROF_ENABLE
+  prof_init();
+#endif
+  telemetry_start();
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -110,6 +161,7 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    sched_dispatch();
   }
   /* USER CODE END 3 */
 }
@@ -255,17 +307,17 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 
-  /* Configure button pins as inputs with pull-up (ping-pong board) */
+  /* Configure button pins as EXTI inputs with pull-up (ping-pong board) */
 
-  /* Right button on PC8 */
+  /* Right button on PC8 (EXTI line 8) */
   GPIO_InitStruct.Pin = GPIO_PIN_8;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 
-  /* Left button on PB15 */
+  /* Left button on PB15 (EXTI line 15) */
   GPIO_InitStruct.Pin = GPIO_PIN_15;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
@@ -274,248 +326,60 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_WritePin(GPIOA, GPIO_PIN_11 | GPIO_PIN_12, GPIO_PIN_RESET);
   HAL_GPIO_WritePin(GPIOC, GPIO_PIN_5 | GPIO_PIN_6, GPIO_PIN_RESET);
 
+  /* Button EXTI interrupts, below SysTick so timer_ticks() timestamps are consistent */
+  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+  HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+
   /* USER CODE END MX_GPIO_Init_2 */
 }
 
 /* USER CODE BEGIN 4 */
 
-/* See GAME_GUIDE.md for game rules and instructions */
-
-/* Game configuration constants */
-#define WINNING_SCORE 5
-#define INITIAL_SPEED 200
-#define MIN_SPEED 100
-#define SPEED_DECREASE 20
-#define SCORE_DISPLAY_TIME 2000
-
-typedef enum
-{
-  GAME_START,
-  BALL_MOVING_RIGHT,
-  BALL_MOVING_LEFT,
-  POINT_SCORED,
-  GAME_OVER
-} GameState;
-
 /**
- * Main ping-pong game loop (never returns)
+ * EXTI callback, starts the key sampler (or hands the edge to the button
+ * module) and wakes the input task
  */
-void ping_pong_game(void)
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
-  GameState state = GAME_START;
-  int ball_position = 4;
-  int ball_direction = 1;
-  uint32_t ball_speed = INITIAL_SPEED;
-  uint8_t left_score = 0;
-  uint8_t right_score = 0;
-  int button_pressed = 0;
-
-  leds_clear();
-  HAL_Delay(500);
-
-  /* Flash LEDs to signal game start */
-  for (int i = 0; i < 3; i++)
-  {
-    leds_all();
-    HAL_Delay(200);
-    leds_clear();
-    HAL_Delay(200);
-  }
-
-  HAL_Delay(500);
-
-  while (1)
-  {
-    switch (state)
-    {
-
-    case GAME_START:
-      ball_position = 4;
-
-      if ((HAL_GetTick() % 2) == 0)
-      {
-        ball_direction = 1;
-        state = BALL_MOVING_RIGHT;
-      }
-      else
-      {
-        ball_direction = -1;
-        state = BALL_MOVING_LEFT;
-      }
-
-      ball_speed = INITIAL_SPEED;
-      break;
-
-    case BALL_MOVING_RIGHT:
-      leds_index(ball_position);
-      timer_init(ball_speed);
-
-      while (!timer_now())
-      {
-        button_pressed = button_read();
-
-        if (button_pressed == RIGHT_BUTTON && ball_position == 8)
-        {
-          ball_direction = -1;
-          state = BALL_MOVING_LEFT;
-
-          if (ball_speed > MIN_SPEED)
-          {
-            ball_speed -= SPEED_DECREASE;
-          }
-
-          break;
-        }
-      }
-
-      if (state == BALL_MOVING_RIGHT)
-      {
-        ball_position++;
-
-        if (ball_position > 8)
-        {
-          left_score++;
-          state = POINT_SCORED;
-
-          for (int i = 0; i < 3; i++)
-          {
-            leds_all();
-            HAL_Delay(100);
-            leds_clear();
-            HAL_Delay(100);
-          }
-        }
-      }
-      break;
-
-    case BALL_MOVING_LEFT:
-      leds_index(ball_position);
-      timer_init(ball_speed);
-
-      while (!timer_now())
-      {
-        button_pressed = button_read();
-
-        if (button_pressed == LEFT_BUTTON && ball_position == 1)
-        {
-          ball_direction = 1;
-          state = BALL_MOVING_RIGHT;
-
-          if (ball_speed > MIN_SPEED)
-          {
-            ball_speed -= SPEED_DECREASE;
-          }
-
-          break;
-        }
-      }
-
-      if (state == BALL_MOVING_LEFT)
-      {
-        ball_position--;
-
-        if (ball_position < 1)
-        {
-          right_score++;
-          state = POINT_SCORED;
-
-          for (int i = 0; i < 3; i++)
-          {
-            leds_all();
-            HAL_Delay(100);
-            leds_clear();
-            HAL_Delay(100);
-          }
-        }
-      }
-      break;
-
-    case POINT_SCORED:
-      show_score(right_score, left_score, SCORE_DISPLAY_TIME);
-
-      if (left_score >= WINNING_SCORE)
-      {
-        show_winner(0, 3000);
-        state = GAME_OVER;
-      }
-      else if (right_score >= WINNING_SCORE)
-      {
-        show_winner(1, 3000);
-        state = GAME_OVER;
-      }
-      else
-      {
-        state = GAME_START;
-      }
-      break;
-
-    case GAME_OVER:
-      HAL_Delay(1000);
-      show_score(right_score, left_score, 3000);
-
-      left_score = 0;
-      right_score = 0;
-      state = GAME_START;
-
-      HAL_Delay(2000);
-
-      for (int i = 0; i < 2; i++)
-      {
-        leds_all();
-        HAL_Delay(300);
-        leds_clear();
-        HAL_Delay(300);
-      }
-      break;
-
-    default:
-      state = GAME_START;
-      break;
-    }
-  }
+#if KEYS_SAMPLED
+  (void)GPIO_Pin;
+  keys_wake();
+#else
+  button_irq(GPIO_Pin);
+#endif
+  game_input_irq();
 }
 
+/* LED hardware test patterns */
+static const AnimFrame test_frames[] = {
+  {0x01, 0, 500}, {0x02, 0, 500}, {0x04, 0, 500}, {0x08, 0, 500},
+  {0x10, 0, 500}, {0x20, 0, 500}, {0x40, 0, 500}, {0x80, 0, 500},
+  {0x00, 0, 500},
+  {0x01, 0, 100}, {0x02, 0, 100}, {0x04, 0, 100}, {0x08, 0, 100},
+  {0x10, 0, 100}, {0x20, 0, 100}, {0x40, 0, 100}, {0x80, 0, 100},
+  {0x80, 0, 100}, {0x40, 0, 100}, {0x20, 0, 100}, {0x10, 0, 100},
+  {0x08, 0, 100}, {0x04, 0, 100}, {0x02, 0, 100}, {0x01, 0, 100},
+  {0x00, 0, 500},
+  {0xFF, 0, 300}, {0x00, 0, 300},
+  {0xFF, 0, 300}, {0x00, 0, 300},
+  {0xFF, 0, 300}, {0x00, 0, 1300}
+};
+static ANIM_DEFINE(test_anim, test_frames, ANIM_LOOP);
+
 /**
  * LED hardware test function - cycles through test patterns
- * To use: Call test_leds() instead of ping_pong_game() in main()
+ * To use: Call test_leds() instead of game_init() in main()
  */
 void test_leds(void)
 {
+  anim_play(&test_anim, 0, 0);
+
   while (1)
   {
-    for (int i = 1; i <= 8; i++)
-    {
-      leds_index(i);
-      HAL_Delay(500);
-    }
-
-    leds_clear();
-    HAL_Delay(500);
-
-    for (int i = 1; i <= 8; i++)
-    {
-      leds_index(i);
-      HAL_Delay(100);
-    }
-
-    for (int i = 8; i >= 1; i--)
-    {
-      leds_index(i);
-      HAL_Delay(100);
-    }
-
-    leds_clear();
-    HAL_Delay(500);
-
-    for (int i = 0; i < 3; i++)
-    {
-      leds_all();
-      HAL_Delay(300);
-      leds_clear();
-      HAL_Delay(300);
-    }
-
-    HAL_Delay(1000);
+    anim_update();
+    power_idle_until(POWER_NO_DEADLINE);
   }
 }
 
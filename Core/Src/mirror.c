@@ -0,0 +1,133 @@
+/*
+ * mirror.c
+ *
+ * Live copy of the LED frames as telemetry
+ *
+ * The frame hook runs wherever leds.c is called from, always task context:
+ * it sends at once when the rate allows, and otherwise keeps the frame for
+ * the mirror task, which sends the latest one when the time comes.
+ */
+
+#include "mirror.h"
+#include "mirror_codec.h"
+#include "leds.h"
+#include "sched.h"
+#include "telemetry.h"
+#include "timebase.h"
+
+#define MIRROR_DEADLINE_US  2000
+
+static MirrorCodec codec;
+static uint8_t latest[MIRROR_LEDS];     /* frame on the LEDs */
+static uint64_t latest_at = 0;          /* when it went up */
+static uint8_t pending = 0;             /* latest not sent yet */
+static uint8_t need_key = 1;            /* the viewer may have lost track */
+static uint64_t next_at = 0;            /* earliest time for a record */
+static uint64_t key_at = 0;             /* periodic key frame due */
+static uint32_t frames = 0;
+static uint32_t merged = 0;
+
+static void mirror_run(void *arg);
+
+static Task mirror_task = {
+    .name = "mirror", .run = mirror_run, .deadline_us = MIRROR_DEADLINE_US
+};
+
+/* Send the latest frame, as a key when one is due */
+static void send(uint64_t now) {
+    uint8_t payload[MIRROR_PAYLOAD_MAX];
+    int key = need_key || now >= key_at;
+    uint64_t at = pending ? latest_at : now;    /* a periodic key is of now */
+    uint8_t len = mirror_encode(&codec, latest, key, payload);
+
+    pending = 0;
+    if (len == 0) {
+        return;
+    }
+    if (!telemetry_send(TLM_LEDS, at, payload, len)) {
+        need_key = 1;
+        next_at = now + TELEMETRY_RETRY_US;
+        return;
+    }
+    frames++;
+    next_at = now + MIRROR_RECORD_US(len);
+    if (key) {
+        need_key = 0;
+        key_at = now + MIRROR_KEY_US;
+    }
+}
+
+static void wake(void) {
+    uint64_t at = key_at;
+
+    if ((pending || need_key) && next_at < at) {
+        at = next_at;
+    }
+    sched_wake_at(&mirror_task, at);
+}
+
+/* Every frame leds.c puts up */
+static void frame(const uint8_t levels[8]) {
+    uint64_t now = timebase_us();
+
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        latest[n] = levels[n];
+    }
+    latest_at = now;
+    if (pending) {
+        merged++;
+    }
+    pending = 1;
+    if (now >= next_at) {
+        send(now);
+    }
+    wake();
+}
+
+/* Mirror task: a frame held back by the rate limit, the periodic key */
+static void mirror_run(void *arg) {
+    uint64_t now = timebase_us();
+
+    (void)arg;
+    if (((pending || need_key) && now >= next_at) || now >= key_at) {
+        send(now);
+    }
+    wake();
+}
+
+/**
+ * Hook the LED frames and add the mirror task
+ */
+void mirror_init(void) {
+    uint8_t mask = leds_get_mask();
+
+    mirror_codec_reset(&codec);
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        latest[n] = (mask & (1u << n)) ? 255 : 0;
+    }
+    latest_at = timebase_us();
+    pending = 1;
+    need_key = 1;
+    next_at = 0;
+    key_at = latest_at;
+    frames = 0;
+    merged = 0;
+
+    sched_add(&mirror_task);
+    leds_set_frame_hook(frame);
+    sched_signal(&mirror_task);
+}
+
+/**
+ * Records sent, keys included
+ */
+uint32_t mirror_frames(void) {
+    return frames;
+}
+
+/**
+ * Frames merged into a later one by the rate limit
+ */
+uint32_t mirror_merged(void) {
+    return merged;
+}
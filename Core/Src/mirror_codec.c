@@ -0,0 +1,155 @@
+/*
+ * mirror_codec.c
+ *
+ * LED frame encoding of the mirror stream, free of hardware
+ */
+
+#include "mirror_codec.h"
+
+/**
+ * Forget the previous frame
+ */
+void mirror_codec_reset(MirrorCodec *c) {
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        c->levels[n] = 0;
+    }
+    c->valid = 0;
+}
+
+static uint8_t encode_key(const uint8_t levels[MIRROR_LEDS], uint8_t *out) {
+    uint8_t len = 0;
+
+    out[len++] = MIRROR_KEY;
+    for (uint8_t n = 0; n < MIRROR_LEDS;) {
+        uint8_t run = 1;
+
+        while (n + run < MIRROR_LEDS && levels[n + run] == levels[n]) {
+            run++;
+        }
+        out[len++] = run;
+        out[len++] = levels[n];
+        n = (uint8_t)(n + run);
+    }
+    return len;
+}
+
+/* Groups of changed LEDs; returns 1 + bytes, or 1 for no change */
+static uint8_t encode_delta(const uint8_t *prev, const uint8_t *levels, uint8_t *out) {
+    uint8_t len = 0;
+    uint8_t from = 0;           /* end of the previous group */
+
+    out[len++] = MIRROR_DELTA;
+    for (uint8_t n = 0; n < MIRROR_LEDS;) {
+        if (levels[n] == prev[n]) {
+            n++;
+            continue;
+        }
+
+        uint8_t count = 1;
+
+        while (n + count < MIRROR_LEDS && levels[n + count] != prev[n + count]) {
+            count++;
+        }
+        out[len++] = (uint8_t)((n - from) << 4 | count);
+        for (uint8_t k = 0; k < count; k++) {
+            out[len++] = levels[n + k];
+        }
+        n = (uint8_t)(n + count);
+        from = n;
+    }
+    return len;
+}
+
+/**
+ * Encode a frame against the previous one
+ */
+uint8_t mirror_encode(MirrorCodec *c, const uint8_t levels[MIRROR_LEDS], int key, uint8_t *out) {
+    uint8_t len;
+
+    if (key || !c->valid) {
+        len = encode_key(levels, out);
+    } else {
+        uint8_t delta[MIRROR_PAYLOAD_MAX];
+        uint8_t delta_len = encode_delta(c->levels, levels, delta);
+
+        if (delta_len == 1) {
+            return 0;
+        }
+        len = encode_key(levels, out);
+        if (delta_len < len) {
+            for (uint8_t n = 0; n < delta_len; n++) {
+                out[n] = delta[n];
+            }
+            len = delta_len;
+        }
+    }
+
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        c->levels[n] = levels[n];
+    }
+    c->valid = 1;
+    return len;
+}
+
+/* The frame a payload makes of the previous one, 0 if malformed */
+static int parse(const MirrorCodec *c, const uint8_t *payload, uint8_t len, uint8_t *next) {
+    uint8_t at = 0;             /* LED the next run or group starts on */
+    uint8_t i = 1;
+
+    if (len < 2) {
+        return 0;
+    }
+
+    if (payload[0] == MIRROR_KEY) {
+        while (i + 1u < len) {
+            uint8_t run = payload[i];
+
+            if (run == 0 || at + run > MIRROR_LEDS) {
+                return 0;
+            }
+            for (uint8_t k = 0; k < run; k++) {
+                next[at++] = payload[i + 1u];
+            }
+            i = (uint8_t)(i + 2u);
+        }
+        return i == len && at == MIRROR_LEDS;
+    }
+    if (payload[0] != MIRROR_DELTA || !c->valid) {
+        return 0;
+    }
+
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        next[n] = c->levels[n];
+    }
+    while (i < len) {
+        uint8_t skip = payload[i] >> 4;
+        uint8_t count = payload[i] & 0x0Fu;
+
+        at = (uint8_t)(at + skip);
+        if (count == 0 || at + count > MIRROR_LEDS || i + 1u + count > len) {
+            return 0;
+        }
+        for (uint8_t k = 0; k < count; k++) {
+            next[at++] = payload[i + 1u + k];
+        }
+        i = (uint8_t)(i + 1u + count);
+    }
+    return 1;
+}
+
+/**
+ * Decode a TLM_LEDS payload; after a bad one, wait for a key
+ */
+int mirror_decode(MirrorCodec *c, const uint8_t *payload, uint8_t len) {
+    uint8_t next[MIRROR_LEDS];
+
+    if (!parse(c, payload, len, next)) {
+        c->valid = 0;
+        return 0;
+    }
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        c->levels[n] = next[n];
+    }
+    c->valid = 1;
+    return 1;
+}
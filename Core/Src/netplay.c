@@ -0,0 +1,405 @@
+/*
+ * netplay.c
+ *
+ * Two-board match over a serial link, free of hardware
+ */
+
+#include "netplay.h"
+#include "cobs.h"
+#include "speed_curve.h"
+#include <stddef.h>
+
+/* Frame types */
+enum {
+    NET_HELLO = 1,      /* id u32 */
+    NET_SYNC_REQ,       /* t1 u64, right board timebase */
+    NET_SYNC,           /* t1 u64, t2 u64 shared clock */
+    NET_READY,          /* right board matched its clock */
+    NET_START,          /* seed u32, start u64, pacing */
+    NET_INPUT,          /* ack u8, confirmed u64, seq u8, count u8,
+                           count x (event u8, at u64) */
+};
+
+#define NO_PROFILE  0xFF
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int n = 0; n < 4; n++) {
+        p[n] = (uint8_t)(v >> (8 * n));
+    }
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static uint64_t shared(const Netplay *np, uint64_t local) {
+    return (uint64_t)((int64_t)local + np->offset_us);
+}
+
+/* Add the CRC, encode and hand to the transport */
+static void send_frame(Netplay *np, uint8_t *frame, uint32_t len) {
+    uint8_t encoded[COBS_MAX(NETPLAY_FRAME_MAX) + 1];
+
+    frame[len] = crc8(frame, len);
+
+    uint32_t size = cobs_encode(frame, len + 1u, encoded);
+
+    encoded[size++] = 0;
+    np->send(encoded, size, np->send_arg);
+}
+
+static void send_hello(Netplay *np) {
+    uint8_t f[NETPLAY_FRAME_MAX];
+
+    f[0] = NET_HELLO;
+    put32(f + 1, np->id);
+    send_frame(np, f, 5);
+}
+
+static void send_start(Netplay *np) {
+    const GameConfig *c = &np->config;
+    uint8_t f[NETPLAY_FRAME_MAX];
+    uint8_t profile = NO_PROFILE;
+
+    for (uint8_t p = 0; p < SPEED_PROFILE_COUNT; p++) {
+        if (c->speed_curve == speed_curves[p]) {
+            profile = p;
+        }
+    }
+
+    f[0] = NET_START;
+    put32(f + 1, np->seed);
+    put64(f + 5, np->start_us);
+    f[13] = c->winning_score;
+    put32(f + 14, c->initial_speed_us);
+    put32(f + 18, c->min_speed_us);
+    put32(f + 22, c->speed_decrease_us);
+    put32(f + 26, c->hit_early_us);
+    put32(f + 30, c->hit_late_us);
+    f[34] = profile;
+    send_frame(np, f, 35);
+}
+
+static void send_input(Netplay *np) {
+    uint8_t f[NETPLAY_FRAME_MAX];
+    uint32_t len = 12;
+
+    f[0] = NET_INPUT;
+    f[1] = np->in_seq;
+    put64(f + 2, np->confirmed_us);
+    f[10] = np->out_seq;
+    f[11] = np->out_count;
+    for (uint8_t n = 0; n < np->out_count; n++) {
+        f[len] = np->outbox[n].event;
+        put64(f + len + 1, np->outbox[n].at_us);
+        len += 9;
+    }
+    send_frame(np, f, len);
+    np->send_now = 0;
+}
+
+static void start(Netplay *np, uint64_t start_us) {
+    np->start_us = start_us;
+    np->out_count = 0;
+    np->out_seq = 0;
+    np->in_seq = 0;
+    np->confirmed_us = start_us;
+    np->peer_confirmed_us = start_us;
+    np->phase = NETPLAY_PHASE_PLAYING;
+    rollback_reset(&np->rb, &np->config, np->seed, start_us, np->rb.show_ms);
+}
+
+/* Right board: one clock sample, kept if its round trip is the shortest
+   so far (the bound on its error is half the round trip) */
+static void sync_sample(Netplay *np, uint64_t t1, uint64_t t2, uint64_t now) {
+    if (now < t1 || np->side != NETPLAY_RIGHT) {
+        return;
+    }
+
+    uint32_t rtt = (uint32_t)(now - t1);
+
+    /* Let the best round trip age, so a drifting offset is picked up */
+    if (np->best_rtt_us < UINT32_MAX - 100u) {
+        np->best_rtt_us += 100u;
+    }
+    if (rtt <= np->best_rtt_us) {
+        np->best_rtt_us = rtt;
+        np->offset_us = (int64_t)t2 - (int64_t)(t1 + rtt / 2u);
+    }
+    if (np->samples < UINT8_MAX) {
+        np->samples++;
+    }
+}
+
+/* Presses from the peer, in sequence; the confirmed time only counts when
+   none is missing */
+static void take_input(Netplay *np, const uint8_t *f, uint32_t len) {
+    uint8_t ack = f[1];
+    uint64_t confirmed = get64(f + 2);
+    uint8_t seq = f[10];
+    uint8_t count = f[11];
+    uint8_t acked = (uint8_t)(ack - np->out_seq);
+
+    if (len != 12u + 9u * count) {
+        np->rx_bad++;
+        return;
+    }
+
+    if (acked <= np->out_count) {
+        for (uint8_t n = acked; n < np->out_count; n++) {
+            np->outbox[n - acked] = np->outbox[n];
+        }
+        np->out_count -= acked;
+        np->out_seq = ack;
+    }
+
+    for (uint8_t n = 0; n < count; n++) {
+        uint8_t s = (uint8_t)(seq + n);
+        uint8_t event = f[12 + 9 * n];
+
+        if (s != np->in_seq || (event != GAME_EV_PRESS_LEFT && event != GAME_EV_PRESS_RIGHT)) {
+            continue;
+        }
+        rollback_input(&np->rb, event, get64(f + 13 + 9 * n));
+        np->in_seq++;
+    }
+
+    if ((uint8_t)(seq + count) == np->in_seq && confirmed > np->peer_confirmed_us) {
+        np->peer_confirmed_us = confirmed;
+    }
+}
+
+static void take_frame(Netplay *np, const uint8_t *f, uint32_t len, uint64_t now) {
+    uint8_t out[NETPLAY_FRAME_MAX];
+
+    switch (f[0]) {
+    case NET_HELLO:
+        if (len == 5 && np->phase == NETPLAY_PHASE_HELLO && get32(f + 1) != np->id) {
+            np->peer_id = get32(f + 1);
+            np->side = (np->id < np->peer_id) ? NETPLAY_LEFT : NETPLAY_RIGHT;
+            np->phase = NETPLAY_PHASE_SYNC;
+            if (np->side == NETPLAY_RIGHT) {
+                np->next_sync = now;
+            } else {
+                np->offset_us = 0;
+            }
+        }
+        break;
+
+    case NET_SYNC_REQ:
+        if (len == 9 && np->side == NETPLAY_LEFT && np->phase != NETPLAY_PHASE_HELLO) {
+            out[0] = NET_SYNC;
+            for (int n = 0; n < 8; n++) {
+                out[1 + n] = f[1 + n];
+            }
+            put64(out + 9, shared(np, now));
+            send_frame(np, out, 17);
+        }
+        break;
+
+    case NET_SYNC:
+        if (len == 17) {
+            sync_sample(np, get64(f + 1), get64(f + 9), now);
+        }
+        break;
+
+    case NET_READY:
+        if (np->side == NETPLAY_LEFT && np->phase == NETPLAY_PHASE_SYNC) {
+            start(np, shared(np, now) + NETPLAY_START_US);
+        }
+        if (np->side == NETPLAY_LEFT && np->phase == NETPLAY_PHASE_PLAYING) {
+            send_start(np);
+        }
+        break;
+
+    case NET_START:
+        if (len == 35 && np->side == NETPLAY_RIGHT && np->phase == NETPLAY_PHASE_SYNC) {
+            np->seed = get32(f + 1);
+            np->config.winning_score = f[13];
+            np->config.initial_speed_us = get32(f + 14);
+            np->config.min_speed_us = get32(f + 18);
+            np->config.speed_decrease_us = get32(f + 22);
+            np->config.hit_early_us = get32(f + 26);
+            np->config.hit_late_us = get32(f + 30);
+            np->config.speed_curve = (f[34] < SPEED_PROFILE_COUNT) ? speed_curves[f[34]] : NULL;
+            start(np, get64(f + 5));
+        }
+        break;
+
+    case NET_INPUT:
+        if (len >= 12 && np->phase == NETPLAY_PHASE_PLAYING) {
+            take_input(np, f, len);
+        }
+        break;
+
+    default:
+        np->rx_bad++;
+        break;
+    }
+}
+
+/**
+ * Start looking for a peer
+ */
+void netplay_init(Netplay *np, uint32_t id, uint32_t seed, const GameConfig *config,
+                  uint32_t (*show_ms)(const Game *game),
+                  void (*send)(const uint8_t *bytes, uint32_t len, void *arg), void *arg,
+                  uint64_t now) {
+    np->phase = NETPLAY_PHASE_HELLO;
+    np->side = NETPLAY_LEFT;
+    np->id = id;
+    np->peer_id = 0;
+    np->seed = seed;
+    np->offset_us = 0;
+    np->best_rtt_us = UINT32_MAX;
+    np->samples = 0;
+    np->config = *config;
+    np->config.field_leds = 2 * GAME_LEDS;
+    np->out_count = 0;
+    np->send_now = 0;
+    np->next_hello = now;
+    np->next_sync = GAME_NO_STEP;
+    np->next_beat = now;
+    np->rx_len = 0;
+    np->rx_over = 0;
+    np->send = send;
+    np->send_arg = arg;
+    np->rx_bad = 0;
+    np->stalls = 0;
+    np->lost = 0;
+
+    /* The intro plays until the match starts */
+    rollback_reset(&np->rb, &np->config, seed, now, show_ms);
+}
+
+/**
+ * Take up received bytes
+ */
+void netplay_receive(Netplay *np, const uint8_t *bytes, uint32_t len, uint64_t now) {
+    uint8_t frame[NETPLAY_FRAME_MAX + 2];
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (bytes[i] != 0) {
+            if (np->rx_len < sizeof(np->rx)) {
+                np->rx[np->rx_len++] = bytes[i];
+            } else {
+                np->rx_over = 1;
+            }
+            continue;
+        }
+
+        int32_t size = (np->rx_len != 0 && !np->rx_over) ? cobs_decode(np->rx, np->rx_len, frame) : -1;
+
+        if (size >= 2 && crc8(frame, (uint32_t)size - 1u) == frame[size - 1]) {
+            take_frame(np, frame, (uint32_t)size - 1u, now);
+        } else if (np->rx_len != 0) {
+            np->rx_bad++;
+        }
+        np->rx_len = 0;
+        np->rx_over = 0;
+    }
+}
+
+/**
+ * A press on this board
+ */
+void netplay_press(Netplay *np, uint64_t at) {
+    if (np->phase != NETPLAY_PHASE_PLAYING) {
+        return;
+    }
+    if (np->out_count == NETPLAY_UNACKED) {
+        np->lost++;
+        return;
+    }
+
+    RollbackInput *in = &np->outbox[np->out_count++];
+
+    in->event = (np->side == NETPLAY_LEFT) ? GAME_EV_PRESS_LEFT : GAME_EV_PRESS_RIGHT;
+    in->at_us = shared(np, at);
+    if (in->at_us <= np->confirmed_us) {
+        in->at_us = np->confirmed_us + 1u;  /* never behind what we vouched for */
+    }
+    rollback_input(&np->rb, in->event, in->at_us);
+    np->send_now = 1;
+}
+
+/**
+ * Send what is due and run the game
+ */
+uint64_t netplay_run(Netplay *np, uint64_t now) {
+    uint8_t f[NETPLAY_FRAME_MAX];
+    uint64_t wake;
+
+    if (np->phase != NETPLAY_PHASE_PLAYING && now >= np->next_hello) {
+        send_hello(np);
+        np->next_hello = now + NETPLAY_HELLO_US;
+    }
+
+    if (np->phase != NETPLAY_PHASE_HELLO && np->side == NETPLAY_RIGHT && now >= np->next_sync) {
+        if (np->phase == NETPLAY_PHASE_SYNC && np->samples >= NETPLAY_SYNCS) {
+            f[0] = NET_READY;
+            send_frame(np, f, 1);
+        }
+        f[0] = NET_SYNC_REQ;
+        put64(f + 1, now);
+        send_frame(np, f, 9);
+        np->next_sync = now + ((np->phase == NETPLAY_PHASE_PLAYING) ? NETPLAY_RESYNC_US
+                                                                     : NETPLAY_HELLO_US / 4u);
+    }
+
+    /* The game holds its intro until the match starts */
+    if (np->phase != NETPLAY_PHASE_PLAYING) {
+        return (np->next_hello < np->next_sync) ? np->next_hello : np->next_sync;
+    }
+
+    uint64_t shared_now = shared(np, now);
+
+    if (shared_now > np->confirmed_us) {
+        np->confirmed_us = shared_now;
+    }
+    if (np->send_now || now >= np->next_beat) {
+        send_input(np);
+        np->next_beat = now + NETPLAY_BEAT_US;
+    }
+
+    /* Run behind the clock by the input delay, and no further than the
+       peer can still roll us back */
+    uint64_t until = (shared_now > NETPLAY_DELAY_US) ? shared_now - NETPLAY_DELAY_US : 0;
+    uint64_t limit = np->peer_confirmed_us + ROLLBACK_WINDOW_US;
+    uint8_t stalled = until > limit;
+
+    if (stalled) {
+        until = limit;
+        np->stalls++;
+    }
+    rollback_advance(&np->rb, until);
+
+    wake = (np->next_beat < np->next_sync) ? np->next_beat : np->next_sync;
+
+    /* Stalled, the peer's next INPUT is what moves the game on */
+    uint64_t next = stalled ? GAME_NO_STEP : rollback_next_at(&np->rb);
+
+    if (next != GAME_NO_STEP) {
+        next = netplay_local(np, next + NETPLAY_DELAY_US);
+        if (next < wake) {
+            wake = next;
+        }
+    }
+    return wake;
+}
+
+/**
+ * Local timebase time of a shared clock time
+ */
+uint64_t netplay_local(const Netplay *np, uint64_t shared_us) {
+    return (uint64_t)((int64_t)shared_us - np->offset_us);
+}
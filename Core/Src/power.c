@@ -0,0 +1,189 @@
+/*
+ * power.c
+ *
+ * Tickless low-power idle
+ */
+
+#include "power.h"
+#include "timer.h"
+#include "timebase.h"
+#include "ledpwm.h"
+#include "clock.h"
+#include "stm32l4xx_hal.h"
+
+#define SLEEP_TICKLESS_MIN_US  2000     /* shorter waits keep SysTick */
+#define STOP2_MIN_MS           5        /* shorter waits use Sleep mode */
+#define LPTIM_MAX_MS           0xFFFF   /* 16-bit counter at 1 kHz */
+
+static volatile uint8_t stop_inhibit = 0;
+static uint8_t power_ready = 0;
+static uint32_t carry_us = 0;           /* time not yet turned into ticks */
+
+/* Read the asynchronous LPTIM counter: two equal reads in a row */
+static uint32_t lptim_count(void) {
+    uint32_t a, b;
+
+    do {
+        a = LPTIM1->CNT;
+        b = LPTIM1->CNT;
+    } while (a != b);
+
+    return a;
+}
+
+/* One-shot LPTIM1 wake-up after ms milliseconds */
+static void lptim_arm(uint32_t ms) {
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF | LPTIM_ICR_ARRMCF;
+    LPTIM1->ARR = ms;
+    while (!(LPTIM1->ISR & LPTIM_ISR_ARROK)) {
+    }
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR = LPTIM_CR_ENABLE | LPTIM_CR_SNGSTRT;
+}
+
+/* Stop LPTIM1 and return the milliseconds it counted */
+static uint32_t lptim_disarm(uint32_t armed_ms) {
+    uint32_t elapsed = (LPTIM1->ISR & LPTIM_ISR_ARRM) ? armed_ms : lptim_count();
+
+    LPTIM1->ICR = LPTIM_ICR_ARRMCF;
+    LPTIM1->CR = 0;
+    return elapsed;
+}
+
+/* Feed slept time into the HAL tick and the timer wheel */
+static void catch_up(uint64_t slept_us) {
+    uint64_t total = slept_us + carry_us;
+    uint32_t ticks = (uint32_t)(total / 1000u);
+
+    carry_us = (uint32_t)(total % 1000u);
+    uwTick += ticks;
+    timer_advance(ticks);
+}
+
+/**
+ * Start LSI and configure LPTIM1 as STOP2 wake-up timer
+ */
+void power_init(void) {
+    RCC->CSR |= RCC_CSR_LSION;
+    while (!(RCC->CSR & RCC_CSR_LSIRDY)) {
+    }
+
+    /* LPTIM1 kernel clock = LSI, keeps running in STOP2 */
+    MODIFY_REG(RCC->CCIPR, RCC_CCIPR_LPTIM1SEL, RCC_CCIPR_LPTIM1SEL_0);
+    __HAL_RCC_LPTIM1_CLK_ENABLE();
+
+    LPTIM1->CR = 0;
+    LPTIM1->CFGR = LPTIM_CFGR_PRESC_2 | LPTIM_CFGR_PRESC_0;    /* /32 -> 1 kHz */
+    LPTIM1->IER = LPTIM_IER_ARRMIE;
+
+    /* LPTIM1 wake-up reaches the NVIC through EXTI line 32 */
+    EXTI->IMR2 |= EXTI_IMR2_IM32;
+    HAL_NVIC_SetPriority(LPTIM1_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+
+    /* Come out of STOP2 on HSI16, the PLL source, for a fast restore;
+       clock_set_profile() changes this to MSI for the idle profile */
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI);
+
+    power_ready = 1;
+}
+
+/**
+ * Sleep until a deadline, the next timer expiry or an interrupt
+ */
+void power_idle_until(uint64_t deadline_us) {
+    /* Interrupts stay pending until time is caught up, so ISRs timestamp
+       with a correct clock; WFI still wakes on them */
+    __disable_irq();
+
+    uint64_t now = timebase_us();
+    uint64_t wake = deadline_us;
+    uint32_t ticks;
+
+    if (timer_next_expiry(&ticks)) {
+        /* Tick boundary position is unknown to within 1 ms, round down */
+        uint64_t tick_wake = now + (uint64_t)ticks * 1000u - carry_us;
+
+        if (tick_wake < wake) {
+            wake = tick_wake;
+        }
+    }
+
+    if (wake <= now) {
+        __enable_irq();
+        return;
+    }
+
+    uint64_t span = wake - now;
+
+    if (span < SLEEP_TICKLESS_MIN_US) {
+        /* Too short to bother: plain Sleep, SysTick wakes us */
+        timebase_alarm(wake);
+        __WFI();
+        __enable_irq();
+        return;
+    }
+
+    HAL_SuspendTick();
+
+    uint32_t span_ms = (uint32_t)(span / 1000u);
+
+    if (!stop_inhibit && !ledpwm_running() && span_ms >= STOP2_MIN_MS) {
+        uint32_t armed = (span_ms > LPTIM_MAX_MS) ? LPTIM_MAX_MS : span_ms;
+
+        lptim_arm(armed);
+        HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+        clock_restore();
+        timebase_advance((uint64_t)lptim_disarm(armed) * 1000u);
+    } else {
+        timebase_alarm(wake);
+        HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    }
+
+    catch_up(timebase_us() - now);
+    HAL_ResumeTick();
+    __enable_irq();
+}
+
+/**
+ * Forbid or allow STOP2 (nestable)
+ */
+void power_stop_inhibit(int inhibit) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (inhibit) {
+        stop_inhibit++;
+    } else if (stop_inhibit > 0) {
+        stop_inhibit--;
+    }
+    __set_PRIMASK(primask);
+}
+
+/**
+ * LPTIM1 interrupt handler hook, the wake-up itself is all we need
+ */
+void power_lptim_irq(void) {
+    LPTIM1->ICR = LPTIM_ICR_ARRMCF;
+}
+
+/**
+ * Sleep instead of spinning (overrides the weak HAL implementation)
+ */
+void HAL_Delay(uint32_t Delay) {
+    if (!power_ready) {
+        /* Before power_init(): the HAL's own busy wait */
+        uint32_t start = HAL_GetTick();
+
+        while ((HAL_GetTick() - start) <= Delay) {
+        }
+        return;
+    }
+
+    uint64_t deadline = timebase_us() + (uint64_t)Delay * 1000u;
+
+    while (timebase_us() < deadline) {
+        power_idle_until(deadline);
+    }
+}
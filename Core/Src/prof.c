@@ -0,0 +1,147 @@
+/*
+ * prof.c
+ *
+ * Cycle-accurate profiling scopes on the DWT cycle counter
+ */
+
+#include "prof.h"
+
+#if PROF_ENABLE
+
+#include "clock.h"
+#include "sched.h"
+#include "telemetry.h"
+#include "stm32l4xx_hal.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_SIZE  192
+
+static ProfStats table[PROF_SCOPE_COUNT];
+
+#define PROF_NAME_(id, name) [PROF_##id] = name,
+
+static const char *const names[PROF_SCOPE_COUNT] = {
+    PROF_SCOPES(PROF_NAME_)
+};
+
+static void dump_run(void *arg);
+
+static Task dump_task = {
+    .name = "prof", .run = dump_run, .period_us = PROF_DUMP_PERIOD_MS * 1000u
+};
+
+/* Histogram bucket of a pass: bit length of the cycle count */
+static inline uint32_t bucket(uint32_t cycles) {
+    uint32_t b = (cycles == 0) ? 0 : 32u - __CLZ(cycles);
+
+    return (b < PROF_BUCKETS) ? b : PROF_BUCKETS - 1;
+}
+
+/* Dump between rallies only, so the table never crowds the game's own
+   records out of the telemetry ring */
+static void dump_run(void *arg) {
+    (void)arg;
+
+    if (clock_profile() == CLOCK_PROFILE_IDLE) {
+        prof_dump();
+    }
+}
+
+/**
+ * Start the cycle counter, clear the table and add the dump task
+ */
+void prof_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    prof_reset();
+    sched_add(&dump_task);
+}
+
+/**
+ * Record one pass of a scope
+ */
+void prof_record(uint8_t scope, uint32_t cycles) {
+    if (scope >= PROF_SCOPE_COUNT) {
+        return;
+    }
+
+    ProfStats *s = &table[scope];
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (s->count == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->count++;
+    s->total += cycles;
+    s->buckets[bucket(cycles)]++;
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Statistics of a scope so far
+ */
+const ProfStats *prof_stats(uint8_t scope) {
+    return (scope < PROF_SCOPE_COUNT) ? &table[scope] : NULL;
+}
+
+/**
+ * Clear the table
+ */
+void prof_reset(void) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    memset(table, 0, sizeof(table));
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Send the table as telemetry text
+ */
+void prof_dump(void) {
+    char line[LINE_SIZE];
+    int len;
+
+    if (telemetry_text_pending() != 0) {
+        return;                 /* the last one is still going out */
+    }
+
+    len = snprintf(line, sizeof(line),
+                   "prof cycles @ %lu Hz\n%-18s %9s %8s %8s %8s  log2 histogram\n",
+                   (unsigned long)SystemCoreClock, "scope", "count", "min", "mean", "max");
+    telemetry_text(line, (uint32_t)len);
+
+    for (int n = 0; n < PROF_SCOPE_COUNT; n++) {
+        ProfStats s;
+        uint32_t primask = __get_PRIMASK();
+
+        /* Copy under the lock, the table may change in interrupts */
+        __disable_irq();
+        s = table[n];
+        __set_PRIMASK(primask);
+
+        len = snprintf(line, sizeof(line), "%-18s %9lu %8lu %8lu %8lu ", names[n],
+                       (unsigned long)s.count, (unsigned long)s.min,
+                       (unsigned long)(s.count ? s.total / s.count : 0),
+                       (unsigned long)s.max);
+
+        /* Non-empty buckets as <bucket>:<count> */
+        for (int b = 0; b < PROF_BUCKETS && len < (int)sizeof(line) - 16; b++) {
+            if (s.buckets[b] != 0) {
+                len += snprintf(line + len, sizeof(line) - (size_t)len, " %d:%lu", b,
+                                (unsigned long)s.buckets[b]);
+            }
+        }
+        len += snprintf(line + len, sizeof(line) - (size_t)len, "\n");
+        telemetry_text(line, (uint32_t)len);
+    }
+}
+
+#endif /* PROF_ENABLE */
@@ -0,0 +1,142 @@
+/*
+ * replay.c
+ *
+ * Compact match recording for deterministic replay
+ */
+
+#include "replay.h"
+#include <stddef.h>
+
+static const uint8_t magic[4] = { 'R', 'P', 'L', '1' };
+
+/* LEB128: 7 bits per byte, high bit set on all but the last */
+static uint32_t put_varint(uint8_t *out, uint64_t value) {
+    uint32_t n = 0;
+
+    do {
+        uint8_t byte = value & 0x7F;
+
+        value >>= 7;
+        out[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+
+    return n;
+}
+
+static int get_varint(ReplayReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->len) {
+            return 0;
+        }
+
+        uint8_t byte = reader->buf[reader->pos++];
+
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Start a recording
+ */
+int replay_record_start(ReplayLog *log, uint8_t *buf, uint32_t size,
+                        uint32_t seed, uint64_t start_us) {
+    if (buf == NULL || size < REPLAY_HEADER_MAX) {
+        return 0;
+    }
+
+    log->buf = buf;
+    log->size = size;
+    log->len = 0;
+
+    for (int n = 0; n < 4; n++) {
+        buf[log->len++] = magic[n];
+    }
+    for (int n = 0; n < 4; n++) {
+        buf[log->len++] = (uint8_t)(seed >> (8 * n));
+    }
+    log->len += put_varint(&buf[log->len], start_us);
+
+    log->last_us = start_us;
+    log->edges = 0;
+    log->full = 0;
+    return 1;
+}
+
+/**
+ * Append an edge
+ */
+void replay_record_edge(ReplayLog *log, const ButtonEvent *event) {
+    uint8_t bytes[10];
+
+    if (log->buf == NULL || log->full) {
+        return;
+    }
+
+    /* An edge timestamped before the previous one is recorded at the
+       same time, keeping the log monotonic */
+    uint64_t delta = (event->timestamp > log->last_us) ? event->timestamp - log->last_us : 0;
+    uint64_t word = (delta << 2) | ((uint64_t)(event->button - 1) << 1) | (event->pressed ? 1 : 0);
+    uint32_t n = put_varint(bytes, word);
+
+    if (log->len + n > log->size) {
+        log->full = 1;
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        log->buf[log->len++] = bytes[i];
+    }
+    log->last_us += delta;
+    log->edges++;
+}
+
+/**
+ * Open a log for reading
+ */
+int replay_open(ReplayReader *reader, const uint8_t *buf, uint32_t len,
+                uint32_t *seed, uint64_t *start_us) {
+    if (buf == NULL || len < 9) {
+        return 0;
+    }
+    for (int n = 0; n < 4; n++) {
+        if (buf[n] != magic[n]) {
+            return 0;
+        }
+    }
+
+    reader->buf = buf;
+    reader->len = len;
+    reader->pos = 8;
+    *seed = (uint32_t)buf[4] | (uint32_t)buf[5] << 8 | (uint32_t)buf[6] << 16 |
+            (uint32_t)buf[7] << 24;
+
+    if (!get_varint(reader, start_us)) {
+        return 0;
+    }
+    reader->last_us = *start_us;
+    return 1;
+}
+
+/**
+ * Read the next edge
+ */
+int replay_next(ReplayReader *reader, ButtonEvent *event) {
+    uint64_t word;
+
+    if (!get_varint(reader, &word)) {
+        return 0;
+    }
+
+    reader->last_us += word >> 2;
+    event->timestamp = reader->last_us;
+    event->button = (uint8_t)(((word >> 1) & 1) + 1);
+    event->pressed = (uint8_t)(word & 1);
+    return 1;
+}
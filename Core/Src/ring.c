@@ -0,0 +1,373 @@
+/*
+ * ring.c
+ *
+ * Token ring over daisy-chained serial links, free of hardware
+ */
+
+#include "ring.h"
+#include "cobs.h"
+
+/* Frame types */
+enum {
+    RING_CLAIM = 1,     /* id u32 */
+    RING_ENUM,          /* master id u32, count u8 */
+    RING_START,         /* master id u32, nodes u8, epoch u8 */
+    RING_TOKEN,         /* epoch u8 */
+    RING_MSG,           /* sender u8, seq u8, payload */
+};
+
+/* Counting the ring must be done by then, or it starts again */
+#define ENUM_TIMEOUT_US  (4u * (RING_PACE_US + RING_NODES_MAX * RING_HOP_US))
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int n = 0; n < 4; n++) {
+        p[n] = (uint8_t)(v >> (8 * n));
+    }
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Add the CRC, encode and hand to the transport */
+static void send_frame(Ring *ring, uint8_t *frame, uint32_t len) {
+    uint8_t encoded[COBS_MAX(RING_FRAME_MAX) + 1];
+
+    frame[len] = crc8(frame, len);
+
+    uint32_t size = cobs_encode(frame, len + 1u, encoded);
+
+    encoded[size++] = 0;
+    ring->send(encoded, size, ring->arg);
+}
+
+static void send_claim(Ring *ring) {
+    uint8_t f[RING_FRAME_MAX];
+
+    f[0] = RING_CLAIM;
+    put32(f + 1, ring->id);
+    send_frame(ring, f, 5);
+}
+
+static void send_enum(Ring *ring, uint32_t master, uint8_t count) {
+    uint8_t f[RING_FRAME_MAX];
+
+    f[0] = RING_ENUM;
+    put32(f + 1, master);
+    f[5] = count;
+    send_frame(ring, f, 6);
+}
+
+static void send_token(Ring *ring, uint64_t now) {
+    uint8_t f[RING_FRAME_MAX];
+
+    f[0] = RING_TOKEN;
+    f[1] = ring->epoch;
+    send_frame(ring, f, 2);
+    ring->token_at = now;
+}
+
+/* Holding the token: own message out ahead of it. One still out from the
+   last visit has been lost, as it travels ahead of the token. */
+static void visit(Ring *ring) {
+    if (ring->out_count == 0) {
+        return;
+    }
+    if (ring->in_flight) {
+        ring->resent++;
+    }
+
+    uint8_t f[RING_FRAME_MAX];
+    const RingMsg *m = &ring->out[0];
+
+    f[0] = RING_MSG;
+    f[1] = ring->address;
+    f[2] = ring->out_seq;
+    for (uint8_t n = 0; n < m->len; n++) {
+        f[3 + n] = m->bytes[n];
+    }
+    send_frame(ring, f, 3u + m->len);
+    ring->in_flight = 1;
+}
+
+/* Master: token out again, a new rotation */
+static void pass_token(Ring *ring, uint64_t now) {
+    ring->holding = 0;
+    visit(ring);
+    send_token(ring, now);
+    ring->rotation_start = now;
+}
+
+static void elect(Ring *ring, uint64_t now) {
+    ring->phase = RING_PHASE_ELECT;
+    ring->master_id = ring->id;
+    ring->nodes = 0;
+    ring->holding = 0;
+    ring->next_claim = now;
+    ring->token_at = now;
+    ring->elections++;
+}
+
+static void become_ready(Ring *ring, uint8_t nodes, uint8_t epoch, uint64_t now) {
+    ring->phase = RING_PHASE_READY;
+    ring->nodes = nodes;
+    ring->epoch = epoch;
+    ring->in_flight = 0;
+    ring->token_at = now;
+    for (uint8_t n = 0; n < RING_NODES_MAX; n++) {
+        ring->seen[n] = 0;
+    }
+    if (ring->ready) {
+        ring->ready(ring->arg);
+    }
+}
+
+static int take_claim(Ring *ring, uint32_t claim, uint64_t now) {
+    if (ring->phase == RING_PHASE_ENUM && ring->address == 0) {
+        return 0;                   /* ahead of our ENUM, from the election */
+    }
+    if (ring->phase != RING_PHASE_ELECT) {
+        elect(ring, now);           /* a board joined or started again */
+    }
+    if (claim == ring->id) {
+        ring->phase = RING_PHASE_ENUM;
+        ring->address = 0;
+        ring->token_at = now;
+        send_enum(ring, ring->id, 1);
+        return 0;
+    }
+    if (claim < ring->master_id) {
+        ring->master_id = claim;
+    }
+    return claim < ring->id;
+}
+
+static int take_frame(Ring *ring, const uint8_t *f, uint32_t len, uint64_t now) {
+    switch (f[0]) {
+    case RING_CLAIM:
+        return (len == 5) ? take_claim(ring, get32(f + 1), now) : 0;
+
+    case RING_ENUM:
+        if (len != 6) {
+            return 0;
+        }
+        if (get32(f + 1) == ring->id && ring->phase == RING_PHASE_ENUM && ring->address == 0) {
+            /* Round: every board has its address, tell them the count */
+            uint8_t out[RING_FRAME_MAX];
+
+            out[0] = RING_START;
+            put32(out + 1, ring->id);
+            out[5] = f[5];
+            out[6] = (uint8_t)(ring->epoch + 1u);
+            send_frame(ring, out, 7);
+        } else if (ring->phase == RING_PHASE_ELECT && get32(f + 1) == ring->master_id &&
+                   f[5] < RING_NODES_MAX) {
+            ring->phase = RING_PHASE_ENUM;
+            ring->address = f[5];
+            ring->token_at = now;
+            send_enum(ring, ring->master_id, (uint8_t)(f[5] + 1u));
+        }
+        return 0;
+
+    case RING_START:
+        if (len != 7 || ring->phase != RING_PHASE_ENUM) {
+            return 0;
+        }
+        if (get32(f + 1) == ring->id) {
+            become_ready(ring, f[5], f[6], now);
+            ring->rotation_start = now;
+            pass_token(ring, now);
+            return 0;
+        }
+        if (get32(f + 1) == ring->master_id) {
+            become_ready(ring, f[5], f[6], now);
+            return 1;
+        }
+        return 0;
+
+    case RING_TOKEN:
+        if (len != 2 || ring->phase != RING_PHASE_READY) {
+            return 0;
+        }
+        if (ring->address != 0) {
+            ring->epoch = f[1];
+            visit(ring);
+            send_token(ring, now);
+            return 0;
+        }
+        if (f[1] != ring->epoch) {
+            return 0;               /* a lost token turned up after all */
+        }
+
+        uint32_t took = (uint32_t)(now - ring->rotation_start);
+
+        ring->rotations++;
+        if (took > ring->rotation_max_us) {
+            ring->rotation_max_us = took;
+        }
+        ring->token_at = now;
+        ring->hold_until = ring->rotation_start + RING_PACE_US;
+        if (ring->out_count == 0 && now < ring->hold_until) {
+            ring->holding = 1;      /* idle: ring_run() sends it on */
+        } else {
+            pass_token(ring, now);
+        }
+        return 0;
+
+    case RING_MSG: {
+        uint8_t sender = f[1];
+        uint8_t seq = f[2];
+
+        if (len < 3 || len > 3u + RING_PAYLOAD_MAX || ring->phase != RING_PHASE_READY ||
+            sender >= ring->nodes) {
+            return 0;
+        }
+        if (sender == ring->address) {
+            /* Round the ring: off it, and the next one may go */
+            if (ring->in_flight && seq == ring->out_seq) {
+                for (uint8_t n = 1; n < ring->out_count; n++) {
+                    ring->out[n - 1] = ring->out[n];
+                }
+                ring->out_count--;
+                ring->out_seq++;
+                ring->in_flight = 0;
+            }
+            return 0;
+        }
+        if (ring->seen[sender] && ring->seen_seq[sender] == seq) {
+            /* Delivered already. A copy whose sender has gone would go
+               round for ever: the master drops its second pass in one
+               rotation, a resend only comes once per rotation. */
+            if (ring->address == 0 && ring->seen_lap[sender] == (uint8_t)ring->rotations) {
+                return 0;
+            }
+        } else {
+            ring->seen[sender] = 1;
+            ring->seen_seq[sender] = seq;
+            ring->deliver(sender, f + 3, (uint8_t)(len - 3u), ring->arg);
+        }
+        ring->seen_lap[sender] = (uint8_t)ring->rotations;
+        return 1;
+    }
+
+    default:
+        ring->rx_bad++;
+        return 0;
+    }
+}
+
+/**
+ * Start electing a master
+ */
+void ring_init(Ring *ring, uint32_t id,
+               void (*send)(const uint8_t *bytes, uint32_t len, void *arg),
+               void (*deliver)(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg),
+               void (*ready)(void *arg), void *arg, uint64_t now) {
+    ring->id = id;
+    ring->address = 0;
+    ring->epoch = 0;
+    ring->out_count = 0;
+    ring->out_seq = 0;
+    ring->in_flight = 0;
+    ring->send = send;
+    ring->deliver = deliver;
+    ring->ready = ready;
+    ring->arg = arg;
+    ring->rotations = 0;
+    ring->rotation_max_us = 0;
+    ring->regenerated = 0;
+    ring->resent = 0;
+    ring->rx_bad = 0;
+    ring->elections = 0;
+    elect(ring, now);
+}
+
+/**
+ * Take up one received frame
+ */
+int ring_receive(Ring *ring, const uint8_t *encoded, uint32_t len, uint64_t now) {
+    uint8_t frame[COBS_MAX(RING_FRAME_MAX)];
+
+    if (len == 0) {
+        return 0;
+    }
+
+    int32_t size = (len <= sizeof(frame)) ? cobs_decode(encoded, len, frame) : -1;
+
+    if (size < 2 || size > RING_FRAME_MAX || crc8(frame, (uint32_t)size - 1u) != frame[size - 1]) {
+        ring->rx_bad++;
+        return 0;
+    }
+    return take_frame(ring, frame, (uint32_t)size - 1u, now);
+}
+
+/**
+ * Queue a broadcast to every other board
+ */
+int ring_post(Ring *ring, const uint8_t *bytes, uint8_t len) {
+    if (ring->out_count == RING_QUEUE || len > RING_PAYLOAD_MAX) {
+        return 0;
+    }
+
+    RingMsg *m = &ring->out[ring->out_count++];
+
+    for (uint8_t n = 0; n < len; n++) {
+        m->bytes[n] = bytes[n];
+    }
+    m->len = len;
+    return 1;
+}
+
+/**
+ * Timers: CLAIM repeats, token pacing and loss
+ */
+uint64_t ring_run(Ring *ring, uint64_t now) {
+    uint64_t bound = ring_rotation_bound_us(ring->nodes);
+
+    switch (ring->phase) {
+    case RING_PHASE_ELECT:
+        if (now >= ring->next_claim) {
+            send_claim(ring);
+            ring->next_claim = now + RING_CLAIM_US;
+        }
+        return ring->next_claim;
+
+    case RING_PHASE_ENUM:
+        if (now >= ring->token_at + ENUM_TIMEOUT_US) {
+            elect(ring, now);
+            return now;
+        }
+        return ring->token_at + ENUM_TIMEOUT_US;
+
+    default:
+        break;
+    }
+
+    if (ring->address != 0) {
+        /* No token for several rotations: the master has gone */
+        if (now >= ring->token_at + 4u * bound) {
+            elect(ring, now);
+            return now;
+        }
+        return ring->token_at + 4u * bound;
+    }
+
+    if (ring->holding) {
+        if (now >= ring->hold_until) {
+            pass_token(ring, now);
+        }
+    } else if (now >= ring->token_at + bound) {
+        /* Lost: a new one, under an epoch the old one does not have */
+        ring->epoch++;
+        ring->regenerated++;
+        pass_token(ring, now);
+    }
+    return ring->holding ? ring->hold_until : ring->token_at + bound;
+}
+
+/**
+ * Longest wait for a full token rotation
+ */
+uint64_t ring_rotation_bound_us(uint8_t nodes) {
+    return RING_PACE_US + (uint64_t)(nodes ? nodes : RING_NODES_MAX) * RING_HOP_US;
+}
@@ -0,0 +1,323 @@
+/*
+ * ringbus.c
+ *
+ * Token ring (ring.h) on UART5, both directions by DMA
+ *
+ * The ring task is the only reader of the receive buffer and the only
+ * writer of the transmit queue's tail; the DMA interrupt takes entries
+ * off its head. Queue changes happen with interrupts locked.
+ */
+
+#include "ringbus.h"
+#include "cobs.h"
+#include "power.h"
+#include "sched.h"
+#include "timebase.h"
+#include "stm32l4xx_hal.h"
+
+#define RING_DEADLINE_US  500
+#define ENCODED_MAX       COBS_MAX(RING_FRAME_MAX)   /* without the delimiter */
+
+/* One transfer: a frame in the receive buffer, or one of our own */
+typedef struct {
+    const uint8_t *bytes;
+    uint16_t len;
+    uint8_t own[ENCODED_MAX + 1];
+} TxEntry;
+
+static Ring ring;
+
+static uint8_t rx[RINGBUS_RX];
+static uint16_t rx_tail = 0;            /* start of the next frame */
+
+static TxEntry txq[RINGBUS_TXQ];
+static volatile uint8_t txq_head = 0;   /* being sent while sending */
+static volatile uint8_t txq_count = 0;
+static volatile uint8_t sending = 0;
+static uint32_t overflows = 0;
+
+static DMA_HandleTypeDef hdma_tx;
+static DMA_HandleTypeDef hdma_rx;
+
+static void ring_run_task(void *arg);
+
+static Task ring_task = {
+    .name = "ring", .run = ring_run_task, .deadline_us = RING_DEADLINE_US
+};
+
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/* Start the entry at the head. Interrupts locked. */
+static void start_next(void) {
+    while (txq_count != 0) {
+        const TxEntry *e = &txq[txq_head];
+
+        sending = 1;
+        if (HAL_DMA_Start_IT(&hdma_tx, (uint32_t)e->bytes, (uint32_t)&UART5->TDR, e->len) == HAL_OK) {
+            return;
+        }
+        /* Channel in error: drop the entry rather than stall */
+        txq_head = (uint8_t)((txq_head + 1u) % RINGBUS_TXQ);
+        txq_count--;
+        sending = 0;
+    }
+}
+
+/* Transmit complete (or failed, the bytes are lost either way) */
+static void transfer_done(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    txq_head = (uint8_t)((txq_head + 1u) % RINGBUS_TXQ);
+    txq_count--;
+    sending = 0;
+    start_next();
+}
+
+/* Queue up to two stretches as one frame, or drop it whole */
+static void queue(const uint8_t *a, uint16_t a_len, const uint8_t *b, uint16_t b_len) {
+    uint8_t need = (b_len != 0) ? 2u : 1u;
+    uint32_t primask = lock();
+
+    if (txq_count + need > RINGBUS_TXQ) {
+        overflows++;
+        unlock(primask);
+        return;
+    }
+
+    TxEntry *e = &txq[(txq_head + txq_count) % RINGBUS_TXQ];
+
+    e->bytes = a;
+    e->len = a_len;
+    if (b_len != 0) {
+        e = &txq[(txq_head + txq_count + 1u) % RINGBUS_TXQ];
+        e->bytes = b;
+        e->len = b_len;
+    }
+    txq_count = (uint8_t)(txq_count + need);
+    if (!sending) {
+        start_next();
+    }
+    unlock(primask);
+}
+
+/* Ring transport for the frames this board makes: copied into the entry */
+static void send_own(const uint8_t *bytes, uint32_t len, void *arg) {
+    (void)arg;
+    if (len > ENCODED_MAX + 1u) {
+        return;
+    }
+
+    uint32_t primask = lock();
+
+    if (txq_count == RINGBUS_TXQ) {
+        overflows++;
+        unlock(primask);
+        return;
+    }
+
+    TxEntry *e = &txq[(txq_head + txq_count) % RINGBUS_TXQ];
+
+    for (uint32_t n = 0; n < len; n++) {
+        e->own[n] = bytes[n];
+    }
+    e->bytes = e->own;
+    e->len = (uint16_t)len;
+    txq_count++;
+    if (!sending) {
+        start_next();
+    }
+    unlock(primask);
+}
+
+/* Half or full ring received */
+static void rx_event(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    sched_signal(&ring_task);
+}
+
+/* One frame from rx_tail to the delimiter at end: taken up where it lies,
+   passed on from there */
+static void take_frame(uint16_t end, uint64_t now) {
+    uint16_t len = (uint16_t)((end + RINGBUS_RX - rx_tail) % RINGBUS_RX);
+    uint16_t first = (uint16_t)(RINGBUS_RX - rx_tail);     /* bytes to the wrap */
+
+    if (len <= ENCODED_MAX && len < first) {
+        if (ring_receive(&ring, rx + rx_tail, len, now)) {
+            queue(rx + rx_tail, (uint16_t)(len + 1u), NULL, 0);
+        }
+        return;
+    }
+    if (len > ENCODED_MAX) {
+        ring.rx_bad++;              /* noise, or bytes lost to an overrun */
+        return;
+    }
+
+    /* Round the end: decoding wants it in one piece, sending does not */
+    uint8_t linear[ENCODED_MAX];
+
+    for (uint16_t n = 0; n < len; n++) {
+        linear[n] = rx[(rx_tail + n) % RINGBUS_RX];
+    }
+    if (ring_receive(&ring, linear, len, now)) {
+        queue(rx + rx_tail, first, rx, (uint16_t)(len + 1u - first));
+    }
+}
+
+/* Ring task: frames received, then the ring's timers */
+static void ring_run_task(void *arg) {
+    uint64_t now = timebase_us();
+    uint16_t head = (uint16_t)(RINGBUS_RX - __HAL_DMA_GET_COUNTER(&hdma_rx));
+    uint16_t at = rx_tail;
+
+    (void)arg;
+    if (head == RINGBUS_RX) {
+        head = 0;
+    }
+    while (at != head) {
+        if (rx[at] == 0) {
+            take_frame(at, now);
+            rx_tail = (uint16_t)((at + 1u) % RINGBUS_RX);
+        } else if ((uint16_t)((at + RINGBUS_RX - rx_tail) % RINGBUS_RX) > ENCODED_MAX) {
+            rx_tail = at;           /* no delimiter in reach: not a frame */
+            ring.rx_bad++;
+        }
+        at = (uint16_t)((at + 1u) % RINGBUS_RX);
+    }
+
+    sched_wake_at(&ring_task, ring_run(&ring, now));
+}
+
+static void dma_setup(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel, uint32_t direction,
+                      uint32_t mode) {
+    hdma->Instance = channel;
+    hdma->Init.Request = DMA_REQUEST_2;     /* UART5_TX on 1, UART5_RX on 2 */
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.Mode = mode;
+    hdma->Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(hdma) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+/**
+ * Set up UART5 and both DMA channels, add the ring task
+ */
+void ringbus_init(void (*deliver)(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg),
+                  void (*ready)(void *arg), void *arg) {
+    GPIO_InitTypeDef gpio = {0};
+
+    __HAL_RCC_UART5_CONFIG(RCC_UART5CLKSOURCE_HSI);
+    __HAL_RCC_UART5_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_GPIOD_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = GPIO_PULLUP;        /* an unplugged RX idles high */
+    gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    gpio.Alternate = GPIO_AF8_UART5;
+    gpio.Pin = GPIO_PIN_12;
+    HAL_GPIO_Init(GPIOC, &gpio);
+    gpio.Pin = GPIO_PIN_2;
+    HAL_GPIO_Init(GPIOD, &gpio);
+
+    UART5->CR1 = 0;
+    UART5->BRR = UART_DIV_SAMPLING16(HSI_VALUE, RINGBUS_BAUD);
+    UART5->CR3 = USART_CR3_DMAT | USART_CR3_DMAR;
+
+    dma_setup(&hdma_tx, DMA2_Channel1, DMA_MEMORY_TO_PERIPH, DMA_NORMAL);
+    hdma_tx.XferCpltCallback = transfer_done;
+    hdma_tx.XferErrorCallback = transfer_done;
+
+    dma_setup(&hdma_rx, DMA2_Channel2, DMA_PERIPH_TO_MEMORY, DMA_CIRCULAR);
+    hdma_rx.XferHalfCpltCallback = rx_event;
+    hdma_rx.XferCpltCallback = rx_event;
+
+    txq_head = 0;
+    txq_count = 0;
+    sending = 0;
+    rx_tail = 0;
+    if (HAL_DMA_Start_IT(&hdma_rx, (uint32_t)&UART5->RDR, (uint32_t)rx, RINGBUS_RX) != HAL_OK) {
+        Error_Handler();
+    }
+
+    UART5->ICR = USART_ICR_IDLECF | USART_ICR_ORECF;
+    UART5->CR1 = USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE | USART_CR1_UE;
+
+    HAL_NVIC_SetPriority(DMA2_Channel1_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Channel1_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Channel2_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Channel2_IRQn);
+    HAL_NVIC_SetPriority(UART5_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(UART5_IRQn);
+
+    power_stop_inhibit(1);
+
+    /* The chip's unique id, folded, tells the boards apart */
+    ring_init(&ring, HAL_GetUIDw0() ^ (HAL_GetUIDw1() * 0x9E3779B1u) ^ HAL_GetUIDw2(),
+              send_own, deliver, ready, arg, timebase_us());
+    sched_add(&ring_task);
+    sched_signal(&ring_task);
+}
+
+/**
+ * Queue a broadcast to every other board
+ */
+int ringbus_post(const uint8_t *bytes, uint8_t len) {
+    return ring_post(&ring, bytes, len);
+}
+
+/**
+ * The ring's state, read-only
+ */
+const Ring *ringbus_state(void) {
+    return &ring;
+}
+
+/**
+ * Frames dropped because the transmit queue was full
+ */
+uint32_t ringbus_overflows(void) {
+    return overflows;
+}
+
+/**
+ * DMA2 Channel 1 interrupt handler hook
+ */
+void ringbus_tx_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_tx);
+}
+
+/**
+ * DMA2 Channel 2 interrupt handler hook
+ */
+void ringbus_rx_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_rx);
+}
+
+/**
+ * UART5 interrupt handler hook
+ */
+void ringbus_uart_irq(void) {
+    uint32_t isr = UART5->ISR;
+
+    if (isr & USART_ISR_IDLE) {
+        UART5->ICR = USART_ICR_IDLECF;
+        sched_signal(&ring_task);
+    }
+    if (isr & USART_ISR_ORE) {
+        /* A byte lost; the frame fails its CRC and the ring sends it again */
+        UART5->ICR = USART_ICR_ORECF;
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * rollback.c
+ *
+ * Rollback session over the game core, free of hardware
+ */
+
+#include "rollback.h"
+
+static RollbackSnap *snap(Rollback *rb, uint8_t n) {
+    return &rb->snaps[(rb->snap_first + n) % ROLLBACK_SNAPS];
+}
+
+/* Take up a show request the way game.c does */
+static void take_show(Rollback *rb, uint64_t at) {
+    Game *game = &rb->game;
+    uint32_t ms = rb->show_ms(game);
+
+    rb->anim_end_at = (ms == UINT32_MAX) ? GAME_NO_STEP : at + (uint64_t)ms * 1000u;
+    rb->show = game->show;
+    rb->shows++;
+    game->show = GAME_SHOW_NONE;
+}
+
+/* Snapshot the game before the events at a time; the oldest snapshot and
+   the presses before it go when there is no room */
+static void take_snap(Rollback *rb, uint64_t at) {
+    if (rb->snap_count == ROLLBACK_SNAPS) {
+        rb->snap_first = (uint8_t)((rb->snap_first + 1u) % ROLLBACK_SNAPS);
+        rb->snap_count--;
+
+        uint64_t oldest = snap(rb, 0)->at_us;
+        uint8_t gone = 0;
+
+        while (gone < rb->input_next && rb->inputs[gone].at_us < oldest) {
+            gone++;
+        }
+        for (uint8_t n = gone; n < rb->input_count; n++) {
+            rb->inputs[n - gone] = rb->inputs[n];
+        }
+        rb->input_count -= gone;
+        rb->input_next -= gone;
+    }
+
+    RollbackSnap *s = snap(rb, rb->snap_count++);
+
+    s->game = rb->game;
+    s->anim_end_at = rb->anim_end_at;
+    s->at_us = at;
+}
+
+/* Feed the due events in time order, return how many */
+static uint32_t feed(Rollback *rb, uint64_t until) {
+    uint32_t fed = 0;
+
+    for (;;) {
+        uint64_t press_at = GAME_NO_STEP;
+        uint8_t press_event = GAME_EV_PRESS_LEFT;
+        uint64_t at;
+
+        if (rb->input_next < rb->input_count) {
+            press_at = rb->inputs[rb->input_next].at_us;
+            press_event = rb->inputs[rb->input_next].event;
+        }
+
+        uint8_t event = game_next_due(&rb->game, press_at, press_event, rb->anim_end_at, until, &at);
+
+        if (event == GAME_EVENT_COUNT) {
+            return fed;
+        }
+        if (at >= snap(rb, (uint8_t)(rb->snap_count - 1u))->at_us + ROLLBACK_SNAP_US) {
+            take_snap(rb, at);
+        }
+        if (event == GAME_EV_ANIM_DONE) {
+            rb->anim_end_at = GAME_NO_STEP;
+        } else if (event != GAME_EV_STEP) {
+            rb->input_next++;
+        }
+
+        game_event(&rb->game, event, at);
+        if (rb->game.show != GAME_SHOW_NONE) {
+            take_show(rb, at);
+        }
+        fed++;
+    }
+}
+
+/**
+ * Start a session on a new game
+ */
+void rollback_reset(Rollback *rb, const GameConfig *config, uint32_t seed, uint64_t start_us,
+                    uint32_t (*show_ms)(const Game *game)) {
+    rb->show_ms = show_ms;
+    rb->anim_end_at = GAME_NO_STEP;
+    rb->sim_us = start_us;
+    rb->snap_first = 0;
+    rb->snap_count = 0;
+    rb->input_count = 0;
+    rb->input_next = 0;
+    rb->shows = 0;
+    rb->rollbacks = 0;
+    rb->replayed = 0;
+    rb->dropped = 0;
+
+    game_reset(&rb->game, config, seed, start_us);
+    if (rb->game.show != GAME_SHOW_NONE) {
+        take_show(rb, start_us);
+    }
+    take_snap(rb, start_us);
+}
+
+/**
+ * Add a press, rolling back if the session is already past its time
+ */
+int rollback_input(Rollback *rb, uint8_t event, uint64_t at_us) {
+    if (rb->input_count == ROLLBACK_INPUTS || at_us < snap(rb, 0)->at_us) {
+        rb->dropped++;
+        return 0;
+    }
+
+    uint8_t pos = rb->input_count;
+
+    while (pos > 0 && (rb->inputs[pos - 1].at_us > at_us ||
+                       (rb->inputs[pos - 1].at_us == at_us && rb->inputs[pos - 1].event > event))) {
+        rb->inputs[pos] = rb->inputs[pos - 1];
+        pos--;
+    }
+    rb->inputs[pos].at_us = at_us;
+    rb->inputs[pos].event = event;
+    rb->input_count++;
+
+    if (at_us > rb->sim_us) {
+        return 1;
+    }
+
+    /* Back to the last snapshot before the press, then forward again */
+    uint8_t keep = rb->snap_count;
+
+    while (snap(rb, (uint8_t)(keep - 1u))->at_us > at_us) {
+        keep--;
+    }
+
+    const RollbackSnap *s = snap(rb, (uint8_t)(keep - 1u));
+    uint64_t until = rb->sim_us;
+
+    rb->snap_count = keep;
+    rb->game = s->game;
+    rb->anim_end_at = s->anim_end_at;
+    rb->sim_us = s->at_us;
+    rb->input_next = 0;
+    while (rb->inputs[rb->input_next].at_us < s->at_us) {
+        rb->input_next++;
+    }
+
+    rb->rollbacks++;
+    rb->replayed += feed(rb, until);
+    rb->sim_us = until;
+    return 1;
+}
+
+/**
+ * Feed every event due up to a time
+ */
+void rollback_advance(Rollback *rb, uint64_t until_us) {
+    if (until_us <= rb->sim_us) {
+        return;
+    }
+    feed(rb, until_us);
+    rb->sim_us = until_us;
+}
+
+/**
+ * Next time the game has an event of its own
+ */
+uint64_t rollback_next_at(const Rollback *rb) {
+    return (rb->game.step_at < rb->anim_end_at) ? rb->game.step_at : rb->anim_end_at;
+}
@@ -0,0 +1,169 @@
+/*
+ * sched.c
+ *
+ * Cooperative run-to-completion task scheduler
+ */
+
+#include "sched.h"
+#include "timebase.h"
+#include "power.h"
+#include "prof.h"
+#include "stm32l4xx_hal.h"
+
+static Task *tasks = NULL;
+
+/* Interrupt lock, sched_signal() may run in any handler */
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/* Time the task became ready, SCHED_NEVER if it is not */
+static uint64_t ready_since(const Task *task, uint64_t now) {
+    uint64_t since = (task->release <= now) ? task->release : SCHED_NEVER;
+
+    if (task->signaled && task->signal_at < since) {
+        since = task->signal_at;
+    }
+    return since;
+}
+
+/* Run one task and account for it */
+static void run_task(Task *task, uint64_t now, uint64_t since) {
+    uint32_t primask = lock();
+    task->signaled = 0;
+    unlock(primask);
+
+    if (task->release <= now) {
+        if (task->period_us == 0) {
+            task->release = SCHED_NEVER;
+        } else {
+            task->release += task->period_us;
+            if (task->release <= now) {
+                /* Fell more than a period behind: drop the lost releases */
+                task->release = now + task->period_us;
+            }
+        }
+    }
+
+    task->run(task->arg);
+
+    uint64_t done = timebase_us();
+
+    task->runs++;
+    task->last_us = (uint32_t)(done - now);
+    if (task->last_us > task->max_us) {
+        task->max_us = task->last_us;
+    }
+    if (task->deadline_us != 0 && done - since > task->deadline_us) {
+        task->misses++;
+    }
+}
+
+/**
+ * Forget all tasks
+ */
+void sched_init(void) {
+    tasks = NULL;
+}
+
+/**
+ * Add a task below all tasks added before it
+ */
+void sched_add(Task *task) {
+    Task **link = &tasks;
+
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+
+    task->next = NULL;
+    task->release = task->period_us ? timebase_us() + task->period_us : SCHED_NEVER;
+    task->signaled = 0;
+    task->runs = 0;
+    task->last_us = 0;
+    task->max_us = 0;
+    task->misses = 0;
+    *link = task;
+}
+
+/**
+ * Make a task ready, safe to call from interrupt handlers
+ */
+void sched_signal(Task *task) {
+    uint32_t primask = lock();
+
+    if (!task->signaled) {
+        task->signal_at = timebase_us();
+        task->signaled = 1;
+    }
+    unlock(primask);
+}
+
+/**
+ * Release a task at an absolute time
+ */
+void sched_wake_at(Task *task, uint64_t at_us) {
+    task->release = at_us;
+}
+
+/**
+ * Run the highest-priority ready task
+ */
+int sched_run_once(void) {
+    PROF_BEGIN(SCHED_RUN);
+    uint64_t now = timebase_us();
+
+    for (Task *task = tasks; task != NULL; task = task->next) {
+        uint64_t since = ready_since(task, now);
+
+        if (since != SCHED_NEVER) {
+            run_task(task, now, since);
+            PROF_END(SCHED_RUN);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Run ready tasks until none is left, then sleep
+ */
+void sched_dispatch(void) {
+    /* Re-scan from the top after every run, so a task signaled meanwhile
+       by a higher-priority source goes first */
+    while (sched_run_once()) {
+    }
+
+    uint64_t wake = SCHED_NEVER;
+
+    for (Task *task = tasks; task != NULL; task = task->next) {
+        if (task->release < wake) {
+            wake = task->release;
+        }
+    }
+
+    /* A signal raised after the scan must not be slept through: check
+       with interrupts off, WFI still wakes on the pending interrupt */
+    __disable_irq();
+    for (Task *task = tasks; task != NULL; task = task->next) {
+        if (task->signaled) {
+            __enable_irq();
+            return;
+        }
+    }
+    power_idle_until(wake);
+    __enable_irq();
+}
+
+/**
+ * Iterate the task list
+ */
+Task *sched_next_task(const Task *task) {
+    return (task == NULL) ? tasks : task->next;
+}
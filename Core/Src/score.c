@@ -2,83 +2,88 @@
  * score.c
  *
  * Score display module for ping-pong game
+ *
+ * Displays are keyframe tables played by the animation sequencer, so these
+ * functions return immediately. Run anim_update() until anim_busy() is 0.
  */
 
 #include "score.h"
 #include "leds.h"
+#include "anim.h"
 #include "stm32l4xx_hal.h"
 
+/* Short blank, then the score (breathing) for the requested time */
+static const AnimFrame score_frames[] = {
+    {0x00, 0, 100},
+    {0x00, ANIM_MASK_PARAM | ANIM_HOLD_PARAM | ANIM_BREATHE, 0},
+    {0x00, 0, 0}
+};
+static ANIM_DEFINE(score_anim, score_frames, 0);
+
+/* Five blinks of the winner's half, then the whole field */
+static const AnimFrame winner_frames[] = {
+    {0x00, ANIM_MASK_PARAM, 300}, {0x00, 0, 200},
+    {0x00, ANIM_MASK_PARAM, 300}, {0x00, 0, 200},
+    {0x00, ANIM_MASK_PARAM, 300}, {0x00, 0, 200},
+    {0x00, ANIM_MASK_PARAM, 300}, {0x00, 0, 200},
+    {0x00, ANIM_MASK_PARAM, 300}, {0x00, 0, 200},
+    {0xFF, 0, 500},
+    {0x00, 0, 0}
+};
+static ANIM_DEFINE(winner_anim, winner_frames, 0);
+
 /**
- * Display current score on LEDs
- * @param right_score Right player score (0-4)
- * @param left_score Left player score (0-4)
- * @param duration_ms Display duration in milliseconds
+ * Build the score frame: left score fills LED 1 upwards,
+ * right score fills LED 8 downwards (max 4 LEDs per side)
  */
-void show_score(uint8_t right_score, uint8_t left_score, uint32_t duration_ms)
+uint8_t score_mask(uint8_t right_score, uint8_t left_score)
 {
-    leds_clear();
-    HAL_Delay(100);
+    uint8_t mask = 0;
 
     for (int i = 1; i <= left_score && i <= 4; i++)
     {
-        HAL_GPIO_WritePin(GPIOB, GPIO_PIN_1 << (i - 1), GPIO_PIN_SET);
-    }
-
-    if (right_score >= 1)
-    {
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_6, GPIO_PIN_SET);
-    }
-    if (right_score >= 2)
-    {
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_5, GPIO_PIN_SET);
-    }
-    if (right_score >= 3)
-    {
-        HAL_GPIO_WritePin(GPIOA, GPIO_PIN_12, GPIO_PIN_SET);
+        mask |= LED_BIT(i);
     }
-    if (right_score >= 4)
+    for (int i = 1; i <= right_score && i <= 4; i++)
     {
-        HAL_GPIO_WritePin(GPIOA, GPIO_PIN_11, GPIO_PIN_SET);
+        mask |= LED_BIT(9 - i);
     }
 
-    HAL_Delay(duration_ms);
-    leds_clear();
+    return mask;
 }
 
 /**
- * Show winner by blinking their side's LEDs
- * @param winner 0 (left player) or 1 (right player)
+ * Start the score display
+ * @param right_score Right player score (0-4)
+ * @param left_score Left player score (0-4)
  * @param duration_ms Display duration in milliseconds
  */
-void show_winner(uint8_t winner, uint32_t duration_ms)
+uint32_t show_score(uint8_t right_score, uint8_t left_score, uint32_t duration_ms)
 {
-    const int num_blinks = 5;
-    const int blink_on_time = 300;
-    const int blink_off_time = 200;
+    return anim_play(&score_anim, score_mask(right_score, left_score), duration_ms);
+}
 
-    for (int i = 0; i < num_blinks; i++)
-    {
-        if (winner == 0)
-        {
-            HAL_GPIO_WritePin(GPIOB, GPIO_PIN_1, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOB, GPIO_PIN_11, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOB, GPIO_PIN_12, GPIO_PIN_SET);
-        }
-        else
-        {
-            HAL_GPIO_WritePin(GPIOA, GPIO_PIN_11, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOA, GPIO_PIN_12, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOC, GPIO_PIN_5, GPIO_PIN_SET);
-            HAL_GPIO_WritePin(GPIOC, GPIO_PIN_6, GPIO_PIN_SET);
-        }
+/**
+ * Start the winner display, blinking the winner's side
+ * @param winner 0 (left player) or 1 (right player)
+ */
+uint32_t show_winner(uint8_t winner)
+{
+    return anim_play(&winner_anim, winner == 0 ? LEDS_LEFT_HALF : LEDS_RIGHT_HALF, 0);
+}
 
-        HAL_Delay(blink_on_time);
-        leds_clear();
-        HAL_Delay(blink_off_time);
-    }
+/**
+ * Length of the score display
+ */
+uint32_t score_length(uint32_t duration_ms)
+{
+    return anim_length(&score_anim, duration_ms);
+}
 
-    leds_all();
-    HAL_Delay(500);
-    leds_clear();
+/**
+ * Length of the winner display
+ */
+uint32_t winner_length(void)
+{
+    return anim_length(&winner_anim, 0);
 }
@@ -0,0 +1,40 @@
+/*
+ * speed_curve.c
+ *
+ * Difficulty profiles as step-time tables indexed by rally count
+ */
+
+#include "speed_curve.h"
+#include <string.h>
+
+#define SPEED_ROW_(id, name, formula) \
+    [SPEED_PROFILE_##id] = { SPEED_CURVE_RALLIES(formula) },
+
+const uint32_t speed_curves[SPEED_PROFILE_COUNT][SPEED_CURVE_LEN] = {
+    SPEED_PROFILES(SPEED_ROW_)
+};
+
+#define SPEED_NAME_(id, name, formula) [SPEED_PROFILE_##id] = name,
+
+static const char *const names[SPEED_PROFILE_COUNT] = {
+    SPEED_PROFILES(SPEED_NAME_)
+};
+
+/**
+ * Profile by name, for configuration read at run time
+ */
+uint8_t speed_profile_find(const char *name) {
+    for (uint8_t p = 0; p < SPEED_PROFILE_COUNT; p++) {
+        if (strcmp(names[p], name) == 0) {
+            return p;
+        }
+    }
+    return SPEED_PROFILE_COUNT;
+}
+
+/**
+ * Name of a profile
+ */
+const char *speed_profile_name(uint8_t profile) {
+    return (profile < SPEED_PROFILE_COUNT) ? names[profile] : "?";
+}
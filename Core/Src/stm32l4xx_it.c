@@ -22,6 +22,14 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "timer.h"
+#include "timebase.h"
+#include "power.h"
+#include "ledpwm.h"
+#include "telemetry.h"
+#include "console.h"
+#include "link.h"
+#include "ringbus.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -187,6 +195,7 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  timer_tick();
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -198,6 +207,128 @@ void SysTick_Handler(void)
 /* please refer to the startup file (startup_stm32l4xx.s).                    */
 /******************************************************************************/
 
+/**
+  * @brief This function handles EXTI line[9:5] interrupts (right button PC8).
+  */
+void EXTI9_5_IRQHandler(void)
+{
+  HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_8);
+}
+
+/**
+  * @brief This function handles EXTI line[15:10] interrupts (B1 PC13, left button PB15).
+  */
+void EXTI15_10_IRQHandler(void)
+{
+  HAL_GPIO_EXTI_IRQHandler(B1_Pin);
+  HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_15);
+}
+
+/**
+  * @brief This function handles TIM2 global interrupt (microsecond timebase).
+  */
+void TIM2_IRQHandler(void)
+{
+  timebase_irq();
+}
+
+/**
+  * @brief This function handles LPTIM1 global interrupt (STOP2 wake-up).
+  */
+void LPTIM1_IRQHandler(void)
+{
+  power_lptim_irq();
+}
+
+/**
+  * @brief This function handles DMA1 channel 2 global interrupt (LED PWM).
+  */
+void DMA1_Channel2_IRQHandler(void)
+{
+  ledpwm_dma_irq();
+}
+
+/**
+  * @brief This function handles DMA1 channel 7 global interrupt (USART2 TX).
+  */
+void DMA1_Channel7_IRQHandler(void)
+{
+  telemetry_dma_irq();
+}
+
+/**
+  * @brief This function handles USART2 global interrupt.
+  */
+void USART2_IRQHandler(void)
+{
+  telemetry_uart_irq();
+  console_uart_irq();
+}
+
+/**
+  * @brief This function handles DMA1 channel 6 global interrupt (USART2 RX).
+  */
+void DMA1_Channel6_IRQHandler(void)
+{
+  console_dma_irq();
+}
+
+/**
+  * @brief This function handles EXTI line 3 interrupt (USART2 RX wake-up).
+  */
+void EXTI3_IRQHandler(void)
+{
+  console_wake_irq();
+}
+
+/**
+  * @brief This function handles DMA2 channel 6 global interrupt (USART1 TX).
+  */
+void DMA2_Channel6_IRQHandler(void)
+{
+  link_tx_dma_irq();
+}
+
+/**
+  * @brief This function handles DMA2 channel 7 global interrupt (USART1 RX).
+  */
+void DMA2_Channel7_IRQHandler(void)
+{
+  link_rx_dma_irq();
+}
+
+/**
+  * @brief This function handles USART1 global interrupt (board link).
+  */
+void USART1_IRQHandler(void)
+{
+  link_uart_irq();
+}
+
+/**
+  * @brief This function handles DMA2 channel 1 global interrupt (UART5 TX).
+  */
+void DMA2_Channel1_IRQHandler(void)
+{
+  ringbus_tx_dma_irq();
+}
+
+/**
+  * @brief This function handles DMA2 channel 2 global interrupt (UART5 RX).
+  */
+void DMA2_Channel2_IRQHandler(void)
+{
+  ringbus_rx_dma_irq();
+}
+
+/**
+  * @brief This function handles UART5 global interrupt (board ring).
+  */
+void UART5_IRQHandler(void)
+{
+  ringbus_uart_irq();
+}
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -0,0 +1,251 @@
+/*
+ * telemetry.c
+ *
+ * Game events as COBS-framed binary records on USART2, sent by DMA
+ *
+ * The ring indices run freely and are masked on use. telemetry_send() is
+ * the only writer of head, the DMA completion the only writer of tail;
+ * in_flight (the length of the running transfer) is only touched with
+ * interrupts locked or from the DMA handler.
+ *
+ * The text buffer is task context only: telemetry_text() writes it, the
+ * telemetry task reads it.
+ */
+
+#include "telemetry.h"
+#include "cobs.h"
+#include "power.h"
+#include "sched.h"
+#include "timebase.h"
+#include "stm32l4xx_hal.h"
+
+#define RING_MASK   (TELEMETRY_RING - 1u)
+#define TEXT_MASK   (TELEMETRY_TEXT - 1u)
+#define HEADER      6u      /* type, seq, time_ms */
+#define FRAME_MAX   (HEADER + TELEMETRY_PAYLOAD_MAX + 1u)
+#define TELEMETRY_DEADLINE_US  5000
+
+static uint8_t ring[TELEMETRY_RING];
+static volatile uint16_t head = 0;
+static volatile uint16_t tail = 0;
+static volatile uint16_t in_flight = 0;
+static volatile uint8_t active = 0;     /* holding STOP2 off */
+static uint8_t seq = 0;
+static uint32_t overflows = 0;
+
+static char text_buf[TELEMETRY_TEXT];
+static uint16_t text_head = 0;
+static uint16_t text_tail = 0;
+
+static DMA_HandleTypeDef hdma_tx;
+
+static void telemetry_run(void *arg);
+
+static Task telemetry_task = {
+    .name = "telemetry", .run = telemetry_run, .deadline_us = TELEMETRY_DEADLINE_US
+};
+
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/* Send the next contiguous stretch of the ring, or once it is empty have
+   the USART say when the last byte is out. Interrupts locked. */
+static void start_next(void) {
+    uint16_t pending = (uint16_t)(head - tail);
+
+    if (pending == 0) {
+        if (active) {
+            USART2->CR1 |= USART_CR1_TCIE;
+        }
+        return;
+    }
+
+    USART2->CR1 &= ~USART_CR1_TCIE;
+    if (!active) {
+        active = 1;
+        power_stop_inhibit(1);
+    }
+
+    uint16_t at = tail & RING_MASK;
+    uint16_t chunk = (pending < TELEMETRY_RING - at) ? pending : (uint16_t)(TELEMETRY_RING - at);
+
+    in_flight = chunk;
+    if (HAL_DMA_Start_IT(&hdma_tx, (uint32_t)&ring[at], (uint32_t)&USART2->TDR, chunk) != HAL_OK) {
+        /* Channel busy or in error: drop the stretch rather than stall */
+        tail += chunk;
+        in_flight = 0;
+    }
+}
+
+/* Transfer complete (or failed, the bytes are lost either way) */
+static void transfer_done(DMA_HandleTypeDef *hdma) {
+    (void)hdma;
+    tail += in_flight;
+    in_flight = 0;
+    start_next();
+}
+
+/* Telemetry task: the queued text as TLM_TEXT records, each up to a line
+   end or the payload size; what the ring has no room for waits */
+static void telemetry_run(void *arg) {
+    uint64_t now = timebase_us();
+    uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+
+    (void)arg;
+    while (text_tail != text_head) {
+        uint8_t len = 0;
+
+        while ((uint16_t)(text_tail + len) != text_head && len < TELEMETRY_PAYLOAD_MAX) {
+            payload[len] = (uint8_t)text_buf[(text_tail + len) & TEXT_MASK];
+            if (payload[len++] == '\n') {
+                break;
+            }
+        }
+        if (!telemetry_send(TLM_TEXT, now, payload, len)) {
+            sched_wake_at(&telemetry_task, now + TELEMETRY_RETRY_US);
+            return;
+        }
+        text_tail = (uint16_t)(text_tail + len);
+    }
+}
+
+/**
+ * Set up DMA1 Channel 7 for USART2 transmit
+ */
+void telemetry_init(void) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma_tx.Instance = DMA1_Channel7;
+    hdma_tx.Init.Request = DMA_REQUEST_2;   /* USART2_TX */
+    hdma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_tx.Init.Mode = DMA_NORMAL;
+    hdma_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_tx) != HAL_OK) {
+        Error_Handler();
+    }
+    hdma_tx.XferCpltCallback = transfer_done;
+    hdma_tx.XferErrorCallback = transfer_done;
+
+    USART2->CR3 |= USART_CR3_DMAT;
+
+    HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+    HAL_NVIC_SetPriority(USART2_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(USART2_IRQn);
+}
+
+/**
+ * Queue one record
+ */
+int telemetry_send(uint8_t type, uint64_t at_us, const uint8_t *payload, uint8_t len) {
+    uint8_t frame[FRAME_MAX];
+    uint8_t encoded[COBS_MAX(FRAME_MAX) + 1];
+    uint32_t time_ms = (uint32_t)(at_us / 1000u);
+
+    if (len > TELEMETRY_PAYLOAD_MAX) {
+        len = TELEMETRY_PAYLOAD_MAX;
+    }
+
+    frame[0] = type;
+    frame[1] = seq++;
+    for (int n = 0; n < 4; n++) {
+        frame[2 + n] = (uint8_t)(time_ms >> (8 * n));
+    }
+    for (uint8_t n = 0; n < len; n++) {
+        frame[HEADER + n] = payload[n];
+    }
+    frame[HEADER + len] = crc8(frame, HEADER + len);
+
+    uint32_t size = cobs_encode(frame, HEADER + len + 1u, encoded);
+
+    encoded[size++] = 0;
+
+    if ((uint32_t)(TELEMETRY_RING - (uint16_t)(head - tail)) < size) {
+        overflows++;
+        return 0;
+    }
+
+    uint16_t h = head;
+
+    for (uint32_t n = 0; n < size; n++) {
+        ring[(h + n) & RING_MASK] = encoded[n];
+    }
+    __DMB();
+    head = (uint16_t)(h + size);
+
+    uint32_t primask = lock();
+
+    if (in_flight == 0) {
+        start_next();
+    }
+    unlock(primask);
+    return 1;
+}
+
+/**
+ * Add the telemetry task
+ */
+void telemetry_start(void) {
+    text_head = text_tail = 0;
+    sched_add(&telemetry_task);
+}
+
+/**
+ * Queue text for the telemetry task
+ */
+int telemetry_text(const char *text, uint32_t len) {
+    if (len > (uint32_t)(TELEMETRY_TEXT - (uint16_t)(text_head - text_tail))) {
+        return 0;
+    }
+    for (uint32_t n = 0; n < len; n++) {
+        text_buf[(text_head + n) & TEXT_MASK] = text[n];
+    }
+    text_head = (uint16_t)(text_head + len);
+    sched_signal(&telemetry_task);
+    return 1;
+}
+
+/**
+ * Text bytes queued and not yet sent
+ */
+uint32_t telemetry_text_pending(void) {
+    return (uint16_t)(text_head - text_tail);
+}
+
+/**
+ * Records dropped because the ring was full
+ */
+uint32_t telemetry_overflows(void) {
+    return overflows;
+}
+
+/**
+ * DMA1 Channel 7 interrupt handler hook
+ */
+void telemetry_dma_irq(void) {
+    HAL_DMA_IRQHandler(&hdma_tx);
+}
+
+/**
+ * USART2 interrupt handler hook
+ */
+void telemetry_uart_irq(void) {
+    if ((USART2->CR1 & USART_CR1_TCIE) && (USART2->ISR & USART_ISR_TC)) {
+        USART2->CR1 &= ~USART_CR1_TCIE;
+        if (in_flight == 0 && head == tail && active) {
+            active = 0;
+            power_stop_inhibit(0);
+        }
+    }
+}
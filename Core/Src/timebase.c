@@ -0,0 +1,151 @@
+/*
+ * timebase.c
+ *
+ * Monotonic 64-bit microsecond clock on TIM2
+ *
+ * time = base_us + (overflows << 32) + TIM2->CNT
+ *
+ * base_us absorbs counter restarts (prescaler reloads), so the clock stays
+ * monotonic across system clock changes.
+ */
+
+#include "timebase.h"
+#include "prof.h"
+#include "stm32l4xx_hal.h"
+
+static uint64_t base_us = 0;
+static volatile uint32_t overflows = 0;
+
+/* Interrupt lock, overflow count and counter must be read together */
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/* TIM2 kernel clock: PCLK1, doubled when the APB1 prescaler is not 1 */
+static uint32_t tim2_clock(void) {
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_CFGR_PPRE1_DIV1) {
+        return pclk1;
+    }
+    return pclk1 * 2;
+}
+
+/* Time with interrupts already locked */
+static uint64_t now_locked(void) {
+    uint32_t hi = overflows;
+    uint32_t cnt = TIM2->CNT;
+
+    /* Overflow not serviced yet (we may be running above TIM2_IRQn) */
+    if ((TIM2->SR & TIM_SR_UIF) && cnt < 0x80000000u) {
+        hi++;
+    }
+
+    return base_us + ((uint64_t)hi << 32) + cnt;
+}
+
+/* Restart the counter with a fresh prescaler, base_us keeps the time */
+static void restart_counter(void) {
+    TIM2->CR1 = 0;
+    TIM2->PSC = tim2_clock() / 1000000u - 1;
+    TIM2->ARR = 0xFFFFFFFFu;
+    TIM2->CNT = 0;
+    TIM2->EGR = TIM_EGR_UG;     /* load PSC now */
+    TIM2->SR = 0;
+    overflows = 0;
+    TIM2->CR1 = TIM_CR1_CEN;
+}
+
+/**
+ * Start TIM2 at 1 MHz, the clock reads 0 right after this call
+ */
+void timebase_init(void) {
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    base_us = 0;
+    restart_counter();
+    TIM2->DIER = TIM_DIER_UIE;
+
+    HAL_NVIC_SetPriority(TIM2_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+/**
+ * Current time
+ */
+uint64_t timebase_us(void) {
+    PROF_BEGIN(TIMEBASE_US);
+    uint32_t primask = lock();
+    uint64_t now = now_locked();
+    unlock(primask);
+
+    PROF_END(TIMEBASE_US);
+    return now;
+}
+
+/**
+ * Arm the wake-up alarm, replacing any earlier alarm
+ */
+int timebase_alarm(uint64_t at_us) {
+    uint32_t primask = lock();
+    uint64_t now = now_locked();
+
+    if (at_us <= now) {
+        unlock(primask);
+        return 0;
+    }
+
+    /* Alarms more than one counter period away fire early, harmlessly */
+    TIM2->CCR1 = (uint32_t)(at_us - base_us);
+    TIM2->SR = ~TIM_SR_CC1IF;
+    TIM2->DIER |= TIM_DIER_CC1IE;
+
+    unlock(primask);
+    return 1;
+}
+
+/**
+ * Reload the prescaler after a system clock change, keeps the count
+ */
+void timebase_recalibrate(void) {
+    uint32_t primask = lock();
+
+    base_us = now_locked();
+    TIM2->DIER &= ~TIM_DIER_CC1IE;
+    restart_counter();
+
+    unlock(primask);
+}
+
+/**
+ * Account for time TIM2 did not see
+ */
+void timebase_advance(uint64_t us) {
+    uint32_t primask = lock();
+    base_us += us;
+    unlock(primask);
+}
+
+/**
+ * TIM2 interrupt handler hook
+ */
+void timebase_irq(void) {
+    uint32_t sr = TIM2->SR;
+
+    if (sr & TIM_SR_UIF) {
+        TIM2->SR = ~TIM_SR_UIF;
+        overflows++;
+    }
+
+    /* The alarm only has to wake the CPU, disarm it */
+    if ((sr & TIM_SR_CC1IF) && (TIM2->DIER & TIM_DIER_CC1IE)) {
+        TIM2->SR = ~TIM_SR_CC1IF;
+        TIM2->DIER &= ~TIM_DIER_CC1IE;
+    }
+}
@@ -1,35 +1,261 @@
 /*
  * timer.c
  *
- * Non-blocking timer module using HAL_GetTick()
+ * Software timer wheel driven by SysTick
+ *
+ * Level n has 64 slots of 64^n ticks each. A timer goes into the lowest
+ * level whose range covers its remaining time. Whenever a lower level wraps,
+ * the matching slot of the level above is emptied and its timers are
+ * re-inserted, moving them one level closer to expiry (cascading).
  */
 
 #include "timer.h"
+#include "timebase.h"
 #include "stm32l4xx_hal.h"
 
-static uint32_t timer_start_time = 0;
-static uint32_t timer_duration = 0;
+#define WHEEL_BITS    6
+#define WHEEL_SIZE    (1u << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS  4
+#define WHEEL_RANGE   (1u << (WHEEL_BITS * WHEEL_LEVELS))
+
+static SoftTimer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static volatile uint32_t wheel_now = 0;
+
+/* Interrupt lock, so the main loop can edit lists that SysTick walks */
+static inline uint32_t lock(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void unlock(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+static void unlink(SoftTimer *t) {
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = 0;
+    t->pprev = 0;
+}
+
+/* Put a pending timer into the slot that covers its remaining time.
+   Timers cascaded with no time left land in the level 0 slot that
+   timer_tick() is about to run. */
+static void insert(SoftTimer *t) {
+    uint32_t delta = t->expires - wheel_now;
+    uint32_t when = t->expires;
+    int level = 0;
+
+    if (delta >= 0x80000000u) {
+        /* Overdue: next tick */
+        when = wheel_now + 1;
+        delta = 1;
+    } else if (delta >= WHEEL_RANGE) {
+        /* Beyond the wheel: park in the top level, re-cascaded later */
+        when = wheel_now + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+
+    while (level < WHEEL_LEVELS - 1 && delta >= (1u << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    SoftTimer **slot = &wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+    t->next = *slot;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = slot;
+    *slot = t;
+}
+
+/* Move every timer of one upper-level slot down the wheel */
+static void cascade(int level) {
+    SoftTimer **slot = &wheel[level][(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    SoftTimer *t;
+
+    while ((t = *slot) != 0) {
+        unlink(t);
+        insert(t);
+    }
+}
+
+/**
+ * Reset the wheel, all timers are forgotten
+ */
+void timer_wheel_init(void) {
+    uint32_t primask = lock();
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (uint32_t i = 0; i < WHEEL_SIZE; i++) {
+            wheel[level][i] = 0;
+        }
+    }
+    wheel_now = 0;
+
+    unlock(primask);
+}
+
+/**
+ * Advance the wheel by one millisecond, runs in SysTick context
+ */
+void timer_tick(void) {
+    uint32_t now = wheel_now + 1;
+    wheel_now = now;
+
+    /* Cascade from the top so timers can fall through several levels */
+    for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if ((now & ((1u << (WHEEL_BITS * level)) - 1)) == 0) {
+            cascade(level);
+        }
+    }
+
+    /* Detach the due slot so callbacks may start or stop any timer */
+    SoftTimer *due = wheel[0][now & WHEEL_MASK];
+    SoftTimer *t;
+
+    wheel[0][now & WHEEL_MASK] = 0;
+    if (due) {
+        due->pprev = &due;
+    }
+
+    while ((t = due) != 0) {
+        unlink(t);
+
+        if (t->period) {
+            t->expires += t->period;
+            insert(t);
+        } else {
+            t->state = TIMER_EXPIRED;
+        }
+
+        if (t->callback) {
+            t->callback(t->arg);
+        }
+    }
+}
+
+/**
+ * Advance the wheel by several milliseconds at once
+ */
+void timer_advance(uint32_t ticks) {
+    while (ticks--) {
+        uint32_t primask = lock();
+        timer_tick();
+        unlock(primask);
+    }
+}
+
+/**
+ * Time until the wheel next needs attention
+ */
+int timer_next_expiry(uint32_t *ticks) {
+    uint32_t primask = lock();
+    uint32_t now = wheel_now;
+    uint32_t best = 0;
+
+    /* Level 0 holds everything due in the next 64 ticks, exactly */
+    for (uint32_t k = 1; k <= WHEEL_SIZE; k++) {
+        if (wheel[0][(now + k) & WHEEL_MASK]) {
+            best = k;
+            break;
+        }
+    }
+
+    /* Higher levels: the first cascade that moves a timer down */
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        uint32_t shift = WHEEL_BITS * level;
+
+        for (uint32_t k = 1; k <= WHEEL_SIZE; k++) {
+            uint32_t boundary = ((now >> shift) + k) << shift;
+
+            if (wheel[level][(boundary >> shift) & WHEEL_MASK]) {
+                if (best == 0 || boundary - now < best) {
+                    best = boundary - now;
+                }
+                break;
+            }
+        }
+    }
+
+    unlock(primask);
+
+    *ticks = best;
+    return best != 0;
+}
+
+/**
+ * Current wheel time
+ */
+uint32_t timer_ticks(void) {
+    return wheel_now;
+}
 
 /**
- * Start a non-blocking timer
- * @param ms Duration in milliseconds
+ * Start (or restart) a timer
  */
-void timer_init(uint32_t ms) {
-    timer_start_time = HAL_GetTick();
-    timer_duration = ms;
+void timer_start(SoftTimer *t, uint32_t ms, uint32_t period_ms,
+                 TimerCallback callback, void *arg) {
+    uint32_t primask = lock();
+
+    if (t->state == TIMER_PENDING) {
+        unlink(t);
+    }
+
+    t->expires = wheel_now + (ms ? ms : 1);
+    t->period = period_ms;
+    t->callback = callback;
+    t->arg = arg;
+    t->state = TIMER_PENDING;
+    insert(t);
+
+    unlock(primask);
 }
 
 /**
- * Check if timer has expired
- * @return 0 (still running) or 1 (expired)
+ * Stop a timer, safe to call on an idle or expired timer
  */
-int timer_now(void) {
-    uint32_t current_time = HAL_GetTick();
-    uint32_t elapsed_time = current_time - timer_start_time;
+void timer_stop(SoftTimer *t) {
+    uint32_t primask = lock();
 
-    if (elapsed_time >= timer_duration) {
-        return 1;
-    } else {
-        return 0;
+    if (t->state == TIMER_PENDING) {
+        unlink(t);
     }
+    t->state = TIMER_IDLE;
+
+    unlock(primask);
+}
+
+/**
+ * Check if a one-shot timer has expired
+ */
+int timer_expired(const SoftTimer *t) {
+    return t->state == TIMER_EXPIRED;
+}
+
+/**
+ * Check if a timer is waiting to expire
+ */
+int timer_active(const SoftTimer *t) {
+    return t->state == TIMER_PENDING;
+}
+
+/**
+ * Start a microsecond one-shot timer and arm the wake-up alarm
+ */
+void timer_us_start(UsTimer *t, uint32_t us) {
+    t->deadline = timebase_us() + us;
+    timebase_alarm(t->deadline);
+}
+
+/**
+ * Check if a microsecond timer has expired
+ */
+int timer_us_expired(const UsTimer *t) {
+    return timebase_us() >= t->deadline;
 }
@@ -0,0 +1,290 @@
+/*
+ * tourney.c
+ *
+ * Tournament over the tables of a ring, free of hardware
+ */
+
+#include "tourney.h"
+#include <stdio.h>
+
+/* Ring message kinds */
+enum {
+    MSG_START = 1,      /* mode u8, tables u8, id u32 */
+    MSG_RESULT,         /* round u8, table u8, left u8, right u8 */
+};
+
+static uint8_t matches(const Tourney *t) {
+    return (t->mode == TOURNEY_KNOCKOUT) ? (uint8_t)(t->slot_count / 2u) : t->tables;
+}
+
+/* Round-robin: entrant at a place of the circle in the current round */
+static uint8_t circle(const Tourney *t, uint8_t place) {
+    if (place == 0) {
+        return 0;
+    }
+    return (uint8_t)(1u + (place - 1u + t->round) % (t->entrants - 1u));
+}
+
+static void pair(const Tourney *t, uint8_t match, uint8_t *left, uint8_t *right) {
+    if (t->mode == TOURNEY_KNOCKOUT) {
+        *left = t->slots[match];
+        *right = t->slots[t->slot_count - 1u - match];
+    } else {
+        *left = circle(t, match);
+        *right = circle(t, (uint8_t)(t->entrants - 1u - match));
+    }
+}
+
+/* Put the round's matches on tables; byes go through at once */
+static void draw(Tourney *t) {
+    uint8_t table = 0;
+
+    for (uint8_t n = 0; n < TOURNEY_TABLES_MAX; n++) {
+        t->match_of[n] = TOURNEY_NONE;
+    }
+    for (uint8_t m = 0; m < matches(t); m++) {
+        uint8_t left;
+        uint8_t right;
+
+        pair(t, m, &left, &right);
+        t->played[m] = 0;
+        if (left == TOURNEY_NONE || right == TOURNEY_NONE) {
+            t->winner[m] = (left == TOURNEY_NONE) ? right : left;
+            t->played[m] = 1;
+        } else {
+            t->match_of[table++] = m;
+        }
+    }
+}
+
+/* Count a result; the round goes on with settle() */
+static int record(Tourney *t, uint8_t table, uint8_t left_score, uint8_t right_score) {
+    uint8_t left;
+    uint8_t right;
+
+    if (left_score == right_score || !tourney_pairing(t, table, &left, &right)) {
+        return 0;
+    }
+
+    uint8_t m = t->match_of[table];
+    uint8_t won = (left_score > right_score) ? left : right;
+    uint8_t lost = (won == left) ? right : left;
+    int16_t margin = (int16_t)((left_score > right_score) ? left_score - right_score
+                                                         : right_score - left_score);
+
+    t->wins[won]++;
+    t->losses[lost]++;
+    t->diff[won] = (int16_t)(t->diff[won] + margin);
+    t->diff[lost] = (int16_t)(t->diff[lost] - margin);
+    t->winner[m] = won;
+    t->played[m] = 1;
+    return 1;
+}
+
+/* Next round for as long as the current one is complete */
+static void settle(Tourney *t) {
+    while (!t->done) {
+        for (uint8_t m = 0; m < matches(t); m++) {
+            if (!t->played[m]) {
+                return;
+            }
+        }
+
+        t->round++;
+        if (t->mode == TOURNEY_KNOCKOUT) {
+            uint8_t m = matches(t);
+
+            for (uint8_t n = 0; n < m; n++) {
+                t->slots[n] = t->winner[n];
+            }
+            t->slot_count = m;
+        }
+        if (t->round == t->rounds) {
+            t->done = 1;
+            return;
+        }
+        draw(t);
+        for (uint8_t table = 0; table < t->tables; table++) {
+            if (t->early_set[table]) {
+                t->early_set[table] = 0;
+                record(t, table, t->early[table][0], t->early[table][1]);
+            }
+        }
+    }
+}
+
+/**
+ * Start a tournament
+ */
+void tourney_reset(Tourney *t, uint32_t id, uint8_t mode, uint8_t tables) {
+    if (tables == 0) {
+        tables = 1;
+    }
+    if (tables > TOURNEY_TABLES_MAX) {
+        tables = TOURNEY_TABLES_MAX;
+    }
+
+    t->id = id;
+    t->mode = mode;
+    t->tables = tables;
+    t->entrants = (uint8_t)(2u * tables);
+    t->round = 0;
+    t->done = 0;
+    for (uint8_t n = 0; n < TOURNEY_TABLES_MAX; n++) {
+        t->early_set[n] = 0;
+    }
+    for (uint8_t e = 0; e < TOURNEY_ENTRANTS_MAX; e++) {
+        t->wins[e] = 0;
+        t->losses[e] = 0;
+        t->diff[e] = 0;
+    }
+
+    if (mode == TOURNEY_KNOCKOUT) {
+        uint8_t size = 2;
+
+        t->rounds = 1;
+        while (size < t->entrants) {
+            size = (uint8_t)(size * 2u);
+            t->rounds++;
+        }
+        for (uint8_t s = 0; s < size; s++) {
+            t->slots[s] = (s < t->entrants) ? s : TOURNEY_NONE;
+        }
+        t->slot_count = size;
+    } else {
+        t->rounds = (uint8_t)(t->entrants - 1u);
+        t->slot_count = 0;
+    }
+    draw(t);
+    settle(t);
+}
+
+/**
+ * A table's match in the current round, while it has no result
+ */
+int tourney_pairing(const Tourney *t, uint8_t table, uint8_t *left, uint8_t *right) {
+    if (t->done || table >= t->tables || t->match_of[table] == TOURNEY_NONE ||
+        t->played[t->match_of[table]]) {
+        return 0;
+    }
+    pair(t, t->match_of[table], left, right);
+    return 1;
+}
+
+/**
+ * Enter a match result
+ */
+int tourney_result(Tourney *t, uint8_t round, uint8_t table, uint8_t left_score, uint8_t right_score) {
+    if (!t->done && round == (uint8_t)(t->round + 1u) && table < t->tables &&
+        left_score != right_score && !t->early_set[table]) {
+        /* Its sender has the whole of this round, we are still missing
+           some of it: keep it for the draw */
+        t->early[table][0] = left_score;
+        t->early[table][1] = right_score;
+        t->early_set[table] = 1;
+        return 1;
+    }
+    if (round != t->round || !record(t, table, left_score, right_score)) {
+        return 0;
+    }
+    settle(t);
+    return 1;
+}
+
+static int ahead(const Tourney *t, uint8_t a, uint8_t b) {
+    if (t->wins[a] != t->wins[b]) {
+        return t->wins[a] > t->wins[b];
+    }
+    if (t->diff[a] != t->diff[b]) {
+        return t->diff[a] > t->diff[b];
+    }
+    return a < b;
+}
+
+/**
+ * Entrants in standings order
+ */
+uint8_t tourney_standings(const Tourney *t, uint8_t *order) {
+    for (uint8_t e = 0; e < t->entrants; e++) {
+        uint8_t at = e;
+
+        while (at > 0 && ahead(t, e, order[at - 1])) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = e;
+    }
+    return t->entrants;
+}
+
+/**
+ * Ring message starting a tournament
+ */
+uint8_t tourney_start_message(const Tourney *t, uint8_t *out) {
+    out[0] = MSG_START;
+    out[1] = t->mode;
+    out[2] = t->tables;
+    for (int n = 0; n < 4; n++) {
+        out[3 + n] = (uint8_t)(t->id >> (8 * n));
+    }
+    return 7;
+}
+
+/**
+ * Ring message with a result
+ */
+uint8_t tourney_result_message(uint8_t round, uint8_t table, uint8_t left_score,
+                               uint8_t right_score, uint8_t *out) {
+    out[0] = MSG_RESULT;
+    out[1] = round;
+    out[2] = table;
+    out[3] = left_score;
+    out[4] = right_score;
+    return 5;
+}
+
+/**
+ * Apply a ring message
+ */
+int tourney_message(Tourney *t, const uint8_t *bytes, uint8_t len) {
+    if (len == 7 && bytes[0] == MSG_START) {
+        uint32_t id = (uint32_t)bytes[3] | (uint32_t)bytes[4] << 8 |
+                      (uint32_t)bytes[5] << 16 | (uint32_t)bytes[6] << 24;
+
+        if (id == t->id && bytes[2] == t->tables) {
+            return 0;
+        }
+        tourney_reset(t, id, bytes[1], bytes[2]);
+        return 1;
+    }
+    if (len == 5 && bytes[0] == MSG_RESULT) {
+        return tourney_result(t, bytes[1], bytes[2], bytes[3], bytes[4]);
+    }
+    return 0;
+}
+
+/**
+ * Standings as text
+ */
+uint32_t tourney_format(const Tourney *t, char *out, uint32_t size) {
+    uint8_t order[TOURNEY_ENTRANTS_MAX];
+    uint32_t len = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+    out[0] = '\0';
+    tourney_standings(t, order);
+    for (uint8_t n = 0; n < t->entrants && len + 1u < size; n++) {
+        uint8_t e = order[n];
+        int w = snprintf(out + len, size - len, "%2u. P%-2u %u-%u %+d\n", n + 1u, e,
+                         t->wins[e], t->losses[e], t->diff[e]);
+
+        if (w < 0 || (uint32_t)w >= size - len) {
+            out[len] = '\0';    /* whole lines only */
+            break;
+        }
+        len += (uint32_t)w;
+    }
+    return len;
+}
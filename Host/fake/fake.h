@@ -0,0 +1,94 @@
+/*
+ * fake.h
+ *
+ * Control side of the host fakes
+ *
+ * Time on the host is virtual. timebase_us() reads a counter that only
+ * moves when the code under test sleeps (power_idle_until) or a test calls
+ * vclock_advance_to(); the move is instant, and SysTick (HAL tick plus
+ * timer_tick) fires at every millisecond boundary crossed on the way.
+ * Simulated interrupts (button edges, ...) are queued with vclock_at() and
+ * run at their exact virtual time, in order with the ticks.
+ */
+
+#ifndef FAKE_H_
+#define FAKE_H_
+
+#include "telemetry.h"
+#include <stdint.h>
+
+#define VCLOCK_NEVER  UINT64_MAX
+
+/* A telemetry_send() call */
+typedef struct {
+    uint8_t type;
+    uint64_t at_us;
+    uint8_t len;
+    uint8_t payload[TELEMETRY_PAYLOAD_MAX];
+} FakeRecord;
+
+typedef void (*VclockFn)(void *arg);
+
+/**
+ * Time 0, no queued interrupts, no limit
+ */
+void vclock_reset(void);
+
+/**
+ * Current virtual time, same as timebase_us()
+ */
+uint64_t vclock_now(void);
+
+/**
+ * Queue a simulated interrupt
+ * @param at_us Virtual time to run it at (now if already passed)
+ * @param fn Handler
+ * @param arg Passed to fn
+ * @return 1 if queued, 0 if the queue is full
+ */
+int vclock_at(uint64_t at_us, VclockFn fn, void *arg);
+
+/**
+ * Move time forward, running ticks and queued interrupts on the way
+ * @param at_us Target time, ignored if not in the future
+ */
+void vclock_advance_to(uint64_t at_us);
+
+/**
+ * Never let power_idle_until() sleep past this time
+ * @param at_us Limit, VCLOCK_NEVER for none
+ */
+void vclock_set_limit(uint64_t at_us);
+
+/**
+ * Number of times power_idle_until() found nothing to wake it
+ * (no deadline, no timer, no interrupt, no limit): a hang on target
+ */
+uint32_t vclock_stalls(void);
+
+/**
+ * Apply pending BSRR writes of every port to ODR
+ */
+void fake_gpio_latch(void);
+
+/**
+ * Put all ports back in their reset state, inputs pulled high
+ */
+void fake_gpio_reset(void);
+
+/**
+ * Number of clock profile changes since clock_init()
+ */
+uint32_t fake_clock_switches(void);
+
+/**
+ * Number of telemetry records sent since telemetry_init()
+ */
+uint32_t fake_telemetry_count(void);
+
+/**
+ * The n-th telemetry record sent since telemetry_init(), NULL if none
+ */
+const FakeRecord *fake_telemetry(uint32_t n);
+
+#endif /* FAKE_H_ */
@@ -0,0 +1,235 @@
+/*
+ * fake_hal.c
+ *
+ * Host fake of the HAL pieces the game modules use: GPIO ports, the HAL
+ * tick and the interrupt mask, plus stand-ins for the modules that drive
+ * timers, DMA and clocks directly (ledpwm, clock).
+ */
+
+#include "stm32l4xx_hal.h"
+#include "main.h"
+#include "ledpwm.h"
+#include "clock.h"
+#include "keys.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "fake.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+GPIO_TypeDef fake_gpioa, fake_gpiob, fake_gpioc, fake_gpioh;
+uint32_t fake_primask = 0;
+volatile uint32_t uwTick = 0;
+
+static GPIO_TypeDef *const ports[] = { GPIOA, GPIOB, GPIOC, GPIOH };
+
+/**
+ * Apply pending BSRR writes of every port to ODR
+ */
+void fake_gpio_latch(void) {
+    for (size_t p = 0; p < sizeof(ports) / sizeof(ports[0]); p++) {
+        uint32_t bsrr = ports[p]->BSRR;
+
+        /* Set wins over reset, as on the real register */
+        ports[p]->ODR = (ports[p]->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFFu);
+        ports[p]->BSRR = 0;
+    }
+}
+
+/**
+ * Put all ports back in their reset state, inputs pulled high
+ */
+void fake_gpio_reset(void) {
+    for (size_t p = 0; p < sizeof(ports) / sizeof(ports[0]); p++) {
+        memset((void *)ports[p], 0, sizeof(GPIO_TypeDef));
+        ports[p]->IDR = 0xFFFF;
+    }
+}
+
+uint32_t HAL_GetTick(void) {
+    return uwTick;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+    GPIOx->BSRR = (PinState == GPIO_PIN_SET) ? GPIO_Pin : (uint32_t)GPIO_Pin << 16;
+    fake_gpio_latch();
+}
+
+void Error_Handler(void) {
+    fprintf(stderr, "Error_Handler() called\n");
+    abort();
+}
+
+/* ledpwm: no TIM1/DMA on the host, frames with dimmed LEDs are only
+   recorded. Host tests run with leds_pwm_enable(0). */
+
+static uint32_t wave[LEDPWM_MAX_PORTS][LEDPWM_SLOTS];
+static int pwm_running = 0;
+
+void ledpwm_init(void) {
+    pwm_running = 0;
+}
+
+void ledpwm_start(GPIO_TypeDef *const ports_in[], int count) {
+    (void)ports_in;
+    pwm_running = (count >= 1 && count <= LEDPWM_MAX_PORTS);
+}
+
+void ledpwm_stop(void) {
+    pwm_running = 0;
+}
+
+void ledpwm_recalibrate(void) {
+}
+
+int ledpwm_running(void) {
+    return pwm_running;
+}
+
+uint32_t *ledpwm_wave(int port) {
+    return wave[port];
+}
+
+void ledpwm_commit(void) {
+}
+
+void ledpwm_dma_irq(void) {
+}
+
+/* keys: no TIM5/DMA on the host, the board feeds button_irq() directly
+   like a KEYS_SAMPLED 0 build */
+
+void keys_init(void) {
+}
+
+void keys_wake(void) {
+}
+
+uint64_t keys_poll(void) {
+    return UINT64_MAX;
+}
+
+uint32_t keys_pressed(void) {
+    return 0;
+}
+
+void keys_recalibrate(void) {
+}
+
+/* telemetry: no USART or DMA on the host, records are kept for tests */
+
+#define RECORDS 256
+
+static FakeRecord records[RECORDS];
+static uint32_t record_count = 0;
+
+void telemetry_init(void) {
+    record_count = 0;
+}
+
+int telemetry_send(uint8_t type, uint64_t at_us, const uint8_t *payload, uint8_t len) {
+    if (record_count == RECORDS) {
+        return 0;
+    }
+
+    FakeRecord *r = &records[record_count++];
+
+    r->type = type;
+    r->at_us = at_us;
+    r->len = (len < sizeof(r->payload)) ? len : (uint8_t)sizeof(r->payload);
+    memcpy(r->payload, payload, r->len);
+    return 1;
+}
+
+/* No telemetry task on the host: text goes out at once, a record per
+   line or payload */
+void telemetry_start(void) {
+}
+
+int telemetry_text(const char *text, uint32_t len) {
+    uint32_t sent = 0;
+
+    while (sent < len) {
+        uint8_t n = 0;
+
+        while (sent + n < len && n < TELEMETRY_PAYLOAD_MAX && text[sent + n++] != '\n') {
+        }
+        if (!telemetry_send(TLM_TEXT, timebase_us(), (const uint8_t *)text + sent, n)) {
+            return 0;
+        }
+        sent += n;
+    }
+    return 1;
+}
+
+uint32_t telemetry_text_pending(void) {
+    return 0;
+}
+
+uint32_t telemetry_overflows(void) {
+    return 0;
+}
+
+void telemetry_dma_irq(void) {
+}
+
+void telemetry_uart_irq(void) {
+}
+
+/**
+ * Records sent since telemetry_init()
+ */
+uint32_t fake_telemetry_count(void) {
+    return record_count;
+}
+
+/**
+ * The n-th record sent since telemetry_init()
+ */
+const FakeRecord *fake_telemetry(uint32_t n) {
+    return (n < record_count) ? &records[n] : NULL;
+}
+
+/* clock: remember the profile so tests can check the game's requests */
+
+static ClockProfile profile = CLOCK_PROFILE_RUN;
+static uint32_t switches = 0;
+
+void clock_init(void) {
+    profile = CLOCK_PROFILE_RUN;
+    switches = 0;
+}
+
+void clock_set_profile(ClockProfile next) {
+    if (next != profile) {
+        profile = next;
+        switches++;
+    }
+}
+
+ClockProfile clock_profile(void) {
+    return profile;
+}
+
+void clock_restore(void) {
+}
+
+uint32_t clock_last_switch_us(void) {
+    return 0;
+}
+
+uint32_t clock_max_switch_us(void) {
+    return 0;
+}
+
+/**
+ * Number of profile changes since clock_init()
+ */
+uint32_t fake_clock_switches(void) {
+    return switches;
+}
@@ -0,0 +1,92 @@
+/*
+ * stm32l4xx_hal.h (host fake)
+ *
+ * Just enough of the STM32L4 HAL and CMSIS for the hardware-independent
+ * modules to compile on a PC. GPIO ports are plain structs in RAM; a write
+ * to BSRR is latched into ODR by fake_gpio_latch() (see fake.h), which the
+ * virtual clock calls whenever time moves. Interrupt masking is a flag, since host tests
+ * are single-threaded.
+ */
+
+#ifndef FAKE_STM32L4XX_HAL_H_
+#define FAKE_STM32L4XX_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    HAL_OK = 0x00,
+    HAL_ERROR = 0x01,
+    HAL_BUSY = 0x02,
+    HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+    volatile uint32_t BRR;
+    volatile uint32_t ASCR;
+} GPIO_TypeDef;
+
+typedef struct {
+    void *Instance;
+    struct {
+        uint32_t BaudRate;
+    } Init;
+} UART_HandleTypeDef;
+
+extern GPIO_TypeDef fake_gpioa, fake_gpiob, fake_gpioc, fake_gpioh;
+
+#define GPIOA  (&fake_gpioa)
+#define GPIOB  (&fake_gpiob)
+#define GPIOC  (&fake_gpioc)
+#define GPIOH  (&fake_gpioh)
+
+#define GPIO_PIN_0   ((uint16_t)0x0001)
+#define GPIO_PIN_1   ((uint16_t)0x0002)
+#define GPIO_PIN_2   ((uint16_t)0x0004)
+#define GPIO_PIN_3   ((uint16_t)0x0008)
+#define GPIO_PIN_4   ((uint16_t)0x0010)
+#define GPIO_PIN_5   ((uint16_t)0x0020)
+#define GPIO_PIN_6   ((uint16_t)0x0040)
+#define GPIO_PIN_7   ((uint16_t)0x0080)
+#define GPIO_PIN_8   ((uint16_t)0x0100)
+#define GPIO_PIN_9   ((uint16_t)0x0200)
+#define GPIO_PIN_10  ((uint16_t)0x0400)
+#define GPIO_PIN_11  ((uint16_t)0x0800)
+#define GPIO_PIN_12  ((uint16_t)0x1000)
+#define GPIO_PIN_13  ((uint16_t)0x2000)
+#define GPIO_PIN_14  ((uint16_t)0x4000)
+#define GPIO_PIN_15  ((uint16_t)0x8000)
+
+/* CMSIS intrinsics */
+extern uint32_t fake_primask;
+
+static inline uint32_t __get_PRIMASK(void) { return fake_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { fake_primask = primask; }
+static inline void __disable_irq(void) { fake_primask = 1; }
+static inline void __enable_irq(void) { fake_primask = 0; }
+static inline void __DMB(void) { __sync_synchronize(); }
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __WFI(void) { }
+
+/* HAL tick, advanced by the virtual clock */
+extern volatile uint32_t uwTick;
+
+uint32_t HAL_GetTick(void);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+#endif /* FAKE_STM32L4XX_HAL_H_ */
@@ -0,0 +1,180 @@
+/*
+ * vclock.c
+ *
+ * Virtual clock: host versions of timebase.c and power.c
+ */
+
+#include "fake.h"
+#include "timebase.h"
+#include "power.h"
+#include "timer.h"
+#include "stm32l4xx_hal.h"
+
+#define QUEUE_SIZE  64
+
+typedef struct {
+    uint64_t at;
+    VclockFn fn;
+    void *arg;
+} Pending;
+
+static uint64_t now_us = 0;
+static uint64_t tick_at = 1000;     /* next SysTick */
+static uint64_t limit = VCLOCK_NEVER;
+static uint32_t stalls = 0;
+static Pending queue[QUEUE_SIZE];   /* sorted by time, FIFO on ties */
+static int queued = 0;
+
+/**
+ * Time 0, no queued interrupts, no limit
+ */
+void vclock_reset(void) {
+    now_us = 0;
+    tick_at = 1000;
+    limit = VCLOCK_NEVER;
+    stalls = 0;
+    queued = 0;
+    uwTick = 0;
+}
+
+/**
+ * Current virtual time
+ */
+uint64_t vclock_now(void) {
+    return now_us;
+}
+
+/**
+ * Queue a simulated interrupt
+ */
+int vclock_at(uint64_t at_us, VclockFn fn, void *arg) {
+    if (queued == QUEUE_SIZE) {
+        return 0;
+    }
+
+    int i = queued;
+
+    while (i > 0 && queue[i - 1].at > at_us) {
+        queue[i] = queue[i - 1];
+        i--;
+    }
+    queue[i].at = at_us;
+    queue[i].fn = fn;
+    queue[i].arg = arg;
+    queued++;
+    return 1;
+}
+
+/**
+ * Move time forward, running ticks and queued interrupts on the way
+ */
+void vclock_advance_to(uint64_t at_us) {
+    for (;;) {
+        uint64_t next = tick_at;
+
+        if (queued > 0 && queue[0].at <= next) {
+            next = queue[0].at;
+        }
+        if (next > at_us) {
+            break;
+        }
+        if (next > now_us) {
+            now_us = next;
+        }
+
+        if (queued > 0 && queue[0].at <= tick_at) {
+            Pending p = queue[0];
+
+            queued--;
+            for (int i = 0; i < queued; i++) {
+                queue[i] = queue[i + 1];
+            }
+            p.fn(p.arg);
+        } else {
+            tick_at += 1000;
+            uwTick++;
+            timer_tick();
+        }
+        fake_gpio_latch();
+    }
+
+    if (at_us > now_us) {
+        now_us = at_us;
+    }
+    fake_gpio_latch();
+}
+
+/**
+ * Never let power_idle_until() sleep past this time
+ */
+void vclock_set_limit(uint64_t at_us) {
+    limit = at_us;
+}
+
+/**
+ * Number of times power_idle_until() found nothing to wake it
+ */
+uint32_t vclock_stalls(void) {
+    return stalls;
+}
+
+/* timebase.h */
+
+void timebase_init(void) {
+}
+
+uint64_t timebase_us(void) {
+    return now_us;
+}
+
+int timebase_alarm(uint64_t at_us) {
+    return at_us > now_us;
+}
+
+void timebase_recalibrate(void) {
+}
+
+void timebase_advance(uint64_t us) {
+    vclock_advance_to(now_us + us);
+}
+
+void timebase_irq(void) {
+}
+
+/* power.h: sleeping is jumping to the next thing that would wake the CPU */
+
+void power_init(void) {
+}
+
+void power_idle_until(uint64_t deadline_us) {
+    uint64_t wake = deadline_us;
+    uint32_t ticks;
+
+    if (timer_next_expiry(&ticks)) {
+        uint64_t tick_wake = tick_at + (uint64_t)(ticks - 1) * 1000u;
+
+        if (tick_wake < wake) {
+            wake = tick_wake;
+        }
+    }
+    if (queued > 0 && queue[0].at < wake) {
+        wake = queue[0].at;
+    }
+    if (limit < wake) {
+        wake = limit;
+    }
+
+    if (wake == VCLOCK_NEVER) {
+        stalls++;
+    } else {
+        vclock_advance_to(wake);
+    }
+    __enable_irq();
+}
+
+void power_stop_inhibit(int inhibit) {
+    (void)inhibit;
+}
+
+void power_lptim_irq(void) {
+}
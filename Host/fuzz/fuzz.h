@@ -0,0 +1,19 @@
+/*
+ * fuzz.h
+ *
+ * Fuzz target entry point, shared by libFuzzer and the standalone driver
+ */
+
+#ifndef FUZZ_H_
+#define FUZZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Run one input; aborts with a message when an invariant breaks
+ * @return 0
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif /* FUZZ_H_ */
@@ -0,0 +1,307 @@
+/*
+ * fuzz_game.c
+ *
+ * Fuzz target: arbitrary timed button waveforms through the real button
+ * queue and debouncer into the game core, checked against invariants
+ *
+ * Input layout:
+ *   4 bytes    game seed (little endian)
+ *   2 bytes    per edge, big endian:
+ *                bit 15    button (0 left, 1 right)
+ *                bit 14    level (1 pressed)
+ *                bit 13    burst: queue without letting the game run, as
+ *                          when the CPU is busy (at most a queue's worth)
+ *                bit 12    unit of the delay, 0 = 10 us, 1 = 1 ms
+ *                bits 0-11 delay since the previous edge
+ * Delays of 0 give simultaneous edges, 10 us units give contact bounce.
+ *
+ * The game is driven like game.c's logic task: debounced presses are read
+ * with their edge times and fed with game_next_due(), animation ends come
+ * from the animation lengths. After the last edge the game runs on for
+ * TAIL_US so pending steps and screens play out.
+ *
+ * Invariants, checked after every event:
+ *   - scores never exceed the winning score, at most one side reaches it
+ *   - while the ball is in play it is on LEDs 1..8, moving, with a step
+ *     time between the minimum and the initial speed, and a step pending
+ *   - every screen has an end pending (the game never stalls)
+ *   - events reach the core in time order
+ * and once per input:
+ *   - no press is lost: per button, the presses the game read are exactly
+ *     those a reference debouncer derives from that button's waveform, at
+ *     the same times, and they come out of both buttons in time order
+ *   - the button queue never dropped an edge
+ */
+
+#include "fuzz.h"
+#include "button.h"
+#include "game_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_EDGES       4096
+#define QUEUE_EDGES     16          /* button.c QUEUE_SIZE */
+#define DEBOUNCE_US     20000       /* button.c DEBOUNCE_DELAY_US */
+#define TAIL_US         30000000ULL
+
+/* Animation lengths in ms, as in the keyframe tables of game.c and
+   score.c (the host game tests pin the same numbers) */
+static const uint32_t show_ms[] = {
+    [GAME_SHOW_INTRO]  = 2200,
+    [GAME_SHOW_MISS]   = 600,
+    [GAME_SHOW_SCORE]  = 100 + SCORE_DISPLAY_TIME,
+    [GAME_SHOW_WINNER] = 3000,
+    [GAME_SHOW_OVER]   = 7200,
+};
+
+typedef struct {
+    uint64_t at;
+    uint8_t button;
+} Press;
+
+static uint64_t now;
+static Game game;
+static uint64_t anim_end_at;
+static uint64_t last_event_at;
+
+static Press read[MAX_EDGES];       /* presses the game read, in order */
+static uint32_t read_count;
+static uint32_t fed_count;          /* of those, fed to the core */
+/* Reference debouncer, one per button */
+typedef struct {
+    uint8_t level;
+    uint8_t raw;
+    uint64_t locked_until;
+    Press presses[MAX_EDGES];
+    uint32_t count;
+} Reference;
+
+static Reference reference[2];
+
+/* button.c takes EXTI edge times from here; injected edges carry theirs */
+uint64_t timebase_us(void) {
+    return now;
+}
+
+static void fail(const char *what) {
+    fprintf(stderr, "invariant broken at %llu us: %s (state %u, ball %d, %u-%u)\n",
+            (unsigned long long)last_event_at, what, game.state, game.position,
+            game.left_score, game.right_score);
+    abort();
+}
+
+static void check(void) {
+    const GameConfig *config = game.config;
+    uint8_t target = config->winning_score;
+
+    if (game.state == GAME_STAY || game.state >= GAME_STATE_COUNT) {
+        fail("unknown state");
+    }
+    if (game.left_score > target || game.right_score > target) {
+        fail("score above the winning score");
+    }
+    if (game.left_score == target && game.right_score == target) {
+        fail("both players won");
+    }
+
+    if (game.state == BALL_MOVING) {
+        if (game.position < 1 || game.position > 8) {
+            fail("ball off the field while in play");
+        }
+        if (game.direction != 1 && game.direction != -1) {
+            fail("ball not moving");
+        }
+        if (game.speed_us < config->min_speed_us || game.speed_us > config->initial_speed_us) {
+            fail("step time out of range");
+        }
+        if (game.step_at == GAME_NO_STEP || game.step_at < last_event_at) {
+            fail("no ball step pending");
+        }
+    } else if (anim_end_at == GAME_NO_STEP) {
+        fail("screen without an end");
+    }
+}
+
+/* What game.c's apply() does with the core's requests, minus the LEDs */
+static void apply(uint64_t at) {
+    if (game.show == GAME_SHOW_NONE) {
+        return;
+    }
+    anim_end_at = (game.show == GAME_SHOW_BALL)
+                  ? GAME_NO_STEP : at + (uint64_t)show_ms[game.show] * 1000;
+    game.show = GAME_SHOW_NONE;
+}
+
+/* The input task: debounced presses out of the button queue */
+static void read_presses(void) {
+    uint64_t at;
+    int button;
+
+    while ((button = button_read_press(&at)) != 0) {
+        if (read_count < MAX_EDGES) {
+            read[read_count].at = at;
+            read[read_count].button = (uint8_t)button;
+        }
+        read_count++;
+    }
+}
+
+/* The logic task running at until_us */
+static void run_until(uint64_t until_us) {
+    now = until_us;
+    read_presses();
+
+    for (;;) {
+        uint64_t press_at = GAME_NO_STEP;
+        uint8_t press_event = GAME_EV_PRESS_LEFT;
+        uint64_t at;
+
+        if (fed_count < read_count) {
+            press_at = read[fed_count].at;
+            press_event = (read[fed_count].button == LEFT_BUTTON)
+                          ? GAME_EV_PRESS_LEFT : GAME_EV_PRESS_RIGHT;
+        }
+
+        uint8_t event = game_next_due(&game, press_at, press_event, anim_end_at, until_us, &at);
+
+        if (event == GAME_EVENT_COUNT) {
+            return;
+        }
+        if (at < last_event_at) {
+            fail("events out of time order");
+        }
+        if (event == GAME_EV_ANIM_DONE) {
+            anim_end_at = GAME_NO_STEP;
+        } else if (event != GAME_EV_STEP) {
+            fed_count++;
+        }
+
+        last_event_at = at;
+        game_event(&game, event, at);
+        apply(at);
+        check();
+    }
+}
+
+/* Debounced level change of one button, recording presses */
+static void reference_change(Reference *r, uint8_t button, uint8_t level, uint64_t at) {
+    r->level = level;
+    r->locked_until = at + DEBOUNCE_US;
+    if (level) {
+        if (r->count < MAX_EDGES) {
+            r->presses[r->count].at = at;
+            r->presses[r->count].button = button;
+        }
+        r->count++;
+    }
+}
+
+/* Presses by the rules, each button on its own: a change of level is
+   taken at once unless the button changed in the last DEBOUNCE_US; one
+   made during that window is taken when the window ends */
+static void reference_edge(uint8_t button, uint8_t pressed, uint64_t at) {
+    Reference *r = &reference[button - 1];
+
+    if (r->raw != r->level && r->locked_until <= at) {
+        reference_change(r, button, r->raw, r->locked_until);
+    }
+    r->raw = pressed;
+    if (r->raw != r->level && r->locked_until <= at) {
+        reference_change(r, button, r->raw, at);
+    }
+}
+
+static void reference_check(void) {
+    uint32_t seen[2] = {0, 0};
+
+    for (int b = 0; b < 2; b++) {
+        Reference *r = &reference[b];
+
+        /* The tail is longer than any window */
+        if (r->raw != r->level) {
+            reference_change(r, (uint8_t)(b + 1), r->raw, r->locked_until);
+        }
+    }
+
+    for (uint32_t n = 0; n < read_count && n < MAX_EDGES; n++) {
+        const Press *p = &read[n];
+        Reference *r = &reference[p->button - 1];
+        uint32_t *i = &seen[p->button - 1];
+
+        if (n > 0 && p->at < read[n - 1].at) {
+            fail("presses read out of time order");
+        }
+        if (*i >= r->count || r->presses[*i].at != p->at) {
+            fail("press read at the wrong time or invented");
+        }
+        (*i)++;
+    }
+    if (seen[0] != reference[0].count || seen[1] != reference[1].count) {
+        fail("press lost");
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    uint32_t queued = 0;
+    uint32_t seed = 0;
+
+    if (size < 4) {
+        return 0;
+    }
+    for (int n = 0; n < 4; n++) {
+        seed |= (uint32_t)data[n] << (8 * n);
+    }
+    data += 4;
+    size -= 4;
+    if (size / 2 > MAX_EDGES) {
+        size = MAX_EDGES * 2;
+    }
+
+    now = 0;
+    read_count = 0;
+    fed_count = 0;
+    for (int b = 0; b < 2; b++) {
+        reference[b].level = 0;
+        reference[b].raw = 0;
+        reference[b].locked_until = 0;
+        reference[b].count = 0;
+    }
+    last_event_at = 0;
+    anim_end_at = GAME_NO_STEP;
+    button_init();
+    game_reset(&game, NULL, seed, now);
+    apply(now);
+    check();
+
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        uint16_t word = (uint16_t)(data[i] << 8 | data[i + 1]);
+        uint32_t delay = word & 0x0FFF;
+        ButtonEvent edge;
+
+        edge.timestamp = now + ((word & 0x1000) ? delay * 1000u : delay * 10u);
+        edge.button = (word & 0x8000) ? RIGHT_BUTTON : LEFT_BUTTON;
+        edge.pressed = (word & 0x4000) ? 1 : 0;
+
+        /* The game catches up before the edge unless the CPU is busy */
+        if (!(word & 0x2000) || queued == QUEUE_EDGES) {
+            run_until(edge.timestamp ? edge.timestamp - 1 : 0);
+            queued = 0;
+        }
+
+        now = edge.timestamp;
+        button_inject(&edge);
+        queued++;
+        reference_edge(edge.button, edge.pressed, edge.timestamp);
+    }
+
+    run_until(now + TAIL_US);
+
+    if (button_dropped() != 0) {
+        fail("button queue dropped an edge");
+    }
+    if (fed_count != read_count) {
+        fail("press read but not fed to the game");
+    }
+    reference_check();
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * standalone.c
+ *
+ * Driver for the fuzz target where libFuzzer is not available (gcc)
+ *
+ * With files or directories as arguments it runs each file once, e.g. to
+ * reproduce a crash or rerun a corpus. Otherwise it generates inputs:
+ * waveforms biased towards what breaks debouncers (contact bounce,
+ * simultaneous edges, busy-CPU bursts between presses at game pace) and
+ * mutations of earlier inputs, without coverage feedback. An input that
+ * breaks an invariant is written to crash-<n>.bin before the abort.
+ *
+ * Usage: fuzz_standalone [-n inputs] [-t seconds] [-s seed] [file|dir]...
+ */
+
+#include "fuzz.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INPUT_MAX  (4 + 2 * 512)
+#define POOL       64               /* earlier inputs kept for mutation */
+
+static const uint8_t *current;
+static size_t current_size;
+static uint64_t runs;
+
+/* Save the input that broke an invariant, async-signal-safe */
+static void on_abort(int sig) {
+    char name[32] = "crash-";
+    char digits[20];
+    int n = 0;
+    uint64_t v = runs;
+
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    size_t len = 6;
+    while (n) {
+        name[len++] = digits[--n];
+    }
+    memcpy(&name[len], ".bin", 5);
+
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd >= 0) {
+        if (write(fd, current, current_size) < 0) {
+            /* nothing more to do in a signal handler */
+        }
+        close(fd);
+        if (write(STDERR_FILENO, "input saved to ", 15) < 0 ||
+            write(STDERR_FILENO, name, strlen(name)) < 0 ||
+            write(STDERR_FILENO, "\n", 1) < 0) {
+        }
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void run(const uint8_t *data, size_t size) {
+    current = data;
+    current_size = size;
+    LLVMFuzzerTestOneInput(data, size);
+    runs++;
+}
+
+static void run_file(const char *path) {
+    static uint8_t buf[1 << 16];
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    size_t size = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    run(buf, size);
+}
+
+static void run_path(const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        perror(path);
+        exit(1);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        run_file(path);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char name[4096];
+
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+            run_file(name);
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+}
+
+static uint64_t rng_state;
+
+/* xorshift64* */
+static uint32_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+static size_t put_edge(uint8_t *buf, size_t len, int right, int pressed,
+                       int burst, int ms, uint32_t delay) {
+    uint16_t word = (uint16_t)((right ? 0x8000 : 0) | (pressed ? 0x4000 : 0) |
+                               (burst ? 0x2000 : 0) | (ms ? 0x1000 : 0) | (delay & 0x0FFF));
+
+    if (len + 2 > INPUT_MAX) {
+        return len;
+    }
+    buf[len] = (uint8_t)(word >> 8);
+    buf[len + 1] = (uint8_t)word;
+    return len + 2;
+}
+
+/* A fresh waveform: presses with optional bounce, on one or both buttons */
+static size_t generate(uint8_t *buf) {
+    size_t len = 0;
+    uint32_t seed = rng();
+    int presses = 1 + (int)(rng() % 48);
+
+    for (int n = 0; n < 4; n++) {
+        buf[len++] = (uint8_t)(seed >> (8 * n));
+    }
+
+    for (int p = 0; p < presses; p++) {
+        int right = rng() & 1;
+        uint32_t r = rng();
+
+        /* Gap before the press: mostly game-scale, sometimes tight */
+        if (r % 8 == 0) {
+            len = put_edge(buf, len, right, 1, 0, 0, rng() % 4096);
+        } else {
+            len = put_edge(buf, len, right, 1, 0, 1, 100 + rng() % 3000);
+        }
+
+        /* Contact bounce: a few edges tens of microseconds apart */
+        int bounces = (r >> 4) % 4 == 0 ? (int)(rng() % 6) : 0;
+        for (int b = 0; b < bounces; b++) {
+            len = put_edge(buf, len, right, b & 1, rng() & 1, 0, rng() % 200);
+        }
+        len = put_edge(buf, len, right, 1, 0, 0, 0);
+
+        /* Simultaneous press of the other button */
+        if ((r >> 8) % 6 == 0) {
+            len = put_edge(buf, len, !right, 1, rng() & 1, 0, rng() % 3);
+            len = put_edge(buf, len, !right, 0, 0, 1, rng() % 200);
+        }
+
+        len = put_edge(buf, len, right, 0, 0, 1, 20 + rng() % 200);
+    }
+    return len;
+}
+
+/* Flip, duplicate or drop a few edges of an earlier input */
+static size_t mutate(uint8_t *buf, size_t len) {
+    int changes = 1 + (int)(rng() % 4);
+
+    for (int c = 0; c < changes && len > 6; c++) {
+        size_t at = 4 + 2 * (rng() % ((len - 4) / 2));
+
+        switch (rng() % 4) {
+        case 0:
+            buf[at + (rng() & 1)] ^= (uint8_t)(1u << (rng() % 8));
+            break;
+        case 1:
+            buf[at] = (uint8_t)rng();
+            buf[at + 1] = (uint8_t)rng();
+            break;
+        case 2:
+            if (len + 2 <= INPUT_MAX) {
+                memmove(&buf[at + 2], &buf[at], len - at);
+                len += 2;
+            }
+            break;
+        default:
+            memmove(&buf[at], &buf[at + 2], len - at - 2);
+            len -= 2;
+            break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    uint64_t limit = 0;
+    double seconds = 10.0;
+    int opt;
+
+    rng_state = (uint64_t)time(NULL) | 1;
+    while ((opt = getopt(argc, argv, "n:t:s:")) != -1) {
+        switch (opt) {
+        case 'n': limit = strtoull(optarg, NULL, 0); break;
+        case 't': seconds = atof(optarg); break;
+        case 's': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+        default:
+            fprintf(stderr, "usage: fuzz_standalone [-n inputs] [-t seconds] [-s seed] [file|dir]...\n");
+            return 2;
+        }
+    }
+
+    signal(SIGABRT, on_abort);
+
+    if (optind < argc) {
+        for (int n = optind; n < argc; n++) {
+            run_path(argv[n]);
+        }
+        printf("%llu inputs, no invariant broken\n", (unsigned long long)runs);
+        return 0;
+    }
+
+    static uint8_t pool[POOL][INPUT_MAX];
+    static size_t pool_len[POOL];
+    static uint8_t buf[INPUT_MAX];
+    struct timespec start, now;
+    double elapsed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t n = 0; limit ? n < limit : elapsed < seconds; n++) {
+        size_t len;
+
+        if (n < POOL || rng() % 2) {
+            len = generate(buf);
+        } else {
+            size_t from = rng() % POOL;
+
+            memcpy(buf, pool[from], pool_len[from]);
+            len = mutate(buf, pool_len[from]);
+        }
+        run(buf, len);
+
+        size_t slot = rng() % POOL;
+        memcpy(pool[slot], buf, len);
+        pool_len[slot] = len;
+
+        if ((n & 0x3FF) == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            elapsed = (double)(now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (double)(now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("%llu inputs in %.1f s (%.0f/s), no invariant broken\n",
+           (unsigned long long)runs, elapsed, runs / elapsed);
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * led_view.c
+ *
+ * Watch a board's LEDs live from its telemetry stream
+ *
+ * Reads the USART2 telemetry (telemetry.h) from a serial port, the pty
+ * replay_tool -p plays a match onto, or a capture file, and decodes the
+ * TLM_LEDS records of mirror.c. The field is redrawn on one line with the
+ * brightness of each LED ('.' off, '#' full), the game state and score,
+ * and the frame and byte rates of the last second; console replies
+ * (TLM_TEXT) are printed above it as they come.
+ *
+ * A record that fails its CRC or a gap in the sequence numbers makes the
+ * viewer forget the frame and wait for the next key ('?' until then).
+ *
+ * -l prints one line per change instead, for piping or a diff against
+ * replay_tool's output:
+ *   time_ms  levels (LED 1 first)
+ *
+ * Usage: led_view [-l] port|pty|capture
+ */
+
+#include "cobs.h"
+#include "game_core.h"
+#include "mirror_codec.h"
+#include "telemetry.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HEADER      6u          /* type, seq, time_ms */
+#define FRAME_MAX   (HEADER + TELEMETRY_PAYLOAD_MAX + 1u)
+#define TEXT_MAX    128
+
+static const char *const state_names[GAME_STATE_COUNT] = {
+    [GAME_INTRO] = "intro", [GAME_START] = "serve", [BALL_MOVING] = "ball",
+    [GAME_MISS] = "miss", [POINT_SCORED] = "score", [GAME_WINNER] = "winner",
+    [GAME_OVER] = "over",
+};
+
+static int lines = 0;           /* -l */
+static MirrorCodec codec;
+static uint32_t time_ms = 0;    /* of the last record */
+static uint8_t state = GAME_INTRO;
+static uint8_t score[2] = { 0, 0 };
+static int have_seq = 0;
+static uint8_t next_seq = 0;
+static uint32_t lost = 0;       /* records missing or damaged */
+static char text[TEXT_MAX + 1];
+static uint32_t text_len = 0;
+
+/* Rates: counted this second, shown from the last one */
+static uint32_t frames = 0;
+static uint32_t bytes = 0;
+static uint32_t frame_rate = 0;
+static uint32_t byte_rate = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: led_view [-l] port|pty|capture\n");
+    exit(2);
+}
+
+static void field(char *out) {
+    static const char shades[] = ".:+*#";
+
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        out[n] = codec.valid ? shades[codec.levels[n] / 52] : '?';
+    }
+    out[MIRROR_LEDS] = '\0';
+}
+
+static void draw(void) {
+    char leds[MIRROR_LEDS + 1];
+
+    if (lines) {
+        return;
+    }
+    field(leds);
+    printf("\r%10.3f  %s  %-6s  %u-%u  %4u fr/s  %5u B/s  lost %u\033[K",
+           time_ms / 1000.0, leds, state < GAME_STATE_COUNT ? state_names[state] : "?",
+           score[0], score[1], frame_rate, byte_rate, lost);
+    fflush(stdout);
+}
+
+static void print_text(void) {
+    text[text_len] = '\0';
+    if (!lines) {
+        printf("\r\033[K%s\n", text);
+    }
+    text_len = 0;
+}
+
+static void on_text(const uint8_t *payload, uint32_t len) {
+    for (uint32_t n = 0; n < len; n++) {
+        if (payload[n] == '\n' || text_len == TEXT_MAX) {
+            print_text();
+        }
+        if (payload[n] != '\n') {
+            text[text_len++] = (char)payload[n];
+        }
+    }
+}
+
+/* One record, COBS removed */
+static void on_record(const uint8_t *frame, uint32_t len) {
+    if (len < HEADER + 1u || crc8(frame, len - 1u) != frame[len - 1u]) {
+        lost++;
+        mirror_codec_reset(&codec);
+        return;
+    }
+    if (have_seq && frame[1] != next_seq) {
+        lost += (uint8_t)(frame[1] - next_seq);
+        mirror_codec_reset(&codec);
+    }
+    have_seq = 1;
+    next_seq = (uint8_t)(frame[1] + 1u);
+    time_ms = (uint32_t)frame[2] | (uint32_t)frame[3] << 8 |
+              (uint32_t)frame[4] << 16 | (uint32_t)frame[5] << 24;
+
+    const uint8_t *payload = frame + HEADER;
+    uint8_t size = (uint8_t)(len - HEADER - 1u);
+
+    switch (frame[0]) {
+    case TLM_STATE:
+        if (size >= 1) {
+            state = payload[0];
+        }
+        break;
+    case TLM_SCORE:
+        if (size >= 2) {
+            score[0] = payload[0];
+            score[1] = payload[1];
+        }
+        break;
+    case TLM_TEXT:
+        on_text(payload, size);
+        break;
+    case TLM_LEDS:
+        if (!mirror_decode(&codec, payload, size)) {
+            break;
+        }
+        frames++;
+        if (lines) {
+            static char last[MIRROR_LEDS + 1];
+            char leds[MIRROR_LEDS + 1];
+
+            field(leds);
+            if (strcmp(leds, last) != 0) {
+                printf("%10u  %s\n", time_ms, leds);
+                strcpy(last, leds);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Bytes off the wire: records end at a zero */
+static void on_bytes(const uint8_t *in, ssize_t len) {
+    static uint8_t encoded[COBS_MAX(FRAME_MAX) + 1];
+    static uint32_t encoded_len = 0;
+    static int overrun = 0;
+    uint8_t frame[COBS_MAX(FRAME_MAX)];
+
+    bytes += (uint32_t)len;
+    for (ssize_t n = 0; n < len; n++) {
+        if (in[n] != 0) {
+            if (encoded_len == sizeof(encoded)) {
+                overrun = 1;
+            } else {
+                encoded[encoded_len++] = in[n];
+            }
+            continue;
+        }
+
+        int32_t size = overrun ? -1 : cobs_decode(encoded, encoded_len, frame);
+
+        if (encoded_len > 0) {
+            if (size < 0) {
+                lost++;
+                mirror_codec_reset(&codec);
+            } else {
+                on_record(frame, (uint32_t)size);
+            }
+        }
+        encoded_len = 0;
+        overrun = 0;
+    }
+}
+
+/* Serial ports and ptys raw at the telemetry's 115200 baud, files as they are */
+static int open_input(const char *path) {
+    struct termios t;
+    int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0) {
+        perror(path);
+        exit(1);
+    }
+    if (isatty(fd) && tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        cfsetspeed(&t, B115200);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l")) != -1) {
+        switch (opt) {
+        case 'l': lines = 1; break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+
+    int fd = open_input(argv[optind]);
+    uint64_t second = now_us() + 1000000u;
+    uint8_t in[512];
+
+    mirror_codec_reset(&codec);
+    draw();
+    for (;;) {
+        struct pollfd p = { .fd = fd, .events = POLLIN };
+
+        poll(&p, 1, 100);
+
+        ssize_t len = read(fd, in, sizeof(in));
+
+        if (len == 0 || (len < 0 && errno != EINTR && errno != EAGAIN)) {
+            break;                      /* end of file, or the pty closed */
+        }
+        if (len > 0) {
+            on_bytes(in, len);
+        }
+
+        uint64_t now = now_us();
+
+        if (now >= second) {
+            frame_rate = frames;
+            byte_rate = bytes;
+            frames = 0;
+            bytes = 0;
+            second = now + 1000000u;
+        }
+        draw();
+    }
+    if (!lines) {
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,373 @@
+/*
+ * match_sim.c
+ *
+ * Headless match simulator for difficulty tuning
+ *
+ * Runs the game core (the same transition table as the firmware) against
+ * modelled players, on all host cores, and reports rally-length and
+ * match-duration distributions for each parameter set.
+ *
+ * Player model: when the ball starts towards a player, the player aims a
+ * press at the moment the ball reaches their end LED, off by a normally
+ * distributed error (mean, sd in ms). The core decides whether the press
+ * is a return, exactly as on the board. Nobody presses during animations.
+ * Players who never miss would play forever: a match is stopped after
+ * MATCH_BINS seconds and counted apart.
+ *
+ * Usage: match_sim [-n matches] [-t threads] [-L mean,sd] [-R mean,sd]
+ *                  [-s win,initial_ms,min_ms,decrease_ms[,early_ms,late_ms]]...
+ *                  [-p profile]...
+ */
+
+#include "game_core.h"
+#include "speed_curve.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SETS      32
+#define MAX_THREADS   256
+#define RALLY_BINS    256           /* returns per point */
+#define MATCH_BINS    1024          /* seconds per match */
+#define NEVER         UINT64_MAX
+#define MATCH_CAP_US  ((uint64_t)MATCH_BINS * 1000000u)   /* stopped there */
+
+/* Animation lengths in ms, as in the keyframe tables of game.c and
+   score.c (the host game tests pin the same numbers) */
+static const uint32_t show_ms[] = {
+    [GAME_SHOW_INTRO]  = 2200,
+    [GAME_SHOW_MISS]   = 600,
+    [GAME_SHOW_SCORE]  = 100 + SCORE_DISPLAY_TIME,
+    [GAME_SHOW_WINNER] = 3000,
+    [GAME_SHOW_OVER]   = 7200,
+};
+
+typedef struct {
+    double mean_ms;
+    double sd_ms;
+} Player;
+
+typedef struct {
+    uint64_t rally[RALLY_BINS];
+    uint64_t match[MATCH_BINS];
+    uint64_t points;
+    uint64_t matches;
+    uint64_t capped;            /* matches stopped at MATCH_CAP_US */
+} Stats;
+
+typedef struct {
+    const GameConfig *config;
+    const Player *players;      /* [0] left, [1] right */
+    uint64_t matches;
+    uint64_t seed;
+    Stats stats;
+} Job;
+
+/* xorshift64* */
+static inline uint64_t rng_next(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_unit(uint64_t *s) {
+    return (double)(rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Normal sample, Box-Muller */
+static double rng_normal(uint64_t *s, double mean, double sd) {
+    double u = rng_unit(s);
+    double v = rng_unit(s);
+
+    if (u < 1e-300) {
+        u = 1e-300;
+    }
+    return mean + sd * sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+}
+
+/* One match from the intro to the end of the game over screen, or to
+   MATCH_CAP_US */
+static void play_match(const GameConfig *config, const Player players[2],
+                       uint64_t *rng, Stats *stats) {
+    Game game;
+    uint64_t now = 0;
+    uint64_t anim_end = NEVER;
+    uint64_t press_at = NEVER;
+    int8_t aimed = 0;           /* direction the pending press is for */
+    uint32_t returns = 0;
+
+    game_reset(&game, config, (uint32_t)(rng_next(rng) >> 32), now);
+
+    for (;;) {
+        if (game.show != GAME_SHOW_NONE) {
+            if (game.show != GAME_SHOW_BALL) {
+                anim_end = now + (uint64_t)show_ms[game.show] * 1000u;
+            }
+            game.show = GAME_SHOW_NONE;
+        }
+
+        if (game.state == BALL_MOVING) {
+            if (game.direction != aimed) {
+                /* Ball now heads for the other player: they aim a press */
+                int8_t end = (game.direction > 0) ? (int8_t)game.config->field_leds : 1;
+                int steps = abs(end - game.position);
+                uint64_t arrive = game.step_at + (uint64_t)(steps - 1) * game.speed_us;
+                const Player *p = &players[game.direction > 0];
+                double error_us = rng_normal(rng, p->mean_ms, p->sd_ms) * 1000.0;
+                double at = (double)arrive + error_us;
+
+                press_at = (at > (double)now) ? (uint64_t)at : now;
+                if (aimed != 0) {
+                    returns++;
+                }
+                aimed = game.direction;
+            }
+
+            if (press_at < game.step_at) {
+                now = press_at;
+                press_at = NEVER;
+                game_event(&game, aimed > 0 ? GAME_EV_PRESS_RIGHT : GAME_EV_PRESS_LEFT, now);
+            } else {
+                now = game.step_at;
+                game_event(&game, GAME_EV_STEP, now);
+            }
+
+            if (game.state == GAME_MISS) {
+                stats->rally[returns < RALLY_BINS ? returns : RALLY_BINS - 1]++;
+                stats->points++;
+                returns = 0;
+                aimed = 0;
+                press_at = NEVER;
+            }
+            if (now >= MATCH_CAP_US) {
+                stats->capped++;
+                break;
+            }
+            continue;
+        }
+
+        /* Animation state: jump to its end */
+        now = anim_end;
+        anim_end = NEVER;
+        if (game.state == GAME_OVER) {
+            break;
+        }
+        game_event(&game, GAME_EV_ANIM_DONE, now);
+    }
+
+    uint64_t seconds = now / 1000000u;
+
+    stats->match[seconds < MATCH_BINS ? seconds : MATCH_BINS - 1]++;
+    stats->matches++;
+}
+
+static void *worker(void *arg) {
+    Job *job = arg;
+    uint64_t rng = job->seed | 1;
+
+    for (uint64_t n = 0; n < job->matches; n++) {
+        play_match(job->config, job->players, &rng, &job->stats);
+    }
+    return NULL;
+}
+
+/* Value below which a fraction q of the histogram lies */
+static unsigned quantile(const uint64_t *hist, unsigned bins, uint64_t total, double q) {
+    uint64_t want = (uint64_t)(q * (double)total);
+    uint64_t seen = 0;
+
+    for (unsigned b = 0; b < bins; b++) {
+        seen += hist[b];
+        if (seen > want) {
+            return b;
+        }
+    }
+    return bins - 1;
+}
+
+static double mean(const uint64_t *hist, unsigned bins, uint64_t total) {
+    double sum = 0;
+
+    for (unsigned b = 0; b < bins; b++) {
+        sum += (double)b * (double)hist[b];
+    }
+    return total ? sum / (double)total : 0.0;
+}
+
+static int parse_player(const char *text, Player *p) {
+    return sscanf(text, "%lf,%lf", &p->mean_ms, &p->sd_ms) == 2 && p->sd_ms >= 0;
+}
+
+/* The firmware's config with the speeds, score and hit window given */
+static int parse_set(const char *text, GameConfig *c) {
+    unsigned win, initial, min, decrease;
+    unsigned early = game_default_config.hit_early_us / 1000u;
+    unsigned late = game_default_config.hit_late_us / 1000u;
+    int fields = sscanf(text, "%u,%u,%u,%u,%u,%u", &win, &initial, &min, &decrease, &early, &late);
+
+    /* The step time must stay between min and initial: a larger decrease
+       would wrap it round to over an hour */
+    if ((fields != 4 && fields != 6)
+        || win == 0 || win > 255 || initial == 0 || min == 0
+        || min > initial || decrease > initial - min) {
+        return 0;
+    }
+    *c = game_default_config;
+    c->winning_score = (uint8_t)win;
+    c->initial_speed_us = initial * 1000u;
+    c->min_speed_us = min * 1000u;
+    c->speed_decrease_us = decrease * 1000u;
+    c->hit_early_us = early * 1000u;
+    c->hit_late_us = late * 1000u;
+    c->speed_curve = NULL;
+    return 1;
+}
+
+static const char *curve_name(const GameConfig *c) {
+    for (uint8_t p = 0; p < SPEED_PROFILE_COUNT; p++) {
+        if (c->speed_curve == speed_curves[p]) {
+            return speed_profile_name(p);
+        }
+    }
+    return "-";
+}
+
+/* The firmware's config with a speed_curve.h profile */
+static int parse_profile(const char *text, GameConfig *c) {
+    uint8_t profile = speed_profile_find(text);
+
+    if (profile == SPEED_PROFILE_COUNT) {
+        return 0;
+    }
+    *c = game_default_config;
+    c->speed_curve = speed_curves[profile];
+    c->initial_speed_us = c->speed_curve[0];
+    c->min_speed_us = c->speed_curve[SPEED_CURVE_LEN - 1];
+    c->speed_decrease_us = 0;
+    return 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: match_sim [-n matches] [-t threads] [-L mean,sd] [-R mean,sd]\n"
+            "                 [-s win,initial_ms,min_ms,decrease_ms[,early_ms,late_ms]]...\n"
+            "                 [-p profile]...\n"
+            "  -n  matches per parameter set (default 1000000)\n"
+            "  -t  worker threads (default: all cores)\n"
+            "  -L  left player press error in ms (default 40,45)\n"
+            "  -R  right player press error in ms (default 40,45)\n"
+            "  -s  parameter set, repeatable (default: the firmware's);\n"
+            "      hit window defaults to the firmware's; min <= initial and\n"
+            "      decrease <= initial - min\n"
+            "  -p  firmware's set with a speed profile (linear, exponential,\n"
+            "      capped), repeatable\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    GameConfig sets[MAX_SETS];
+    int set_count = 0;
+    Player players[2] = { {40, 45}, {40, 45} };
+    uint64_t matches = 1000000;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:L:R:s:p:")) != -1) {
+        switch (opt) {
+        case 'n': matches = strtoull(optarg, NULL, 0); break;
+        case 't': threads = strtol(optarg, NULL, 0); break;
+        case 'L': if (!parse_player(optarg, &players[0])) usage(); break;
+        case 'R': if (!parse_player(optarg, &players[1])) usage(); break;
+        case 's':
+            if (set_count == MAX_SETS || !parse_set(optarg, &sets[set_count])) {
+                usage();
+            }
+            set_count++;
+            break;
+        case 'p':
+            if (set_count == MAX_SETS || !parse_profile(optarg, &sets[set_count])) {
+                usage();
+            }
+            set_count++;
+            break;
+        default: usage();
+        }
+    }
+    if (set_count == 0) {
+        sets[set_count++] = game_default_config;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    static Job jobs[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+
+    printf("players: left %.0f+-%.0f ms, right %.0f+-%.0f ms; %llu matches per set, %ld threads\n\n",
+           players[0].mean_ms, players[0].sd_ms, players[1].mean_ms, players[1].sd_ms,
+           (unsigned long long)matches, threads);
+    printf("win init  min  dec | points/match | returns/point mean p50 p90 p99"
+           " | match s mean  p50  p90  p99 | matches/s | curve\n");
+
+    for (int s = 0; s < set_count; s++) {
+        struct timespec t0, t1;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (long t = 0; t < threads; t++) {
+            memset(&jobs[t], 0, sizeof(jobs[t]));
+            jobs[t].config = &sets[s];
+            jobs[t].players = players;
+            jobs[t].matches = matches / (uint64_t)threads + ((uint64_t)t < matches % (uint64_t)threads);
+            jobs[t].seed = 0x9E3779B97F4A7C15ULL * (uint64_t)(s * MAX_THREADS + t + 1);
+            pthread_create(&tids[t], NULL, worker, &jobs[t]);
+        }
+
+        Stats total;
+
+        memset(&total, 0, sizeof(total));
+        for (long t = 0; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+            for (int b = 0; b < RALLY_BINS; b++) {
+                total.rally[b] += jobs[t].stats.rally[b];
+            }
+            for (int b = 0; b < MATCH_BINS; b++) {
+                total.match[b] += jobs[t].stats.match[b];
+            }
+            total.points += jobs[t].stats.points;
+            total.matches += jobs[t].stats.matches;
+            total.capped += jobs[t].stats.capped;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        double secs = (double)(t1.tv_sec - t0.tv_sec) + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+        const GameConfig *c = &sets[s];
+
+        printf("%3u %4u %4u %4u | %12.2f | %18.2f %3u %3u %3u | %12.1f %4u %4u %4u | %9.0f | %s\n",
+               c->winning_score, c->initial_speed_us / 1000u, c->min_speed_us / 1000u,
+               c->speed_decrease_us / 1000u,
+               total.matches ? (double)total.points / (double)total.matches : 0.0,
+               mean(total.rally, RALLY_BINS, total.points),
+               quantile(total.rally, RALLY_BINS, total.points, 0.50),
+               quantile(total.rally, RALLY_BINS, total.points, 0.90),
+               quantile(total.rally, RALLY_BINS, total.points, 0.99),
+               mean(total.match, MATCH_BINS, total.matches),
+               quantile(total.match, MATCH_BINS, total.matches, 0.50),
+               quantile(total.match, MATCH_BINS, total.matches, 0.90),
+               quantile(total.match, MATCH_BINS, total.matches, 0.99),
+               secs > 0 ? (double)total.matches / secs : 0.0,
+               curve_name(c));
+        if (total.capped) {
+            printf("    %llu matches stopped at %u s, in the last bin\n",
+                   (unsigned long long)total.capped, MATCH_BINS);
+        }
+    }
+    return 0;
+}
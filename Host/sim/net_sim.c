@@ -0,0 +1,372 @@
+/*
+ * net_sim.c
+ *
+ * Two-board match on the host, over a pseudo-terminal
+ *
+ * Each side runs netplay.c (the board's protocol and rollback session) on
+ * the real monotonic clock, shifted by a random offset so the clock sync
+ * has something to find, with a bot for a player: it aims for its end LED
+ * and misses one approach in four. Bytes it sends are held back by the
+ * latency (-l) before they go on the wire, standing in for a slow link;
+ * above NETPLAY_DELAY_US that makes the sessions roll back.
+ *
+ * When a side has played the match to its end and the other side has
+ * vouched for that time, it prints the final score, the match length on
+ * the shared clock and the serve generator. Both sides must print the
+ * same line.
+ *
+ * Usage:
+ *   net_sim [-l latency_ms] [-w win] [-s seed] [-t timeout_s]
+ *           fork a pair on one pty and compare their results
+ *   net_sim -m [...]        open a pty, print its name, play one side
+ *   net_sim -c path [...]   play the other side on that pty
+ */
+
+#define _GNU_SOURCE         /* posix_openpt, ptsname_r */
+
+#include "cobs.h"
+#include "netplay.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUEUE       256         /* frames held back by the latency */
+#define SETTLE_US   500000      /* after the end, before it is final */
+#define LINGER_US   1000000     /* keep the link up for the peer */
+
+typedef struct {
+    uint64_t due;
+    uint32_t len;
+    uint8_t bytes[COBS_MAX(NETPLAY_FRAME_MAX) + 1];
+} Pending;
+
+typedef struct {
+    int done;
+    uint8_t side;
+    char text[96];
+    uint32_t rollbacks;
+    uint32_t replayed;
+    uint32_t stalls;
+    uint32_t rx_bad;
+    uint32_t best_rtt_us;
+} Result;
+
+static Pending queue[QUEUE];
+static unsigned queue_head;
+static unsigned queue_count;
+static uint32_t queue_lost;
+static uint64_t latency_us = 40000;
+static int64_t skew_us;
+static uint64_t rng_state;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + skew_us);
+}
+
+/* xorshift64* */
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* Each side its own id and clock offset, up to 10 s */
+static void seed_process(void) {
+    rng_state = (uint64_t)getpid() << 32 ^ (uint64_t)time(NULL) ^ 0x9E3779B97F4A7C15ULL;
+    skew_us = (int64_t)(rng_next() % 10000000u);
+}
+
+/* Short fixed animations, the ball has no end */
+static uint32_t show_ms(const Game *game) {
+    switch (game->show) {
+    case GAME_SHOW_BALL:  return UINT32_MAX;
+    case GAME_SHOW_OVER:  return UINT32_MAX;     /* hold the final score */
+    case GAME_SHOW_INTRO: return 500;
+    default:              return 300;
+    }
+}
+
+static void send_bytes(const uint8_t *bytes, uint32_t len, void *arg) {
+    (void)arg;
+    if (queue_count == QUEUE) {
+        queue_lost++;
+        return;
+    }
+
+    Pending *p = &queue[(queue_head + queue_count++) % QUEUE];
+
+    p->due = now_us() + latency_us;
+    p->len = len;
+    memcpy(p->bytes, bytes, len);
+}
+
+/* Put the frames that have waited out the latency on the wire */
+static uint64_t flush(int fd, uint64_t now) {
+    while (queue_count != 0 && queue[queue_head].due <= now) {
+        const Pending *p = &queue[queue_head];
+        uint32_t sent = 0;
+
+        while (sent < p->len) {
+            ssize_t n = write(fd, p->bytes + sent, p->len - sent);
+
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                break;          /* peer gone */
+            }
+            sent += (n > 0) ? (uint32_t)n : 0u;
+        }
+        queue_head = (queue_head + 1u) % QUEUE;
+        queue_count--;
+    }
+    return queue_count ? queue[queue_head].due : GAME_NO_STEP;
+}
+
+/* Aim a press at the moment the ball reaches this side's end LED, give or
+   take a few tens of ms, and let one approach in four go */
+static uint64_t bot(Netplay *np, int8_t *aimed) {
+    const Game *g = &np->rb.game;
+    int8_t toward = (np->side == NETPLAY_LEFT) ? -1 : 1;
+    int8_t end = (toward > 0) ? (int8_t)np->config.field_leds : 1;
+
+    if (g->state != BALL_MOVING || g->direction != toward) {
+        *aimed = 0;
+        return GAME_NO_STEP;
+    }
+    if (*aimed || g->position != end - toward || g->step_at == GAME_NO_STEP) {
+        return GAME_NO_STEP;
+    }
+    *aimed = 1;
+    if (rng_next() % 4 == 0) {
+        return GAME_NO_STEP;
+    }
+    return netplay_local(np, g->step_at + (rng_next() % 50) * 1000u - 30000u);
+}
+
+static void play(int fd, uint32_t seed, const GameConfig *config, uint64_t timeout_us,
+                 Result *result) {
+    static Netplay np;
+    uint8_t buf[256];
+    uint64_t now = now_us();
+    uint64_t give_up = now + timeout_us;
+    uint64_t press_at = GAME_NO_STEP;
+    uint64_t final_at = GAME_NO_STEP;
+    int8_t aimed = 0;
+
+    memset(result, 0, sizeof(*result));
+    netplay_init(&np, rng_next() | 1u, seed, config, show_ms, send_bytes, NULL, now);
+
+    for (;;) {
+        ssize_t n;
+
+        now = now_us();
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            netplay_receive(&np, buf, (uint32_t)n, now);
+        }
+        if (press_at <= now) {
+            netplay_press(&np, press_at);
+            press_at = GAME_NO_STEP;
+        }
+
+        uint64_t wake = netplay_run(&np, now);
+
+        if (press_at == GAME_NO_STEP) {
+            press_at = bot(&np, &aimed);
+        }
+
+        const Game *g = &np.rb.game;
+
+        if (final_at == GAME_NO_STEP && g->state == GAME_OVER &&
+            np.rb.sim_us >= g->now_us + SETTLE_US && np.peer_confirmed_us >= g->now_us) {
+            final_at = now;
+            result->done = 1;
+            result->side = np.side;
+            snprintf(result->text, sizeof(result->text), "result %u-%u after %llu ms rng %08x",
+                     g->left_score, g->right_score,
+                     (unsigned long long)((g->now_us - np.start_us) / 1000u), (unsigned)g->rng);
+            result->rollbacks = np.rb.rollbacks;
+            result->replayed = np.rb.replayed;
+            result->stalls = np.stalls;
+            result->rx_bad = np.rx_bad;
+            result->best_rtt_us = np.best_rtt_us;
+        }
+        if (now >= give_up || (final_at != GAME_NO_STEP && now >= final_at + LINGER_US)) {
+            return;
+        }
+
+        uint64_t due = flush(fd, now);
+
+        if (press_at < wake) {
+            wake = press_at;
+        }
+        if (due < wake) {
+            wake = due;
+        }
+
+        int ms = (wake <= now) ? 0 : (wake - now > 10000u) ? 10 : (int)((wake - now + 999u) / 1000u);
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+        poll(&pfd, 1, ms);
+    }
+}
+
+static int open_link(const char *path) {
+    struct termios t;
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0 || tcgetattr(fd, &t) != 0) {
+        perror(path);
+        exit(1);
+    }
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+    return fd;
+}
+
+/* New pty: the master, its raw slave for the other side, and its name */
+static int open_pty(int *slave, char *name, size_t size) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, size) != 0) {
+        perror("pty");
+        exit(1);
+    }
+    *slave = open_link(name);
+    return fd;
+}
+
+static void report(const Result *r) {
+    if (!r->done) {
+        printf("timeout\n");
+        return;
+    }
+    printf("%-5s %s  (rollbacks %u, replayed %u, stalls %u, bad frames %u",
+           r->side == NETPLAY_LEFT ? "left" : "right", r->text, r->rollbacks, r->replayed,
+           r->stalls, r->rx_bad);
+    if (r->side == NETPLAY_RIGHT) {
+        printf(", sync rtt %u us", r->best_rtt_us);
+    }
+    printf(")\n");
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: net_sim [-m | -c pty] [-l latency_ms] [-w win] [-s seed] [-t timeout_s]\n"
+            "  -m  open a pty, print its name and play one side on it\n"
+            "  -c  play the other side on a pty opened with -m\n"
+            "      (default: fork both sides on one pty and compare)\n"
+            "  -l  one-way latency in ms (default 40)\n"
+            "  -w  winning score (default 3)\n"
+            "  -s  serve seed (default: from the clock)\n"
+            "  -t  give up after this many seconds (default 120)\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    GameConfig config = game_default_config;
+    const char *connect = NULL;
+    int manual = 0;
+    uint32_t seed = (uint32_t)time(NULL);
+    uint64_t timeout_us = 120000000u;
+    int opt;
+
+    /* Quick rallies: the bots do not tire */
+    config.winning_score = 3;
+    config.initial_speed_us = 60000;
+    config.min_speed_us = 30000;
+    config.speed_decrease_us = 5000;
+    config.speed_curve = NULL;
+
+    while ((opt = getopt(argc, argv, "mc:l:w:s:t:")) != -1) {
+        switch (opt) {
+        case 'm': manual = 1; break;
+        case 'c': connect = optarg; break;
+        case 'l': latency_us = strtoull(optarg, NULL, 0) * 1000u; break;
+        case 'w': config.winning_score = (uint8_t)strtoul(optarg, NULL, 0); break;
+        case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 't': timeout_us = strtoull(optarg, NULL, 0) * 1000000u; break;
+        default: usage();
+        }
+    }
+    if (optind != argc || config.winning_score == 0 || (manual && connect)) {
+        usage();
+    }
+
+    Result mine;
+    char name[64];
+    int slave;
+
+    if (connect != NULL) {
+        seed_process();
+        play(open_link(connect), seed, &config, timeout_us, &mine);
+        report(&mine);
+        return mine.done ? 0 : 1;
+    }
+
+    int master = open_pty(&slave, name, sizeof(name));
+
+    if (manual) {
+        printf("%s\n", name);
+        fflush(stdout);
+        seed_process();
+        play(master, seed, &config, timeout_us, &mine);
+        report(&mine);
+        return mine.done ? 0 : 1;
+    }
+
+    int pipe_fd[2];
+
+    if (pipe(pipe_fd) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    fflush(stdout);
+
+    pid_t child = fork();
+
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    seed_process();
+
+    if (child == 0) {
+        close(master);
+        close(pipe_fd[0]);
+        play(slave, seed, &config, timeout_us, &mine);
+        if (write(pipe_fd[1], &mine, sizeof(mine)) != (ssize_t)sizeof(mine)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    Result theirs;
+
+    close(slave);
+    close(pipe_fd[1]);
+    printf("pty %s, latency %llu ms, seed %u, first to %u\n", name,
+           (unsigned long long)(latency_us / 1000u), seed, config.winning_score);
+    play(master, seed, &config, timeout_us, &mine);
+    if (read(pipe_fd[0], &theirs, sizeof(theirs)) != (ssize_t)sizeof(theirs)) {
+        theirs.done = 0;
+    }
+    waitpid(child, NULL, 0);
+
+    report(&mine);
+    report(&theirs);
+    if (!mine.done || !theirs.done || strcmp(mine.text, theirs.text) != 0) {
+        printf("boards disagree\n");
+        return 1;
+    }
+    printf("boards agree\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * replay_tool.c
+ *
+ * Play a recorded match back on the host board and print its LED frames
+ *
+ * The log is what game_recording() holds on the board (dump buf/len with
+ * the debugger). Playback runs on the virtual clock, so an hour-long
+ * session takes well under a second; -u stops early to bisect a session,
+ * -e prints the button edges as they are fed in.
+ *
+ * -p plays the match in real time instead, with the LED mirror (mirror.h)
+ * on, and writes the board's telemetry stream to a new pty as USART2 would
+ * send it: run Host/sim/led_view on the pty it names, then press Enter.
+ *
+ * Output, one line per LED change:
+ *   time_ms  LED mask (LED 1 first)  state  left-right score
+ *
+ * Usage: replay_tool [-u until_ms] [-e] [-p] log.bin
+ */
+
+#define _GNU_SOURCE         /* posix_openpt, ptsname_r */
+
+#include "board.h"
+#include "cobs.h"
+#include "fake.h"
+#include "game.h"
+#include "mirror.h"
+#include "replay.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MAX  (1u << 20)
+#define HEADER   6u         /* record type, seq, time_ms */
+
+static const char *const state_names[GAME_STATE_COUNT] = {
+    [GAME_INTRO] = "intro", [GAME_START] = "serve", [BALL_MOVING] = "ball",
+    [GAME_MISS] = "miss", [POINT_SCORED] = "score", [GAME_WINNER] = "winner",
+    [GAME_OVER] = "over",
+};
+
+static uint8_t log_buf[LOG_MAX];
+
+static void usage(void) {
+    fprintf(stderr, "usage: replay_tool [-u until_ms] [-e] [-p] log.bin\n");
+    exit(2);
+}
+
+/* New pty for the viewer; the slave is kept open, raw, so nothing is lost
+   to the line discipline or a viewer that is not there yet */
+static int open_pty(void) {
+    struct termios t;
+    char name[64];
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, sizeof(name)) != 0) {
+        perror("pty");
+        exit(1);
+    }
+
+    int slave = open(name, O_RDWR | O_NOCTTY);
+
+    if (slave < 0 || tcgetattr(slave, &t) != 0) {
+        perror(name);
+        exit(1);
+    }
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+
+    fprintf(stderr, "telemetry on %s, press Enter to start\n", name);
+    getchar();
+    tcflush(slave, TCIFLUSH);
+    return fd;
+}
+
+/* The records sent since the last call, framed as telemetry.c does */
+static void write_records(int fd) {
+    static uint8_t seq = 0;
+
+    for (uint32_t n = 0; n < fake_telemetry_count(); n++) {
+        const FakeRecord *r = fake_telemetry(n);
+        uint32_t time_ms = (uint32_t)(r->at_us / 1000u);
+        uint8_t frame[HEADER + TELEMETRY_PAYLOAD_MAX + 1];
+        uint8_t encoded[COBS_MAX(sizeof(frame)) + 1];
+
+        frame[0] = r->type;
+        frame[1] = seq++;
+        for (int k = 0; k < 4; k++) {
+            frame[2 + k] = (uint8_t)(time_ms >> (8 * k));
+        }
+        memcpy(frame + HEADER, r->payload, r->len);
+        frame[HEADER + r->len] = crc8(frame, HEADER + r->len);
+
+        uint32_t size = cobs_encode(frame, HEADER + r->len + 1u, encoded);
+
+        encoded[size++] = 0;
+        if (write(fd, encoded, size) < 0) {
+            /* Pty full: the viewer sees the gap and waits for a key */
+        }
+    }
+    telemetry_init();
+}
+
+static void sleep_until(struct timespec *at, uint64_t step_us) {
+    at->tv_nsec += (long)(step_us * 1000u);
+    while (at->tv_nsec >= 1000000000L) {
+        at->tv_nsec -= 1000000000L;
+        at->tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, at, NULL);
+}
+
+static void print_frame(uint64_t at_us, uint8_t mask) {
+    const Game *g = game_state();
+    char leds[9];
+
+    for (int n = 0; n < 8; n++) {
+        leds[n] = (mask & (1u << n)) ? '#' : '.';
+    }
+    leds[8] = '\0';
+    printf("%10.3f  %s  %-6s  %u-%u\n", at_us / 1000.0, leds,
+           state_names[g->state], g->left_score, g->right_score);
+}
+
+int main(int argc, char **argv) {
+    uint64_t until_us = UINT64_MAX;
+    int show_edges = 0;
+    int live = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:ep")) != -1) {
+        switch (opt) {
+        case 'u': until_us = strtoull(optarg, NULL, 0) * MS; break;
+        case 'e': show_edges = 1; break;
+        case 'p': live = 1; break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+
+    if (f == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    uint32_t len = (uint32_t)fread(log_buf, 1, sizeof(log_buf), f);
+    fclose(f);
+
+    ReplayReader reader;
+    ButtonEvent edge;
+    uint32_t seed;
+    uint64_t start;
+    uint64_t last_edge = 0;
+
+    if (!replay_open(&reader, log_buf, len, &seed, &start)) {
+        fprintf(stderr, "%s: not a replay log\n", argv[optind]);
+        return 1;
+    }
+    while (replay_next(&reader, &edge)) {
+        last_edge = edge.timestamp - start;
+        if (show_edges) {
+            printf("%10.3f  %s %s\n", last_edge / 1000.0,
+                   edge.button == LEFT_BUTTON ? "left" : "right",
+                   edge.pressed ? "down" : "up");
+        }
+    }
+
+    /* Play on until the last edge's effects have shown, then some */
+    uint64_t end = last_edge + 15000 * MS;
+
+    if (until_us < end) {
+        end = until_us;
+    }
+
+    int pty = live ? open_pty() : -1;
+    struct timespec tick;
+
+    board_init_seeded(seed);
+    if (live) {
+        mirror_init();
+    }
+    game_replay(log_buf, len);
+    clock_gettime(CLOCK_MONOTONIC, &tick);
+
+    uint8_t last = board_leds();
+
+    print_frame(0, last);
+    while (vclock_now() < end) {
+        board_run_until(vclock_now() + MS);
+        if (live) {
+            write_records(pty);
+            sleep_until(&tick, MS);
+        }
+
+        uint8_t mask = board_leds();
+
+        if (mask != last) {
+            print_frame(vclock_now(), mask);
+        }
+        last = mask;
+    }
+    return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * ring_sim.c
+ *
+ * Ring tournament on the host, one process per board over a chain of
+ * pseudo-terminals
+ *
+ * Board i writes to pty i and reads pty i - 1, the first board reads the
+ * last one's: a closed ring like the boards' UART daisy chain. Each runs
+ * ring.c and tourney.c on the real monotonic clock with its own offset.
+ * Frames to pass on go back out of the receive buffer they came in, as on
+ * the board; the boards elect a master, which starts the tournament, and
+ * every table's bot reports a result 200 to 600 ms after its match is
+ * drawn.
+ *
+ * When a board's tournament is over it prints the standings, and the
+ * master the slowest token rotation against the bound. Every board must
+ * print the same standings.
+ *
+ * Usage:
+ *   ring_sim [-n boards] [-k] [-t timeout_s]
+ *     -n  boards on the ring, 2 to 64 (default 8)
+ *     -k  knockout instead of round-robin
+ */
+
+#define _GNU_SOURCE         /* posix_openpt, ptsname_r */
+
+#include "cobs.h"
+#include "ring.h"
+#include "tourney.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RX_SIZE     1024
+#define LINGER_US   500000      /* keep passing frames on for the others */
+
+typedef struct {
+    int done;
+    uint8_t address;
+    uint8_t nodes;
+    char standings[TOURNEY_ENTRANTS_MAX * 24];
+    uint32_t rotations;
+    uint32_t rotation_max_us;
+    uint32_t regenerated;
+    uint32_t resent;
+    uint32_t rx_bad;
+    uint32_t elections;
+} Result;
+
+typedef struct {
+    Ring ring;
+    Tourney t;
+    int out;
+    uint8_t mode;
+    uint64_t result_at;         /* this table's bot reports then */
+    uint8_t result_round;
+} Board;
+
+static int64_t skew_us;
+static uint64_t rng_state;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)((int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + skew_us);
+}
+
+/* xorshift64* */
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void seed_process(void) {
+    rng_state = (uint64_t)getpid() << 32 ^ (uint64_t)time(NULL) ^ 0x9E3779B97F4A7C15ULL;
+    skew_us = (int64_t)(rng_next() % 10000000u);
+}
+
+/* A next board that has stopped reading loses the rest, as a UART would */
+static void write_all(int fd, const uint8_t *bytes, uint32_t len) {
+    uint32_t sent = 0;
+
+    while (sent < len) {
+        ssize_t n = write(fd, bytes + sent, len - sent);
+
+        if (n < 0 && errno == EAGAIN) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+            if (poll(&pfd, 1, 10) <= 0) {
+                return;
+            }
+        } else if (n < 0 && errno != EINTR) {
+            return;             /* ring broken, the others have gone */
+        }
+        sent += (n > 0) ? (uint32_t)n : 0u;
+    }
+}
+
+static void ring_send(const uint8_t *bytes, uint32_t len, void *arg) {
+    write_all(((Board *)arg)->out, bytes, len);
+}
+
+static void ring_deliver(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg) {
+    (void)sender;
+    tourney_message(&((Board *)arg)->t, bytes, len);
+}
+
+/* Counted (again): the master starts a tournament for this ring */
+static void ring_ready(void *arg) {
+    Board *b = arg;
+    uint8_t msg[TOURNEY_MESSAGE_MAX];
+
+    b->result_at = 0;
+    if (b->ring.address != 0) {
+        return;
+    }
+    tourney_reset(&b->t, rng_next() | 1u, b->mode, b->ring.nodes);
+    ring_post(&b->ring, msg, tourney_start_message(&b->t, msg));
+}
+
+/* This table's match: a result a while after it is drawn */
+static void bot(Board *b, uint64_t now) {
+    uint8_t l;
+    uint8_t r;
+    uint8_t msg[TOURNEY_MESSAGE_MAX];
+
+    if (b->ring.phase != RING_PHASE_READY || b->t.id == 0 ||
+        !tourney_pairing(&b->t, b->ring.address, &l, &r)) {
+        b->result_at = 0;
+        return;
+    }
+    if (b->result_at == 0 || b->result_round != b->t.round) {
+        b->result_at = now + 200000u + rng_next() % 400000u;
+        b->result_round = b->t.round;
+        return;
+    }
+    if (now < b->result_at) {
+        return;
+    }
+
+    uint8_t loser = (uint8_t)(rng_next() % 3u);
+    uint8_t left = (rng_next() & 1u) ? 3 : loser;
+    uint8_t right = (left == 3) ? loser : 3;
+    uint8_t round = b->t.round;
+
+    if (ring_post(&b->ring, msg, tourney_result_message(round, b->ring.address, left, right, msg))) {
+        tourney_result(&b->t, round, b->ring.address, left, right);
+    }
+}
+
+/* Frames in the receive buffer up to the last delimiter: each is taken up,
+   and those the ring passes on go out from where they are */
+static uint32_t take_frames(Board *b, uint8_t *rx, uint32_t len, uint64_t now) {
+    uint32_t start = 0;
+
+    for (uint32_t n = 0; n < len; n++) {
+        if (rx[n] != 0) {
+            continue;
+        }
+        if (ring_receive(&b->ring, rx + start, n - start, now)) {
+            write_all(b->out, rx + start, n + 1u - start);
+        }
+        start = n + 1u;
+    }
+    return start;
+}
+
+static void play(int in, int out, uint8_t mode, uint64_t timeout_us, Result *result) {
+    static Board b;
+    static uint8_t rx[RX_SIZE];
+    uint32_t rx_len = 0;
+    uint64_t now = now_us();
+    uint64_t give_up = now + timeout_us;
+    uint64_t done_at = 0;
+
+    memset(result, 0, sizeof(*result));
+    memset(&b, 0, sizeof(b));
+    b.out = out;
+    b.mode = mode;
+    ring_init(&b.ring, rng_next() | 1u, ring_send, ring_deliver, ring_ready, &b, now);
+
+    for (;;) {
+        ssize_t n;
+
+        now = now_us();
+        while ((n = read(in, rx + rx_len, RX_SIZE - rx_len)) > 0) {
+            rx_len += (uint32_t)n;
+
+            uint32_t used = take_frames(&b, rx, rx_len, now);
+
+            if (used == 0 && rx_len == RX_SIZE) {
+                used = rx_len;          /* no delimiter: not a frame */
+            }
+            memmove(rx, rx + used, rx_len - used);
+            rx_len -= used;
+        }
+
+        uint64_t wake = ring_run(&b.ring, now);
+
+        bot(&b, now);
+
+        if (!result->done && b.t.id != 0 && b.t.done && b.ring.out_count == 0) {
+            result->done = 1;
+            result->address = b.ring.address;
+            result->nodes = b.ring.nodes;
+            tourney_format(&b.t, result->standings, sizeof(result->standings));
+            result->rotations = b.ring.rotations;
+            result->rotation_max_us = b.ring.rotation_max_us;
+            result->regenerated = b.ring.regenerated;
+            result->resent = b.ring.resent;
+            result->rx_bad = b.ring.rx_bad;
+            result->elections = b.ring.elections;
+            done_at = now;
+        }
+        if (now >= give_up || (done_at && now >= done_at + LINGER_US)) {
+            return;
+        }
+
+        int ms = (wake <= now) ? 0 : (wake - now > 10000u) ? 10 : (int)((wake - now + 999u) / 1000u);
+        struct pollfd pfd = { .fd = in, .events = POLLIN };
+
+        poll(&pfd, 1, ms);
+    }
+}
+
+static int open_link(const char *path) {
+    struct termios t;
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0 || tcgetattr(fd, &t) != 0) {
+        perror(path);
+        exit(1);
+    }
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+    return fd;
+}
+
+/* New pty: the master, and its raw slave for the next board */
+static int open_pty(int *slave) {
+    char name[64];
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname_r(fd, name, sizeof(name)) != 0) {
+        perror("pty");
+        exit(1);
+    }
+    *slave = open_link(name);
+    return fd;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: ring_sim [-n boards] [-k] [-t timeout_s]\n"
+            "  -n  boards on the ring, 2 to %u (default 8)\n"
+            "  -k  knockout (default: round-robin)\n"
+            "  -t  give up after this many seconds (default 120)\n", RING_NODES_MAX);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static int masters[RING_NODES_MAX];
+    static int slaves[RING_NODES_MAX];
+    static int pipes[RING_NODES_MAX][2];
+    static pid_t pids[RING_NODES_MAX];
+    static Result results[RING_NODES_MAX];
+    unsigned boards = 8;
+    uint8_t mode = TOURNEY_ROUND_ROBIN;
+    uint64_t timeout_us = 120000000u;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:kt:")) != -1) {
+        switch (opt) {
+        case 'n': boards = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'k': mode = TOURNEY_KNOCKOUT; break;
+        case 't': timeout_us = strtoull(optarg, NULL, 0) * 1000000u; break;
+        default: usage();
+        }
+    }
+    if (optind != argc || boards < 2 || boards > RING_NODES_MAX || boards > TOURNEY_TABLES_MAX) {
+        usage();
+    }
+
+    for (unsigned i = 0; i < boards; i++) {
+        masters[i] = open_pty(&slaves[i]);
+        if (pipe(pipes[i]) != 0) {
+            perror("pipe");
+            return 1;
+        }
+    }
+    printf("%u boards, %s, %u entrants\n", boards,
+           mode == TOURNEY_KNOCKOUT ? "knockout" : "round-robin", 2u * boards);
+    fflush(stdout);
+
+    for (unsigned i = 0; i < boards; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pids[i] == 0) {
+            Result mine;
+
+            seed_process();
+            play(slaves[(i + boards - 1u) % boards], masters[i], mode, timeout_us, &mine);
+            if (write(pipes[i][1], &mine, sizeof(mine)) != (ssize_t)sizeof(mine)) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        close(pipes[i][1]);
+    }
+
+    int agree = 1;
+    const Result *first = NULL;
+
+    for (unsigned i = 0; i < boards; i++) {
+        Result *r = &results[i];
+
+        if (read(pipes[i][0], r, sizeof(*r)) != (ssize_t)sizeof(*r)) {
+            r->done = 0;
+        }
+        waitpid(pids[i], NULL, 0);
+        if (!r->done) {
+            printf("board %u: timeout\n", i);
+            agree = 0;
+            continue;
+        }
+        if (first == NULL) {
+            first = r;
+        } else if (strcmp(first->standings, r->standings) != 0 || r->nodes != boards) {
+            printf("board %u disagrees:\n%s", i, r->standings);
+            agree = 0;
+        }
+        if (r->address == 0) {
+            printf("master board %u: %u rotations, slowest %u us of %llu us bound, "
+                   "%u tokens made again\n", i, r->rotations, r->rotation_max_us,
+                   (unsigned long long)ring_rotation_bound_us((uint8_t)boards), r->regenerated);
+        }
+        if (r->resent || r->rx_bad || r->elections > 1) {
+            printf("board %u: resent %u, bad frames %u, elections %u\n", i, r->resent,
+                   r->rx_bad, r->elections);
+        }
+    }
+    if (!agree || first == NULL) {
+        printf("boards disagree\n");
+        return 1;
+    }
+    printf("%s", first->standings);
+    printf("boards agree\n");
+    return 0;
+}
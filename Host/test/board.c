@@ -0,0 +1,131 @@
+/*
+ * board.c
+ *
+ * The ping-pong board on the host
+ */
+
+#include "board.h"
+#include "fake.h"
+#include "stm32l4xx_hal.h"
+#include "button.h"
+#include "leds.h"
+#include "ledpwm.h"
+#include "timer.h"
+#include "clock.h"
+#include "sched.h"
+#include "game.h"
+#include "telemetry.h"
+
+typedef struct {
+    GPIO_TypeDef *port;
+    uint16_t pin;
+} Pin;
+
+/* Same wiring as leds.c / button.c, kept separate so a mistake there
+   shows up here */
+static const Pin led_pins[8] = {
+    {GPIOB, GPIO_PIN_1}, {GPIOB, GPIO_PIN_2}, {GPIOB, GPIO_PIN_11}, {GPIOB, GPIO_PIN_12},
+    {GPIOA, GPIO_PIN_11}, {GPIOA, GPIO_PIN_12}, {GPIOC, GPIO_PIN_5}, {GPIOC, GPIO_PIN_6}
+};
+static const Pin left_pin = {GPIOB, GPIO_PIN_15};
+static const Pin right_pin = {GPIOC, GPIO_PIN_8};
+
+static int game_running = 0;
+
+/* One queued edge: arg encodes button and level */
+static void edge_irq(void *arg) {
+    uintptr_t code = (uintptr_t)arg;
+    const Pin *pin = ((code >> 1) == LEFT_BUTTON) ? &left_pin : &right_pin;
+
+    if (code & 1) {
+        pin->port->IDR &= ~(uint32_t)pin->pin;  /* active low */
+    } else {
+        pin->port->IDR |= pin->pin;
+    }
+
+    /* HAL_GPIO_EXTI_Callback() in main.c */
+    button_irq(pin->pin);
+    if (game_running) {
+        game_input_irq();
+    }
+}
+
+static void reset(int with_game, uint32_t seed) {
+    fake_gpio_reset();
+    vclock_reset();
+    clock_init();
+    timer_wheel_init();
+    leds_init();
+    ledpwm_init();
+    leds_pwm_enable(0);
+    button_init();
+    telemetry_init();
+    sched_init();
+
+    game_running = with_game;
+    if (with_game) {
+        game_init(seed);
+    }
+    fake_gpio_latch();
+}
+
+/**
+ * Reset fakes and modules
+ */
+void board_init(int with_game) {
+    reset(with_game, BOARD_SEED);
+}
+
+/**
+ * Reset fakes and modules and start the game with a given seed
+ */
+void board_init_seeded(uint32_t seed) {
+    reset(1, seed);
+}
+
+/**
+ * Queue a button level change
+ */
+void board_edge(int button, uint64_t at_us, int pressed) {
+    vclock_at(at_us, edge_irq, (void *)(((uintptr_t)button << 1) | (pressed ? 1u : 0u)));
+}
+
+/**
+ * Queue a clean press and release
+ */
+void board_press(int button, uint64_t at_us, uint32_t hold_us) {
+    board_edge(button, at_us, 1);
+    board_edge(button, at_us + hold_us, 0);
+}
+
+/**
+ * Run the scheduler until virtual time reaches at_us
+ */
+void board_run_until(uint64_t at_us) {
+    vclock_set_limit(at_us);
+    for (;;) {
+        /* Work that came due at at_us itself runs before returning */
+        while (sched_run_once()) {
+        }
+        if (vclock_now() >= at_us) {
+            break;
+        }
+        sched_dispatch();
+    }
+    vclock_set_limit(VCLOCK_NEVER);
+}
+
+/**
+ * LEDs that are on
+ */
+uint8_t board_leds(void) {
+    uint8_t mask = 0;
+
+    fake_gpio_latch();
+    for (int j = 0; j < 8; j++) {
+        if (led_pins[j].port->ODR & led_pins[j].pin) {
+            mask |= (uint8_t)(1u << j);
+        }
+    }
+    return mask;
+}
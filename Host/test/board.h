@@ -0,0 +1,54 @@
+/*
+ * board.h
+ *
+ * The ping-pong board on the host: fake GPIO, virtual clock and the same
+ * module start-up and EXTI wiring as main.c
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include <stdint.h>
+
+#define MS  1000u   /* microseconds */
+
+#define BOARD_SEED  1u  /* game seed used by board_init() */
+
+/**
+ * Reset fakes and modules; with_game also starts the game tasks
+ */
+void board_init(int with_game);
+
+/**
+ * Reset fakes and modules and start the game with a given seed
+ */
+void board_init_seeded(uint32_t seed);
+
+/**
+ * Queue a button level change (EXTI edge)
+ * @param button LEFT_BUTTON or RIGHT_BUTTON
+ * @param at_us Virtual time of the edge
+ * @param pressed 1 for down, 0 for up
+ */
+void board_edge(int button, uint64_t at_us, int pressed);
+
+/**
+ * Queue a clean press and release
+ * @param button LEFT_BUTTON or RIGHT_BUTTON
+ * @param at_us Virtual time of the press
+ * @param hold_us Time held down
+ */
+void board_press(int button, uint64_t at_us, uint32_t hold_us);
+
+/**
+ * Run the scheduler until virtual time reaches at_us
+ */
+void board_run_until(uint64_t at_us);
+
+/**
+ * LEDs that are on, read back from the GPIO output registers
+ * @return Bit 0 = LED 1 ... bit 7 = LED 8
+ */
+uint8_t board_leds(void);
+
+#endif /* BOARD_H_ */
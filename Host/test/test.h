@@ -0,0 +1,42 @@
+/*
+ * test.h
+ *
+ * Minimal test runner for the host build
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdint.h>
+
+void test_fail(const char *file, int line, const char *expr,
+               long long actual, long long expected);
+void test_run(const char *name, void (*fn)(void));
+
+/* Stop the current test when a check fails */
+#define CHECK(cond) do { \
+        if (!(cond)) { test_fail(__FILE__, __LINE__, #cond, 0, 0); return; } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        long long a_ = (long long)(actual), e_ = (long long)(expected); \
+        if (a_ != e_) { test_fail(__FILE__, __LINE__, #actual, a_, e_); return; } \
+    } while (0)
+
+#define RUN(fn)  test_run(#fn, fn)
+
+void timer_tests(void);
+void button_tests(void);
+void vcounter_tests(void);
+void leds_tests(void);
+void game_tests(void);
+void replay_tests(void);
+void cobs_tests(void);
+void console_tests(void);
+void rollback_tests(void);
+void netplay_tests(void);
+void ring_tests(void);
+void tourney_tests(void);
+void mirror_tests(void);
+
+#endif /* TEST_H_ */
@@ -0,0 +1,163 @@
+/*
+ * test_button.c
+ *
+ * Edge queue and per-button debouncing
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "button.h"
+
+/* Next debounced edge must be this one */
+#define CHECK_EDGE(btn, down, at) do { \
+        ButtonEvent e_; \
+        CHECK(button_read_edge(&e_)); \
+        CHECK_EQ(e_.button, btn); \
+        CHECK_EQ(e_.pressed, down); \
+        CHECK_EQ(e_.timestamp, at); \
+    } while (0)
+
+static void clean_press_reads_once(void) {
+    board_init(0);
+    board_press(RIGHT_BUTTON, 100 * MS, 80 * MS);
+    vclock_advance_to(300 * MS);
+
+    CHECK_EQ(button_read(), RIGHT_BUTTON);
+    CHECK_EQ(button_read(), 0);
+}
+
+static void bounces_are_one_press(void) {
+    board_init(0);
+    board_edge(LEFT_BUTTON, 100 * MS, 1);
+    board_edge(LEFT_BUTTON, 100 * MS + 300, 0);
+    board_edge(LEFT_BUTTON, 100 * MS + 700, 1);
+    board_edge(LEFT_BUTTON, 101 * MS, 0);
+    board_edge(LEFT_BUTTON, 101 * MS + 400, 1);
+    board_edge(LEFT_BUTTON, 180 * MS, 0);
+    vclock_advance_to(200 * MS);
+
+    CHECK_EQ(button_read(), LEFT_BUTTON);
+    CHECK_EQ(button_read(), 0);
+}
+
+static void separate_presses_both_count(void) {
+    board_init(0);
+    board_press(LEFT_BUTTON, 100 * MS, 30 * MS);
+    board_press(RIGHT_BUTTON, 150 * MS, 30 * MS);
+    vclock_advance_to(300 * MS);
+
+    CHECK_EQ(button_read(), LEFT_BUTTON);
+    CHECK_EQ(button_read(), RIGHT_BUTTON);
+    CHECK_EQ(button_read(), 0);
+}
+
+static void full_queue_counts_drops(void) {
+    board_init(0);
+    for (int n = 0; n < 20; n++) {
+        board_edge(RIGHT_BUTTON, (uint64_t)(n + 1) * MS, n % 2 == 0);
+    }
+    vclock_advance_to(30 * MS);
+
+    CHECK_EQ(button_dropped(), 4);
+}
+
+/* A press on one side does not blind the other, and each keeps its time */
+static void players_debounce_independently(void) {
+    ButtonEvent edge;
+
+    board_init(0);
+    board_press(RIGHT_BUTTON, 100 * MS, 50 * MS);
+    board_press(LEFT_BUTTON, 100 * MS + 300, 50 * MS);
+    board_press(RIGHT_BUTTON, 200 * MS, 50 * MS);
+    board_press(LEFT_BUTTON, 200 * MS, 50 * MS);
+    vclock_advance_to(400 * MS);
+
+    CHECK_EDGE(RIGHT_BUTTON, 1, 100 * MS);
+    CHECK_EDGE(LEFT_BUTTON, 1, 100 * MS + 300);
+    CHECK_EDGE(RIGHT_BUTTON, 0, 150 * MS);
+    CHECK_EDGE(LEFT_BUTTON, 0, 150 * MS + 300);
+    CHECK_EDGE(RIGHT_BUTTON, 1, 200 * MS);
+    CHECK_EDGE(LEFT_BUTTON, 1, 200 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 0, 250 * MS);
+    CHECK_EDGE(LEFT_BUTTON, 0, 250 * MS);
+    CHECK(!button_read_edge(&edge));
+}
+
+/* Release bounce is swallowed like press bounce */
+static void release_is_debounced(void) {
+    ButtonEvent edge;
+
+    board_init(0);
+    board_press(LEFT_BUTTON, 100 * MS, 50 * MS);
+    board_edge(LEFT_BUTTON, 150 * MS + 200, 1);
+    board_edge(LEFT_BUTTON, 150 * MS + 500, 0);
+    vclock_advance_to(300 * MS);
+
+    CHECK_EDGE(LEFT_BUTTON, 1, 100 * MS);
+    CHECK_EDGE(LEFT_BUTTON, 0, 150 * MS);
+    CHECK(!button_read_edge(&edge));
+}
+
+/* A level that changes while the button is locked is taken up when the
+   window closes, so a quick re-press is late but not lost */
+static void change_in_window_settles_at_its_end(void) {
+    ButtonEvent edge;
+    uint64_t at;
+
+    board_init(0);
+    board_press(RIGHT_BUTTON, 100 * MS, 5 * MS);
+    vclock_advance_to(110 * MS);
+
+    CHECK_EDGE(RIGHT_BUTTON, 1, 100 * MS);
+    CHECK(!button_read_edge(&edge));
+    CHECK_EQ(button_settle_at(), 120 * MS);
+
+    vclock_advance_to(120 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 0, 120 * MS);
+    CHECK_EQ(button_settle_at(), UINT64_MAX);
+
+    /* Re-press 10 ms after the release */
+    board_press(RIGHT_BUTTON, 130 * MS, 60 * MS);
+    vclock_advance_to(135 * MS);
+    CHECK_EQ(button_read_press(&at), 0);
+    vclock_advance_to(140 * MS);
+    CHECK_EQ(button_read_press(&at), RIGHT_BUTTON);
+    CHECK_EQ(at, 140 * MS);
+}
+
+/* Edges from the key sampler are debounced already: no window after them */
+static void pass_through_takes_every_edge(void) {
+    ButtonEvent edge;
+
+    board_init(0);
+    button_set_pass_through(1);
+    board_press(RIGHT_BUTTON, 100 * MS, 5 * MS);
+    board_press(RIGHT_BUTTON, 110 * MS, 5 * MS);
+    vclock_advance_to(200 * MS);
+
+    CHECK_EDGE(RIGHT_BUTTON, 1, 100 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 0, 105 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 1, 110 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 0, 115 * MS);
+    CHECK(!button_read_edge(&edge));
+    CHECK_EQ(button_settle_at(), UINT64_MAX);
+
+    /* button_init() goes back to debouncing */
+    board_init(0);
+    board_press(RIGHT_BUTTON, 100 * MS, 5 * MS);
+    vclock_advance_to(110 * MS);
+    CHECK_EDGE(RIGHT_BUTTON, 1, 100 * MS);
+    CHECK(!button_read_edge(&edge));
+}
+
+void button_tests(void) {
+    RUN(clean_press_reads_once);
+    RUN(bounces_are_one_press);
+    RUN(separate_presses_both_count);
+    RUN(full_queue_counts_drops);
+    RUN(players_debounce_independently);
+    RUN(release_is_debounced);
+    RUN(change_in_window_settles_at_its_end);
+    RUN(pass_through_takes_every_edge);
+}
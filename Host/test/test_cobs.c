@@ -0,0 +1,72 @@
+/*
+ * test_cobs.c
+ *
+ * COBS framing and CRC-8 of the serial records
+ */
+
+#include "test.h"
+#include "cobs.h"
+#include <string.h>
+
+/* Encode, check there is no zero, decode back */
+static int round_trip(const uint8_t *in, uint32_t len) {
+    uint8_t encoded[COBS_MAX(600)];
+    uint8_t decoded[600];
+    uint32_t size = cobs_encode(in, len, encoded);
+
+    if (size > COBS_MAX(len) || memchr(encoded, 0, size) != NULL) {
+        return 0;
+    }
+    return cobs_decode(encoded, size, decoded) == (int32_t)len && memcmp(in, decoded, len) == 0;
+}
+
+static void frames_round_trip(void) {
+    static const uint8_t zeros[4] = {0, 0, 0, 0};
+    static const uint8_t mixed[] = {0x11, 0x00, 0x22, 0x33, 0x00, 0x00, 0x44};
+    uint8_t encoded[16];
+    uint8_t run[600];
+
+    CHECK(round_trip(zeros, 0));
+    CHECK(round_trip(zeros, 1));
+    CHECK(round_trip(zeros, 4));
+    CHECK(round_trip(mixed, sizeof(mixed)));
+
+    /* The textbook example */
+    CHECK_EQ(cobs_encode(mixed, 4, encoded), 5);
+    CHECK_EQ(encoded[0], 0x02);
+    CHECK_EQ(encoded[1], 0x11);
+    CHECK_EQ(encoded[2], 0x03);
+
+    /* Runs of non-zero bytes around the 254-byte block limit */
+    for (uint32_t n = 0; n < sizeof(run); n++) {
+        run[n] = (uint8_t)(n % 255 + 1);
+    }
+    CHECK(round_trip(run, 253));
+    CHECK(round_trip(run, 254));
+    CHECK(round_trip(run, 255));
+    CHECK(round_trip(run, sizeof(run)));
+    run[254] = 0;
+    CHECK(round_trip(run, sizeof(run)));
+}
+
+static void malformed_frames_are_rejected(void) {
+    static const uint8_t zero_code[] = {0x00, 0x11};
+    static const uint8_t short_block[] = {0x05, 0x11, 0x22};
+    static const uint8_t zero_inside[] = {0x03, 0x11, 0x00};
+    uint8_t out[8];
+
+    CHECK_EQ(cobs_decode(zero_code, sizeof(zero_code), out), -1);
+    CHECK_EQ(cobs_decode(short_block, sizeof(short_block), out), -1);
+    CHECK_EQ(cobs_decode(zero_inside, sizeof(zero_inside), out), -1);
+}
+
+static void crc8_check_value(void) {
+    CHECK_EQ(crc8((const uint8_t *)"123456789", 9), 0xF4);
+    CHECK_EQ(crc8((const uint8_t *)"", 0), 0x00);
+}
+
+void cobs_tests(void) {
+    RUN(frames_round_trip);
+    RUN(malformed_frames_are_rejected);
+    RUN(crc8_check_value);
+}
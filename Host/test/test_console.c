@@ -0,0 +1,154 @@
+/*
+ * test_console.c
+ *
+ * Console commands against the running game: parameters, pause and resume,
+ * self-test
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "console_cmd.h"
+#include "game.h"
+#include "button.h"
+#include "leds.h"
+#include "speed_curve.h"
+#include <string.h>
+
+static char reply[160];
+
+/* Run a command, return its reply */
+static const char *run(const char *line) {
+    console_execute(line, reply, sizeof(reply));
+    return reply;
+}
+
+static int starts(const char *text, const char *prefix) {
+    return strncmp(text, prefix, strlen(prefix)) == 0;
+}
+
+static void parameters_get_and_set(void) {
+    board_init(1);
+
+    CHECK(starts(run("get win"), "win=5"));
+    CHECK(starts(run("set win 3"), "win=3 from the next serve"));
+    CHECK_EQ(game_config()->winning_score, 3);
+    CHECK(starts(run("set win 0"), "error: win out of range"));
+    CHECK(starts(run("set win three"), "error: win not a number"));
+    CHECK_EQ(game_config()->winning_score, 3);
+
+    /* A speed field selects the formula */
+    CHECK(starts(run("get profile"), "profile=linear"));
+    CHECK(starts(run("set speed 300"), "speed=300"));
+    CHECK_EQ(game_config()->initial_speed_us, 300 * MS);
+    CHECK(game_config()->speed_curve == NULL);
+    CHECK(starts(run("get profile"), "profile=formula"));
+    CHECK(starts(run("set min 400"), "error: min above speed"));
+    CHECK(starts(run("set decrease 300"), "error: decrease above speed - min"));
+    CHECK(starts(run("set decrease 50"), "decrease=50"));
+    CHECK(starts(run("set min 280"), "error: min leaves decrease above speed - min"));
+    CHECK_EQ(game_config()->min_speed_us, MIN_SPEED_US);
+    CHECK(starts(run("set profile capped"), "profile=capped"));
+    CHECK(game_config()->speed_curve == speed_curves[SPEED_PROFILE_CAPPED]);
+    CHECK(starts(run("set profile fastest"), "error: profile unknown"));
+
+    CHECK(starts(run("set debounce 5"), "debounce=5"));
+    CHECK_EQ(button_debounce_us(), 5 * MS);
+
+    CHECK(strstr(run("get"), " late=20 profile=capped debounce=5") != NULL);
+    CHECK(starts(run("get color"), "error: unknown parameter color"));
+    CHECK(starts(run("serve"), "error: unknown command serve"));
+    CHECK_EQ(console_execute("   ", reply, sizeof(reply)), 0);
+}
+
+static void speed_applies_at_next_serve(void) {
+    uint32_t serves = 0;
+
+    board_init(1);
+    board_run_until(2300 * MS);
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+
+    run("set speed 300");
+    CHECK_EQ(game_state()->speed_us, 200 * MS);
+
+    /* Nobody plays: the rally is missed, the next serve is slower */
+    board_run_until(8000 * MS);
+    for (uint32_t n = 0; n < fake_telemetry_count(); n++) {
+        const FakeRecord *r = fake_telemetry(n);
+
+        if (r->type == TLM_SERVE) {
+            CHECK_EQ(r->payload[1] | r->payload[2] << 8, serves ? 300 : 200);
+            serves++;
+        }
+    }
+    CHECK(serves >= 2);
+}
+
+static void pause_freezes_the_game(void) {
+    board_init(1);
+    board_run_until(2300 * MS);
+
+    Game before = *game_state();
+    uint8_t leds = board_leds();
+
+    CHECK(starts(run("pause"), "paused"));
+    CHECK(game_paused());
+
+    /* Presses while paused are dropped */
+    board_press(LEFT_BUTTON, 3000 * MS, 50 * MS);
+    board_press(RIGHT_BUTTON, 5000 * MS, 50 * MS);
+    board_run_until(12300 * MS);
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+    CHECK_EQ(game_state()->position, before.position);
+    CHECK_EQ(game_state()->rally, 0);
+    CHECK_EQ(board_leds(), leds);
+
+    CHECK(starts(run("resume"), "resumed"));
+    CHECK(!game_paused());
+    CHECK_EQ(game_state()->step_at, before.step_at + 10000 * MS);
+
+    board_run_until(before.step_at + 10000 * MS);
+    CHECK(game_state()->position != before.position);
+
+    /* The intro animation stands still too, in the middle of a flash */
+    board_init(1);
+    board_run_until(600 * MS);
+    CHECK_EQ(board_leds(), 0xFF);
+    CHECK(starts(run("pause"), "paused"));
+    board_run_until(5600 * MS);
+    CHECK_EQ(game_state()->state, GAME_INTRO);
+    CHECK_EQ(board_leds(), 0xFF);
+
+    /* and has the rest of its keyframe to go on resume */
+    CHECK(starts(run("resume"), "resumed"));
+    board_run_until(5650 * MS);
+    CHECK_EQ(board_leds(), 0xFF);
+    board_run_until(5750 * MS);
+    CHECK_EQ(board_leds(), 0x00);
+    board_run_until(5950 * MS);
+    CHECK_EQ(board_leds(), 0xFF);
+}
+
+static void selftest_walks_then_restarts(void) {
+    board_init(1);
+    board_run_until(2300 * MS);
+
+    CHECK(starts(run("selftest"), "selftest: led walk 2000 ms, dropped edges 0"));
+
+    board_run_until(2300 * MS + 75 * MS);
+    CHECK_EQ(board_leds(), LED_BIT(1));
+    board_run_until(2300 * MS + 1275 * MS);
+    CHECK_EQ(board_leds(), 0xFF);
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+
+    board_run_until(2300 * MS + 2000 * MS);
+    CHECK_EQ(game_state()->state, GAME_INTRO);
+    CHECK_EQ(game_recording()->len > 0, 1);
+}
+
+void console_tests(void) {
+    RUN(parameters_get_and_set);
+    RUN(speed_applies_at_next_serve);
+    RUN(pause_freezes_the_game);
+    RUN(selftest_walks_then_restarts);
+}
@@ -0,0 +1,422 @@
+/*
+ * test_game.c
+ *
+ * Whole-game timing on the virtual clock: intro, rallies, score screens
+ * and a full match, checked to the millisecond
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "game.h"
+#include "button.h"
+#include "clock.h"
+#include "leds.h"
+#include "speed_curve.h"
+#include "telemetry.h"
+
+#define STATES 64
+
+typedef struct {
+    uint8_t state;
+    int8_t direction;
+    uint64_t at_us;
+} Change;
+
+static Change changes[STATES];
+static int change_count;
+
+/* Run in 1 ms steps, logging every state change */
+static void run_logged(uint64_t until_us) {
+    uint8_t last = game_state()->state;
+
+    while (vclock_now() < until_us) {
+        board_run_until(vclock_now() + MS);
+
+        uint8_t state = game_state()->state;
+
+        if (state != last && change_count < STATES) {
+            changes[change_count].state = state;
+            changes[change_count].direction = game_state()->direction;
+            changes[change_count].at_us = vclock_now();
+            change_count++;
+        }
+        last = state;
+    }
+}
+
+/* The n-th (0-based) change into state, NULL if none */
+static const Change *find(uint8_t state, int n) {
+    for (int i = 0; i < change_count; i++) {
+        if (changes[i].state == state && n-- == 0) {
+            return &changes[i];
+        }
+    }
+    return NULL;
+}
+
+/* Time of the n-th (0-based) change into state, 0 if none */
+static uint64_t entered(uint8_t state, int n) {
+    const Change *change = find(state, n);
+
+    return change ? change->at_us : 0;
+}
+
+static void intro_then_serve(void) {
+    board_init(1);
+    change_count = 0;
+
+    CHECK_EQ(game_state()->state, GAME_INTRO);
+    CHECK_EQ(clock_profile(), CLOCK_PROFILE_IDLE);
+
+    run_logged(2300 * MS);
+    CHECK_EQ(entered(BALL_MOVING, 0), 2200 * MS);
+    CHECK_EQ(board_leds(), LED_BIT(4));
+    CHECK_EQ(clock_profile(), CLOCK_PROFILE_RUN);
+
+    /* One LED per INITIAL_SPEED_US */
+    board_run_until(2400 * MS - 1);
+    CHECK_EQ(board_leds(), LED_BIT(4));
+    board_run_until(2400 * MS);
+    CHECK_EQ(board_leds(), LED_BIT(game_state()->direction > 0 ? 5 : 3));
+}
+
+/* Nobody plays: whoever the serve heads for misses it. A serve to the
+   right leaves the field after 5 steps, one to the left after 4, plus the
+   late tolerance, so every phase length is known exactly once the serve
+   directions are. */
+static void unplayed_match_timeline(void) {
+    const uint64_t between = (600 + 100 + SCORE_DISPLAY_TIME) * MS;
+    uint64_t serve = 2200 * MS;
+    int left = 0, right = 0;
+    int n = 0;
+    int served[2] = {0, 0};
+
+    board_init(1);
+    change_count = 0;
+    run_logged(50000 * MS);
+
+    while (left < WINNING_SCORE && right < WINNING_SCORE) {
+        const Change *ball = find(BALL_MOVING, n);
+
+        CHECK(ball != NULL);
+        CHECK_EQ(ball->at_us, serve);
+
+        uint64_t miss = serve + (ball->direction > 0 ? 5 : 4) * INITIAL_SPEED_US + HIT_LATE_US;
+
+        CHECK_EQ(entered(GAME_MISS, n), miss);
+        CHECK_EQ(entered(POINT_SCORED, n), miss + 600 * MS);
+
+        if (ball->direction > 0) {
+            left++;
+        } else {
+            right++;
+        }
+        served[ball->direction > 0]++;
+        serve = miss + between;
+        n++;
+    }
+
+    /* BOARD_SEED serves both ways */
+    CHECK(served[0] > 0 && served[1] > 0);
+
+    CHECK_EQ(entered(GAME_WINNER, 0), serve);
+    CHECK_EQ(entered(GAME_OVER, 0), serve + 3000 * MS);
+    CHECK_EQ(entered(BALL_MOVING, n), serve + 10200 * MS);
+    CHECK_EQ(vclock_stalls(), 0);
+}
+
+/* Both players return every ball: the step shrinks by SPEED_DECREASE_US
+   per hit down to MIN_SPEED_US */
+static void rally_speeds_up(void) {
+    int returns = 0;
+    int armed = 0;
+    uint64_t last_move = 0;
+    int last_pos = 0;
+    uint32_t last_step = 0;
+
+    board_init(1);
+    board_run_until(2200 * MS);
+
+    while (returns < 12 && vclock_now() < 20000 * MS) {
+        const Game *g = game_state();
+
+        CHECK_EQ(g->state, BALL_MOVING);
+
+        if (g->position != last_pos) {
+            if (last_pos != 0 && (g->position - last_pos) == g->direction) {
+                last_step = (uint32_t)(vclock_now() - last_move);
+            }
+            last_pos = g->position;
+            last_move = vclock_now();
+            armed = 0;
+        }
+
+        if (!armed && g->direction > 0 && g->position == 8) {
+            board_press(RIGHT_BUTTON, vclock_now() + 10 * MS, 30 * MS);
+            armed = 1;
+            returns++;
+        } else if (!armed && g->direction < 0 && g->position == 1) {
+            board_press(LEFT_BUTTON, vclock_now() + 10 * MS, 30 * MS);
+            armed = 1;
+            returns++;
+        }
+
+        board_run_until(vclock_now() + MS);
+    }
+
+    CHECK_EQ(returns, 12);
+    CHECK_EQ(game_state()->speed_us, MIN_SPEED_US);
+    CHECK_EQ(last_step, MIN_SPEED_US);
+    CHECK_EQ(game_state()->left_score + game_state()->right_score, 0);
+}
+
+/* A press ends the score screen at once, but not the miss flash */
+static void press_skips_score_screen(void) {
+    board_init(1);
+    board_run_until(3300 * MS);
+    CHECK_EQ(game_state()->state, GAME_MISS);
+
+    board_press(LEFT_BUTTON, 3400 * MS, 30 * MS);
+    board_run_until(3500 * MS);
+    CHECK_EQ(game_state()->state, GAME_MISS);
+
+    board_run_until(4000 * MS);
+    CHECK_EQ(game_state()->state, POINT_SCORED);
+    CHECK_EQ(clock_profile(), CLOCK_PROFILE_IDLE);
+
+    board_press(RIGHT_BUTTON, 4000 * MS, 30 * MS);
+    board_run_until(4000 * MS + 1);
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+    CHECK_EQ(game_state()->position, 4);
+    CHECK_EQ(clock_profile(), CLOCK_PROFILE_RUN);
+}
+
+/* Early presses do nothing to the ball */
+static void early_press_is_ignored(void) {
+    board_init(1);
+    board_run_until(2300 * MS);
+    CHECK_EQ(game_state()->position, 4);
+
+    int8_t direction = game_state()->direction;
+
+    board_press(LEFT_BUTTON, 2300 * MS, 30 * MS);
+    board_press(RIGHT_BUTTON, 2350 * MS, 30 * MS);
+    board_run_until(2399 * MS);
+    CHECK_EQ(game_state()->direction, direction);
+    CHECK_EQ(game_state()->speed_us, INITIAL_SPEED_US);
+}
+
+/* Serve of BOARD_SEED: when the ball reaches the end LED, and whose */
+static uint64_t first_arrival(int *button) {
+    board_init(1);
+    board_run_until(2200 * MS);
+
+    int8_t direction = game_state()->direction;
+
+    *button = (direction > 0) ? RIGHT_BUTTON : LEFT_BUTTON;
+    return 2200 * MS + (uint64_t)(direction > 0 ? 4 : 3) * INITIAL_SPEED_US;
+}
+
+/* A press up to HIT_EARLY_US before the ball arrives returns it on
+   arrival; one before that is a whiff */
+static void early_press_returns_on_arrival(void) {
+    int button;
+    uint64_t arrival = first_arrival(&button);
+    int8_t direction = game_state()->direction;
+
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+
+    board_press(button, arrival - 30 * MS, 5 * MS);
+    board_run_until(arrival - 1);
+    CHECK_EQ(game_state()->direction, direction);
+    board_run_until(arrival);
+    CHECK_EQ(game_state()->direction, -direction);
+    CHECK_EQ(game_state()->hit_offset_ms, -30);
+    CHECK_EQ(game_state()->speed_us, INITIAL_SPEED_US - SPEED_DECREASE_US);
+
+    arrival = first_arrival(&button);
+    board_press(button, arrival - HIT_EARLY_US - 10 * MS, 5 * MS);
+    board_run_until(arrival + INITIAL_SPEED_US + HIT_LATE_US);
+    CHECK_EQ(game_state()->state, GAME_MISS);
+}
+
+/* The ball can still be returned HIT_LATE_US after its step time on the
+   end LED */
+static void late_press_within_tolerance(void) {
+    int button;
+    uint64_t arrival = first_arrival(&button);
+    int8_t direction = game_state()->direction;
+
+    board_press(button, arrival + INITIAL_SPEED_US + 15 * MS, 5 * MS);
+    board_run_until(arrival + INITIAL_SPEED_US + 15 * MS);
+    CHECK_EQ(game_state()->state, BALL_MOVING);
+    CHECK_EQ(game_state()->direction, -direction);
+    CHECK_EQ(game_state()->hit_offset_ms, INITIAL_SPEED_US / 1000 + 15);
+
+    arrival = first_arrival(&button);
+    board_press(button, arrival + INITIAL_SPEED_US + HIT_LATE_US + MS, 5 * MS);
+    board_run_until(arrival + INITIAL_SPEED_US + HIT_LATE_US + MS);
+    CHECK_EQ(game_state()->state, GAME_MISS);
+}
+
+/* A step time that is not a whole number of ticks averages out: the n-th
+   LED is reached on the first tick at or after n * speed */
+static void ball_keeps_sub_led_position(void) {
+    GameConfig config = game_default_config;
+    Game g;
+
+    config.initial_speed_us = 150500;
+    config.speed_curve = NULL;
+    game_reset(&g, &config, BOARD_SEED, 0);
+    game_event(&g, GAME_EV_ANIM_DONE, 0);
+    CHECK_EQ(g.state, BALL_MOVING);
+
+    int8_t direction = g.direction;
+
+    /* 75 ticks of 1/150.5 LED */
+    CHECK_EQ(game_ball_q16(&g, 75 * MS + 400), 4 * GAME_Q16_ONE + direction * 32659);
+
+    for (int n = 1; n <= 3; n++) {
+        uint64_t due = ((uint64_t)n * 150500 + GAME_TICK_US - 1) / GAME_TICK_US * GAME_TICK_US;
+
+        CHECK_EQ(g.step_at, due);
+        game_event(&g, GAME_EV_STEP, g.step_at);
+        CHECK_EQ(g.position, 4 + n * direction);
+    }
+}
+
+/* The tables come out of their formulas, and a game looks its step time
+   up by the returns so far */
+static void speed_follows_the_profile(void) {
+    const uint32_t *linear = speed_curves[SPEED_PROFILE_LINEAR];
+    const uint32_t *exponential = speed_curves[SPEED_PROFILE_EXPONENTIAL];
+    const uint32_t *capped = speed_curves[SPEED_PROFILE_CAPPED];
+
+    CHECK_EQ(linear[0], INITIAL_SPEED_US);
+    CHECK_EQ(linear[1], INITIAL_SPEED_US - SPEED_DECREASE_US);
+    CHECK_EQ(linear[SPEED_CURVE_LEN - 1], MIN_SPEED_US);
+    CHECK_EQ(exponential[SPEED_HALF_RALLIES], MIN_SPEED_US + SPEED_SPAN_US / 2);
+    CHECK_EQ(exponential[2 * SPEED_HALF_RALLIES], MIN_SPEED_US + SPEED_SPAN_US / 4);
+    CHECK_EQ(capped[SPEED_CAP_RALLIES], SPEED_CAP_US);
+    CHECK_EQ(capped[SPEED_CURVE_LEN - 1], SPEED_CAP_US);
+    for (int n = 1; n < SPEED_CURVE_LEN; n++) {
+        CHECK(exponential[n] < exponential[n - 1]);
+    }
+    CHECK_EQ(speed_profile_find("capped"), SPEED_PROFILE_CAPPED);
+    CHECK_EQ(speed_profile_find("steep"), SPEED_PROFILE_COUNT);
+
+    GameConfig config = game_default_config;
+    Game g;
+
+    config.speed_curve = exponential;
+    game_reset(&g, &config, BOARD_SEED, 0);
+    game_event(&g, GAME_EV_ANIM_DONE, 0);
+    CHECK_EQ(g.speed_us, exponential[0]);
+
+    while (g.rally < SPEED_CURVE_LEN + 2 && g.state == BALL_MOVING) {
+        uint8_t rally = g.rally;
+
+        game_event(&g, GAME_EV_STEP, g.step_at);
+        if (g.position == (g.direction > 0 ? 8 : 1)) {
+            game_event(&g, g.direction > 0 ? GAME_EV_PRESS_RIGHT : GAME_EV_PRESS_LEFT, g.now_us);
+            CHECK_EQ(g.rally, rally + 1);
+            CHECK_EQ(g.speed_us, exponential[g.rally < SPEED_CURVE_LEN ? g.rally : SPEED_CURVE_LEN - 1]);
+        }
+    }
+    CHECK_EQ(g.rally, SPEED_CURVE_LEN + 2);
+}
+
+/* Without a profile the step shrinks by the decrease and stops at the
+   minimum, even when the decrease does not divide the span or exceeds it */
+static void formula_stops_at_min(void) {
+    static const uint32_t decreases[] = { 30 * MS, 300 * MS };
+
+    for (unsigned d = 0; d < sizeof(decreases) / sizeof(decreases[0]); d++) {
+        GameConfig config = game_default_config;
+        Game g;
+
+        config.speed_curve = NULL;
+        config.speed_decrease_us = decreases[d];
+        game_reset(&g, &config, BOARD_SEED, 0);
+        game_event(&g, GAME_EV_ANIM_DONE, 0);
+
+        while (g.rally < 8 && g.state == BALL_MOVING) {
+            game_event(&g, GAME_EV_STEP, g.step_at);
+            if (g.position == (g.direction > 0 ? 8 : 1)) {
+                uint32_t before = g.speed_us;
+
+                game_event(&g, g.direction > 0 ? GAME_EV_PRESS_RIGHT : GAME_EV_PRESS_LEFT, g.now_us);
+                CHECK(g.speed_us >= MIN_SPEED_US);
+                CHECK(g.speed_us <= before);
+            }
+        }
+        CHECK_EQ(g.rally, 8);
+        CHECK_EQ(g.speed_us, MIN_SPEED_US);
+    }
+}
+
+/* Next telemetry record of a type from *n on, NULL if none */
+static const FakeRecord *next_record(uint8_t type, uint32_t *n) {
+    const FakeRecord *r;
+
+    while ((r = fake_telemetry((*n)++)) != NULL) {
+        if (r->type == type) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/* Serve, an early return, the miss that follows and the score, each
+   stamped with the time it happened */
+static void telemetry_follows_the_rally(void) {
+    int button;
+    uint64_t arrival = first_arrival(&button);
+    const FakeRecord *r;
+    uint32_t n = 0;
+
+    board_press(button, arrival - 30 * MS, 5 * MS);
+    board_run_until(arrival + 3000 * MS);
+
+    r = fake_telemetry(0);
+    CHECK(r != NULL);
+    CHECK_EQ(r->type, TLM_STATE);
+    CHECK_EQ(r->payload[0], GAME_INTRO);
+
+    r = next_record(TLM_SERVE, &n);
+    CHECK(r != NULL);
+    CHECK_EQ(r->at_us, 2200 * MS);
+    CHECK_EQ(r->payload[1] | r->payload[2] << 8, INITIAL_SPEED_US / 1000);
+
+    r = next_record(TLM_HIT, &n);
+    CHECK(r != NULL);
+    CHECK_EQ(r->at_us, arrival);
+    CHECK_EQ(r->payload[0], button);
+    CHECK_EQ((int16_t)(r->payload[1] | r->payload[2] << 8), -30);
+    CHECK_EQ(r->payload[3], 1);
+
+    r = next_record(TLM_MISS, &n);
+    CHECK(r != NULL);
+    CHECK(r->payload[0] != button);
+    CHECK_EQ(r->payload[1], 1);
+
+    r = next_record(TLM_SCORE, &n);
+    CHECK(r != NULL);
+    CHECK_EQ(r->payload[0] + r->payload[1], 1);
+    CHECK_EQ(r->payload[button == LEFT_BUTTON ? 0 : 1], 1);
+}
+
+void game_tests(void) {
+    RUN(intro_then_serve);
+    RUN(unplayed_match_timeline);
+    RUN(rally_speeds_up);
+    RUN(press_skips_score_screen);
+    RUN(early_press_is_ignored);
+    RUN(early_press_returns_on_arrival);
+    RUN(late_press_within_tolerance);
+    RUN(ball_keeps_sub_led_position);
+    RUN(speed_follows_the_profile);
+    RUN(formula_stops_at_min);
+    RUN(telemetry_follows_the_rally);
+}
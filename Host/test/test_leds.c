@@ -0,0 +1,47 @@
+/*
+ * test_leds.c
+ *
+ * Frames reach the right GPIO pins
+ */
+
+#include "test.h"
+#include "board.h"
+#include "leds.h"
+
+static void every_single_led(void) {
+    board_init(0);
+
+    for (int i = 1; i <= 8; i++) {
+        leds_index(i);
+        CHECK_EQ(board_leds(), LED_BIT(i));
+    }
+    leds_clear();
+    CHECK_EQ(board_leds(), 0);
+}
+
+static void frames_cross_ports(void) {
+    board_init(0);
+
+    leds_set_mask(0x81);
+    CHECK_EQ(board_leds(), 0x81);
+    leds_set_mask(0x3C);
+    CHECK_EQ(board_leds(), 0x3C);
+    leds_all();
+    CHECK_EQ(board_leds(), 0xFF);
+}
+
+/* Without PWM the dim trail LEDs stay off, only the ball shows */
+static void trail_without_pwm_is_the_ball(void) {
+    board_init(0);
+
+    leds_trail(5, 1);
+    CHECK_EQ(board_leds(), LED_BIT(5));
+    leds_trail(2, -1);
+    CHECK_EQ(board_leds(), LED_BIT(2));
+}
+
+void leds_tests(void) {
+    RUN(every_single_led);
+    RUN(frames_cross_ports);
+    RUN(trail_without_pwm_is_the_ball);
+}
@@ -0,0 +1,60 @@
+/*
+ * test_main.c
+ *
+ * Host test runner: every suite runs on virtual time, so a full match
+ * takes a few milliseconds of real time
+ */
+
+#include "test.h"
+#include <stdio.h>
+#include <time.h>
+
+static int failed_checks = 0;
+static int current_failed = 0;
+static int tests_run = 0;
+static int tests_failed = 0;
+
+void test_fail(const char *file, int line, const char *expr,
+               long long actual, long long expected) {
+    if (actual != expected) {
+        printf("    %s:%d: %s is %lld, expected %lld\n", file, line, expr,
+               actual, expected);
+    } else {
+        printf("    %s:%d: check failed: %s\n", file, line, expr);
+    }
+    failed_checks++;
+    current_failed = 1;
+}
+
+void test_run(const char *name, void (*fn)(void)) {
+    current_failed = 0;
+    fn();
+    tests_run++;
+    if (current_failed) {
+        tests_failed++;
+    }
+    printf("%s %s\n", current_failed ? "FAIL" : "ok  ", name);
+}
+
+int main(void) {
+    clock_t start = clock();
+
+    timer_tests();
+    button_tests();
+    vcounter_tests();
+    leds_tests();
+    game_tests();
+    replay_tests();
+    cobs_tests();
+    console_tests();
+    rollback_tests();
+    netplay_tests();
+    ring_tests();
+    tourney_tests();
+    mirror_tests();
+
+    double ms = 1000.0 * (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("\n%d tests, %d failed (%.1f ms)\n", tests_run, tests_failed, ms);
+    return (tests_failed == 0 && failed_checks == 0) ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/*
+ * test_mirror.c
+ *
+ * LED mirror: frame encoding, and the records the board sends
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "leds.h"
+#include "mirror.h"
+#include "mirror_codec.h"
+#include <string.h>
+
+static void plain(uint8_t mask, uint8_t levels[MIRROR_LEDS]) {
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        levels[n] = (mask & (1u << n)) ? 255 : 0;
+    }
+}
+
+static uint8_t mask_of(const uint8_t levels[MIRROR_LEDS]) {
+    uint8_t mask = 0;
+
+    for (int n = 0; n < MIRROR_LEDS; n++) {
+        if (levels[n] >= 128) {
+            mask |= (uint8_t)(1u << n);
+        }
+    }
+    return mask;
+}
+
+static void frames_round_trip(void) {
+    MirrorCodec enc;
+    MirrorCodec dec;
+    uint8_t out[MIRROR_PAYLOAD_MAX];
+    uint8_t levels[MIRROR_LEDS];
+    uint32_t rng = 12345;
+
+    mirror_codec_reset(&enc);
+    mirror_codec_reset(&dec);
+    for (int frame = 0; frame < 5000; frame++) {
+        rng = rng * 1664525u + 1013904223u;
+        for (int n = 0; n < MIRROR_LEDS; n++) {
+            /* Mostly a few LEDs changing, sometimes all of them */
+            if ((rng >> (n * 3)) % 5 == 0 || frame % 97 == 0) {
+                levels[n] = (uint8_t)(rng >> 8) & ((frame & 1) ? 0xFF : 0x80);
+            }
+        }
+
+        uint8_t len = mirror_encode(&enc, levels, frame % 50 == 0, out);
+
+        CHECK(len <= MIRROR_PAYLOAD_MAX);
+        if (len == 0) {
+            CHECK(memcmp(dec.levels, levels, MIRROR_LEDS) == 0);
+            continue;
+        }
+        CHECK(mirror_decode(&dec, out, len));
+        CHECK(memcmp(dec.levels, levels, MIRROR_LEDS) == 0);
+    }
+}
+
+static void a_ball_step_is_four_bytes(void) {
+    MirrorCodec enc;
+    uint8_t out[MIRROR_PAYLOAD_MAX];
+    uint8_t levels[MIRROR_LEDS];
+
+    mirror_codec_reset(&enc);
+    plain(0x00, levels);
+    CHECK_EQ(mirror_encode(&enc, levels, 0, out), 3);       /* key: 8 x 0 */
+    CHECK_EQ(out[0], MIRROR_KEY);
+    CHECK_EQ(mirror_encode(&enc, levels, 0, out), 0);       /* unchanged */
+
+    plain(LED_BIT(3), levels);
+    CHECK_EQ(mirror_encode(&enc, levels, 0, out), 3);       /* one group */
+    CHECK_EQ(out[0], MIRROR_DELTA);
+    CHECK_EQ(out[1], 2 << 4 | 1);
+    CHECK_EQ(out[2], 255);
+
+    plain(LED_BIT(4), levels);
+    CHECK_EQ(mirror_encode(&enc, levels, 0, out), 4);
+    CHECK_EQ(out[1], 2 << 4 | 2);
+
+    /* All eight lit: the key (one run) beats the delta */
+    plain(0xFF, levels);
+    CHECK_EQ(mirror_encode(&enc, levels, 0, out), 3);
+    CHECK_EQ(out[0], MIRROR_KEY);
+}
+
+static void deltas_wait_for_a_key(void) {
+    MirrorCodec dec;
+    const uint8_t delta[] = { MIRROR_DELTA, 0x01, 255 };
+    const uint8_t key[] = { MIRROR_KEY, 4, 0, 4, 80 };
+    const uint8_t short_key[] = { MIRROR_KEY, 4, 0, 3, 80 };
+    const uint8_t past_end[] = { MIRROR_DELTA, 0x72, 1, 2 };
+
+    mirror_codec_reset(&dec);
+    CHECK(!mirror_decode(&dec, delta, sizeof(delta)));
+    CHECK(!mirror_decode(&dec, short_key, sizeof(short_key)));
+    CHECK(mirror_decode(&dec, key, sizeof(key)));
+    CHECK_EQ(dec.levels[4], 80);
+    CHECK(mirror_decode(&dec, delta, sizeof(delta)));
+    CHECK_EQ(dec.levels[0], 255);
+
+    /* A bad record loses track until the next key */
+    CHECK(!mirror_decode(&dec, past_end, sizeof(past_end)));
+    CHECK(!mirror_decode(&dec, delta, sizeof(delta)));
+    CHECK(mirror_decode(&dec, key, sizeof(key)));
+}
+
+/* Decode every TLM_LEDS record sent; returns how many */
+static int decode_records(MirrorCodec *dec, int *keys) {
+    int count = 0;
+
+    mirror_codec_reset(dec);
+    *keys = 0;
+    for (uint32_t n = 0; n < fake_telemetry_count(); n++) {
+        const FakeRecord *r = fake_telemetry(n);
+
+        if (r->type != TLM_LEDS) {
+            continue;
+        }
+        if (!mirror_decode(dec, r->payload, r->len)) {
+            return -1;
+        }
+        *keys += (r->payload[0] == MIRROR_KEY);
+        count++;
+    }
+    return count;
+}
+
+static void frames_closer_than_their_line_time_merge(void) {
+    MirrorCodec dec;
+    int keys;
+
+    board_init(0);
+    mirror_init();
+    board_run_until(10 * MS);
+    CHECK_EQ(mirror_frames(), 1);                   /* the key, all off */
+
+    leds_index(3);
+    leds_index(4);
+    leds_index(5);
+    CHECK_EQ(mirror_frames(), 2);                   /* LED 3 at once */
+    CHECK_EQ(mirror_merged(), 1);                   /* 4 is never seen */
+    board_run_until(10 * MS + MIRROR_RECORD_US(3) - 100);
+    CHECK_EQ(mirror_frames(), 2);                   /* 3 bytes of payload */
+    board_run_until(10 * MS + MIRROR_RECORD_US(3));
+    CHECK_EQ(mirror_frames(), 3);
+
+    CHECK_EQ(decode_records(&dec, &keys), 3);
+    CHECK_EQ(keys, 1);
+    CHECK_EQ(mask_of(dec.levels), LED_BIT(5));
+}
+
+/* A frame every 100 us for a second stays within the mirror's share */
+static void the_stream_keeps_to_its_share(void) {
+    uint32_t wire = 0;
+
+    board_init(0);
+    mirror_init();
+    for (uint64_t t = 0; t < 1000 * MS; t += 100) {
+        board_run_until(t);
+        leds_index((int)(t / 100) % 8 + 1);
+    }
+    for (uint32_t n = 0; n < fake_telemetry_count(); n++) {
+        if (fake_telemetry(n)->type == TLM_LEDS) {
+            wire += TELEMETRY_WIRE(fake_telemetry(n)->len);
+        }
+    }
+    CHECK(wire <= TELEMETRY_BAUD / 10u * MIRROR_SHARE_PCT / 100u + TELEMETRY_WIRE(MIRROR_PAYLOAD_MAX));
+    CHECK(wire > TELEMETRY_BAUD / 10u * MIRROR_SHARE_PCT / 100u / 2u);
+    CHECK(mirror_merged() > 9000);
+}
+
+/* No one plays: the intro, serves and misses, every frame mirrored */
+static void the_viewer_sees_what_the_board_shows(void) {
+    MirrorCodec dec;
+    int keys;
+
+    board_init(1);
+    mirror_init();
+    for (uint64_t t = 100 * MS; t <= 4000 * MS; t += 100 * MS) {
+        board_run_until(t);
+        CHECK(decode_records(&dec, &keys) > 0);
+        CHECK_EQ(mask_of(dec.levels), board_leds());
+    }
+    CHECK(decode_records(&dec, &keys) > 20);
+    CHECK(keys >= 4);                               /* one a second */
+}
+
+void mirror_tests(void) {
+    RUN(frames_round_trip);
+    RUN(a_ball_step_is_four_bytes);
+    RUN(deltas_wait_for_a_key);
+    RUN(frames_closer_than_their_line_time_merge);
+    RUN(the_stream_keeps_to_its_share);
+    RUN(the_viewer_sees_what_the_board_shows);
+}
@@ -0,0 +1,202 @@
+/*
+ * test_netplay.c
+ *
+ * Two-board match: both boards on one virtual clock, joined by an
+ * in-memory link with latency, must play out the same match
+ */
+
+#include "test.h"
+#include "board.h"
+#include "netplay.h"
+#include "cobs.h"
+#include <string.h>
+
+#define WIRE_FRAMES  512
+#define SKEW_US      (3000 * MS)     /* right board timebase ahead */
+#define MATCH_US     (120000 * MS)
+
+typedef struct {
+    uint64_t due;
+    uint32_t len;
+    uint8_t bytes[COBS_MAX(NETPLAY_FRAME_MAX) + 1];
+} WireFrame;
+
+/* One direction of the link */
+typedef struct {
+    WireFrame frames[WIRE_FRAMES];
+    uint32_t head;
+    uint32_t count;
+    uint32_t sent;
+    uint64_t now;           /* sender's time, shared timebase of the test */
+    uint64_t latency_us;
+    uint32_t corrupt_every; /* flip a byte in every nth frame, 0 for none */
+    uint8_t cut;            /* drop everything */
+} Wire;
+
+static Wire wires[2];       /* [NETPLAY_LEFT] carries what the left board sends */
+static Netplay boards[2];
+
+static uint32_t show_ms(const Game *game) {
+    switch (game->show) {
+    case GAME_SHOW_BALL:
+    case GAME_SHOW_OVER:  return UINT32_MAX;
+    default:              return 300;
+    }
+}
+
+static void wire_send(const uint8_t *bytes, uint32_t len, void *arg) {
+    Wire *w = arg;
+
+    if (w->cut || w->count == WIRE_FRAMES) {
+        return;
+    }
+
+    WireFrame *f = &w->frames[(w->head + w->count++) % WIRE_FRAMES];
+
+    f->due = w->now + w->latency_us;
+    f->len = len;
+    memcpy(f->bytes, bytes, len);
+    if (w->corrupt_every && ++w->sent % w->corrupt_every == 0) {
+        f->bytes[len / 2] ^= 0x10;
+    }
+}
+
+static void wire_deliver(Wire *w, Netplay *to, uint64_t t, uint64_t local) {
+    while (w->count && w->frames[w->head].due <= t) {
+        netplay_receive(to, w->frames[w->head].bytes, w->frames[w->head].len, local);
+        w->head = (w->head + 1) % WIRE_FRAMES;
+        w->count--;
+    }
+}
+
+static uint64_t local_time(int n, uint64_t t) {
+    return t + (n ? SKEW_US : 0);
+}
+
+/* Each board presses for its own player when the ball is one LED from its
+   end, aiming at the arrival; one approach in four is let go */
+static void bots(uint64_t t, uint64_t press_at[2], int8_t aimed[2], uint32_t *rng) {
+    for (int n = 0; n < 2; n++) {
+        Netplay *np = &boards[n];
+        const Game *g = &np->rb.game;
+        int8_t toward = (np->side == NETPLAY_LEFT) ? -1 : 1;
+        int8_t end = (toward > 0) ? (int8_t)np->config.field_leds : 1;
+
+        if (press_at[n] <= local_time(n, t)) {
+            netplay_press(np, press_at[n]);
+            press_at[n] = GAME_NO_STEP;
+        }
+        if (g->state != BALL_MOVING || g->direction != toward) {
+            aimed[n] = 0;
+            continue;
+        }
+        if (aimed[n] || g->position != end - toward) {
+            continue;
+        }
+        aimed[n] = 1;
+        *rng = *rng * 1103515245u + 12345u;
+        if ((*rng >> 16) % 4 != 0) {
+            press_at[n] = netplay_local(np, g->step_at + ((*rng >> 8) % 50) * MS - 30 * MS);
+        }
+    }
+}
+
+/* Run both boards in 1 ms steps until both have held the final score for
+   a second, or the time is up; return the time */
+static uint64_t play(uint64_t latency_us, uint32_t corrupt_every, uint64_t cut_at) {
+    static const uint32_t ids[2] = { 0x1111, 0x2222 };
+    GameConfig config = game_default_config;
+    uint64_t press_at[2] = { GAME_NO_STEP, GAME_NO_STEP };
+    int8_t aimed[2] = { 0, 0 };
+    uint32_t rng = 99;
+    uint64_t t;
+
+    config.winning_score = 3;
+    config.initial_speed_us = 60 * MS;
+    config.min_speed_us = 30 * MS;
+    config.speed_decrease_us = 5 * MS;
+
+    memset(wires, 0, sizeof(wires));
+    for (int n = 0; n < 2; n++) {
+        wires[n].latency_us = latency_us;
+        wires[n].corrupt_every = corrupt_every;
+        netplay_init(&boards[n], ids[n], 1234, &config, show_ms, wire_send, &wires[n],
+                     local_time(n, 0));
+    }
+
+    for (t = 0; t < MATCH_US; t += MS) {
+        wire_deliver(&wires[0], &boards[1], t, local_time(1, t));
+        wire_deliver(&wires[1], &boards[0], t, local_time(0, t));
+        wires[0].cut = wires[1].cut = (t >= cut_at);
+
+        bots(t, press_at, aimed, &rng);
+        for (int n = 0; n < 2; n++) {
+            wires[n].now = t;
+            netplay_run(&boards[n], local_time(n, t));
+        }
+
+        const Game *l = &boards[0].rb.game;
+        const Game *r = &boards[1].rb.game;
+
+        if (l->state == GAME_OVER && r->state == GAME_OVER &&
+            boards[0].rb.sim_us > l->now_us + 1000 * MS && boards[1].rb.sim_us > r->now_us + 1000 * MS) {
+            break;
+        }
+    }
+    return t;
+}
+
+static void boards_agree_over_a_slow_link(void) {
+    const Netplay *l = &boards[0];
+    const Netplay *r = &boards[1];
+
+    CHECK(play(80 * MS, 0, GAME_NO_STEP) < MATCH_US);
+
+    CHECK_EQ(l->side, NETPLAY_LEFT);
+    CHECK_EQ(r->side, NETPLAY_RIGHT);
+    CHECK_EQ(l->offset_us, 0);
+    CHECK(r->offset_us >= -(int64_t)SKEW_US - 1000 && r->offset_us <= -(int64_t)SKEW_US + 1000);
+    CHECK_EQ(r->config.winning_score, 3);
+    CHECK_EQ(r->config.initial_speed_us, 60 * MS);
+    CHECK_EQ(r->start_us, l->start_us);
+
+    CHECK(l->rb.rollbacks > 0 && r->rb.rollbacks > 0);
+    CHECK_EQ(l->rb.dropped + r->rb.dropped, 0);
+    CHECK_EQ(l->rx_bad + r->rx_bad, 0);
+    CHECK_EQ(l->stalls + r->stalls, 0);
+
+    CHECK(l->rb.game.left_score == 3 || l->rb.game.right_score == 3);
+    CHECK_EQ(r->rb.game.left_score, l->rb.game.left_score);
+    CHECK_EQ(r->rb.game.right_score, l->rb.game.right_score);
+    CHECK_EQ(r->rb.game.rng, l->rb.game.rng);
+    CHECK_EQ(r->rb.game.now_us, l->rb.game.now_us);
+}
+
+static void corrupt_frames_are_dropped_and_sent_again(void) {
+    CHECK(play(20 * MS, 7, GAME_NO_STEP) < MATCH_US);
+
+    CHECK(boards[0].rx_bad > 0 && boards[1].rx_bad > 0);
+    CHECK_EQ(boards[1].rb.game.left_score, boards[0].rb.game.left_score);
+    CHECK_EQ(boards[1].rb.game.right_score, boards[0].rb.game.right_score);
+    CHECK_EQ(boards[1].rb.game.rng, boards[0].rb.game.rng);
+    CHECK_EQ(boards[1].rb.game.now_us, boards[0].rb.game.now_us);
+}
+
+static void a_dead_link_stalls_the_game(void) {
+    CHECK_EQ(play(10 * MS, 0, 5000 * MS), MATCH_US);
+
+    for (int n = 0; n < 2; n++) {
+        const Netplay *np = &boards[n];
+
+        CHECK_EQ(np->phase, NETPLAY_PHASE_PLAYING);
+        CHECK(np->stalls > 0);
+        CHECK_EQ(np->rb.sim_us, np->peer_confirmed_us + ROLLBACK_WINDOW_US);
+        CHECK(np->peer_confirmed_us <= 5000 * MS);
+    }
+}
+
+void netplay_tests(void) {
+    RUN(boards_agree_over_a_slow_link);
+    RUN(corrupt_frames_are_dropped_and_sent_again);
+    RUN(a_dead_link_stalls_the_game);
+}
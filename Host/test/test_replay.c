@@ -0,0 +1,175 @@
+/*
+ * test_replay.c
+ *
+ * Replay log encoding, and a recorded session played back on a fresh
+ * board giving the same LED frames
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "game.h"
+#include "replay.h"
+#include <string.h>
+
+#define FRAMES 2048
+
+typedef struct {
+    uint64_t at_us;
+    uint8_t mask;
+} Frame;
+
+typedef struct {
+    Frame frames[FRAMES];
+    int count;
+} FrameLog;
+
+static FrameLog recorded, replayed;
+static uint8_t saved[4096];
+
+/* Run for 1 ms, logging an LED change with its time relative to start_us */
+static void step_frames(FrameLog *log, uint64_t start_us) {
+    board_run_until(vclock_now() + MS);
+
+    uint8_t mask = board_leds();
+
+    if ((log->count == 0 || mask != log->frames[log->count - 1].mask) && log->count < FRAMES) {
+        log->frames[log->count].at_us = vclock_now() - start_us;
+        log->frames[log->count].mask = mask;
+        log->count++;
+    }
+}
+
+/* Player pressing when the ball reaches them, early or late, with the odd
+   bounce; driven by a fixed LCG so the session is the same every run */
+static void play_session(FrameLog *frames, uint64_t until_us) {
+    uint32_t lcg = 12345;
+    int8_t aimed = 0;
+
+    frames->count = 0;
+    while (vclock_now() < until_us) {
+        const Game *g = game_state();
+
+        if (g->state == BALL_MOVING && g->direction != aimed) {
+            int button = (g->direction > 0) ? RIGHT_BUTTON : LEFT_BUTTON;
+            int steps = (g->direction > 0) ? 8 - g->position : g->position - 1;
+
+            lcg = lcg * 1103515245u + 12345u;
+            uint64_t at = vclock_now() + (uint64_t)steps * g->speed_us + ((lcg >> 16) % 250) * MS;
+
+            board_press(button, at, 40 * MS);
+            if (lcg & 0x40) {
+                board_edge(button, at + 40 * MS + 300, 1);
+                board_edge(button, at + 40 * MS + 700, 0);
+            }
+            aimed = g->direction;
+        } else if (g->state != BALL_MOVING) {
+            aimed = 0;
+        }
+
+        step_frames(frames, 0);
+    }
+}
+
+static void varints_round_trip(void) {
+    static const ButtonEvent edges[] = {
+        {5, LEFT_BUTTON, 1}, {5, RIGHT_BUTTON, 0}, {130, RIGHT_BUTTON, 1},
+        {70000, LEFT_BUTTON, 0}, {0x123456789ULL, RIGHT_BUTTON, 1}
+    };
+    uint8_t buf[64];
+    ReplayLog log;
+    ReplayReader reader;
+    ButtonEvent event;
+    uint32_t seed;
+    uint64_t start;
+
+    CHECK(replay_record_start(&log, buf, sizeof(buf), 0xDEADBEEF, 3));
+    for (size_t n = 0; n < sizeof(edges) / sizeof(edges[0]); n++) {
+        replay_record_edge(&log, &edges[n]);
+    }
+    CHECK_EQ(log.edges, 5);
+    CHECK_EQ(log.full, 0);
+
+    CHECK(replay_open(&reader, buf, log.len, &seed, &start));
+    CHECK_EQ(seed, 0xDEADBEEF);
+    CHECK_EQ(start, 3);
+    for (size_t n = 0; n < sizeof(edges) / sizeof(edges[0]); n++) {
+        CHECK(replay_next(&reader, &event));
+        CHECK_EQ(event.timestamp, edges[n].timestamp);
+        CHECK_EQ(event.button, edges[n].button);
+        CHECK_EQ(event.pressed, edges[n].pressed);
+    }
+    CHECK(!replay_next(&reader, &event));
+
+    buf[0] = 'X';
+    CHECK(!replay_open(&reader, buf, log.len, &seed, &start));
+}
+
+static void full_log_stops_recording(void) {
+    uint8_t buf[REPLAY_HEADER_MAX + 4];
+    ReplayLog log;
+    ButtonEvent event = {0, LEFT_BUTTON, 1};
+
+    CHECK(!replay_record_start(&log, buf, REPLAY_HEADER_MAX - 1, 1, 0));
+    CHECK(replay_record_start(&log, buf, sizeof(buf), 1, 0));
+
+    uint32_t header = log.len;
+
+    for (int n = 1; n <= 10; n++) {
+        event.timestamp = (uint64_t)n * 100000;
+        replay_record_edge(&log, &event);
+    }
+    CHECK_EQ(log.full, 1);
+    CHECK(log.len <= sizeof(buf));
+    CHECK(log.edges < 10);
+    CHECK_EQ(log.len - header, log.edges * 3);  /* 100 ms deltas take 3 bytes */
+}
+
+/* Same frames when played back right away, or later on a board that
+   has been running with a different seed */
+static void session_replays_exactly(void) {
+    const uint64_t length = 60000 * MS;
+    const uint64_t later = 1234 * MS + 567;
+
+    board_init_seeded(0xC0FFEE);
+    play_session(&recorded, length);
+
+    const ReplayLog *log = game_recording();
+    uint32_t len = log->len;
+    uint32_t edges = log->edges;
+
+    CHECK(edges > 20);
+    CHECK_EQ(log->full, 0);
+    CHECK(len <= sizeof(saved));
+    memcpy(saved, log->buf, len);
+
+    CHECK(recorded.count > 100);
+    CHECK(game_state()->left_score + game_state()->right_score > 0);
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint64_t start = pass ? later : 0;
+
+        board_init_seeded(7);
+        board_run_until(start);
+        CHECK(game_replay(saved, len));
+        replayed.count = 0;
+        while (vclock_now() < start + length) {
+            step_frames(&replayed, start);
+        }
+
+        CHECK_EQ(replayed.count, recorded.count);
+        for (int n = 0; n < recorded.count; n++) {
+            CHECK_EQ(replayed.frames[n].at_us, recorded.frames[n].at_us);
+            CHECK_EQ(replayed.frames[n].mask, recorded.frames[n].mask);
+        }
+
+        /* The playback records the same edges again */
+        CHECK_EQ(game_recording()->edges, edges);
+    }
+}
+
+void replay_tests(void) {
+    RUN(varints_round_trip);
+    RUN(full_log_stops_recording);
+    RUN(session_replays_exactly);
+}
@@ -0,0 +1,228 @@
+/*
+ * test_ring.c
+ *
+ * Token ring: a dozen boards on one virtual clock, each link an
+ * in-memory wire with a fixed hop time
+ */
+
+#include "test.h"
+#include "board.h"
+#include "ring.h"
+#include "cobs.h"
+#include <string.h>
+
+#define NODES      12
+#define HOP_US     300
+#define STEP_US    100
+#define POSTS      20          /* broadcasts from every board */
+#define WIRE_MAX   64
+
+typedef struct {
+    uint64_t due;
+    uint32_t len;
+    uint8_t bytes[COBS_MAX(RING_FRAME_MAX) + 1];
+} WireFrame;
+
+/* Wire n carries what board n sends to board n + 1 */
+typedef struct {
+    WireFrame frames[WIRE_MAX];
+    uint32_t head;
+    uint32_t count;
+    uint64_t cut_until;         /* drop everything before then */
+    uint8_t corrupt_msgs;       /* flip a byte in this many MSG frames */
+} Wire;
+
+typedef struct {
+    Ring ring;
+    uint64_t skew;              /* local timebase offset */
+    uint8_t posted;
+    uint8_t got[NODES];         /* broadcasts delivered, per sender board */
+    uint8_t out_of_order;
+} Node;
+
+static Wire wires[NODES];
+static Node nodes[NODES];
+static uint64_t now;
+
+static void wire_put(int n, const uint8_t *bytes, uint32_t len) {
+    Wire *w = &wires[n];
+
+    if (now < w->cut_until || w->count == WIRE_MAX) {
+        return;
+    }
+
+    WireFrame *f = &w->frames[(w->head + w->count++) % WIRE_MAX];
+
+    f->due = now + HOP_US;
+    f->len = len;
+    memcpy(f->bytes, bytes, len);
+
+    uint8_t frame[COBS_MAX(RING_FRAME_MAX)];
+
+    if (w->corrupt_msgs && cobs_decode(bytes, len - 1, frame) > 0 && frame[0] == 5) {
+        f->bytes[len / 2] ^= 0x20;
+        w->corrupt_msgs--;
+    }
+}
+
+static void ring_send(const uint8_t *bytes, uint32_t len, void *arg) {
+    wire_put((int)((Node *)arg - nodes), bytes, len);
+}
+
+/* Payload: the sending board and its count, which must arrive in order */
+static void ring_deliver(uint8_t sender, const uint8_t *bytes, uint8_t len, void *arg) {
+    Node *node = arg;
+    uint8_t from = bytes[0];
+
+    (void)sender;
+    if (len != 2 || from >= NODES || bytes[1] != node->got[from]) {
+        node->out_of_order = 1;
+        return;
+    }
+    node->got[from]++;
+}
+
+static void start(void) {
+    uint32_t rng = 0x2545F491;
+
+    memset(wires, 0, sizeof(wires));
+    memset(nodes, 0, sizeof(nodes));
+    now = 0;
+    for (int n = 0; n < NODES; n++) {
+        rng = rng * 1664525u + 1013904223u;
+        nodes[n].skew = (uint64_t)(rng % 1000) * MS;
+        ring_init(&nodes[n].ring, rng, ring_send, ring_deliver, NULL, &nodes[n], nodes[n].skew);
+    }
+}
+
+static void run_for(uint64_t span, int post) {
+    uint64_t end = now + span;
+
+    for (; now < end; now += STEP_US) {
+        for (int n = 0; n < NODES; n++) {
+            Wire *w = &wires[(n + NODES - 1) % NODES];
+            Node *node = &nodes[n];
+
+            while (w->count && w->frames[w->head].due <= now) {
+                WireFrame f = w->frames[w->head];
+
+                w->head = (w->head + 1) % WIRE_MAX;
+                w->count--;
+                if (ring_receive(&node->ring, f.bytes, f.len - 1, now + node->skew)) {
+                    wire_put(n, f.bytes, f.len);    /* passed on as it came */
+                }
+            }
+            if (post && node->ring.phase == RING_PHASE_READY && node->posted < POSTS) {
+                uint8_t msg[2] = { (uint8_t)n, node->posted };
+
+                node->posted += (uint8_t)ring_post(&node->ring, msg, 2);
+            }
+            ring_run(&node->ring, now + node->skew);
+        }
+    }
+}
+
+static int master(void) {
+    int m = 0;
+
+    for (int n = 1; n < NODES; n++) {
+        if (nodes[n].ring.id < nodes[m].ring.id) {
+            m = n;
+        }
+    }
+    return m;
+}
+
+static void election_counts_the_ring(void) {
+    start();
+    run_for(2000 * MS, 0);
+
+    int m = master();
+
+    for (int k = 0; k < NODES; k++) {
+        Ring *ring = &nodes[(m + k) % NODES].ring;
+
+        CHECK_EQ(ring->phase, RING_PHASE_READY);
+        CHECK_EQ(ring->address, k);
+        CHECK_EQ(ring->nodes, NODES);
+    }
+    CHECK(nodes[m].ring.rotations > 50);
+    CHECK_EQ(nodes[m].ring.regenerated, 0);
+}
+
+/* Every board hears every other board's broadcasts once, in order */
+static int all_delivered(void) {
+    for (int n = 0; n < NODES; n++) {
+        if (nodes[n].out_of_order || nodes[n].posted < POSTS ||
+            nodes[n].ring.out_count != 0) {
+            return 0;
+        }
+        for (int from = 0; from < NODES; from++) {
+            if (from != n && nodes[n].got[from] != POSTS) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void broadcasts_reach_every_board_once(void) {
+    start();
+    run_for(1000 * MS, 1);
+    run_for(2000 * MS, 1);
+
+    int m = master();
+
+    CHECK(all_delivered());
+    CHECK_EQ(nodes[m].ring.regenerated, 0);
+    CHECK(nodes[m].ring.rotation_max_us <= ring_rotation_bound_us(NODES));
+    for (int n = 0; n < NODES; n++) {
+        CHECK_EQ(nodes[n].ring.resent, 0);
+        CHECK_EQ(nodes[n].ring.rx_bad, 0);
+    }
+}
+
+static void a_lost_token_is_made_again(void) {
+    start();
+    run_for(1000 * MS, 0);
+
+    int m = master();
+    uint32_t elections = nodes[m].ring.elections;
+
+    /* Long enough that whatever is on the wire is gone, token included */
+    wires[(m + 5) % NODES].cut_until = now + 30 * MS;
+    run_for(2000 * MS, 1);
+
+    CHECK(all_delivered());
+    CHECK(nodes[m].ring.regenerated >= 1);
+    CHECK_EQ(nodes[m].ring.elections, elections);
+    CHECK_EQ(nodes[m].ring.phase, RING_PHASE_READY);
+}
+
+static void a_corrupt_message_is_sent_again(void) {
+    start();
+    run_for(1000 * MS, 0);
+
+    int m = master();
+
+    wires[(m + 3) % NODES].corrupt_msgs = 3;
+    run_for(2000 * MS, 1);
+
+    uint32_t resent = 0;
+    uint32_t bad = 0;
+
+    for (int n = 0; n < NODES; n++) {
+        resent += nodes[n].ring.resent;
+        bad += nodes[n].ring.rx_bad;
+    }
+    CHECK(all_delivered());
+    CHECK_EQ(bad, 3);
+    CHECK(resent >= 3);
+}
+
+void ring_tests(void) {
+    RUN(election_counts_the_ring);
+    RUN(broadcasts_reach_every_board_once);
+    RUN(a_lost_token_is_made_again);
+    RUN(a_corrupt_message_is_sent_again);
+}
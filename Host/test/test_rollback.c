@@ -0,0 +1,123 @@
+/*
+ * test_rollback.c
+ *
+ * Rollback sessions: presses that arrive late must play out exactly as if
+ * they had been there in time
+ */
+
+#include "test.h"
+#include "board.h"
+#include "rollback.h"
+
+#define PLAY_US     (60000 * MS)
+#define PRESSES     256
+
+static RollbackInput presses[PRESSES];
+static int press_count;
+
+static uint32_t show_ms(const Game *game) {
+    return (game->show == GAME_SHOW_BALL) ? UINT32_MAX : 300;
+}
+
+static GameConfig two_boards(void) {
+    GameConfig config = game_default_config;
+
+    config.field_leds = 2 * GAME_LEDS;
+    config.winning_score = 9;
+    return config;
+}
+
+/* Play in 1 ms steps with a player on each side that aims for the end LED
+   and misses one approach in four; log the presses */
+static void play_reference(Rollback *rb, const GameConfig *config) {
+    uint32_t rng = 12345;
+    int8_t aimed = 0;
+
+    press_count = 0;
+    rollback_reset(rb, config, 7, 0, show_ms);
+
+    for (uint64_t t = 0; t < PLAY_US; t += MS) {
+        rollback_advance(rb, t);
+
+        const Game *g = &rb->game;
+        int8_t end = (g->direction > 0) ? (int8_t)config->field_leds : 1;
+
+        if (g->state != BALL_MOVING) {
+            aimed = 0;
+            continue;
+        }
+        if (aimed == g->direction || g->position != end - g->direction) {
+            continue;
+        }
+        aimed = g->direction;
+
+        rng = rng * 1103515245u + 12345u;
+        if ((rng >> 16) % 4 == 0 || press_count == PRESSES) {
+            continue;
+        }
+
+        RollbackInput *p = &presses[press_count++];
+
+        p->event = (g->direction > 0) ? GAME_EV_PRESS_RIGHT : GAME_EV_PRESS_LEFT;
+        p->at_us = g->step_at + ((rng >> 8) % 50) * MS - 30 * MS;
+        rollback_input(rb, p->event, p->at_us);
+    }
+    rollback_advance(rb, PLAY_US);
+}
+
+/* The same presses, each handed over late_us after it was made */
+static void play_late(Rollback *rb, const GameConfig *config, uint64_t late_us) {
+    int next = 0;
+
+    rollback_reset(rb, config, 7, 0, show_ms);
+    for (uint64_t t = 0; t < PLAY_US; t += MS) {
+        while (next < press_count && presses[next].at_us + late_us <= t) {
+            rollback_input(rb, presses[next].event, presses[next].at_us);
+            next++;
+        }
+        rollback_advance(rb, t);
+    }
+    rollback_advance(rb, PLAY_US);
+}
+
+static void late_presses_play_out_the_same(void) {
+    static Rollback ref;
+    static Rollback late;
+    GameConfig config = two_boards();
+
+    play_reference(&ref, &config);
+    CHECK(press_count > 10);
+    CHECK_EQ(ref.rollbacks, 0);
+    CHECK(ref.game.left_score + ref.game.right_score > 3);
+
+    for (uint64_t late_us = 5 * MS; late_us <= 200 * MS; late_us += 65 * MS) {
+        play_late(&late, &config, late_us);
+
+        CHECK(late.rollbacks > 0);
+        CHECK_EQ(late.dropped, 0);
+        CHECK_EQ(late.game.state, ref.game.state);
+        CHECK_EQ(late.game.left_score, ref.game.left_score);
+        CHECK_EQ(late.game.right_score, ref.game.right_score);
+        CHECK_EQ(late.game.position, ref.game.position);
+        CHECK_EQ(late.game.rally, ref.game.rally);
+        CHECK_EQ(late.game.rng, ref.game.rng);
+        CHECK_EQ(late.game.step_at, ref.game.step_at);
+        CHECK_EQ(late.anim_end_at, ref.anim_end_at);
+        CHECK_EQ(late.shows > ref.shows, 1);
+    }
+}
+
+static void presses_before_the_snapshots_are_dropped(void) {
+    static Rollback rb;
+    GameConfig config = two_boards();
+
+    play_reference(&rb, &config);
+    CHECK(rb.snaps[rb.snap_first].at_us > 0);
+    CHECK_EQ(rollback_input(&rb, GAME_EV_PRESS_LEFT, 0), 0);
+    CHECK_EQ(rb.dropped, 1);
+}
+
+void rollback_tests(void) {
+    RUN(late_presses_play_out_the_same);
+    RUN(presses_before_the_snapshots_are_dropped);
+}
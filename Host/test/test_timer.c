@@ -0,0 +1,94 @@
+/*
+ * test_timer.c
+ *
+ * Timer wheel expiry times on the virtual clock
+ */
+
+#include "test.h"
+#include "board.h"
+#include "fake.h"
+#include "timer.h"
+
+static int fired = 0;
+
+static void count(void *arg) {
+    (void)arg;
+    fired++;
+}
+
+static void one_shot_fires_on_its_tick(void) {
+    SoftTimer t;
+
+    board_init(0);
+    timer_start(&t, 5, 0, NULL, NULL);
+
+    vclock_advance_to(5 * MS - 1);
+    CHECK(!timer_expired(&t));
+    vclock_advance_to(5 * MS);
+    CHECK(timer_expired(&t));
+}
+
+static void periodic_keeps_its_rate(void) {
+    SoftTimer t;
+
+    board_init(0);
+    fired = 0;
+    timer_start(&t, 10, 10, count, NULL);
+
+    vclock_advance_to(1000 * MS);
+    CHECK_EQ(fired, 100);
+    timer_stop(&t);
+}
+
+/* Timers past the first level (64 ms) and second level (4096 ms) cascade
+   down and must still fire on their exact tick */
+static void cascaded_timers_are_exact(void) {
+    static const uint32_t delays[] = { 63, 64, 65, 128, 4095, 4096, 4097, 70000 };
+    SoftTimer t[sizeof(delays) / sizeof(delays[0])];
+
+    for (unsigned i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+        board_init(0);
+        timer_start(&t[i], delays[i], 0, NULL, NULL);
+
+        vclock_advance_to((uint64_t)delays[i] * MS - 1);
+        CHECK_EQ(timer_expired(&t[i]), 0);
+        vclock_advance_to((uint64_t)delays[i] * MS);
+        CHECK_EQ(timer_expired(&t[i]), 1);
+    }
+}
+
+/* Tickless idle jumps straight to the expiry, however far it is */
+static void idle_wakes_on_next_expiry(void) {
+    SoftTimer t;
+
+    board_init(0);
+    timer_start(&t, 300, 0, NULL, NULL);
+
+    while (!timer_expired(&t)) {
+        board_run_until(vclock_now() + 1000 * MS);
+    }
+    CHECK(vclock_now() >= 300 * MS);
+    CHECK_EQ(vclock_stalls(), 0);
+}
+
+static void us_timer_deadline(void) {
+    UsTimer t;
+
+    board_init(0);
+    vclock_advance_to(1234);
+    timer_us_start(&t, 200000);
+    CHECK_EQ(t.deadline, 201234);
+
+    vclock_advance_to(201233);
+    CHECK(!timer_us_expired(&t));
+    vclock_advance_to(201234);
+    CHECK(timer_us_expired(&t));
+}
+
+void timer_tests(void) {
+    RUN(one_shot_fires_on_its_tick);
+    RUN(periodic_keeps_its_rate);
+    RUN(cascaded_timers_are_exact);
+    RUN(idle_wakes_on_next_expiry);
+    RUN(us_timer_deadline);
+}
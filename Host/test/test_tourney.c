@@ -0,0 +1,144 @@
+/*
+ * test_tourney.c
+ *
+ * Tournament draw, results and standings
+ */
+
+#include "test.h"
+#include "tourney.h"
+#include <string.h>
+
+/* Play every drawn match, the lower entrant winning 3-1; return matches */
+static int play_out(Tourney *t, uint8_t met[][TOURNEY_ENTRANTS_MAX]) {
+    int played = 0;
+
+    while (!t->done && played < 10000) {
+        uint8_t round = t->round;
+        int any = 0;
+
+        for (uint8_t table = 0; table < t->tables; table++) {
+            uint8_t l;
+            uint8_t r;
+
+            if (!tourney_pairing(t, table, &l, &r)) {
+                continue;
+            }
+            if (met) {
+                met[l][r]++;
+                met[r][l]++;
+            }
+            if (!tourney_result(t, round, table, l < r ? 3 : 1, l < r ? 1 : 3)) {
+                return -1;
+            }
+            played++;
+            any = 1;
+            if (t->round != round) {
+                break;
+            }
+        }
+        if (!any) {
+            return -1;
+        }
+    }
+    return played;
+}
+
+static void round_robin_plays_every_pair_once(void) {
+    static uint8_t met[TOURNEY_ENTRANTS_MAX][TOURNEY_ENTRANTS_MAX];
+    static Tourney t;
+    uint8_t order[TOURNEY_ENTRANTS_MAX];
+
+    memset(met, 0, sizeof(met));
+    tourney_reset(&t, 1, TOURNEY_ROUND_ROBIN, 5);
+    CHECK_EQ(t.entrants, 10);
+    CHECK_EQ(t.rounds, 9);
+
+    CHECK_EQ(play_out(&t, met), 45);
+    CHECK(t.done);
+    for (int a = 0; a < 10; a++) {
+        for (int b = 0; b < 10; b++) {
+            CHECK_EQ(met[a][b], a != b);
+        }
+    }
+
+    /* The lower number always won: standings are in entrant order */
+    CHECK_EQ(tourney_standings(&t, order), 10);
+    for (int n = 0; n < 10; n++) {
+        CHECK_EQ(order[n], n);
+        CHECK_EQ(t.wins[n], 9 - n);
+        CHECK_EQ(t.diff[n], 2 * (9 - n) - 2 * n);
+    }
+}
+
+static void knockout_gives_byes_and_a_champion(void) {
+    static Tourney t;
+    uint8_t l;
+    uint8_t r;
+
+    /* 6 entrants in a bracket of 8: 0 and 1 have byes, two matches on
+       tables 0 and 1, table 2 idle */
+    tourney_reset(&t, 1, TOURNEY_KNOCKOUT, 3);
+    CHECK_EQ(t.rounds, 3);
+    CHECK(tourney_pairing(&t, 0, &l, &r));
+    CHECK_EQ(l, 2);
+    CHECK_EQ(r, 5);
+    CHECK(tourney_pairing(&t, 1, &l, &r));
+    CHECK_EQ(l, 3);
+    CHECK_EQ(r, 4);
+    CHECK(!tourney_pairing(&t, 2, &l, &r));
+
+    CHECK_EQ(play_out(&t, NULL), 5);
+    CHECK(t.done);
+    CHECK_EQ(t.slot_count, 1);
+    CHECK_EQ(t.slots[0], 0);
+    CHECK_EQ(t.wins[0], 2);
+    CHECK_EQ(t.losses[0], 0);
+}
+
+static void results_count_once_in_their_round(void) {
+    static Tourney t;
+    uint8_t msg[TOURNEY_MESSAGE_MAX];
+    uint8_t len;
+    uint8_t l;
+    uint8_t r;
+
+    tourney_reset(&t, 7, TOURNEY_ROUND_ROBIN, 2);
+    len = tourney_result_message(0, 0, 3, 2, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 1);
+    CHECK_EQ(tourney_message(&t, msg, len), 0);     /* repeated */
+    len = tourney_result_message(2, 1, 3, 2, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 0);     /* two rounds on */
+    len = tourney_result_message(0, 1, 2, 2, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 0);     /* no draws */
+
+    /* Next round, ahead of the last result of this one: held */
+    len = tourney_result_message(1, 1, 3, 2, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 1);
+    CHECK_EQ(tourney_message(&t, msg, len), 0);
+    CHECK_EQ(t.wins[2], 0);
+    len = tourney_result_message(0, 1, 0, 3, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 1);
+    CHECK_EQ(t.round, 1);
+    CHECK_EQ(t.wins[2], 2);                         /* 1-2, then 2-3 */
+    CHECK(!tourney_pairing(&t, 1, &l, &r));
+
+    /* A start with the same id changes nothing, a new one starts over */
+    len = tourney_start_message(&t, msg);
+    CHECK_EQ(tourney_message(&t, msg, len), 0);
+    CHECK_EQ(t.round, 1);
+    msg[3] ^= 1;
+    CHECK_EQ(tourney_message(&t, msg, len), 1);
+    CHECK_EQ(t.round, 0);
+    CHECK_EQ(t.id, 6);
+
+    char text[256];
+
+    CHECK(tourney_format(&t, text, sizeof(text)) > 0);
+    CHECK(strncmp(text, " 1. P0  0-0 +0\n", 15) == 0);
+}
+
+void tourney_tests(void) {
+    RUN(round_robin_plays_every_pair_once);
+    RUN(knockout_gives_byes_and_a_champion);
+    RUN(results_count_once_in_their_round);
+}
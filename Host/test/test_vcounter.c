@@ -0,0 +1,75 @@
+/*
+ * test_vcounter.c
+ *
+ * Bit-parallel vertical-counter debouncer
+ */
+
+#include "test.h"
+#include "vcounter.h"
+
+/* Feed the same sample n times, OR of the flipped bits */
+static uint32_t feed(VCounter *v, uint32_t sample, int n) {
+    uint32_t flipped = 0;
+
+    while (n-- > 0) {
+        flipped |= vcounter_update(v, sample);
+    }
+    return flipped;
+}
+
+static void flips_on_the_last_stable_sample(void) {
+    VCounter v;
+
+    vcounter_reset(&v, 0);
+    CHECK_EQ(feed(&v, 0x1, VCOUNTER_SAMPLES - 1), 0);
+    CHECK_EQ(v.state, 0);
+    CHECK_EQ(vcounter_busy(&v), 0x1);
+
+    CHECK_EQ(vcounter_update(&v, 0x1), 0x1);
+    CHECK_EQ(v.state, 0x1);
+    CHECK_EQ(vcounter_busy(&v), 0);
+
+    /* Release the same way */
+    CHECK_EQ(feed(&v, 0, VCOUNTER_SAMPLES - 1), 0);
+    CHECK_EQ(vcounter_update(&v, 0), 0x1);
+    CHECK_EQ(v.state, 0);
+}
+
+static void bounce_restarts_the_count(void) {
+    VCounter v;
+
+    vcounter_reset(&v, 0);
+    for (int n = 0; n < 50; n++) {
+        /* Never VCOUNTER_SAMPLES in a row */
+        CHECK_EQ(feed(&v, 0x8000, VCOUNTER_SAMPLES - 1), 0);
+        CHECK_EQ(vcounter_update(&v, 0), 0);
+    }
+    CHECK_EQ(v.state, 0);
+    CHECK_EQ(vcounter_busy(&v), 0);
+}
+
+/* 32 inputs, input n goes down at sample n: each flips VCOUNTER_SAMPLES
+   samples later on its own */
+static void inputs_count_independently(void) {
+    VCounter v;
+    uint32_t sample = 0;
+
+    vcounter_reset(&v, 0);
+    for (int n = 0; n < 32 + VCOUNTER_SAMPLES; n++) {
+        if (n < 32) {
+            sample |= 1u << n;
+        }
+
+        uint32_t flipped = vcounter_update(&v, sample);
+        int expect = n - (VCOUNTER_SAMPLES - 1);
+
+        CHECK_EQ(flipped, (expect >= 0 && expect < 32) ? (1u << expect) : 0);
+    }
+    CHECK_EQ(v.state, 0xFFFFFFFFu);
+}
+
+void vcounter_tests(void) {
+    RUN(flips_on_the_last_stable_sample);
+    RUN(bounce_restarts_the_count);
+    RUN(inputs_count_independently);
+}